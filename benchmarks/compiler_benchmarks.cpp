@@ -4,6 +4,7 @@
 #include "frontend/lexer.hpp"
 #include "frontend/parser.hpp"
 #include "frontend/semantics_pass.hpp"
+#include "optimization/optimization.hpp"
 #include "state.hpp"
 
 #include <benchmark/benchmark.h>
@@ -219,3 +220,77 @@ static void BM_Compiler_TableConstructors(benchmark::State& state)
     close(S);
 }
 BENCHMARK(BM_Compiler_TableConstructors)->Unit(benchmark::kMillisecond);
+
+// Roughly 256KB of functions with loops, branches, calls and table constructors.
+static std::string make_large_source()
+{
+    std::string source;
+    for (size_t i = 0; source.size() < 256 * 1024; ++i)
+    {
+        const auto n = std::to_string(i);
+        source += "function update_" + n + "(entities, dt) {\n"
+                  "    let moved = 0;\n"
+                  "    for (let i = 0; i < #entities; i++) {\n"
+                  "        let e = entities[i];\n"
+                  "        if (e.active && e.speed > 0) {\n"
+                  "            e.x = e.x + e.vx * dt; e.y = e.y + e.vy * dt;\n"
+                  "            moved += 1;\n"
+                  "        } else {\n"
+                  "            e.state = { kind = \"idle\", since = " + n + ", tags = {1, 2, 3} };\n"
+                  "        }\n"
+                  "    }\n"
+                  "    return moved > 0 ? moved : nil;\n"
+                  "}\n";
+    }
+    return source;
+}
+
+// Benchmark the semantics pass and code generation over a large source
+static void BM_Compiler_LargeSource(benchmark::State& state)
+{
+    const auto code = make_large_source();
+    State* S = new_state();
+    {
+        auto tokens = tokenize(S, code, "benchmark");
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            behl::gc_collect(S);
+            AstHolder holder(S);
+            auto ast = parse(holder, tokens, "benchmark");
+            state.ResumeTiming();
+
+            ast = SemanticsPass::apply(S, holder, ast);
+            auto proto = compile(S, ast, "benchmark");
+            benchmark::DoNotOptimize(proto);
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(code.size()));
+    }
+    close(S);
+}
+BENCHMARK(BM_Compiler_LargeSource)->Unit(benchmark::kMillisecond);
+
+// Benchmark the AST optimization pipeline over a large source
+static void BM_Optimizer_LargeSource(benchmark::State& state)
+{
+    const auto code = make_large_source();
+    State* S = new_state();
+    {
+        auto tokens = tokenize(S, code, "benchmark");
+        for (auto _ : state)
+        {
+            state.PauseTiming();
+            behl::gc_collect(S);
+            AstHolder holder(S);
+            auto ast = parse(holder, tokens, "benchmark");
+            ast = SemanticsPass::apply(S, holder, ast);
+            state.ResumeTiming();
+
+            ast = ASTOptimizationPipeline::apply(holder, ast);
+            benchmark::DoNotOptimize(ast);
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(code.size()));
+    }
+    close(S);
+}
+BENCHMARK(BM_Optimizer_LargeSource)->Unit(benchmark::kMillisecond);
@@ -140,3 +140,83 @@ static void BM_Lexer_Operators(benchmark::State& state)
     behl::close(S);
 }
 BENCHMARK(BM_Lexer_Operators)->Unit(benchmark::kMillisecond);
+
+// Builds roughly size bytes of source by repeating a snippet with numbered identifiers.
+static std::string make_large_source(std::string_view snippet, size_t size)
+{
+    std::string source;
+    source.reserve(size + snippet.size() + 32);
+    for (size_t i = 0; source.size() < size; ++i)
+    {
+        const auto suffix = std::to_string(i);
+        for (size_t pos = 0; pos < snippet.size(); ++pos)
+        {
+            if (snippet[pos] == '$')
+            {
+                source += suffix;
+            }
+            else
+            {
+                source += snippet[pos];
+            }
+        }
+    }
+    return source;
+}
+
+static void run_throughput(benchmark::State& state, std::string_view snippet)
+{
+    auto* S = behl::new_state();
+
+    const auto source = make_large_source(snippet, 1024 * 1024);
+    for (auto _ : state)
+    {
+        auto tokens = tokenize(S, source, "benchmark");
+        benchmark::DoNotOptimize(tokens);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(source.size()));
+
+    behl::close(S);
+}
+
+static void BM_Lexer_LargeFile_Mixed(benchmark::State& state)
+{
+    run_throughput(state, R"(
+    // Accumulates the weighted values of entry $.
+    function accumulate_entry_$(values, weight) {
+        let total_weight = 0;
+        for (let index = 0; index < #values; index++) {
+            if (values[index] != nil && values[index] > 0x10) {
+                total_weight += values[index] * weight;
+            } else {
+                print("skipping value at position", index);
+            }
+        }
+        return total_weight;
+    }
+)");
+}
+BENCHMARK(BM_Lexer_LargeFile_Mixed)->Unit(benchmark::kMillisecond);
+
+static void BM_Lexer_LargeFile_Comments(benchmark::State& state)
+{
+    run_throughput(state, R"(
+    /*
+     * Block $ documents the function below in a long paragraph that spans several lines, the way
+     * library code is usually commented, so the lexer spends most of its time inside comment bodies.
+     */
+    // Line comments trail after the block comment and describe the parameters one by one.
+    // value: the number that is checked against the configured limits before it is stored.
+    let limit_$ = 100; // trailing comment after a statement
+)");
+}
+BENCHMARK(BM_Lexer_LargeFile_Comments)->Unit(benchmark::kMillisecond);
+
+static void BM_Lexer_LargeFile_Strings(benchmark::State& state)
+{
+    run_throughput(state, R"(
+    let message_$ = "The quick brown fox jumps over the lazy dog while the lexer looks for the closing quote.";
+    let escaped_$ = 'Tab\tseparated\tcolumns and a newline\n at the end of a rather long line of text.';
+)");
+}
+BENCHMARK(BM_Lexer_LargeFile_Strings)->Unit(benchmark::kMillisecond);
@@ -160,3 +160,43 @@ static void BM_Parser_TableConstructors(benchmark::State& state)
     behl::close(S);
 }
 BENCHMARK(BM_Parser_TableConstructors)->Unit(benchmark::kMillisecond);
+
+// Roughly 256KB of functions with loops, branches, calls and table constructors.
+static std::string make_large_source()
+{
+    std::string source;
+    for (size_t i = 0; source.size() < 256 * 1024; ++i)
+    {
+        const auto n = std::to_string(i);
+        source += "function update_" + n + "(entities, dt) {\n"
+                  "    let moved = 0;\n"
+                  "    for (let i = 0; i < #entities; i++) {\n"
+                  "        let e = entities[i];\n"
+                  "        if (e.active && e.speed > 0) {\n"
+                  "            e.x = e.x + e.vx * dt; e.y = e.y + e.vy * dt;\n"
+                  "            moved += 1;\n"
+                  "        } else {\n"
+                  "            e.state = { kind = \"idle\", since = " + n + ", tags = {1, 2, 3} };\n"
+                  "        }\n"
+                  "    }\n"
+                  "    return moved > 0 ? moved : nil;\n"
+                  "}\n";
+    }
+    return source;
+}
+
+static void BM_Parser_LargeSource(benchmark::State& state)
+{
+    const auto code = make_large_source();
+    auto* S = behl::new_state();
+    auto tokens = tokenize(S, code, "benchmark");
+    for (auto _ : state)
+    {
+        AstHolder holder(S);
+        auto ast = parse(holder, tokens, "benchmark");
+        benchmark::DoNotOptimize(ast);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(code.size()));
+    behl::close(S);
+}
+BENCHMARK(BM_Parser_LargeSource)->Unit(benchmark::kMillisecond);
@@ -3,6 +3,7 @@
 #include <behl/config.hpp>
 #include <behl/export.hpp>
 #include <behl/types.hpp>
+#include <memory>
 #include <optional>
 #include <span>
 #include <string_view>
@@ -44,6 +45,27 @@ namespace behl
     // If make_global is true, also registers the module as a global variable.
     BEHL_API void create_module(State* S, std::string_view module_name, const ModuleDef& module_def);
 
+    // Enables the on-disk cache of compiled modules used by import(), disabled when dir is empty (the default).
+    // Entries are keyed by the module's absolute path, size, modification time, content hash and compiler version,
+    // stale or damaged entries are rebuilt automatically. The directory can be shared by states and processes.
+    BEHL_API void set_module_cache_dir(State* S, std::string_view dir);
+
+    // Compiles the modules reachable from the script at entry_path through import() calls with literal names, using
+    // up to threads worker threads (0 uses the hardware concurrency). Independent modules are compiled concurrently
+    // and import() later instantiates the precompiled module instead of compiling it. Modules that can not be read
+    // or compiled are skipped, import() reports their errors as usual. Returns the number of modules preloaded.
+    BEHL_API size_t preload_modules(State* S, std::string_view entry_path, size_t threads = 0);
+
+    // Every function of a chunk is compiled at load time by default, which reports all errors up front. With lazy
+    // compilation enabled nested functions are compiled on their first call and errors in their bodies are raised by
+    // that call.
+    BEHL_API void set_lazy_compilation(State* S, bool enabled);
+
+    // Functions remember the line and column of every instruction for error messages and the debugger. Disabling
+    // column info drops the columns of everything loaded afterwards, including bytecode, which makes the line tables
+    // about half as large. Errors then report column 0.
+    BEHL_API void set_column_info(State* S, bool enabled);
+
     // Stack manipulation
     ///////////////////////////////////////////////////////////////////////////
 
@@ -243,10 +265,46 @@ namespace behl
     //////////////////////////////////////////////////////////////////////////
 
     // Loads a chunk from the given buffer and pushes the resulting function onto the stack, throws on error.
-    BEHL_API void load_buffer(State* S, std::string_view str, std::string_view chunkname, bool optimize = true);
+    BEHL_API void load_buffer(State* S, std::string_view str, std::string_view chunkname, OptLevel level = OptLevel::kO2);
+
+    // Loads source text delivered in pieces by reader, which is called until it returns an empty view. Only the
+    // text of the token being scanned is buffered, so the complete source never has to be in memory.
+    BEHL_API void load_reader(
+        State* S, SourceReader reader, void* userdata, std::string_view chunkname, OptLevel level = OptLevel::kO2);
 
     // Nearly identical to load_buffer but uses "<string>" as the chunk name.
-    BEHL_API void load_string(State* S, std::string_view str, bool optimize = true);
+    BEHL_API void load_string(State* S, std::string_view str, OptLevel level = OptLevel::kO2);
+
+    // Returns per pass statistics of the AST optimizer for the chunk most recently compiled from source in this state.
+    // The view is valid until the next load, it is empty for OptLevel::kO0.
+    BEHL_API std::span<const OptimizationPassStats> get_optimization_report(State* S);
+
+    // Loads precompiled bytecode produced by dump() and pushes the resulting function onto the stack.
+    // Throws RuntimeError if the data is corrupt or was produced by an incompatible build. The data is copied.
+    // Bytecode is checked for consistency but not verified, only load bytecode from trusted sources.
+    BEHL_API void load_bytecode(State* S, std::string_view data, std::string_view chunkname = {});
+
+    // Like load_bytecode but maps the file into memory, instructions and line tables are used in place.
+    // The mapping is released once the loaded functions have been collected.
+    BEHL_API void load_bytecode_file(State* S, std::string_view path);
+
+    // Returns true if the data starts with the precompiled bytecode signature.
+    // load_buffer() accepts bytecode as well and forwards it to load_bytecode().
+    BEHL_API bool is_bytecode(std::string_view data);
+
+    // Compiles a script once so that it can be instantiated into any number of states with load_compiled(), also from
+    // different threads. Throws the same errors as load_buffer. Accepts precompiled bytecode as well.
+    BEHL_API std::shared_ptr<const CompiledScript> compile_shared(
+        std::string_view source, std::string_view chunkname = {}, OptLevel level = OptLevel::kO2);
+
+    // Pushes a new instance of a compiled script onto the stack. Instructions and line tables are shared with every
+    // other instance and released with the last one, strings and constants are created in the state.
+    BEHL_API void load_compiled(State* S, const std::shared_ptr<const CompiledScript>& script);
+
+    // Serializes the script function at the top of the stack, the stack is left unchanged.
+    // The output is passed to writer in one or more chunks, the format is specific to the behl version and platform.
+    // When strip_debug_info is set line and column information is omitted.
+    BEHL_API void dump(State* S, BytecodeWriter writer, void* userdata, bool strip_debug_info = false);
 
     BEHL_API void call(State* S, int32_t nargs, int32_t nresults);
 
@@ -259,6 +317,21 @@ namespace behl
     // Performs a single step of garbage collection.
     BEHL_API void gc_step(State* S);
 
+    // Runs a full collection, then releases pooled objects and unused table capacity.
+    // When trim_os_heap is set the allocator is asked to return free pages to the OS (glibc and MSVC CRT).
+    // Table hash parts are rehashed, so this must not be called while a table is being traversed with next().
+    BEHL_API void gc_compact(State* S, bool trim_os_heap = true);
+
+    // Starts an allocation region. Objects created until the matching region_end() are bump-allocated
+    // from an arena and released together when the region ends, without being swept individually.
+    // Objects still reachable from outside the region at that point (globals, the stack, pinned values,
+    // upvalues or any object created before the region) are promoted to the regular heap instead.
+    // The collector does not run while a region is active. Regions nest, only the outermost end releases memory.
+    BEHL_API void region_begin(State* S);
+
+    // Ends the region started by region_begin().
+    BEHL_API void region_end(State* S);
+
     // Standard library loading
     //////////////////////////////////////////////////////////////////////////
 
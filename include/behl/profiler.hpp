@@ -0,0 +1,39 @@
+#pragma once
+
+#include <behl/export.hpp>
+#include <behl/types.hpp>
+#include <string>
+
+namespace behl
+{
+    // Output formats for the allocation profile
+    enum class ProfileFormat
+    {
+        kFolded, // Collapsed stacks, one "outer;...;inner;[type] bytes" line per allocation site
+        kPprof,  // Uncompressed pprof protobuf (profile.proto), readable by `go tool pprof`
+    };
+
+    // Default distance in bytes between two allocation samples.
+    inline constexpr size_t kDefaultProfileSampleInterval = 512 * 1024;
+
+    // Starts the sampling allocation profiler, one sample is taken every sample_interval allocated bytes.
+    // Each sample records the current script call stack and the type of the object being allocated.
+    // Calling this while the profiler is running only updates the sample interval.
+    BEHL_API void profiler_start(State* S, size_t sample_interval = kDefaultProfileSampleInterval);
+
+    // Stops sampling, already collected samples are kept until profiler_reset() is called.
+    BEHL_API void profiler_stop(State* S);
+
+    // Returns true if the allocation profiler is currently sampling.
+    BEHL_API bool profiler_is_running(State* S);
+
+    // Discards all collected samples.
+    BEHL_API void profiler_reset(State* S);
+
+    // Returns the number of samples collected so far.
+    BEHL_API size_t profiler_sample_count(State* S);
+
+    // Serializes the aggregated allocation sites in the requested format.
+    BEHL_API std::string profiler_dump(State* S, ProfileFormat format);
+
+} // namespace behl
@@ -9,9 +9,12 @@
 namespace behl
 {
     struct State;
+    struct CompiledScript;
 
     using CFunction = int (*)(State* S);
     using PrintHandler = void (*)(State* S, std::string_view msg);
+    using BytecodeWriter = void (*)(State* S, std::string_view chunk, void* userdata);
+    using SourceReader = std::string_view (*)(State* S, void* userdata);
 
     // Value type categories.
     inline constexpr uint8_t kTableLikeTypeBit = 1u << 4;
@@ -37,6 +40,23 @@ namespace behl
         kNullOpt = 1,
     };
 
+    // Optimization level used when compiling source.
+    enum class OptLevel : uint8_t
+    {
+        kO0, // No AST optimizations
+        kO1, // Local rewrites: loop specialization and constant folding
+        kO2, // All optimizations
+    };
+
+    // Statistics of one optimization pass for the most recently compiled chunk, see get_optimization_report().
+    struct OptimizationPassStats
+    {
+        std::string_view name;
+        uint32_t runs = 0;    // Times the pass was run until the pipeline settled
+        uint32_t changes = 0; // Runs that changed the program
+        uint64_t time_ns = 0; // Total time spent in the pass
+    };
+
     // If the amount of returned values is variable, this should be passed as the nresults parameter when performing calls.
     constexpr int kMultRet = -1;
 
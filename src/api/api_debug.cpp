@@ -102,20 +102,21 @@ namespace behl
         }
 
         const auto& frame = S->call_stack.back();
-        if (!frame.proto || frame.pc >= frame.proto->line_info.size())
+        if (!frame.proto || !frame.proto->line_table.contains(frame.pc))
         {
             return false;
         }
 
         // PC points at the current instruction (not yet executed during debug callback)
+        const auto position = frame.proto->line_table.lookup(frame.pc);
         if (line)
         {
-            *line = frame.proto->line_info[frame.pc];
+            *line = position.line;
         }
 
-        if (column && frame.pc < frame.proto->column_info.size())
+        if (column)
         {
-            *column = frame.proto->column_info[frame.pc];
+            *column = position.column;
         }
 
         if (file)
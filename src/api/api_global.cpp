@@ -1,6 +1,7 @@
 #include "behl.hpp"
 #include "gc/gc.hpp"
 #include "gc/gc_object.hpp"
+#include "gc/gc_region.hpp"
 #include "gc/gco_string.hpp"
 #include "gc/gco_table.hpp"
 #include "state.hpp"
@@ -100,6 +101,7 @@ namespace behl
         auto* key_obj = gc_new_string(S, name);
 
         Value key(key_obj);
+        gc_region_barrier(S, table, key, value);
         table->hash.insert_or_assign(S, key, value);
 
         S->stack.pop_back();
@@ -1,6 +1,9 @@
 #include "ast/ast.hpp"
 #include "ast/ast_holder.hpp"
+#include "backend/bytecode_file.hpp"
 #include "backend/compiler.hpp"
+#include "common/format.hpp"
+#include "common/mapped_file.hpp"
 #include "common/string.hpp"
 #include "frontend/export_transform.hpp"
 #include "frontend/lexer.hpp"
@@ -9,43 +12,43 @@
 #include "gc/gc.hpp"
 #include "gc/gc_object.hpp"
 #include "gc/gco_closure.hpp"
+#include "gc/gco_proto.hpp"
 #include "gc/gco_string.hpp"
 #include "optimization/optimization.hpp"
 #include "state.hpp"
 #include "vm/value.hpp"
 
 #include <behl/behl.hpp>
+#include <behl/exceptions.hpp>
 #include <cassert>
+#include <memory>
+#include <string>
 
 namespace behl
 {
-    void load_buffer(State* S, std::string_view str, std::string_view chunkname, bool optimize)
+    static void load_source(State* S, Lexer& lexer, const std::string& name, OptLevel level)
     {
-        assert(S != nullptr && "State can not be null");
-
         GCPauseGuard gc_pause(S);
 
-        std::string name = !chunkname.empty() ? std::string(chunkname) : "<string>";
-
-        auto tokens = tokenize(S, str, name);
-
-        AstHolder holder(S);
-        auto* ast = parse(holder, tokens, name);
+        // Shared with the functions left uncompiled, the AST is released once all of them have been compiled.
+        auto holder = std::make_shared<AstHolder>(S);
+        auto* ast = parse(*holder, lexer, name);
         assert(ast != nullptr);
 
-        ast = transform_exports(S, holder, ast);
+        ast = transform_exports(S, *holder, ast);
         assert(ast != nullptr);
 
-        ast = SemanticsPass::apply(S, holder, ast);
+        ast = SemanticsPass::apply(S, *holder, ast);
         assert(ast != nullptr);
 
-        if (optimize)
+        S->optimization_report.clear();
+        if (level != OptLevel::kO0)
         {
-            ast = ASTOptimizationPipeline::apply(holder, ast);
+            ast = ASTOptimizationPipeline::apply(*holder, ast, level, &S->optimization_report);
             assert(ast != nullptr);
         }
 
-        auto* proto_obj = compile(S, ast, name);
+        auto* proto_obj = compile(S, ast, name, S->lazy_compilation ? holder : nullptr, level);
 
         auto* closure_obj = gc_new_closure(S, proto_obj);
 
@@ -53,11 +56,140 @@ namespace behl
         S->stack.push_back(S, Value(closure_val));
     }
 
-    void load_string(State* S, std::string_view str, bool optimize)
+    void load_buffer(State* S, std::string_view str, std::string_view chunkname, OptLevel level)
+    {
+        assert(S != nullptr && "State can not be null");
+
+        if (is_bytecode_image(str))
+        {
+            load_bytecode(S, str, chunkname);
+            return;
+        }
+
+        std::string name = !chunkname.empty() ? std::string(chunkname) : "<string>";
+
+        // Tokens are scanned as the parser asks for them, the token stream is never materialized.
+        Lexer lexer(S, str, name);
+        load_source(S, lexer, name, level);
+    }
+
+    void load_reader(State* S, SourceReader reader, void* userdata, std::string_view chunkname, OptLevel level)
+    {
+        assert(S != nullptr && "State can not be null");
+        assert(reader != nullptr && "Reader can not be null");
+
+        std::string name = !chunkname.empty() ? std::string(chunkname) : "<reader>";
+
+        Lexer lexer(S, reader, userdata, name);
+        load_source(S, lexer, name, level);
+    }
+
+    void load_string(State* S, std::string_view str, OptLevel level)
+    {
+        assert(S != nullptr && "State can not be null");
+
+        load_buffer(S, str, "<string>", level);
+    }
+
+    std::span<const OptimizationPassStats> get_optimization_report(State* S)
+    {
+        assert(S != nullptr && "State can not be null");
+
+        return S->optimization_report;
+    }
+
+    void load_bytecode(State* S, std::string_view data, std::string_view chunkname)
+    {
+        assert(S != nullptr && "State can not be null");
+
+        GCPauseGuard gc_pause(S);
+
+        auto* proto_obj = read_bytecode(S, data, nullptr, !chunkname.empty() ? chunkname : "<bytecode>");
+
+        auto* closure_obj = gc_new_closure(S, proto_obj);
+        S->stack.push_back(S, Value(closure_obj));
+    }
+
+    void load_bytecode_file(State* S, std::string_view path)
     {
         assert(S != nullptr && "State can not be null");
 
-        load_buffer(S, str, "<string>", optimize);
+        auto file = MappedFile::open(path);
+        if (!file)
+        {
+            throw RuntimeError(behl::format("cannot open {}", path));
+        }
+
+        GCPauseGuard gc_pause(S);
+
+        // The protos reference the mapping for their instructions and line tables, it is unmapped with the last of them.
+        const std::string_view image(reinterpret_cast<const char*>(file->data()), file->size());
+        auto* proto_obj = read_bytecode(S, image, file, path);
+
+        auto* closure_obj = gc_new_closure(S, proto_obj);
+        S->stack.push_back(S, Value(closure_obj));
+    }
+
+    bool is_bytecode(std::string_view data)
+    {
+        return is_bytecode_image(data);
+    }
+
+    static void append_chunk(State*, std::string_view chunk, void* userdata)
+    {
+        static_cast<std::string*>(userdata)->append(chunk);
+    }
+
+    std::shared_ptr<const CompiledScript> compile_shared(std::string_view source, std::string_view chunkname, OptLevel level)
+    {
+        auto script = std::make_shared<CompiledScript>();
+        script->chunkname = !chunkname.empty() ? std::string(chunkname) : "<string>";
+
+        // Compiled in a scratch state, only the serialized image outlives it.
+        State* scratch = new_state();
+        try
+        {
+            load_buffer(scratch, source, script->chunkname, level);
+            dump(scratch, append_chunk, &script->image);
+        }
+        catch (...)
+        {
+            close(scratch);
+            throw;
+        }
+        close(scratch);
+
+        return script;
+    }
+
+    void load_compiled(State* S, const std::shared_ptr<const CompiledScript>& script)
+    {
+        assert(S != nullptr && "State can not be null");
+        assert(script != nullptr && "Script can not be null");
+
+        GCPauseGuard gc_pause(S);
+
+        // The image was produced by this process and is immutable, the checksum does not need to be verified again.
+        auto* proto_obj = read_bytecode(S, script->image, script, script->chunkname, false);
+
+        auto* closure_obj = gc_new_closure(S, proto_obj);
+        S->stack.push_back(S, Value(closure_obj));
+    }
+
+    void dump(State* S, BytecodeWriter writer, void* userdata, bool strip_debug_info)
+    {
+        assert(S != nullptr && "State can not be null");
+        assert(writer != nullptr && "Writer can not be null");
+
+        if (S->stack.empty() || !S->stack.back().is_closure())
+        {
+            throw TypeError("dump expects a script function at the top of the stack");
+        }
+
+        auto* proto = S->stack.back().get_closure()->proto;
+        compile_all(S, proto);
+
+        write_bytecode(S, proto, writer, userdata, strip_debug_info);
     }
 
 } // namespace behl
@@ -0,0 +1,63 @@
+#include "profiler.hpp"
+#include "state.hpp"
+#include "state_profiler.hpp"
+
+#include <behl/profiler.hpp>
+#include <cassert>
+
+namespace behl
+{
+    void profiler_start(State* S, size_t sample_interval)
+    {
+        assert(S && "State cannot be null");
+        assert(sample_interval > 0 && "Sample interval must be positive");
+
+        auto& prof = S->profiler;
+        prof.sample_interval = sample_interval;
+        prof.bytes_until_sample = static_cast<int64_t>(sample_interval);
+        prof.enabled = true;
+    }
+
+    void profiler_stop(State* S)
+    {
+        assert(S && "State cannot be null");
+        S->profiler.enabled = false;
+    }
+
+    bool profiler_is_running(State* S)
+    {
+        assert(S && "State cannot be null");
+        return S->profiler.enabled;
+    }
+
+    void profiler_reset(State* S)
+    {
+        assert(S && "State cannot be null");
+
+        auto& prof = S->profiler;
+        prof.sites.clear();
+        prof.total_samples = 0;
+        prof.bytes_until_sample = static_cast<int64_t>(prof.sample_interval);
+    }
+
+    size_t profiler_sample_count(State* S)
+    {
+        assert(S && "State cannot be null");
+        return S->profiler.total_samples;
+    }
+
+    std::string profiler_dump(State* S, ProfileFormat format)
+    {
+        assert(S && "State cannot be null");
+
+        switch (format)
+        {
+            case ProfileFormat::kFolded:
+                return profiler_format_folded(S->profiler);
+            case ProfileFormat::kPprof:
+                return profiler_format_pprof(S->profiler);
+        }
+        return {};
+    }
+
+} // namespace behl
@@ -83,6 +83,27 @@ namespace behl
         delete S;
     }
 
+    void set_module_cache_dir(State* S, std::string_view dir)
+    {
+        assert(S != nullptr && "State can not be null");
+
+        S->module_cache_dir = dir;
+    }
+
+    void set_lazy_compilation(State* S, bool enabled)
+    {
+        assert(S != nullptr && "State can not be null");
+
+        S->lazy_compilation = enabled;
+    }
+
+    void set_column_info(State* S, bool enabled)
+    {
+        assert(S != nullptr && "State can not be null");
+
+        S->column_info = enabled;
+    }
+
     void set_print_handler(State* S, PrintHandler handler)
     {
         assert(S != nullptr && "State can not be null");
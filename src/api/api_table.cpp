@@ -1,5 +1,6 @@
 #include "gc/gc.hpp"
 #include "gc/gc_object.hpp"
+#include "gc/gc_region.hpp"
 #include "gc/gco_string.hpp"
 #include "gc/gco_table.hpp"
 #include "gc/gco_userdata.hpp"
@@ -116,6 +117,8 @@ namespace behl
         GCTable* t = table_val.get_table();
         assert(t != nullptr);
 
+        gc_region_barrier(S, t, key, val);
+
         if (key.is_integer())
         {
             int64_t k = key.get_integer();
@@ -429,6 +432,8 @@ namespace behl
         // If key exists, do raw set
         if (exists)
         {
+            gc_region_barrier(S, t, key, val);
+
             if (key.is_integer())
             {
                 const auto k = key.get_integer();
@@ -453,6 +458,8 @@ namespace behl
         if (!newindex_mm.has_value())
         {
             // No metamethod, do raw set
+            gc_region_barrier(S, t, key, val);
+
             if (key.is_integer())
             {
                 const auto k = key.get_integer();
@@ -613,10 +620,12 @@ namespace behl
 
         if (target.is_table())
         {
+            gc_region_barrier(S, target.get_table(), mt_val);
             target.get_table()->metatable = metatable;
         }
         else if (target.is_userdata())
         {
+            gc_region_barrier(S, target.get_userdata(), mt_val);
             target.get_userdata()->metatable = metatable;
         }
     }
@@ -4,6 +4,7 @@
 #include "common/string.hpp"
 #include "common/vector.hpp"
 #include "frontend/lexer.hpp"
+#include "platform.hpp"
 
 #include <behl/config.hpp>
 #include <behl/types.hpp>
@@ -14,7 +15,7 @@
 
 namespace behl
 {
-    enum class AstNodeType
+    enum class AstNodeType : uint8_t
     {
         kNil,
         kBool,
@@ -72,6 +73,8 @@ namespace behl
 
     struct AstVisitor;
 
+    // Nodes carry no vtable, clone and accept dispatch on the type tag. Visitors passed as their concrete type get
+    // their visit functions called directly, nodes are trivially destructible and released with the holder's pools.
     struct AstNode
     {
         AstNodeType type;
@@ -83,9 +86,9 @@ namespace behl
             : type(t)
         {
         }
-        virtual ~AstNode() = default;
-        virtual AstNode* clone(AstHolder& holder) const = 0;
-        virtual void accept(AstVisitor& v) const = 0;
+        AstNode* clone(AstHolder& holder) const;
+        template<typename V>
+        void accept(V& v) const;
 
         bool is(AstNodeType t) const
         {
@@ -138,11 +141,10 @@ namespace behl
             : AstNode(AstNodeType::kNil)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstNil>(holder);
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstBlock : AstNode
@@ -157,7 +159,7 @@ namespace behl
         AstBlock& operator=(const AstBlock&) = delete;
         AstBlock(AstBlock&&) = default;
         AstBlock& operator=(AstBlock&&) = default;
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto* c = make_clone<AstBlock>(holder);
             AstNode** tail = &c->first_stat;
@@ -168,7 +170,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstProgram : AstNode
@@ -182,7 +183,7 @@ namespace behl
             : AstNode(AstNodeType::kProgram)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto* c = make_clone<AstProgram>(holder);
             c->is_module = is_module;
@@ -200,7 +201,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstBool : AstNode
@@ -212,11 +212,10 @@ namespace behl
             , value(v)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstBool>(holder, value);
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstInt : AstNode
@@ -228,11 +227,10 @@ namespace behl
             , value(v)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstInt>(holder, value);
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstFP : AstNode
@@ -244,23 +242,24 @@ namespace behl
             , value(v)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstFP>(holder, value);
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstString : AstNode
     {
         static constexpr AstNodeType kType = AstNodeType::kString;
-        char* data;
+        const char* data; // Interned by the holder, shared with every equal string
         size_t length;
+        Atom atom;
 
-        AstString(char* d, size_t len)
+        AstString(const char* d, size_t len, Atom a)
             : AstNode(AstNodeType::kString)
             , data(d)
             , length(len)
+            , atom(a)
         {
         }
 
@@ -269,11 +268,10 @@ namespace behl
             return std::string_view(data, length);
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
-            return holder.make_string(view());
+            return make_clone<AstString>(holder, data, length, atom);
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstVararg : AstNode
@@ -283,11 +281,10 @@ namespace behl
             : AstNode(AstNodeType::kVararg)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstVararg>(holder);
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstIdent : AstNode
@@ -299,11 +296,18 @@ namespace behl
             , name(n)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstIdent>(holder, static_cast<AstString*>(name->clone(holder)));
         }
-        void accept(AstVisitor& v) const override;
+    };
+
+    // Types both operands of an arithmetic operation or comparison are proven to have
+    enum class OperandTypes : uint8_t
+    {
+        kUnknown,
+        kIntegers,
+        kFloats,
     };
 
     struct AstBinOp : AstNode
@@ -312,6 +316,7 @@ namespace behl
         TokenType op;
         AstNode* left;
         AstNode* right;
+        OperandTypes operand_types = OperandTypes::kUnknown; // Set by type inference
         AstBinOp(TokenType o, AstNode* l, AstNode* r)
             : AstNode(AstNodeType::kBinOp)
             , op(o)
@@ -319,12 +324,12 @@ namespace behl
             , right(std::move(r))
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto* cloned = make_clone<AstBinOp>(holder, op, left->clone(holder), right->clone(holder));
+            cloned->operand_types = operand_types;
             return cloned;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstUnOp : AstNode
@@ -338,11 +343,10 @@ namespace behl
             , expr(std::move(e))
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstUnOp>(holder, op, expr->clone(holder));
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstTernary : AstNode
@@ -360,13 +364,12 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstTernary>(
                 holder, condition->clone(holder), true_expr->clone(holder), false_expr->clone(holder));
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstFuncCall : AstNode
@@ -381,7 +384,7 @@ namespace behl
             , first_arg(first_a)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto* c = make_clone<AstFuncCall>(holder, func->clone(holder));
             c->is_self_call = is_self_call;
@@ -395,7 +398,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct TableField : AstNode
@@ -410,14 +412,10 @@ namespace behl
             , value(v)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<TableField>(holder, key ? key->clone(holder) : nullptr, value->clone(holder));
         }
-        void accept(AstVisitor& v) const override
-        {
-            (void)v; /* TableField doesn't visit */
-        }
     };
 
     struct AstTableCtor : AstNode
@@ -428,7 +426,7 @@ namespace behl
             : AstNode(AstNodeType::kTableCtor)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto* c = make_clone<AstTableCtor>(holder);
             // Clone fields linked list
@@ -442,7 +440,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstIndex : AstNode
@@ -456,11 +453,10 @@ namespace behl
             , key(std::move(k))
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstIndex>(holder, table->clone(holder), key->clone(holder));
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstMember : AstNode
@@ -474,11 +470,10 @@ namespace behl
             , name(n)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstMember>(holder, table->clone(holder), static_cast<AstString*>(name->clone(holder)));
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstFuncDef : AstNode
@@ -487,13 +482,14 @@ namespace behl
         AstString* first_param = nullptr;
         bool is_vararg = false;
         bool is_method = false;
-        std::string_view self_name;
+        const AstString* self_name = nullptr; // Name a local function refers to itself by, set by the compiler
         AstBlock* block = nullptr;
+        uint32_t opt_stamp = 0; // Optimization step that last changed the body, see AstTransformer
         AstFuncDef()
             : AstNode(AstNodeType::kFuncDef)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto* c = make_clone<AstFuncDef>(holder);
             // Clone param linked list
@@ -517,7 +513,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstAssign : AstNode
@@ -529,7 +524,7 @@ namespace behl
             : AstNode(AstNodeType::kAssign)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto* cloned = make_clone<AstAssign>(holder);
             AstNode** var_tail = &cloned->first_var;
@@ -546,7 +541,6 @@ namespace behl
             }
             return cloned;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstLocalDecl : AstNode
@@ -562,7 +556,7 @@ namespace behl
             , first_init(fi)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             AstString* cloned_names = nullptr;
             AstString** name_tail = &cloned_names;
@@ -580,7 +574,6 @@ namespace behl
             }
             return make_clone<AstLocalDecl>(holder, is_const, cloned_names, cloned_inits);
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstAssignLocal : AstNode
@@ -596,12 +589,11 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstAssignLocal>(holder, name, expr->clone(holder));
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstAssignGlobal : AstNode
@@ -617,12 +609,11 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstAssignGlobal>(holder, name, expr->clone(holder));
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstAssignUpvalue : AstNode
@@ -638,12 +629,11 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstAssignUpvalue>(holder, name, expr->clone(holder));
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstCompoundAssign : AstNode
@@ -661,12 +651,11 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstCompoundAssign>(holder, target->clone(holder), op, expr->clone(holder));
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstIncrement : AstNode
@@ -680,12 +669,11 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstIncrement>(holder, target->clone(holder));
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstDecrement : AstNode
@@ -699,12 +687,11 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstDecrement>(holder, target->clone(holder));
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstCompoundLocal : AstNode
@@ -713,6 +700,7 @@ namespace behl
         AstString* name;
         TokenType op;
         AstNode* expr;
+        OperandTypes operand_types = OperandTypes::kUnknown; // Set by type inference
 
         AstCompoundLocal(AstString* n, TokenType o, AstNode* e)
             : AstNode(AstNodeType::kCompoundLocal)
@@ -722,12 +710,13 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
-            return make_clone<AstCompoundLocal>(holder, name, op, expr->clone(holder));
+            auto* cloned = make_clone<AstCompoundLocal>(holder, name, op, expr->clone(holder));
+            cloned->operand_types = operand_types;
+            return cloned;
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstCompoundGlobal : AstNode
@@ -745,12 +734,11 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstCompoundGlobal>(holder, name, op, expr->clone(holder));
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstCompoundUpvalue : AstNode
@@ -768,12 +756,11 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstCompoundUpvalue>(holder, name, op, expr->clone(holder));
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstIncLocal : AstNode
@@ -787,12 +774,11 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstIncLocal>(holder, name);
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstIncGlobal : AstNode
@@ -806,12 +792,11 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstIncGlobal>(holder, name);
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstIncUpvalue : AstNode
@@ -825,12 +810,11 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstIncUpvalue>(holder, name);
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstDecLocal : AstNode
@@ -844,12 +828,11 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstDecLocal>(holder, name);
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstDecGlobal : AstNode
@@ -863,12 +846,11 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstDecGlobal>(holder, name);
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstDecUpvalue : AstNode
@@ -882,12 +864,11 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstDecUpvalue>(holder, name);
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct ElseIf : AstNode
@@ -899,7 +880,7 @@ namespace behl
             : AstNode(AstNodeType::kElseIf)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto c = make_clone<ElseIf>(holder);
             if (cond)
@@ -918,10 +899,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor&) const override
-        {
-            // ElseIf is not directly visited, only through AstIf
-        }
     };
 
     struct AstIf : AstNode
@@ -936,7 +913,7 @@ namespace behl
             , cond(std::move(c))
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto c = make_clone<AstIf>(holder, cond->clone(holder));
 
@@ -971,7 +948,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstWhile : AstNode
@@ -984,7 +960,7 @@ namespace behl
             , cond(std::move(c))
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto c = make_clone<AstWhile>(holder, cond->clone(holder));
             if (block)
@@ -999,7 +975,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstForNum : AstNode
@@ -1017,7 +992,7 @@ namespace behl
             , end(std::move(e))
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto c = make_clone<AstForNum>(holder, var, start->clone(holder), end->clone(holder));
             if (step)
@@ -1036,7 +1011,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstForIn : AstNode
@@ -1050,7 +1024,7 @@ namespace behl
             : AstNode(AstNodeType::kForIn)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto c = make_clone<AstForIn>(holder);
             // Clone names
@@ -1079,7 +1053,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstForC : AstNode
@@ -1098,7 +1071,7 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto c = make_clone<AstForC>(holder, init ? init->clone(holder) : nullptr,
                 condition ? condition->clone(holder) : nullptr, update ? update->clone(holder) : nullptr);
@@ -1114,7 +1087,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     // Optimized numeric C-style for loop
@@ -1141,7 +1113,7 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto c = make_clone<AstForCNumeric>(holder, var, start->clone(holder), end->clone(holder),
                 step ? step->clone(holder) : nullptr, ascending, inclusive);
@@ -1157,7 +1129,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstFuncDefStat : AstNode
@@ -1169,11 +1140,12 @@ namespace behl
         AstString* first_param = nullptr;
         bool is_vararg = false;
         AstBlock* block = nullptr;
+        uint32_t opt_stamp = 0; // Optimization step that last changed the body, see AstTransformer
         AstFuncDefStat()
             : AstNode(AstNodeType::kFuncDefStat)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto* c = make_clone<AstFuncDefStat>(holder);
             // Clone name_parts linked list
@@ -1205,7 +1177,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstReturn : AstNode
@@ -1217,7 +1188,7 @@ namespace behl
             , first_expr(first_e)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto* c = make_clone<AstReturn>(holder);
             // Clone exprs linked list
@@ -1230,7 +1201,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstBreak : AstNode
@@ -1240,11 +1210,10 @@ namespace behl
             : AstNode(AstNodeType::kBreak)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstBreak>(holder);
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstContinue : AstNode
@@ -1254,11 +1223,10 @@ namespace behl
             : AstNode(AstNodeType::kContinue)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstContinue>(holder);
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstDefer : AstNode
@@ -1272,7 +1240,7 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto* c = make_clone<AstDefer>(holder);
             if (body)
@@ -1282,7 +1250,6 @@ namespace behl
             return c;
         }
 
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstScope : AstNode
@@ -1293,7 +1260,7 @@ namespace behl
             : AstNode(AstNodeType::kScope)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto* c = make_clone<AstScope>(holder);
             if (block)
@@ -1308,7 +1275,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstExprStat : AstNode
@@ -1320,12 +1286,11 @@ namespace behl
             , expr(std::move(e))
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto cloned_expr = expr->clone(holder);
             return make_clone<AstExprStat>(holder, std::move(cloned_expr));
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstModuleDecl : AstNode
@@ -1336,11 +1301,10 @@ namespace behl
             : AstNode(AstNodeType::kModuleDecl)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstModuleDecl>(holder);
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstExportDecl : AstNode
@@ -1353,11 +1317,10 @@ namespace behl
             , declaration(decl)
         {
         }
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             return make_clone<AstExportDecl>(holder, declaration->clone(holder));
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstExportList : AstNode
@@ -1370,7 +1333,7 @@ namespace behl
         {
         }
 
-        AstNode* clone(AstHolder& holder) const override
+        AstNode* clone(AstHolder& holder) const
         {
             auto c = holder.make<AstExportList>();
             AstString** tail = &c->first_name;
@@ -1382,7 +1345,6 @@ namespace behl
             }
             return c;
         }
-        void accept(AstVisitor& v) const override;
     };
 
     struct AstVisitor
@@ -1443,208 +1405,277 @@ namespace behl
         virtual void visit(const AstExportList&) = 0;
     };
 
-    inline void AstNil::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstBool::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstInt::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstFP::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstString::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstVararg::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstIdent::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstBinOp::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstUnOp::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstTernary::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstFuncCall::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstTableCtor::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstIndex::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstMember::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstFuncDef::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
+    inline AstNode* AstNode::clone(AstHolder& holder) const
+    {
+        switch (type)
+        {
+            case AstNodeType::kNil:
+                return static_cast<const AstNil*>(this)->clone(holder);
+            case AstNodeType::kBlock:
+                return static_cast<const AstBlock*>(this)->clone(holder);
+            case AstNodeType::kProgram:
+                return static_cast<const AstProgram*>(this)->clone(holder);
+            case AstNodeType::kBool:
+                return static_cast<const AstBool*>(this)->clone(holder);
+            case AstNodeType::kInteger:
+                return static_cast<const AstInt*>(this)->clone(holder);
+            case AstNodeType::kFP:
+                return static_cast<const AstFP*>(this)->clone(holder);
+            case AstNodeType::kString:
+                return static_cast<const AstString*>(this)->clone(holder);
+            case AstNodeType::kVararg:
+                return static_cast<const AstVararg*>(this)->clone(holder);
+            case AstNodeType::kIdent:
+                return static_cast<const AstIdent*>(this)->clone(holder);
+            case AstNodeType::kBinOp:
+                return static_cast<const AstBinOp*>(this)->clone(holder);
+            case AstNodeType::kUnOp:
+                return static_cast<const AstUnOp*>(this)->clone(holder);
+            case AstNodeType::kTernary:
+                return static_cast<const AstTernary*>(this)->clone(holder);
+            case AstNodeType::kFuncCall:
+                return static_cast<const AstFuncCall*>(this)->clone(holder);
+            case AstNodeType::kTableField:
+                return static_cast<const TableField*>(this)->clone(holder);
+            case AstNodeType::kTableCtor:
+                return static_cast<const AstTableCtor*>(this)->clone(holder);
+            case AstNodeType::kIndex:
+                return static_cast<const AstIndex*>(this)->clone(holder);
+            case AstNodeType::kMember:
+                return static_cast<const AstMember*>(this)->clone(holder);
+            case AstNodeType::kFuncDef:
+                return static_cast<const AstFuncDef*>(this)->clone(holder);
+            case AstNodeType::kAssign:
+                return static_cast<const AstAssign*>(this)->clone(holder);
+            case AstNodeType::kLocalDecl:
+                return static_cast<const AstLocalDecl*>(this)->clone(holder);
+            case AstNodeType::kAssignLocal:
+                return static_cast<const AstAssignLocal*>(this)->clone(holder);
+            case AstNodeType::kAssignGlobal:
+                return static_cast<const AstAssignGlobal*>(this)->clone(holder);
+            case AstNodeType::kAssignUpvalue:
+                return static_cast<const AstAssignUpvalue*>(this)->clone(holder);
+            case AstNodeType::kCompoundAssign:
+                return static_cast<const AstCompoundAssign*>(this)->clone(holder);
+            case AstNodeType::kIncrement:
+                return static_cast<const AstIncrement*>(this)->clone(holder);
+            case AstNodeType::kDecrement:
+                return static_cast<const AstDecrement*>(this)->clone(holder);
+            case AstNodeType::kCompoundLocal:
+                return static_cast<const AstCompoundLocal*>(this)->clone(holder);
+            case AstNodeType::kCompoundGlobal:
+                return static_cast<const AstCompoundGlobal*>(this)->clone(holder);
+            case AstNodeType::kCompoundUpvalue:
+                return static_cast<const AstCompoundUpvalue*>(this)->clone(holder);
+            case AstNodeType::kIncLocal:
+                return static_cast<const AstIncLocal*>(this)->clone(holder);
+            case AstNodeType::kIncGlobal:
+                return static_cast<const AstIncGlobal*>(this)->clone(holder);
+            case AstNodeType::kIncUpvalue:
+                return static_cast<const AstIncUpvalue*>(this)->clone(holder);
+            case AstNodeType::kDecLocal:
+                return static_cast<const AstDecLocal*>(this)->clone(holder);
+            case AstNodeType::kDecGlobal:
+                return static_cast<const AstDecGlobal*>(this)->clone(holder);
+            case AstNodeType::kDecUpvalue:
+                return static_cast<const AstDecUpvalue*>(this)->clone(holder);
+            case AstNodeType::kElseIf:
+                return static_cast<const ElseIf*>(this)->clone(holder);
+            case AstNodeType::kIf:
+                return static_cast<const AstIf*>(this)->clone(holder);
+            case AstNodeType::kWhile:
+                return static_cast<const AstWhile*>(this)->clone(holder);
+            case AstNodeType::kForNum:
+                return static_cast<const AstForNum*>(this)->clone(holder);
+            case AstNodeType::kForIn:
+                return static_cast<const AstForIn*>(this)->clone(holder);
+            case AstNodeType::kForC:
+                return static_cast<const AstForC*>(this)->clone(holder);
+            case AstNodeType::kForCNumeric:
+                return static_cast<const AstForCNumeric*>(this)->clone(holder);
+            case AstNodeType::kFuncDefStat:
+                return static_cast<const AstFuncDefStat*>(this)->clone(holder);
+            case AstNodeType::kReturn:
+                return static_cast<const AstReturn*>(this)->clone(holder);
+            case AstNodeType::kBreak:
+                return static_cast<const AstBreak*>(this)->clone(holder);
+            case AstNodeType::kContinue:
+                return static_cast<const AstContinue*>(this)->clone(holder);
+            case AstNodeType::kDefer:
+                return static_cast<const AstDefer*>(this)->clone(holder);
+            case AstNodeType::kScope:
+                return static_cast<const AstScope*>(this)->clone(holder);
+            case AstNodeType::kExprStat:
+                return static_cast<const AstExprStat*>(this)->clone(holder);
+            case AstNodeType::kModuleDecl:
+                return static_cast<const AstModuleDecl*>(this)->clone(holder);
+            case AstNodeType::kExportDecl:
+                return static_cast<const AstExportDecl*>(this)->clone(holder);
+            case AstNodeType::kExportList:
+                return static_cast<const AstExportList*>(this)->clone(holder);
+        }
+        BEHL_UNREACHABLE();
     }
 
-    inline void AstAssign::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstAssignLocal::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstAssignGlobal::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstAssignUpvalue::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstCompoundAssign::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstCompoundLocal::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstCompoundGlobal::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstCompoundUpvalue::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstIncrement::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstIncLocal::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstIncGlobal::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstIncUpvalue::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstDecrement::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstDecLocal::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstDecGlobal::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstDecUpvalue::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstLocalDecl::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstIf::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstWhile::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstForNum::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstForIn::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstForC::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-
-    inline void AstForCNumeric::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstFuncDefStat::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstReturn::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstBreak::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstContinue::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstDefer::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstScope::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstExprStat::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-
-    inline void AstBlock::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstProgram::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstModuleDecl::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstExportDecl::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
-    }
-    inline void AstExportList::accept(AstVisitor& v) const
-    {
-        v.visit(*this);
+    template<typename V>
+    void AstNode::accept(V& v) const
+    {
+        switch (type)
+        {
+            case AstNodeType::kNil:
+                v.visit(*static_cast<const AstNil*>(this));
+                break;
+            case AstNodeType::kBlock:
+                v.visit(*static_cast<const AstBlock*>(this));
+                break;
+            case AstNodeType::kProgram:
+                v.visit(*static_cast<const AstProgram*>(this));
+                break;
+            case AstNodeType::kBool:
+                v.visit(*static_cast<const AstBool*>(this));
+                break;
+            case AstNodeType::kInteger:
+                v.visit(*static_cast<const AstInt*>(this));
+                break;
+            case AstNodeType::kFP:
+                v.visit(*static_cast<const AstFP*>(this));
+                break;
+            case AstNodeType::kString:
+                v.visit(*static_cast<const AstString*>(this));
+                break;
+            case AstNodeType::kVararg:
+                v.visit(*static_cast<const AstVararg*>(this));
+                break;
+            case AstNodeType::kIdent:
+                v.visit(*static_cast<const AstIdent*>(this));
+                break;
+            case AstNodeType::kBinOp:
+                v.visit(*static_cast<const AstBinOp*>(this));
+                break;
+            case AstNodeType::kUnOp:
+                v.visit(*static_cast<const AstUnOp*>(this));
+                break;
+            case AstNodeType::kTernary:
+                v.visit(*static_cast<const AstTernary*>(this));
+                break;
+            case AstNodeType::kFuncCall:
+                v.visit(*static_cast<const AstFuncCall*>(this));
+                break;
+            case AstNodeType::kTableCtor:
+                v.visit(*static_cast<const AstTableCtor*>(this));
+                break;
+            case AstNodeType::kIndex:
+                v.visit(*static_cast<const AstIndex*>(this));
+                break;
+            case AstNodeType::kMember:
+                v.visit(*static_cast<const AstMember*>(this));
+                break;
+            case AstNodeType::kFuncDef:
+                v.visit(*static_cast<const AstFuncDef*>(this));
+                break;
+            case AstNodeType::kAssign:
+                v.visit(*static_cast<const AstAssign*>(this));
+                break;
+            case AstNodeType::kLocalDecl:
+                v.visit(*static_cast<const AstLocalDecl*>(this));
+                break;
+            case AstNodeType::kAssignLocal:
+                v.visit(*static_cast<const AstAssignLocal*>(this));
+                break;
+            case AstNodeType::kAssignGlobal:
+                v.visit(*static_cast<const AstAssignGlobal*>(this));
+                break;
+            case AstNodeType::kAssignUpvalue:
+                v.visit(*static_cast<const AstAssignUpvalue*>(this));
+                break;
+            case AstNodeType::kCompoundAssign:
+                v.visit(*static_cast<const AstCompoundAssign*>(this));
+                break;
+            case AstNodeType::kIncrement:
+                v.visit(*static_cast<const AstIncrement*>(this));
+                break;
+            case AstNodeType::kDecrement:
+                v.visit(*static_cast<const AstDecrement*>(this));
+                break;
+            case AstNodeType::kCompoundLocal:
+                v.visit(*static_cast<const AstCompoundLocal*>(this));
+                break;
+            case AstNodeType::kCompoundGlobal:
+                v.visit(*static_cast<const AstCompoundGlobal*>(this));
+                break;
+            case AstNodeType::kCompoundUpvalue:
+                v.visit(*static_cast<const AstCompoundUpvalue*>(this));
+                break;
+            case AstNodeType::kIncLocal:
+                v.visit(*static_cast<const AstIncLocal*>(this));
+                break;
+            case AstNodeType::kIncGlobal:
+                v.visit(*static_cast<const AstIncGlobal*>(this));
+                break;
+            case AstNodeType::kIncUpvalue:
+                v.visit(*static_cast<const AstIncUpvalue*>(this));
+                break;
+            case AstNodeType::kDecLocal:
+                v.visit(*static_cast<const AstDecLocal*>(this));
+                break;
+            case AstNodeType::kDecGlobal:
+                v.visit(*static_cast<const AstDecGlobal*>(this));
+                break;
+            case AstNodeType::kDecUpvalue:
+                v.visit(*static_cast<const AstDecUpvalue*>(this));
+                break;
+            case AstNodeType::kIf:
+                v.visit(*static_cast<const AstIf*>(this));
+                break;
+            case AstNodeType::kWhile:
+                v.visit(*static_cast<const AstWhile*>(this));
+                break;
+            case AstNodeType::kForNum:
+                v.visit(*static_cast<const AstForNum*>(this));
+                break;
+            case AstNodeType::kForIn:
+                v.visit(*static_cast<const AstForIn*>(this));
+                break;
+            case AstNodeType::kForC:
+                v.visit(*static_cast<const AstForC*>(this));
+                break;
+            case AstNodeType::kForCNumeric:
+                v.visit(*static_cast<const AstForCNumeric*>(this));
+                break;
+            case AstNodeType::kFuncDefStat:
+                v.visit(*static_cast<const AstFuncDefStat*>(this));
+                break;
+            case AstNodeType::kReturn:
+                v.visit(*static_cast<const AstReturn*>(this));
+                break;
+            case AstNodeType::kBreak:
+                v.visit(*static_cast<const AstBreak*>(this));
+                break;
+            case AstNodeType::kContinue:
+                v.visit(*static_cast<const AstContinue*>(this));
+                break;
+            case AstNodeType::kDefer:
+                v.visit(*static_cast<const AstDefer*>(this));
+                break;
+            case AstNodeType::kScope:
+                v.visit(*static_cast<const AstScope*>(this));
+                break;
+            case AstNodeType::kExprStat:
+                v.visit(*static_cast<const AstExprStat*>(this));
+                break;
+            case AstNodeType::kModuleDecl:
+                v.visit(*static_cast<const AstModuleDecl*>(this));
+                break;
+            case AstNodeType::kExportDecl:
+                v.visit(*static_cast<const AstExportDecl*>(this));
+                break;
+            case AstNodeType::kExportList:
+                v.visit(*static_cast<const AstExportList*>(this));
+                break;
+            case AstNodeType::kTableField:
+            case AstNodeType::kElseIf:
+                break; // Visited through their parent node
+        }
     }
 
 } // namespace behl
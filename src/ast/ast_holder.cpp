@@ -4,6 +4,9 @@
 #include "memory.hpp"
 
 #include <algorithm>
+#include <cassert>
+#include <memory>
+#include <utility>
 
 namespace behl
 {
@@ -11,19 +14,22 @@ namespace behl
         : m_state(state)
     {
         m_pools.emplace_back(m_state, m_state);
+        m_atoms.init(m_state, 0);
+
+        [[maybe_unused]] const Atom self_atom = intern("self");
+        assert(self_atom == kAtomSelf);
     }
 
     AstHolder::~AstHolder()
     {
-        destroy_all_nodes();
-        m_nodes.destroy(m_state);
+        m_atoms.destroy(m_state);
         m_pools.destroy(m_state);
     }
 
     AstHolder::AstHolder(AstHolder&& other) noexcept
         : m_state(other.m_state)
         , m_pools(std::move(other.m_pools))
-        , m_nodes(std::move(other.m_nodes))
+        , m_atoms(std::exchange(other.m_atoms, {}))
     {
         other.m_state = nullptr;
     }
@@ -32,13 +38,12 @@ namespace behl
     {
         if (this != &other)
         {
-            destroy_all_nodes();
-            m_nodes.destroy(m_state);
+            m_atoms.destroy(m_state);
             m_pools.destroy(m_state);
 
             m_state = other.m_state;
             m_pools = std::move(other.m_pools);
-            m_nodes = std::move(other.m_nodes);
+            m_atoms = std::exchange(other.m_atoms, {});
 
             other.m_state = nullptr;
         }
@@ -63,33 +68,34 @@ namespace behl
         return ptr;
     }
 
-    void AstHolder::track_node(AstNode* node)
+    const AstHolder::Interned& AstHolder::intern_data(std::string_view str)
     {
-        m_nodes.push_back(m_state, node);
-    }
+        auto it = m_atoms.find(str);
+        if (it != m_atoms.end())
+        {
+            return it->second;
+        }
 
-    AstString* AstHolder::make_string(std::string_view str)
-    {
-        // Allocate memory for the string data
+        // Allocate memory for the string data, the map key refers to it so it must outlive the map
         char* data = static_cast<char*>(allocate(str.size(), 1));
         std::copy(str.begin(), str.end(), data);
 
-        // Allocate and construct the AstString node
-        void* mem = allocate(sizeof(AstString), alignof(AstString));
-        AstString* node = new (mem) AstString(data, str.size());
-
-        // Track for destruction
-        track_node(node);
+        const Interned interned{ data, static_cast<Atom>(m_atoms.size()) };
+        return m_atoms.insert(m_state, std::string_view(data, str.size()), interned).first->second;
+    }
 
-        return node;
+    Atom AstHolder::intern(std::string_view str)
+    {
+        return intern_data(str).atom;
     }
 
-    void AstHolder::destroy_all_nodes()
+    AstString* AstHolder::make_string(std::string_view str)
     {
-        for (auto it = m_nodes.rbegin(); it != m_nodes.rend(); ++it)
-        {
-            std::destroy_at(*it);
-        }
+        const Interned& interned = intern_data(str);
+
+        // Allocate and construct the AstString node
+        void* mem = allocate(sizeof(AstString), alignof(AstString));
+        return std::construct_at(static_cast<AstString*>(mem), interned.data, str.size(), interned.atom);
     }
 
 } // namespace behl
@@ -1,12 +1,16 @@
 #pragma once
 
+#include "common/hash_map.hpp"
+#include "common/string.hpp"
 #include "common/vector.hpp"
 #include "memory.hpp"
 
 #include <behl/export.hpp>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string_view>
+#include <type_traits>
 
 namespace behl
 {
@@ -14,6 +18,24 @@ namespace behl
     struct AstString;
     struct State;
 
+    // Identifier interned by the AstHolder, equal names of the same holder share one atom so later phases compare and
+    // hash integers instead of strings.
+    using Atom = uint32_t;
+
+    constexpr Atom kInvalidAtom = UINT32_MAX;
+
+    // Atoms the holder interns on construction, used for names the compiler introduces itself.
+    constexpr Atom kAtomSelf = 0;
+
+    struct AtomHash
+    {
+        size_t operator()(Atom atom) const noexcept
+        {
+            // Fibonacci hashing spreads the small consecutive atoms over the high bits the map uses as tag
+            return static_cast<size_t>(static_cast<uint64_t>(atom) * 0x9E3779B97F4A7C15ULL);
+        }
+    };
+
     class BEHL_API AstHolder
     {
     public:
@@ -26,25 +48,25 @@ namespace behl
         AstHolder(AstHolder&&) noexcept;
         AstHolder& operator=(AstHolder&&) noexcept;
 
-        // Allocate a new node of type T
+        // Allocate a new node of type T, nodes are never destroyed individually, the pools are released as a whole
         template<typename T, typename... Args>
         T* make(Args&&... args)
         {
+            static_assert(std::is_trivially_destructible_v<T>, "AST nodes must not own resources");
+
             // Allocate memory from pool
             void* mem = allocate(sizeof(T), alignof(T));
 
             // Construct in-place
-            T* node = std::construct_at(static_cast<T*>(mem), std::forward<Args>(args)...);
-
-            // Track for destruction
-            track_node(node);
-
-            return node;
+            return std::construct_at(static_cast<T*>(mem), std::forward<Args>(args)...);
         }
 
-        // Allocate string node with string data (untracked memory)
+        // Allocate string node with string data (untracked memory), equal strings share their data and atom
         AstString* make_string(std::string_view str);
 
+        // Returns the atom of the string, interning it on first use
+        Atom intern(std::string_view str);
+
         State* state() const
         {
             return m_state;
@@ -99,12 +121,18 @@ namespace behl
         };
 
         void* allocate(size_t size, size_t alignment);
-        void track_node(AstNode* node);
-        void destroy_all_nodes();
+
+        struct Interned
+        {
+            const char* data;
+            Atom atom;
+        };
+
+        const Interned& intern_data(std::string_view str);
 
         State* m_state;
         Vector<Pool> m_pools;
-        Vector<AstNode*> m_nodes;
+        HashMap<std::string_view, Interned, StringHash, StringEq> m_atoms;
     };
 
 } // namespace behl
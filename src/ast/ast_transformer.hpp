@@ -12,6 +12,14 @@ namespace behl
         AstHolder& holder;
         bool changed = false;
 
+    private:
+        // Function bodies that changed are stamped with change_stamp. When revisit_from is set, top level functions
+        // stamped before it are skipped, their bodies are unchanged since the transformer last ran over them.
+        uint32_t change_stamp = 0;
+        uint32_t revisit_from = 0;
+        uint32_t function_depth = 0;
+        bool function_changed = false;
+
     public:
         explicit AstTransformer(AstHolder& h)
             : holder(h)
@@ -21,12 +29,24 @@ namespace behl
 
         // Returns true if any transformations were made
         bool has_changed() const
+        {
+            return changed || function_changed;
+        }
+        // Returns true if a transformation was made outside of function bodies
+        bool has_changed_outside_functions() const
         {
             return changed;
         }
         void reset_changed()
         {
             changed = false;
+            function_changed = false;
+        }
+
+        void set_change_tracking(uint32_t stamp, uint32_t revisit)
+        {
+            change_stamp = stamp;
+            revisit_from = revisit;
         }
 
         // Main entry point - transforms a node and its children
@@ -68,7 +88,7 @@ namespace behl
                 case AstNodeType::kMember:
                     return visit_Member(static_cast<AstMember*>(node));
                 case AstNodeType::kFuncDef:
-                    return visit_FuncDef(static_cast<AstFuncDef*>(node));
+                    return transform_function(static_cast<AstFuncDef*>(node), &AstTransformer::visit_FuncDef);
                 case AstNodeType::kLocalDecl:
                     return visit_LocalDecl(static_cast<AstLocalDecl*>(node));
                 case AstNodeType::kAssign:
@@ -104,7 +124,7 @@ namespace behl
                 case AstNodeType::kForCNumeric:
                     return visit_ForCNumeric(static_cast<AstForCNumeric*>(node));
                 case AstNodeType::kFuncDefStat:
-                    return visit_FuncDefStat(static_cast<AstFuncDefStat*>(node));
+                    return transform_function(static_cast<AstFuncDefStat*>(node), &AstTransformer::visit_FuncDefStat);
                 case AstNodeType::kReturn:
                     return visit_Return(static_cast<AstReturn*>(node));
                 case AstNodeType::kBreak:
@@ -122,6 +142,35 @@ namespace behl
             }
         }
 
+        template<typename T>
+        AstNode* transform_function(T* node, AstNode* (AstTransformer::*visit)(T*))
+        {
+            // Nested functions are created and changed only through their enclosing function, whose stamp covers them.
+            if (function_depth == 0 && revisit_from != 0 && node->opt_stamp < revisit_from)
+            {
+                return node;
+            }
+
+            const bool outer_changed = changed;
+            changed = false;
+
+            function_depth++;
+            AstNode* result = (this->*visit)(node);
+            function_depth--;
+
+            if (changed)
+            {
+                node->opt_stamp = change_stamp;
+                if (function_depth == 0)
+                {
+                    function_changed = true;
+                }
+            }
+            changed = outer_changed || (changed && function_depth != 0);
+
+            return result;
+        }
+
         // Transform a linked list of nodes (e.g., function arguments, initializers)
         // Supports removal: if transform returns nullptr, the node is removed from the list
         void transform_list(AstNode*& first)
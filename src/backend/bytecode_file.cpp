@@ -0,0 +1,825 @@
+#include "bytecode_file.hpp"
+
+#include "common/format.hpp"
+#include "common/string.hpp"
+#include "config_internal.hpp"
+#include "gc/gc.hpp"
+#include "gc/gco_proto.hpp"
+#include "gc/gco_string.hpp"
+#include "optimization/bytecode/bytecode_context.hpp"
+#include "state.hpp"
+#include "vm/bytecode.hpp"
+#include "vm/value.hpp"
+
+#include <array>
+#include <behl/exceptions.hpp>
+#include <cassert>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace behl
+{
+    // File layout, all values in native byte order:
+    //
+    //   header   signature, format version, type sizes, flags, byte order mark, payload size and checksum
+    //   strings  count followed by length prefixed strings, padded to 8 bytes
+    //   protos   the main proto followed depth-first by its nested protos
+    //
+    // Arrays that the VM reads directly (instructions, line tables and their checkpoints) and numeric constants are aligned
+    // to their natural alignment relative to the start of the image, so a page aligned mapping can be used in place.
+    static constexpr std::array<char, 4> kSignature = { '\x1B', 'B', 'H', 'C' };
+    static constexpr uint32_t kByteOrderMark = 0x01020304;
+    static constexpr uint32_t kNoString = 0xFFFFFFFF;
+    static constexpr size_t kHeaderSize = 32;
+    static constexpr size_t kMaxProtoDepth = 200;
+    static constexpr uint8_t kFlagStripped = 1u << 0;
+    static constexpr size_t kMultValues = static_cast<uint8_t>(kMultRet);
+
+    struct BytecodeHeader
+    {
+        std::array<char, 4> signature;
+        uint16_t version;
+        uint8_t instruction_size;
+        uint8_t integer_size;
+        uint8_t number_size;
+        uint8_t opcode_count;
+        uint8_t flags;
+        uint8_t reserved;
+        uint32_t byte_order;
+        uint64_t payload_size;
+        uint64_t checksum;
+    };
+    static_assert(sizeof(BytecodeHeader) == kHeaderSize);
+
+    // FNV-1a over the header (excluding the checksum field) and the payload.
+    static uint64_t bytecode_checksum(const BytecodeHeader& header, std::string_view payload)
+    {
+        const auto header_bytes = std::string_view(reinterpret_cast<const char*>(&header), offsetof(BytecodeHeader, checksum));
+        return fnv1a_64(payload, fnv1a_64(header_bytes));
+    }
+
+    bool is_bytecode_image(std::string_view data) noexcept
+    {
+        return data.size() >= kSignature.size() && std::memcmp(data.data(), kSignature.data(), kSignature.size()) == 0;
+    }
+
+    class BytecodeEncoder
+    {
+    public:
+        explicit BytecodeEncoder(bool strip_debug_info)
+            : strip_debug_info_(strip_debug_info)
+        {
+        }
+
+        std::string encode(const GCProto* root)
+        {
+            write_proto(root);
+
+            std::string payload;
+            put<uint32_t>(payload, static_cast<uint32_t>(strings_.size()));
+            for (const auto str : strings_)
+            {
+                put<uint32_t>(payload, static_cast<uint32_t>(str.size()));
+                payload.append(str);
+            }
+
+            // Header is 8 byte aligned, keeping the proto section aligned keeps every array in it aligned.
+            pad(payload, 8);
+            payload.append(protos_);
+            return payload;
+        }
+
+    private:
+        template<typename T>
+        static void put(std::string& out, T value)
+        {
+            out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        static void pad(std::string& out, size_t alignment)
+        {
+            while (out.size() % alignment != 0)
+            {
+                out.push_back('\0');
+            }
+        }
+
+        uint32_t string_index(const GCString* str)
+        {
+            if (str == nullptr)
+            {
+                return kNoString;
+            }
+
+            const auto view = str->view();
+            const auto [it, inserted] = string_indices_.try_emplace(view, static_cast<uint32_t>(strings_.size()));
+            if (inserted)
+            {
+                strings_.push_back(view);
+            }
+            return it->second;
+        }
+
+        template<typename T>
+        void put_array(const T* data, size_t count, size_t alignment)
+        {
+            put<uint32_t>(protos_, static_cast<uint32_t>(count));
+            pad(protos_, alignment);
+            if (count > 0)
+            {
+                protos_.append(reinterpret_cast<const char*>(data), count * sizeof(T));
+            }
+        }
+
+        void write_proto(const GCProto* proto)
+        {
+            put<uint32_t>(protos_, string_index(proto->name));
+            put<uint32_t>(protos_, string_index(proto->source_name));
+            put<uint32_t>(protos_, string_index(proto->source_path));
+            put<uint32_t>(protos_, proto->num_params);
+            put<uint32_t>(protos_, proto->max_stack_size);
+            put<uint8_t>(protos_, proto->is_vararg ? 1 : 0);
+            put<uint8_t>(protos_, proto->has_upvalues ? 1 : 0);
+            put<uint16_t>(protos_, 0);
+
+            put_array(proto->code.data(), proto->code.size(), alignof(Instruction));
+
+            put<uint32_t>(protos_, static_cast<uint32_t>(proto->str_constants.size()));
+            for (const auto& constant : proto->str_constants)
+            {
+                assert(constant.is_string());
+                put<uint32_t>(protos_, string_index(constant.get_string()));
+            }
+
+            put<uint32_t>(protos_, static_cast<uint32_t>(proto->int_constants.size()));
+            pad(protos_, alignof(Integer));
+            for (const auto& constant : proto->int_constants)
+            {
+                put<Integer>(protos_, constant.get_integer());
+            }
+
+            put<uint32_t>(protos_, static_cast<uint32_t>(proto->fp_constants.size()));
+            pad(protos_, alignof(FP));
+            for (const auto& constant : proto->fp_constants)
+            {
+                put<FP>(protos_, constant.get_fp());
+            }
+
+            put_array(proto->table_constants.data(), proto->table_constants.size(), alignof(uint32_t));
+            put_array(proto->table_constant_data.data(), proto->table_constant_data.size(), alignof(uint32_t));
+            put_array(proto->switch_tables.data(), proto->switch_tables.size(), alignof(uint32_t));
+            put_array(proto->switch_data.data(), proto->switch_data.size(), alignof(uint32_t));
+
+            put<uint32_t>(protos_, static_cast<uint32_t>(proto->upvalue_names.size()));
+            for (const auto* upvalue_name : proto->upvalue_names)
+            {
+                put<uint32_t>(protos_, string_index(upvalue_name));
+            }
+
+            const auto& lines = proto->line_table;
+            const bool keep_lines = !strip_debug_info_ && lines.count > 0;
+            put<uint32_t>(protos_, keep_lines ? lines.count : 0);
+            put<uint8_t>(protos_, keep_lines && lines.has_columns ? 1 : 0);
+            put<uint8_t>(protos_, 0);
+            put<uint16_t>(protos_, 0);
+            put_array(lines.deltas.data(), keep_lines ? lines.deltas.size() : 0, alignof(uint8_t));
+            put_array(lines.checkpoints.data(), keep_lines ? lines.checkpoints.size() : 0, alignof(LineCheckpoint));
+
+            put<uint32_t>(protos_, static_cast<uint32_t>(proto->protos.size()));
+            for (const auto* nested_proto : proto->protos)
+            {
+                write_proto(nested_proto);
+            }
+        }
+
+        bool strip_debug_info_;
+        std::string protos_;
+        std::vector<std::string_view> strings_;
+        std::unordered_map<std::string_view, uint32_t> string_indices_;
+    };
+
+    class BytecodeDecoder
+    {
+    public:
+        BytecodeDecoder(State* S, std::string_view image, std::shared_ptr<const void> backing, std::string_view chunkname,
+            bool verify_checksum)
+            : S_(S)
+            , image_(image)
+            , cursor_(kHeaderSize)
+            , backing_(std::move(backing))
+            , chunkname_(chunkname)
+            , verify_checksum_(verify_checksum)
+        {
+        }
+
+        GCProto* decode()
+        {
+            read_header();
+            read_strings();
+
+            auto* proto = read_proto(0);
+            if (cursor_ != image_.size())
+            {
+                fail("trailing data after the main function");
+            }
+            return proto;
+        }
+
+    private:
+        [[noreturn]] void fail(std::string_view reason) const
+        {
+            throw RuntimeError(behl::format("invalid bytecode: {}", reason), SourceLocation(chunkname_));
+        }
+
+        size_t remaining() const
+        {
+            return image_.size() - cursor_;
+        }
+
+        template<typename T>
+        T read()
+        {
+            if (remaining() < sizeof(T))
+            {
+                fail("unexpected end of data");
+            }
+
+            T value;
+            std::memcpy(&value, image_.data() + cursor_, sizeof(T));
+            cursor_ += sizeof(T);
+            return value;
+        }
+
+        // Reads an element count and makes sure that many elements of the given size can still follow.
+        uint32_t read_count(size_t element_size)
+        {
+            const auto count = read<uint32_t>();
+            if (count > remaining() / element_size)
+            {
+                fail("element count exceeds the size of the data");
+            }
+            return count;
+        }
+
+        void skip_padding(size_t alignment)
+        {
+            while (cursor_ % alignment != 0)
+            {
+                if (read<uint8_t>() != 0)
+                {
+                    fail("non-zero padding");
+                }
+            }
+        }
+
+        template<typename T>
+        void read_array(Vector<T>& out, size_t alignment)
+        {
+            const auto count = read<uint32_t>();
+            skip_padding(alignment);
+            if (count > remaining() / sizeof(T))
+            {
+                fail("element count exceeds the size of the data");
+            }
+
+            const char* src = image_.data() + cursor_;
+            cursor_ += count * sizeof(T);
+
+            if (count == 0)
+            {
+                return;
+            }
+
+            if (backing_ && reinterpret_cast<uintptr_t>(src) % alignof(T) == 0)
+            {
+                // Code and line tables are never written after load, so they can reference an image that other
+                // states share.
+                out.assign_external(S_, reinterpret_cast<const T*>(src), count);
+                return;
+            }
+
+            out.resize(S_, count);
+            std::memcpy(static_cast<void*>(out.data()), src, count * sizeof(T));
+        }
+
+        GCString* read_string_ref()
+        {
+            const auto index = read<uint32_t>();
+            if (index == kNoString)
+            {
+                return nullptr;
+            }
+            if (index >= strings_.size())
+            {
+                fail("string index out of range");
+            }
+            return strings_[index];
+        }
+
+        void read_header()
+        {
+            if (image_.size() < kHeaderSize || !is_bytecode_image(image_))
+            {
+                fail("missing bytecode signature");
+            }
+
+            BytecodeHeader header;
+            std::memcpy(&header, image_.data(), kHeaderSize);
+
+            if (header.version != kBytecodeFormatVersion)
+            {
+                fail(behl::format("format version {} is not supported (expected {})", header.version, kBytecodeFormatVersion));
+            }
+            if (header.byte_order != kByteOrderMark)
+            {
+                fail("byte order does not match this platform");
+            }
+            if (header.instruction_size != sizeof(Instruction) || header.integer_size != sizeof(Integer)
+                || header.number_size != sizeof(FP) || header.opcode_count != kOpCount)
+            {
+                fail("produced by an incompatible build");
+            }
+            if ((header.flags & ~kFlagStripped) != 0 || header.reserved != 0)
+            {
+                fail("unknown header flags");
+            }
+            if (header.payload_size != image_.size() - kHeaderSize)
+            {
+                fail("payload size does not match the header");
+            }
+            if (verify_checksum_ && header.checksum != bytecode_checksum(header, image_.substr(kHeaderSize)))
+            {
+                fail("checksum mismatch");
+            }
+        }
+
+        void read_strings()
+        {
+            const auto count = read_count(sizeof(uint32_t));
+            strings_.reserve(count);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                const auto length = read<uint32_t>();
+                if (length > remaining())
+                {
+                    fail("string exceeds the size of the data");
+                }
+                strings_.push_back(gc_new_string(S_, image_.substr(cursor_, length)));
+                cursor_ += length;
+            }
+            skip_padding(8);
+        }
+
+        GCProto* read_proto(size_t depth)
+        {
+            if (depth > kMaxProtoDepth)
+            {
+                fail("functions nested too deeply");
+            }
+
+            auto* proto = gc_new_proto(S_);
+            proto->backing = backing_;
+            proto->name = read_string_ref();
+            proto->source_name = read_string_ref();
+            proto->source_path = read_string_ref();
+            proto->num_params = read<uint32_t>();
+            proto->max_stack_size = read<uint32_t>();
+
+            const auto is_vararg = read<uint8_t>();
+            const auto has_upvalues = read<uint8_t>();
+            if (is_vararg > 1 || has_upvalues > 1 || read<uint16_t>() != 0)
+            {
+                fail("malformed function header");
+            }
+            proto->is_vararg = is_vararg != 0;
+            proto->has_upvalues = has_upvalues != 0;
+
+            if (proto->max_stack_size > kMaxRegisters + 1 || proto->num_params > proto->max_stack_size)
+            {
+                fail("register count out of range");
+            }
+
+            read_array(proto->code, alignof(Instruction));
+            if (proto->code.empty())
+            {
+                fail("function without instructions");
+            }
+
+            const auto str_count = read_count(sizeof(uint32_t));
+            proto->str_constants.reserve(S_, str_count);
+            for (uint32_t i = 0; i < str_count; ++i)
+            {
+                auto* str = read_string_ref();
+                if (str == nullptr)
+                {
+                    fail("missing string constant");
+                }
+                proto->str_constants.push_back(S_, Value(str));
+            }
+
+            const auto int_count = read<uint32_t>();
+            skip_padding(alignof(Integer));
+            if (int_count > remaining() / sizeof(Integer))
+            {
+                fail("element count exceeds the size of the data");
+            }
+            proto->int_constants.reserve(S_, int_count);
+            for (uint32_t i = 0; i < int_count; ++i)
+            {
+                proto->int_constants.push_back(S_, Value(read<Integer>()));
+            }
+
+            const auto fp_count = read<uint32_t>();
+            skip_padding(alignof(FP));
+            if (fp_count > remaining() / sizeof(FP))
+            {
+                fail("element count exceeds the size of the data");
+            }
+            proto->fp_constants.reserve(S_, fp_count);
+            for (uint32_t i = 0; i < fp_count; ++i)
+            {
+                proto->fp_constants.push_back(S_, Value(read<FP>()));
+            }
+
+            read_array(proto->table_constants, alignof(uint32_t));
+            read_array(proto->table_constant_data, alignof(uint32_t));
+            validate_table_constants(*proto);
+            read_array(proto->switch_tables, alignof(uint32_t));
+            read_array(proto->switch_data, alignof(uint32_t));
+            validate_switch_tables(*proto);
+
+            const auto upvalue_count = read_count(sizeof(uint32_t));
+            if (upvalue_count > kMaxUpvalues)
+            {
+                fail("too many upvalues");
+            }
+            proto->upvalue_names.reserve(S_, upvalue_count);
+            for (uint32_t i = 0; i < upvalue_count; ++i)
+            {
+                proto->upvalue_names.push_back(S_, read_string_ref());
+            }
+
+            auto& lines = proto->line_table;
+            lines.count = read<uint32_t>();
+            const auto has_columns = read<uint8_t>();
+            if (has_columns > 1 || read<uint8_t>() != 0 || read<uint16_t>() != 0)
+            {
+                fail("malformed line table header");
+            }
+            lines.has_columns = has_columns != 0;
+            read_array(lines.deltas, alignof(uint8_t));
+            read_array(lines.checkpoints, alignof(LineCheckpoint));
+            if (!lines.is_valid(proto->code.size()))
+            {
+                fail("line table does not match the instructions");
+            }
+            if (!S_->column_info)
+            {
+                lines.strip_columns(S_);
+            }
+
+            // Every nested proto takes at least its fixed size header.
+            const auto nested_count = read_count(sizeof(uint32_t) * 8);
+            proto->protos.reserve(S_, nested_count);
+            for (uint32_t i = 0; i < nested_count; ++i)
+            {
+                proto->protos.push_back(S_, read_proto(depth + 1));
+            }
+
+            validate_code(*proto);
+            return proto;
+        }
+
+        // Checks that every constant table lies inside the table data and only refers to existing constants.
+        void validate_table_constants(const GCProto& proto) const
+        {
+            const size_t data_size = proto.table_constant_data.size();
+            for (const uint32_t offset : proto.table_constants)
+            {
+                if (offset > data_size || data_size - offset < 2)
+                {
+                    fail("constant table out of range");
+                }
+                const uint32_t* data = proto.table_constant_data.data() + offset;
+                const uint64_t entry_count = static_cast<uint64_t>(data[0]) + 2 * static_cast<uint64_t>(data[1]);
+                if (entry_count > data_size - offset - 2)
+                {
+                    fail("constant table out of range");
+                }
+                for (uint64_t i = 0; i < entry_count; ++i)
+                {
+                    const uint32_t entry = data[2 + i];
+                    const ConstIndex index = table_constant_index(entry);
+                    switch (table_constant_kind(entry))
+                    {
+                        case TableConstantKind::kNil:
+                        case TableConstantKind::kFalse:
+                        case TableConstantKind::kTrue:
+                            break;
+                        case TableConstantKind::kInteger:
+                            if (index >= proto.int_constants.size())
+                            {
+                                fail("constant index out of range");
+                            }
+                            break;
+                        case TableConstantKind::kFP:
+                            if (index >= proto.fp_constants.size())
+                            {
+                                fail("constant index out of range");
+                            }
+                            break;
+                        case TableConstantKind::kString:
+                            if (index >= proto.str_constants.size())
+                            {
+                                fail("constant index out of range");
+                            }
+                            break;
+                        default:
+                            fail("unknown constant table entry");
+                    }
+                }
+            }
+        }
+
+        // Checks that every jump table lies inside the switch data, only refers to existing constants and only selects
+        // its own slots.
+        void validate_switch_tables(const GCProto& proto) const
+        {
+            const size_t data_size = proto.switch_data.size();
+            for (const uint32_t offset : proto.switch_tables)
+            {
+                if (offset > data_size || data_size - offset < kSwitchHeaderSize)
+                {
+                    fail("switch table out of range");
+                }
+                const uint32_t* data = proto.switch_data.data() + offset;
+                const uint32_t slot_count = data[1];
+                if (slot_count == 0)
+                {
+                    fail("switch table without slots");
+                }
+                switch (static_cast<SwitchKind>(data[0]))
+                {
+                    case SwitchKind::kDense:
+                        if (data[2] >= proto.int_constants.size())
+                        {
+                            fail("constant index out of range");
+                        }
+                        break;
+                    case SwitchKind::kHash:
+                    {
+                        const uint32_t capacity = data[2];
+                        if (capacity == 0 || (capacity & (capacity - 1)) != 0
+                            || 2 * static_cast<uint64_t>(capacity) > data_size - offset - kSwitchHeaderSize)
+                        {
+                            fail("switch table out of range");
+                        }
+                        for (uint32_t i = 0; i < capacity; ++i)
+                        {
+                            const uint32_t key = data[kSwitchHeaderSize + 2 * i];
+                            const uint32_t slot = data[kSwitchHeaderSize + 2 * i + 1];
+                            if (key != 0 && (key - 1 >= proto.str_constants.size() || slot >= slot_count))
+                            {
+                                fail("switch table entry out of range");
+                            }
+                        }
+                        break;
+                    }
+                    default:
+                        fail("unknown switch table kind");
+                }
+            }
+        }
+
+        // Checks that every operand which indexes a table of the proto, a register of its frame or one of its upvalues
+        // stays inside it, so a damaged image can not make the VM read outside of its constants or its stack frame.
+        void validate_code(const GCProto& proto) const
+        {
+            const auto check_index = [&](size_t index, size_t size) {
+                if (index >= size)
+                {
+                    fail("constant index out of range");
+                }
+            };
+
+            // Registers first to first + count - 1, count is kMultValues when the range ends at frame.top.
+            const auto check_registers = [&](size_t pc, size_t first, size_t count) {
+                const size_t last = count == kMultValues || count == 0 ? first : first + count - 1;
+                if (last >= proto.max_stack_size)
+                {
+                    fail(behl::format("register out of range at instruction {}", pc));
+                }
+            };
+
+            const auto check_upvalue = [&](size_t pc, size_t index) {
+                if (index >= proto.upvalue_names.size())
+                {
+                    fail(behl::format("upvalue index out of range at instruction {}", pc));
+                }
+            };
+
+            const auto check_target = [&](size_t pc, int64_t target) {
+                if (target < 0 || static_cast<uint64_t>(target) >= proto.code.size())
+                {
+                    fail(behl::format("jump target out of range at instruction {}", pc));
+                }
+            };
+
+            const size_t size = proto.code.size();
+            for (size_t pc = 0; pc < size; ++pc)
+            {
+                const Instruction instr = proto.code[pc];
+                if (static_cast<size_t>(instr.op()) >= kOpCount)
+                {
+                    fail(behl::format("unknown opcode at instruction {}", pc));
+                }
+
+                // VARARG grows the stack for the values it copies, they may start right after the frame.
+                const uint8_t fields = instr.op() == OpCode::kOpVararg ? 0 : register_fields(instr);
+                if (fields & kFieldA)
+                {
+                    check_registers(pc, instr.a(), 1);
+                }
+                if (fields & kFieldB)
+                {
+                    check_registers(pc, instr.b(), 1);
+                }
+                if (fields & kFieldC)
+                {
+                    check_registers(pc, instr.c(), 1);
+                }
+
+                const auto next = static_cast<int64_t>(pc) + 1;
+                switch (instr.op())
+                {
+                    case OpCode::kOpLoadNil:
+                        check_registers(pc, instr.a(), size_t{ instr.b() } + 1);
+                        break;
+                    case OpCode::kOpSelf:
+                        check_registers(pc, instr.a(), 2);
+                        break;
+                    case OpCode::kOpCall:
+                        check_registers(pc, instr.a(), instr.b());
+                        check_registers(pc, instr.a(), instr.c());
+                        break;
+                    case OpCode::kOpTailCall:
+                    case OpCode::kOpReturn:
+                        check_registers(pc, instr.a(), instr.b());
+                        break;
+                    case OpCode::kOpSetList:
+                        check_registers(pc, instr.a(), size_t{ instr.b() } + 2);
+                        break;
+                    case OpCode::kOpVararg:
+                        if (instr.a() > proto.max_stack_size)
+                        {
+                            fail(behl::format("register out of range at instruction {}", pc));
+                        }
+                        break;
+                    case OpCode::kOpGetUpval:
+                    case OpCode::kOpSetUpval:
+                        check_upvalue(pc, instr.b());
+                        break;
+                    case OpCode::kOpIncUpvalue:
+                    case OpCode::kOpDecUpvalue:
+                        check_upvalue(pc, instr.a());
+                        break;
+                    case OpCode::kOpLoadS:
+                    case OpCode::kOpGetGlobal:
+                    case OpCode::kOpSetGlobal:
+                        check_index(instr.const_or_proto_index(), proto.str_constants.size());
+                        break;
+                    case OpCode::kOpGetFieldS:
+                    case OpCode::kOpSetFieldS:
+                        check_index(instr.small_const_index(), proto.str_constants.size());
+                        break;
+                    case OpCode::kOpIncGlobal:
+                    case OpCode::kOpDecGlobal:
+                        check_index(instr.large_const_index(), proto.str_constants.size());
+                        break;
+                    case OpCode::kOpLoadI:
+                        check_index(instr.const_or_proto_index(), proto.int_constants.size());
+                        break;
+                    case OpCode::kOpLoadF:
+                        check_index(instr.const_or_proto_index(), proto.fp_constants.size());
+                        break;
+                    case OpCode::kOpNewTableK:
+                        check_index(instr.const_or_proto_index(), proto.table_constants.size());
+                        break;
+                    case OpCode::kOpAddKI:
+                    case OpCode::kOpSubKI:
+                    case OpCode::kOpLTI:
+                    case OpCode::kOpGEI:
+                    case OpCode::kOpLEI:
+                    case OpCode::kOpGTI:
+                        check_index(instr.small_const_index(), proto.int_constants.size());
+                        break;
+                    case OpCode::kOpAddKF:
+                    case OpCode::kOpSubKF:
+                    case OpCode::kOpLTF:
+                    case OpCode::kOpGEF:
+                    case OpCode::kOpLEF:
+                    case OpCode::kOpGTF:
+                        check_index(instr.small_const_index(), proto.fp_constants.size());
+                        break;
+                    case OpCode::kOpClosure:
+                    {
+                        const auto proto_idx = instr.const_or_proto_index();
+                        if (proto_idx >= proto.protos.size())
+                        {
+                            fail("function index out of range");
+                        }
+                        // The capture descriptors follow the instruction.
+                        const size_t capture_count = proto.protos[proto_idx]->upvalue_names.size();
+                        if (capture_count > size - pc - 1)
+                        {
+                            fail("truncated closure captures");
+                        }
+                        // Their operands are checked like those of the instructions they are encoded as.
+                        for (size_t capture = pc + 1; capture <= pc + capture_count; ++capture)
+                        {
+                            const auto kind = proto.code[capture].op();
+                            if (kind != OpCode::kOpMove && kind != OpCode::kOpGetUpval)
+                            {
+                                fail(behl::format("malformed closure capture at instruction {}", capture));
+                            }
+                        }
+                        break;
+                    }
+                    case OpCode::kOpSwitch:
+                    {
+                        const auto table = instr.const_or_proto_index();
+                        check_index(table, proto.switch_tables.size());
+                        // The slots follow the instruction and are plain jumps, checked on their own.
+                        const uint32_t slot_count = proto.switch_data[proto.switch_tables[table] + 1];
+                        if (slot_count > size - pc - 1)
+                        {
+                            fail("truncated switch slots");
+                        }
+                        for (size_t slot = pc + 1; slot <= pc + slot_count; ++slot)
+                        {
+                            if (proto.code[slot].op() != OpCode::kOpJmp)
+                            {
+                                fail(behl::format("switch slot is not a jump at instruction {}", slot));
+                            }
+                        }
+                        break;
+                    }
+                    case OpCode::kOpJmp:
+                        check_target(pc, next + instr.jump_offset());
+                        break;
+                    case OpCode::kOpForPrep:
+                        check_target(pc, next + instr.signed_offset());
+                        break;
+                    case OpCode::kOpForLoop:
+                        check_target(pc, static_cast<int64_t>(pc) + instr.signed_offset());
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+
+        State* S_;
+        std::string_view image_;
+        size_t cursor_;
+        std::shared_ptr<const void> backing_;
+        std::string_view chunkname_;
+        bool verify_checksum_;
+        std::vector<GCString*> strings_;
+    };
+
+    void write_bytecode(State* S, const GCProto* proto, BytecodeWriter writer, void* userdata, bool strip_debug_info)
+    {
+        assert(proto != nullptr);
+
+        BytecodeEncoder encoder(strip_debug_info);
+        const std::string payload = encoder.encode(proto);
+
+        BytecodeHeader header{};
+        header.signature = kSignature;
+        header.version = kBytecodeFormatVersion;
+        header.instruction_size = sizeof(Instruction);
+        header.integer_size = sizeof(Integer);
+        header.number_size = sizeof(FP);
+        header.opcode_count = static_cast<uint8_t>(kOpCount);
+        header.flags = strip_debug_info ? kFlagStripped : 0;
+        header.byte_order = kByteOrderMark;
+        header.payload_size = payload.size();
+        header.checksum = bytecode_checksum(header, payload);
+
+        writer(S, std::string_view(reinterpret_cast<const char*>(&header), sizeof(header)), userdata);
+        writer(S, payload, userdata);
+    }
+
+    GCProto* read_bytecode(State* S, std::string_view data, std::shared_ptr<const void> backing, std::string_view chunkname,
+        bool verify_checksum)
+    {
+        GCPauseGuard gc_pause(S);
+
+        BytecodeDecoder decoder(S, data, std::move(backing), chunkname, verify_checksum);
+        return decoder.decode();
+    }
+
+} // namespace behl
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <behl/types.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace behl
+{
+    struct State;
+    struct GCProto;
+
+    // Bytecode image of a script compiled with compile_shared(). States instantiating it reference the image for their
+    // instructions and line tables, the shared_ptr owning this object keeps it alive.
+    struct CompiledScript
+    {
+        std::string image;
+        std::string chunkname;
+    };
+
+    // Bumped whenever the layout of the file or the instruction encoding changes.
+    inline constexpr uint16_t kBytecodeFormatVersion = 5;
+
+    // True when data starts with the precompiled bytecode signature.
+    bool is_bytecode_image(std::string_view data) noexcept;
+
+    // Serializes proto and its nested protos. The image is handed to writer in one or more chunks.
+    void write_bytecode(State* S, const GCProto* proto, BytecodeWriter writer, void* userdata, bool strip_debug_info);
+
+    // Rebuilds a proto tree from a bytecode image, throws RuntimeError if the image is corrupt or was produced by an
+    // incompatible build. When backing is set, data must stay valid and unchanged for as long as backing is alive:
+    // instructions and line tables are then referenced in place instead of being copied, and never written. The checksum can be skipped
+    // for images that never left the process.
+    GCProto* read_bytecode(State* S, std::string_view data, std::shared_ptr<const void> backing, std::string_view chunkname,
+        bool verify_checksum = true);
+
+} // namespace behl
@@ -1,6 +1,7 @@
 #include "backend/compiler.hpp"
 
 #include "ast/ast.hpp"
+#include "ast/ast_holder.hpp"
 #include "behl.hpp"
 #include "common/format.hpp"
 #include "common/hash_map.hpp"
@@ -10,15 +11,21 @@
 #include "gc/gc_object.hpp"
 #include "gc/gco_proto.hpp"
 #include "gc/gco_string.hpp"
+#include "optimization/optimization.hpp"
 #include "state.hpp"
 #include "vm/bytecode.hpp"
 
+#include <algorithm>
 #include <behl/exceptions.hpp>
 #include <cmath>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <optional>
+#include <span>
 #include <stdexcept>
 #include <utility>
+#include <vector>
 
 namespace behl
 {
@@ -28,6 +35,7 @@ namespace behl
     struct Local
     {
         std::string_view name;
+        Atom atom;
         int32_t start_pc;
         Reg reg;
         bool is_const;
@@ -38,6 +46,7 @@ namespace behl
         uint8_t index;
         bool is_local;
         bool is_const;
+        Atom atom; // Name of the captured variable, lazily compiled functions resolve it again
     };
 
     struct LoopContext
@@ -74,9 +83,17 @@ namespace behl
         AutoVector<UpvalueInfo> upvalues;
         AutoVector<LoopContext> loop_stack; // Stack of loop contexts for break/continue
         AutoVector<DeferInfo> defer_stack;  // Stack of defer statements (LIFO order)
-        AutoHashMap<std::string_view, size_t, StringHash, StringEq> upvalue_indices;
+        AutoHashMap<Atom, size_t, AtomHash> upvalue_indices;
+        // String constants emitted for identifiers, skips hashing the name again for every global or field access
+        AutoHashMap<Atom, ConstIndex, AtomHash> atom_constant_indices;
+        // Index of every constant in the pools of current_proto, keeps adding constants O(1) for huge functions
+        AutoHashMap<Value, ConstIndex, ValueHash, ValueEq> str_constant_indices;
+        AutoHashMap<Value, ConstIndex, ValueHash, ValueEq> int_constant_indices;
+        AutoHashMap<Value, ConstIndex, ValueHash, ValueEq> fp_constant_indices;
+        std::shared_ptr<AstHolder> ast; // Set when nested functions are compiled on their first call
         int32_t lastline = 1;
         int32_t lastcolumn = 1;
+        OptLevel level = OptLevel::kO2;
         uint8_t freereg = 0;
         uint8_t min_freereg = 0;
         bool is_module = false;
@@ -91,54 +108,83 @@ namespace behl
             , loop_stack(state)
             , defer_stack(state)
             , upvalue_indices(state)
+            , atom_constant_indices(state)
+            , str_constant_indices(state)
+            , int_constant_indices(state)
+            , fp_constant_indices(state)
         {
         }
     };
 
-    template<typename Container>
-    static ConstIndex add_constant_impl(CompilerState& C, Container& container, Value v)
+    // Function body as found in an AstFuncDef or an AstFuncDefStat.
+    struct FunctionSource
     {
-        for (ConstIndex i = 0; i < container.size(); ++i)
+        const AstString* first_param = nullptr;
+        const AstBlock* block = nullptr;
+        const AstString* self_name = nullptr;
+        bool is_method = false;
+        bool is_vararg = false;
+    };
+
+    // Function whose bytecode is generated on its first call. Keeps the AST of its chunk alive until then, the
+    // captures were resolved when the enclosing function was compiled.
+    struct LazyFunction
+    {
+        std::shared_ptr<AstHolder> ast;
+        FunctionSource source;
+        std::vector<UpvalueInfo> upvalues;
+        int32_t line = 0;
+        OptLevel level = OptLevel::kO2;
+    };
+
+    template<typename Container, typename Indices>
+    static ConstIndex add_constant_impl(CompilerState& C, Container& container, Indices& indices, Value v)
+    {
+        auto it = indices.find(v);
+        if (it != indices.end())
         {
-            if (container[i] == v)
-            {
-                return i;
-            }
+            return it->second;
         }
 
+        const auto index = static_cast<ConstIndex>(container.size());
         container.push_back(C.S, v);
+        indices.insert_or_assign(v, index);
 
-        return static_cast<ConstIndex>(container.size() - 1);
+        return index;
     }
 
     ConstIndex add_integer_constant(CompilerState& C, Integer val)
     {
-        return add_constant_impl(C, C.current_proto->int_constants, Value(val));
+        return add_constant_impl(C, C.current_proto->int_constants, C.int_constant_indices, Value(val));
     }
 
     ConstIndex add_fp_constant(CompilerState& C, FP val)
     {
-        return add_constant_impl(C, C.current_proto->fp_constants, Value(val));
+        return add_constant_impl(C, C.current_proto->fp_constants, C.fp_constant_indices, Value(val));
     }
 
-    static ConstIndex add_string_constant(CompilerState& C, std::string_view str)
+    // String constant of a name or literal from the AST, the atom index skips hashing the string again.
+    static ConstIndex add_string_constant(CompilerState& C, const AstString* str)
     {
-        for (ConstIndex i = 0; i < C.current_proto->str_constants.size(); ++i)
+        auto atom_it = C.atom_constant_indices.find(str->atom);
+        if (atom_it != C.atom_constant_indices.end())
         {
-            auto& const_val = C.current_proto->str_constants[i];
-            assert(const_val.is_string());
-
-            auto* const_str = const_val.get_string();
-            if (const_str->view() == str)
-            {
-                return i;
-            }
+            return atom_it->second;
         }
 
-        auto* string = gc_new_string(C.S, str);
-        C.current_proto->str_constants.push_back(C.S, Value(string));
-
-        return static_cast<ConstIndex>(C.current_proto->str_constants.size() - 1);
+        ConstIndex index;
+        auto it = C.str_constant_indices.find(str->view());
+        if (it != C.str_constant_indices.end())
+        {
+            index = it->second;
+        }
+        else
+        {
+            auto* string = gc_new_string(C.S, str->view());
+            index = add_constant_impl(C, C.current_proto->str_constants, C.str_constant_indices, Value(string));
+        }
+        C.atom_constant_indices.insert_or_assign(str->atom, index);
+        return index;
     }
 
     static SourceLocation get_location(const CompilerState& C)
@@ -180,6 +226,74 @@ namespace behl
         C.current_proto->column_info.push_back(C.S, column >= 0 ? column : C.lastcolumn);
     }
 
+    // Arithmetic without runtime checks when type inference proved both operands integers or both floats
+    static std::optional<Instruction> make_typed_arithmetic(TokenType op, OperandTypes types, Reg a, Reg b, Reg c)
+    {
+        const bool ints = types == OperandTypes::kIntegers;
+        if (types == OperandTypes::kUnknown)
+        {
+            return std::nullopt;
+        }
+        switch (op)
+        {
+            case TokenType::kPlus:
+                return ints ? make_op_addii(a, b, c) : make_op_addff(a, b, c);
+            case TokenType::kMinus:
+                return ints ? make_op_subii(a, b, c) : make_op_subff(a, b, c);
+            case TokenType::kStar:
+                return ints ? make_op_mulii(a, b, c) : make_op_mulff(a, b, c);
+            case TokenType::kSlash:
+                // Dividing integers gives a float, there is no integer form
+                if (ints)
+                {
+                    return std::nullopt;
+                }
+                return make_op_divff(a, b, c);
+            default:
+                return std::nullopt;
+        }
+    }
+
+    // Comparison of typed operands skipping the next instruction unless `lhs op rhs` holds, or when negated unless the
+    // opposite comparison holds, like the jump forms of the generic comparisons.
+    static std::optional<Instruction> make_typed_compare(TokenType op, OperandTypes types, Reg lhs, Reg rhs, bool negated)
+    {
+        const bool ints = types == OperandTypes::kIntegers;
+        if (types == OperandTypes::kUnknown)
+        {
+            return std::nullopt;
+        }
+        if (negated)
+        {
+            switch (op)
+            {
+                case TokenType::kLt:
+                    return ints ? make_op_leii(rhs, lhs) : make_op_leff(rhs, lhs);
+                case TokenType::kLe:
+                    return ints ? make_op_ltii(rhs, lhs) : make_op_ltff(rhs, lhs);
+                case TokenType::kGt:
+                    return ints ? make_op_leii(lhs, rhs) : make_op_leff(lhs, rhs);
+                case TokenType::kGe:
+                    return ints ? make_op_ltii(lhs, rhs) : make_op_ltff(lhs, rhs);
+                default:
+                    return std::nullopt;
+            }
+        }
+        switch (op)
+        {
+            case TokenType::kLt:
+                return ints ? make_op_ltii(lhs, rhs) : make_op_ltff(lhs, rhs);
+            case TokenType::kLe:
+                return ints ? make_op_leii(lhs, rhs) : make_op_leff(lhs, rhs);
+            case TokenType::kGt:
+                return ints ? make_op_ltii(rhs, lhs) : make_op_ltff(rhs, lhs);
+            case TokenType::kGe:
+                return ints ? make_op_leii(rhs, lhs) : make_op_leff(rhs, lhs);
+            default:
+                return std::nullopt;
+        }
+    }
+
     static void enter_scope(CompilerState& C)
     {
         C.scopes.emplace_back(AutoVector<Local>(C.S));
@@ -227,7 +341,7 @@ namespace behl
         return static_cast<int>(C.scopes.size());
     }
 
-    static int32_t resolve_local(CompilerState& C, std::string_view name)
+    static const Local* find_local(const CompilerState& C, Atom name)
     {
         // Search from innermost to outermost scope
         for (auto scope_it = C.scopes.rbegin(); scope_it != C.scopes.rend(); ++scope_it)
@@ -235,33 +349,28 @@ namespace behl
             // Search locals in reverse order within the scope
             for (auto local_it = scope_it->rbegin(); local_it != scope_it->rend(); ++local_it)
             {
-                if (local_it->name == name)
+                if (local_it->atom == name)
                 {
-                    return local_it->reg;
+                    return &*local_it;
                 }
             }
         }
-        return kInvalidLocal;
+        return nullptr;
     }
 
-    static bool is_local_const(CompilerState& C, std::string_view name)
+    static int32_t resolve_local(CompilerState& C, Atom name)
     {
-        // Search from innermost to outermost scope
-        for (auto scope_it = C.scopes.rbegin(); scope_it != C.scopes.rend(); ++scope_it)
-        {
-            // Search locals in reverse order within the scope
-            for (auto local_it = scope_it->rbegin(); local_it != scope_it->rend(); ++local_it)
-            {
-                if (local_it->name == name)
-                {
-                    return local_it->is_const;
-                }
-            }
-        }
-        return false;
+        const Local* local = find_local(C, name);
+        return local ? local->reg : kInvalidLocal;
     }
 
-    static bool is_upvalue_const(CompilerState& C, std::string_view name)
+    static bool is_local_const(CompilerState& C, Atom name)
+    {
+        const Local* local = find_local(C, name);
+        return local ? local->is_const : false;
+    }
+
+    static bool is_upvalue_const(CompilerState& C, Atom name)
     {
         const auto& upvalues = C.upvalues;
 
@@ -277,7 +386,7 @@ namespace behl
         return false;
     }
 
-    static uint32_t resolve_upvalue(CompilerState& C, std::string_view name)
+    static uint32_t resolve_upvalue(CompilerState& C, Atom name)
     {
         auto it = C.upvalue_indices.find(name);
         if (it != C.upvalue_indices.end())
@@ -289,14 +398,12 @@ namespace behl
             return kInvalidUpvalue;
         }
         auto& upvalues = C.upvalues;
-        int32_t loc = resolve_local(*C.parent, name);
-        if (loc >= 0)
+        if (const Local* local = find_local(*C.parent, name))
         {
-            bool is_const = is_local_const(*C.parent, name);
             uint32_t idx = static_cast<uint32_t>(upvalues.size());
-            upvalues.push_back(UpvalueInfo{ static_cast<uint8_t>(loc), true, is_const });
+            upvalues.push_back(UpvalueInfo{ local->reg, true, local->is_const, name });
             C.upvalue_indices.insert_or_assign(name, idx);
-            C.current_proto->upvalue_names.push_back(C.S, gc_new_string(C.S, name));
+            C.current_proto->upvalue_names.push_back(C.S, gc_new_string(C.S, local->name));
             C.current_proto->has_upvalues = true;
             // Parent function needs to close this upvalue when it returns
             C.parent->current_proto->has_upvalues = true;
@@ -309,9 +416,10 @@ namespace behl
                 ? C.parent->upvalues[static_cast<size_t>(up)].is_const
                 : false;
             uint32_t idx = static_cast<uint32_t>(upvalues.size());
-            upvalues.push_back(UpvalueInfo{ static_cast<uint8_t>(up), false, is_const });
+            upvalues.push_back(UpvalueInfo{ static_cast<uint8_t>(up), false, is_const, name });
             C.upvalue_indices.insert_or_assign(name, idx);
-            C.current_proto->upvalue_names.push_back(C.S, gc_new_string(C.S, name));
+            // Same name as the enclosing function's upvalue, share its string
+            C.current_proto->upvalue_names.push_back(C.S, C.parent->current_proto->upvalue_names[up]);
             C.current_proto->has_upvalues = true;
             // Upvalue chain - parent also needs to track upvalues
             C.parent->current_proto->has_upvalues = true;
@@ -320,7 +428,315 @@ namespace behl
         return kInvalidUpvalue;
     }
 
-    struct VisitorAdapter : AstVisitor
+    // Collects the names a function body may resolve in enclosing functions, including those referenced by nested
+    // functions. Parameters of the functions being walked are excluded, other declarations are not tracked so the
+    // result can contain names that turn out to be locals, which only costs an unused upvalue.
+    struct CaptureCollector final : AstVisitor
+    {
+        AutoVector<Atom> names;
+        AutoVector<Atom> bound;
+
+        explicit CaptureCollector(State* S)
+            : names(S)
+            , bound(S)
+        {
+        }
+
+        void collect_function(const AstString* first_param, const AstBlock* block, const AstString* self_name, bool is_method)
+        {
+            const auto bound_size = bound.size();
+            if (is_method)
+            {
+                bound.push_back(kAtomSelf);
+            }
+            else if (self_name)
+            {
+                bound.push_back(self_name->atom);
+            }
+            for (const AstNode* p = first_param; p; p = p->next_child)
+            {
+                bound.push_back(static_cast<const AstString*>(p)->atom);
+            }
+            if (block)
+            {
+                visit(*block);
+            }
+            bound.resize(bound_size);
+        }
+
+        void add(Atom name)
+        {
+            if (std::find(bound.begin(), bound.end(), name) != bound.end())
+            {
+                return;
+            }
+            if (std::find(names.begin(), names.end(), name) == names.end())
+            {
+                names.push_back(name);
+            }
+        }
+
+        void walk(const AstNode* node)
+        {
+            if (node)
+            {
+                node->accept(*this);
+            }
+        }
+
+        void walk_list(const AstNode* first)
+        {
+            for (const AstNode* node = first; node; node = node->next_child)
+            {
+                node->accept(*this);
+            }
+        }
+
+        void visit(const AstNil&) override
+        {
+        }
+        void visit(const AstBool&) override
+        {
+        }
+        void visit(const AstInt&) override
+        {
+        }
+        void visit(const AstFP&) override
+        {
+        }
+        void visit(const AstString&) override
+        {
+        }
+        void visit(const AstVararg&) override
+        {
+        }
+        void visit(const AstIdent& node) override
+        {
+            add(node.name->atom);
+        }
+        void visit(const AstBinOp& node) override
+        {
+            walk(node.left);
+            walk(node.right);
+        }
+        void visit(const AstUnOp& node) override
+        {
+            walk(node.expr);
+        }
+        void visit(const AstTernary& node) override
+        {
+            walk(node.condition);
+            walk(node.true_expr);
+            walk(node.false_expr);
+        }
+        void visit(const AstFuncCall& node) override
+        {
+            walk(node.func);
+            walk_list(node.first_arg);
+        }
+        void visit(const AstTableCtor& node) override
+        {
+            for (const AstNode* field = node.first_field; field; field = field->next_child)
+            {
+                walk(static_cast<const TableField*>(field)->key);
+                walk(static_cast<const TableField*>(field)->value);
+            }
+        }
+        void visit(const AstIndex& node) override
+        {
+            walk(node.table);
+            walk(node.key);
+        }
+        void visit(const AstMember& node) override
+        {
+            walk(node.table);
+        }
+        void visit(const AstFuncDef& node) override
+        {
+            collect_function(node.first_param, node.block, node.self_name, node.is_method);
+        }
+
+        void visit(const AstAssign& node) override
+        {
+            walk_list(node.first_var);
+            walk_list(node.first_expr);
+        }
+        void visit(const AstAssignLocal& node) override
+        {
+            add(node.name->atom);
+            walk(node.expr);
+        }
+        void visit(const AstAssignGlobal& node) override
+        {
+            walk(node.expr);
+        }
+        void visit(const AstAssignUpvalue& node) override
+        {
+            add(node.name->atom);
+            walk(node.expr);
+        }
+        void visit(const AstCompoundAssign& node) override
+        {
+            walk(node.target);
+            walk(node.expr);
+        }
+        void visit(const AstCompoundLocal& node) override
+        {
+            add(node.name->atom);
+            walk(node.expr);
+        }
+        void visit(const AstCompoundGlobal& node) override
+        {
+            walk(node.expr);
+        }
+        void visit(const AstCompoundUpvalue& node) override
+        {
+            add(node.name->atom);
+            walk(node.expr);
+        }
+        void visit(const AstIncrement& node) override
+        {
+            walk(node.target);
+        }
+        void visit(const AstIncLocal& node) override
+        {
+            add(node.name->atom);
+        }
+        void visit(const AstIncGlobal&) override
+        {
+        }
+        void visit(const AstIncUpvalue& node) override
+        {
+            add(node.name->atom);
+        }
+        void visit(const AstDecrement& node) override
+        {
+            walk(node.target);
+        }
+        void visit(const AstDecLocal& node) override
+        {
+            add(node.name->atom);
+        }
+        void visit(const AstDecGlobal&) override
+        {
+        }
+        void visit(const AstDecUpvalue& node) override
+        {
+            add(node.name->atom);
+        }
+        void visit(const AstLocalDecl& node) override
+        {
+            walk_list(node.first_init);
+        }
+        void visit(const AstIf& node) override
+        {
+            walk(node.cond);
+            walk(node.then_block);
+            for (const AstNode* elseif = node.first_elseif; elseif; elseif = elseif->next_child)
+            {
+                walk(static_cast<const ElseIf*>(elseif)->cond);
+                walk(static_cast<const ElseIf*>(elseif)->block);
+            }
+            walk(node.else_block);
+        }
+        void visit(const AstWhile& node) override
+        {
+            walk(node.cond);
+            walk(node.block);
+        }
+        void visit(const AstForNum& node) override
+        {
+            walk(node.start);
+            walk(node.end);
+            walk(node.step);
+            walk(node.block);
+        }
+        void visit(const AstForIn& node) override
+        {
+            if (!node.declares_variables)
+            {
+                for (const AstNode* name = node.first_name; name; name = name->next_child)
+                {
+                    add(static_cast<const AstString*>(name)->atom);
+                }
+            }
+            walk_list(node.first_expr);
+            walk(node.block);
+        }
+        void visit(const AstForC& node) override
+        {
+            walk(node.init);
+            walk(node.condition);
+            walk(node.update);
+            walk(node.block);
+        }
+        void visit(const AstForCNumeric& node) override
+        {
+            walk(node.start);
+            walk(node.end);
+            walk(node.step);
+            walk(node.block);
+        }
+        void visit(const AstFuncDefStat& node) override
+        {
+            // Single part names declare the function, dotted names start with a variable lookup.
+            const auto* first_name = static_cast<const AstString*>(node.first_name_part);
+            const bool is_simple_name = first_name && !first_name->next_child;
+            if (first_name && !is_simple_name)
+            {
+                add(first_name->atom);
+            }
+            collect_function(node.first_param, node.block, is_simple_name ? first_name : nullptr,
+                node.is_method);
+        }
+        void visit(const AstReturn& node) override
+        {
+            walk_list(node.first_expr);
+        }
+        void visit(const AstBreak&) override
+        {
+        }
+        void visit(const AstContinue&) override
+        {
+        }
+        void visit(const AstDefer& node) override
+        {
+            walk(node.body);
+        }
+        void visit(const AstScope& node) override
+        {
+            walk(node.block);
+        }
+        void visit(const AstExprStat& node) override
+        {
+            walk(node.expr);
+        }
+
+        void visit(const AstBlock& node) override
+        {
+            walk_list(node.first_stat);
+        }
+        void visit(const AstProgram& node) override
+        {
+            walk(node.block);
+        }
+        void visit(const AstModuleDecl&) override
+        {
+        }
+        void visit(const AstExportDecl& node) override
+        {
+            walk(node.declaration);
+        }
+        void visit(const AstExportList& node) override
+        {
+            for (const AstNode* name = node.first_name; name; name = name->next_child)
+            {
+                add(static_cast<const AstString*>(name)->atom);
+            }
+        }
+    };
+
+    struct VisitorAdapter final : AstVisitor
     {
         CompilerState& C;
         std::optional<Reg> target_reg;
@@ -336,6 +752,7 @@ namespace behl
         }
 
         void compile_call(const AstFuncCall& node, uint8_t nresults);
+        bool try_compile_switch(const AstIf& node);
 
         bool last_instruction_is_terminal() const
         {
@@ -362,7 +779,7 @@ namespace behl
         {
             if (auto* ident = expr->try_as<AstIdent>())
             {
-                int32_t loc = resolve_local(C, ident->name->view());
+                int32_t loc = resolve_local(C, ident->name->atom);
                 if (loc >= 0)
                 {
                     return { static_cast<uint8_t>(loc), false };
@@ -378,7 +795,7 @@ namespace behl
         {
             if (auto* ident = expr->try_as<AstIdent>())
             {
-                int32_t loc = resolve_local(C, ident->name->view());
+                int32_t loc = resolve_local(C, ident->name->atom);
                 if (loc >= 0)
                 {
                     return { static_cast<uint8_t>(loc), false };
@@ -410,7 +827,7 @@ namespace behl
             if (auto* str_node = expr->try_as<AstString>())
             {
                 const auto reg = get_target_reg();
-                const auto k = add_string_constant(C, str_node->view());
+                const auto k = add_string_constant(C, str_node);
                 emit(C, make_op_loads(reg, k), C.lastline);
                 return { reg, true };
             }
@@ -526,7 +943,7 @@ namespace behl
 
         const auto reg = get_target_reg();
 
-        const auto k = add_string_constant(C, node.view());
+        const auto k = add_string_constant(C, &node);
         emit(C, make_op_loads(reg, k), C.lastline);
     }
 
@@ -539,7 +956,7 @@ namespace behl
     void VisitorAdapter::visit(const AstIdent& node)
     {
         const auto reg = get_target_reg();
-        int32_t loc = resolve_local(C, node.name->view());
+        int32_t loc = resolve_local(C, node.name->atom);
         if (loc >= 0)
         {
             if (reg != static_cast<uint8_t>(loc))
@@ -549,14 +966,14 @@ namespace behl
         }
         else
         {
-            uint32_t up = resolve_upvalue(C, node.name->view());
+            uint32_t up = resolve_upvalue(C, node.name->atom);
             if (up != kInvalidUpvalue)
             {
                 emit(C, make_op_getupval(reg, static_cast<uint8_t>(up)), C.lastline);
             }
             else
             {
-                const auto k = add_string_constant(C, node.name->view());
+                const auto k = add_string_constant(C, node.name);
                 emit(C, make_op_getglobal(reg, k), C.lastline);
             }
         }
@@ -816,7 +1233,11 @@ namespace behl
             auto [rreg, r_free] = try_get_rk(node.right);
             compile_for_jump = true;
 
-            if (node.op == TokenType::kEq)
+            if (auto typed = make_typed_compare(node.op, node.operand_types, lreg, rreg, true))
+            {
+                emit(C, *typed, C.lastline);
+            }
+            else if (node.op == TokenType::kEq)
             {
                 emit(C, make_op_ne(lreg, rreg), C.lastline);
             }
@@ -1115,22 +1536,25 @@ namespace behl
         Instruction instr{};
         bool emitted_sequence = false;
 
+        const auto typed = make_typed_arithmetic(node.op, node.operand_types, result_reg, left_reg, right_reg);
+        const auto compare = make_typed_compare(node.op, node.operand_types, left_reg, right_reg, false);
+
         switch (node.op)
         {
             case TokenType::kPlus:
-                instr = make_op_add(result_reg, left_reg, right_reg);
+                instr = typed.value_or(make_op_add(result_reg, left_reg, right_reg));
                 break;
             case TokenType::kMinus:
-                instr = make_op_sub(result_reg, left_reg, right_reg);
+                instr = typed.value_or(make_op_sub(result_reg, left_reg, right_reg));
                 break;
             case TokenType::kStar:
-                instr = make_op_mul(result_reg, left_reg, right_reg);
+                instr = typed.value_or(make_op_mul(result_reg, left_reg, right_reg));
                 break;
             case TokenType::kPower:
                 instr = make_op_pow(result_reg, left_reg, right_reg);
                 break;
             case TokenType::kSlash:
-                instr = make_op_div(result_reg, left_reg, right_reg);
+                instr = typed.value_or(make_op_div(result_reg, left_reg, right_reg));
                 break;
             case TokenType::kPercent:
                 instr = make_op_mod(result_reg, left_reg, right_reg);
@@ -1165,27 +1589,27 @@ namespace behl
                 emitted_sequence = true;
                 break;
             case TokenType::kLt:
-                emit(C, make_op_lt(left_reg, right_reg), C.lastline);
+                emit(C, compare.value_or(make_op_lt(left_reg, right_reg)), C.lastline);
                 emit(C, make_op_loadbool(result_reg, true, true), C.lastline);
                 emit(C, make_op_loadbool(result_reg, false, false), C.lastline);
                 emitted_sequence = true;
                 break;
             case TokenType::kLe:
-                emit(C, make_op_le(left_reg, right_reg), C.lastline);
+                emit(C, compare.value_or(make_op_le(left_reg, right_reg)), C.lastline);
                 emit(C, make_op_loadbool(result_reg, true, true), C.lastline);
                 emit(C, make_op_loadbool(result_reg, false, false), C.lastline);
                 emitted_sequence = true;
                 break;
             case TokenType::kGt:
 
-                emit(C, make_op_gt(left_reg, right_reg), C.lastline);
+                emit(C, compare.value_or(make_op_gt(left_reg, right_reg)), C.lastline);
                 emit(C, make_op_loadbool(result_reg, true, true), C.lastline);
                 emit(C, make_op_loadbool(result_reg, false, false), C.lastline);
                 emitted_sequence = true;
                 break;
             case TokenType::kGe:
 
-                emit(C, make_op_ge(left_reg, right_reg), C.lastline);
+                emit(C, compare.value_or(make_op_ge(left_reg, right_reg)), C.lastline);
                 emit(C, make_op_loadbool(result_reg, true, true), C.lastline);
                 emit(C, make_op_loadbool(result_reg, false, false), C.lastline);
                 emitted_sequence = true;
@@ -1563,24 +1987,169 @@ namespace behl
         }
     }
 
+    static bool is_table_constant_value(const AstNode* node)
+    {
+        switch (node->type)
+        {
+            case AstNodeType::kNil:
+            case AstNodeType::kBool:
+            case AstNodeType::kInteger:
+            case AstNodeType::kFP:
+            case AstNodeType::kString:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Keys a constant table can hold without changing the result of the constructor. Numeric keys could land in the
+    // array part and are only accepted without positional entries, so the array values never have to be interleaved.
+    static bool is_table_constant_key(const AstNode* node, bool has_positional)
+    {
+        switch (node->type)
+        {
+            case AstNodeType::kIdent:
+            case AstNodeType::kString:
+            case AstNodeType::kBool:
+                return true;
+            case AstNodeType::kInteger:
+                return !has_positional;
+            case AstNodeType::kFP:
+                return !has_positional && !std::isnan(node->as<AstFP>()->value);
+            default:
+                return false;
+        }
+    }
+
+    static uint32_t add_table_constant_entry(CompilerState& C, const AstNode* node)
+    {
+        switch (node->type)
+        {
+            case AstNodeType::kBool:
+                return make_table_constant_entry(
+                    node->as<AstBool>()->value ? TableConstantKind::kTrue : TableConstantKind::kFalse);
+            case AstNodeType::kInteger:
+                return make_table_constant_entry(
+                    TableConstantKind::kInteger, add_integer_constant(C, node->as<AstInt>()->value));
+            case AstNodeType::kFP:
+                return make_table_constant_entry(TableConstantKind::kFP, add_fp_constant(C, node->as<AstFP>()->value));
+            case AstNodeType::kString:
+                return make_table_constant_entry(
+                    TableConstantKind::kString, add_string_constant(C, node->as<AstString>()));
+            case AstNodeType::kIdent:
+                return make_table_constant_entry(
+                    TableConstantKind::kString, add_string_constant(C, node->as<AstIdent>()->name));
+            default:
+                return make_table_constant_entry(TableConstantKind::kNil);
+        }
+    }
+
+    // Records a constructor made only of literals as a constant table of the proto, the table is then built by a
+    // single NEWTABLEK instead of a load and a SETFIELD per entry. Returns the index of the constant table.
+    static std::optional<ConstIndex> add_table_constant(CompilerState& C, const AstTableCtor& node)
+    {
+        if (C.level == OptLevel::kO0 || !node.first_field)
+        {
+            return std::nullopt;
+        }
+
+        uint32_t array_size = 0;
+        uint32_t hash_size = 0;
+        for (const AstNode* n = node.first_field; n; n = n->next_child)
+        {
+            const auto* field = static_cast<const TableField*>(n);
+            if (!is_table_constant_value(field->value))
+            {
+                return std::nullopt;
+            }
+            if (field->key)
+            {
+                ++hash_size;
+            }
+            else
+            {
+                ++array_size;
+            }
+        }
+        for (const AstNode* n = node.first_field; n; n = n->next_child)
+        {
+            const auto* field = static_cast<const TableField*>(n);
+            if (field->key && !is_table_constant_key(field->key, array_size > 0))
+            {
+                return std::nullopt;
+            }
+        }
+
+        auto* proto = C.current_proto;
+        const auto index = static_cast<ConstIndex>(proto->table_constants.size());
+        const size_t offset = proto->table_constant_data.size();
+        // Every entry refers to a pool, a pool outgrowing the entry encoding keeps the remaining tables generic
+        if (index > 0x1FFFF || offset > std::numeric_limits<uint32_t>::max()
+            || proto->str_constants.size() + hash_size + array_size > kMaxTableConstantIndex
+            || proto->int_constants.size() + hash_size + array_size > kMaxTableConstantIndex
+            || proto->fp_constants.size() + hash_size + array_size > kMaxTableConstantIndex)
+        {
+            return std::nullopt;
+        }
+
+        auto& data = proto->table_constant_data;
+        data.reserve(C.S, offset + 2 + array_size + 2 * static_cast<size_t>(hash_size));
+        data.push_back(C.S, array_size);
+        data.push_back(C.S, hash_size);
+        for (const AstNode* n = node.first_field; n; n = n->next_child)
+        {
+            const auto* field = static_cast<const TableField*>(n);
+            if (!field->key)
+            {
+                data.push_back(C.S, add_table_constant_entry(C, field->value));
+            }
+        }
+        for (const AstNode* n = node.first_field; n; n = n->next_child)
+        {
+            const auto* field = static_cast<const TableField*>(n);
+            if (field->key)
+            {
+                data.push_back(C.S, add_table_constant_entry(C, field->key));
+                data.push_back(C.S, add_table_constant_entry(C, field->value));
+            }
+        }
+        proto->table_constants.push_back(C.S, static_cast<uint32_t>(offset));
+        return index;
+    }
+
     void VisitorAdapter::visit(const AstTableCtor& node)
     {
         const auto reg = get_target_reg();
-        uint8_t array_hint = 0;
-        uint8_t hash_hint = 0;
+
+        if (auto k = add_table_constant(C, node))
+        {
+            emit(C, make_op_newtablek(reg, *k), C.lastline);
+            C.freereg = reg + 1;
+            if (C.freereg < C.min_freereg)
+            {
+                C.freereg = C.min_freereg;
+            }
+            return;
+        }
+
+        size_t array_count = 0;
+        size_t hash_count = 0;
         // Count array vs hash fields
         for (AstNode* n = node.first_field; n; n = n->next_child)
         {
             auto* field = static_cast<TableField*>(n);
             if (!field->key)
             {
-                ++array_hint;
+                ++array_count;
             }
             else
             {
-                ++hash_hint;
+                ++hash_count;
             }
         }
+        // Hints only size the initial allocation, huge constructors start at the largest hint and grow from there
+        const auto array_hint = static_cast<uint8_t>(std::min<size_t>(array_count, 0xFF));
+        const auto hash_hint = static_cast<uint8_t>(std::min<size_t>(hash_count, 0xFF));
         emit(C, make_op_newtable(reg, array_hint, hash_hint), C.lastline);
         Reg temp_reg = alloc_reg(C);
         uint32_t array_idx = 0; // Start from 0
@@ -1597,7 +2166,7 @@ namespace behl
                 if (auto* id = field->key->try_as<AstIdent>())
                 {
                     key_reg = alloc_reg(C);
-                    const auto k = add_string_constant(C, id->name->view());
+                    const auto k = add_string_constant(C, id->name);
                     emit(C, make_op_loads(key_reg, k), C.lastline);
                     emit(C, make_op_setfield(reg, key_reg, val_reg), C.lastline);
                     free_reg(C, key_reg);
@@ -1656,7 +2225,7 @@ namespace behl
         auto [table_reg, table_free] = try_get_reg(node.table);
 
         // Check if key is a constant integer in range [0, 511] for GETFIELDI optimization
-        if (auto* int_node = dynamic_cast<const AstInt*>(node.key))
+        if (auto* int_node = node.key->try_as<AstInt>())
         {
             if (int_node->value >= 0 && int_node->value <= 511)
             {
@@ -1679,9 +2248,9 @@ namespace behl
         }
 
         // Check if key is a string constant in range [0, 511] for GETFIELDS optimization
-        if (auto* str_node = dynamic_cast<const AstString*>(node.key))
+        if (auto* str_node = node.key->try_as<AstString>())
         {
-            ConstIndex k = add_string_constant(C, str_node->view());
+            ConstIndex k = add_string_constant(C, str_node);
             if (k <= 511)
             {
                 emit(C, make_op_getfields(result_reg, table_reg, k), C.lastline);
@@ -1702,13 +2271,15 @@ namespace behl
             }
         }
 
+        const Reg saved_freereg = C.freereg;
         auto [key_reg, key_free] = try_get_rk(node.key);
 
         emit(C, make_op_getfield(result_reg, table_reg, key_reg), C.lastline);
 
-        if (key_free)
+        // A computed key may leave temporaries below its result, all of them go with the key
+        if (key_free && C.freereg > saved_freereg)
         {
-            free_reg(C, key_reg);
+            C.freereg = std::max(saved_freereg, C.min_freereg);
         }
         if (table_free)
         {
@@ -1729,7 +2300,7 @@ namespace behl
         Reg result_reg = get_target_reg();
         node.table->accept(*this);
         Reg table_reg = C.freereg - 1;
-        const auto k = add_string_constant(C, node.name->view());
+        const auto k = add_string_constant(C, node.name);
 
         // Use GETFIELDS if the constant index fits in 9 bits
         if (k <= 511)
@@ -1755,47 +2326,65 @@ namespace behl
         }
     }
 
-    void VisitorAdapter::visit(const AstFuncDef& node)
+    // Runs the bytecode peephole passes over the finished function, their statistics add up over all functions.
+    static void optimize_bytecode(CompilerState& C)
     {
-        auto* child_proto = gc_new_proto(C.S);
-        child_proto->source_name = C.current_proto->source_name;
-        // Count params
-        uint32_t param_count = 0;
-        for (AstNode* p = node.first_param; p; p = p->next_child)
+        if (C.level == OptLevel::kO0 || C.current_proto->max_stack_size > kMaxTrackedRegisters)
         {
-            param_count++;
+            return;
         }
-        child_proto->num_params = param_count;
-        child_proto->is_vararg = node.is_vararg;
 
-        // Set function name for debugging
-        if (!node.self_name.empty())
-        {
-            child_proto->name = gc_new_string(C.S, node.self_name);
-        }
-        else
+        std::vector<OptimizationPassStats> report;
+        BytecodeOptimizationPipeline::apply(C.S, C.current_proto, C.level, &report);
+
+        auto& total = C.S->optimization_report;
+        for (const auto& pass : report)
         {
-            child_proto->name = gc_new_string(C.S, "<anonymous>");
+            auto it = std::find_if(total.begin(), total.end(), [&](const auto& entry) { return entry.name == pass.name; });
+            if (it == total.end())
+            {
+                total.push_back(pass);
+                continue;
+            }
+            it->runs += pass.runs;
+            it->changes += pass.changes;
+            it->time_ns += pass.time_ns;
         }
+    }
 
-        C.current_proto->protos.push_back(C.S, child_proto);
-        const auto proto_idx = static_cast<ProtoIndex>(C.current_proto->protos.size() - 1);
+    // Encodes the positions of the finished function into its line table and frees the per-instruction vectors.
+    static void finish_line_table(CompilerState& C)
+    {
+        auto* proto = C.current_proto;
+        const auto columns = C.S->column_info ? std::span<const int>(proto->column_info.data(), proto->column_info.size())
+                                              : std::span<const int>();
+        proto->line_table.build(C.S, std::span<const int>(proto->line_info.data(), proto->line_info.size()), columns);
+        proto->line_info.destroy(C.S);
+        proto->column_info.destroy(C.S);
+    }
 
-        CompilerState child(C.S, &C, C.current_proto->protos[proto_idx]);
+    // Generates the bytecode of a function into the proto of the given compiler state.
+    static void compile_function_body(CompilerState& child, const FunctionSource& fn, int32_t line)
+    {
+        uint32_t param_count = 0;
+        for (const AstNode* p = fn.first_param; p; p = p->next_child)
+        {
+            param_count++;
+        }
 
         // Emit VARARGPREP as first instruction if this is a vararg function
-        if (node.is_vararg)
+        if (fn.is_vararg)
         {
-            emit(child, make_op_varargprep(static_cast<uint8_t>(param_count)), C.lastline);
+            emit(child, make_op_varargprep(static_cast<uint8_t>(param_count)), line);
         }
 
         enter_scope(child);
 
         uint8_t first_param_reg = 0;
 
-        if (node.is_method)
+        if (fn.is_method)
         {
-            Local self_loc{ "self", static_cast<int>(child.current_proto->code.size()), 0, false };
+            Local self_loc{ "self", kAtomSelf, static_cast<int>(child.current_proto->code.size()), 0, false };
             child.scopes.back().push_back(self_loc);
             first_param_reg = 1;
         }
@@ -1803,19 +2392,23 @@ namespace behl
         {
             first_param_reg = 1;
 
-            if (!node.self_name.empty())
+            if (fn.self_name)
             {
-                Local self_ref_loc{ node.self_name, static_cast<int>(child.current_proto->code.size()), 0, false };
+                Local self_ref_loc{
+                    fn.self_name->view(), fn.self_name->atom, static_cast<int>(child.current_proto->code.size()), 0, false
+                };
                 child.scopes.back().push_back(self_ref_loc);
             }
         }
 
         uint8_t param_idx = 0;
-        for (AstNode* p = node.first_param; p; p = p->next_child)
+        for (const AstNode* p = fn.first_param; p; p = p->next_child)
         {
-            auto* param_str = static_cast<AstString*>(p);
+            auto* param_str = static_cast<const AstString*>(p);
             Reg param_reg = static_cast<Reg>(first_param_reg + param_idx);
-            Local param_loc{ param_str->view(), static_cast<int>(child.current_proto->code.size()), param_reg, false };
+            Local param_loc{
+                param_str->view(), param_str->atom, static_cast<int>(child.current_proto->code.size()), param_reg, false
+            };
             child.scopes.back().push_back(param_loc);
             param_idx++;
         }
@@ -1823,10 +2416,16 @@ namespace behl
         child.freereg = first_param_reg + param_idx;
         child.min_freereg = child.freereg;
 
+        // Parameters occupy their registers even when the body allocates none, calls size the frame from this.
+        if (child.current_proto->max_stack_size < child.freereg)
+        {
+            child.current_proto->max_stack_size = child.freereg;
+        }
+
         VisitorAdapter child_visitor(child);
-        if (node.block)
+        if (fn.block)
         {
-            child_visitor.visit(*node.block);
+            child_visitor.visit(*fn.block);
         }
 
         // Only add implicit return if the last instruction isn't already a return
@@ -1841,6 +2440,64 @@ namespace behl
 
         leave_scope(child);
 
+        optimize_bytecode(child);
+        finish_line_table(child);
+    }
+
+    void VisitorAdapter::visit(const AstFuncDef& node)
+    {
+        auto* child_proto = gc_new_proto(C.S);
+        child_proto->source_name = C.current_proto->source_name;
+        // Count params
+        uint32_t param_count = 0;
+        for (AstNode* p = node.first_param; p; p = p->next_child)
+        {
+            param_count++;
+        }
+        child_proto->num_params = param_count;
+        child_proto->is_vararg = node.is_vararg;
+
+        // Set function name for debugging
+        if (node.self_name)
+        {
+            child_proto->name = gc_new_string(C.S, node.self_name->view());
+        }
+        else
+        {
+            child_proto->name = gc_new_string(C.S, "<anonymous>");
+        }
+
+        C.current_proto->protos.push_back(C.S, child_proto);
+        const auto proto_idx = static_cast<ProtoIndex>(C.current_proto->protos.size() - 1);
+
+        CompilerState child(C.S, &C, C.current_proto->protos[proto_idx]);
+        child.ast = C.ast;
+        child.level = C.level;
+
+        const FunctionSource fn{ node.first_param, node.block, node.self_name, node.is_method, node.is_vararg };
+        if (C.ast)
+        {
+            // The body is compiled on the first call, only its captures have to be known to emit the closure.
+            CaptureCollector collector(C.S);
+            collector.collect_function(fn.first_param, fn.block, fn.self_name, fn.is_method);
+            for (const auto name : collector.names)
+            {
+                resolve_upvalue(child, name);
+            }
+
+            auto lazy = std::make_shared<LazyFunction>();
+            lazy->ast = C.ast;
+            lazy->source = fn;
+            lazy->upvalues.assign(child.upvalues.begin(), child.upvalues.end());
+            lazy->line = C.lastline;
+            lazy->level = C.level;
+            child_proto->lazy = std::move(lazy);
+        }
+        else
+        {
+            compile_function_body(child, fn, C.lastline);
+        }
+
         // If child has upvalues, parent needs to close them when returning
         if (child.current_proto->has_upvalues)
         {
@@ -1880,7 +2537,7 @@ namespace behl
             if (auto* idx = node.first_var->try_as<AstIndex>())
             {
                 // Check if key is a constant integer in range [0, 511] for SETFIELDI optimization
-                if (auto* int_node = dynamic_cast<const AstInt*>(idx->key))
+                if (auto* int_node = idx->key->try_as<AstInt>())
                 {
                     if (int_node->value >= 0 && int_node->value <= 511)
                     {
@@ -1903,9 +2560,9 @@ namespace behl
                 }
 
                 // Check if key is a string constant in range [0, 511] for SETFIELDS optimization
-                if (auto* str_node = dynamic_cast<const AstString*>(idx->key))
+                if (auto* str_node = idx->key->try_as<AstString>())
                 {
-                    ConstIndex k = add_string_constant(C, str_node->view());
+                    ConstIndex k = add_string_constant(C, str_node);
                     if (k <= 511)
                     {
                         auto [table_reg, table_needs_free] = try_get_rk(idx->table);
@@ -1969,10 +2626,11 @@ namespace behl
                     if (auto* id = v->try_as<AstIdent>())
                     {
                         auto id_name = id->name->view();
-                        int32_t loc = resolve_local(C, id_name);
+                        auto id_atom = id->name->atom;
+                        int32_t loc = resolve_local(C, id_atom);
                         if (loc >= 0)
                         {
-                            if (is_local_const(C, id_name))
+                            if (is_local_const(C, id_atom))
                             {
                                 throw SemanticError(
                                     behl::format("Cannot assign to const variable '{}'", id_name), get_location(C));
@@ -1981,10 +2639,10 @@ namespace behl
                         }
                         else
                         {
-                            uint32_t up = resolve_upvalue(C, id_name);
+                            uint32_t up = resolve_upvalue(C, id_atom);
                             if (up != kInvalidUpvalue)
                             {
-                                if (is_upvalue_const(C, id_name))
+                                if (is_upvalue_const(C, id_atom))
                                 {
                                     throw SemanticError(
                                         behl::format("Cannot assign to const upvalue '{}'", id_name), get_location(C));
@@ -1993,7 +2651,7 @@ namespace behl
                             }
                             else
                             {
-                                const auto k = add_string_constant(C, id->name->view());
+                                const auto k = add_string_constant(C, id->name);
                                 emit(C, make_op_setglobal(val_reg, k), C.lastline);
                             }
                         }
@@ -2014,7 +2672,7 @@ namespace behl
                     {
                         mem->table->accept(*this);
                         Reg table_reg = C.freereg - 1;
-                        const auto k = add_string_constant(C, mem->name->view());
+                        const auto k = add_string_constant(C, mem->name);
                         if (k <= 511)
                         {
                             emit(C, make_op_setfields(table_reg, val_reg, k), C.lastline);
@@ -2056,10 +2714,11 @@ namespace behl
             if (auto* id = v->try_as<AstIdent>())
             {
                 auto id_name = id->name->view();
-                int32_t loc = resolve_local(C, id_name);
+                auto id_atom = id->name->atom;
+                int32_t loc = resolve_local(C, id_atom);
                 if (loc >= 0)
                 {
-                    if (is_local_const(C, id_name))
+                    if (is_local_const(C, id_atom))
                     {
                         throw SemanticError(behl::format("Cannot assign to const variable '{}'", id_name), get_location(C));
                     }
@@ -2067,10 +2726,10 @@ namespace behl
                 }
                 else
                 {
-                    uint32_t up = resolve_upvalue(C, id_name);
+                    uint32_t up = resolve_upvalue(C, id_atom);
                     if (up != kInvalidUpvalue)
                     {
-                        if (is_upvalue_const(C, id_name))
+                        if (is_upvalue_const(C, id_atom))
                         {
                             throw SemanticError(behl::format("Cannot assign to const upvalue '{}'", id_name), get_location(C));
                         }
@@ -2078,7 +2737,7 @@ namespace behl
                     }
                     else
                     {
-                        const auto k = add_string_constant(C, id->name->view());
+                        const auto k = add_string_constant(C, id->name);
                         emit(C, make_op_setglobal(val_reg, k), C.lastline);
                     }
                 }
@@ -2086,7 +2745,7 @@ namespace behl
             else if (auto* idx = v->try_as<AstIndex>())
             {
                 // Check if key is a constant integer in range [0, 511] for SETFIELDI optimization
-                if (auto* int_node = dynamic_cast<const AstInt*>(idx->key))
+                if (auto* int_node = idx->key->try_as<AstInt>())
                 {
                     if (int_node->value >= 0 && int_node->value <= 511)
                     {
@@ -2101,9 +2760,9 @@ namespace behl
                 }
 
                 // Check if key is a string constant in range [0, 511] for SETFIELDS optimization
-                if (auto* str_node = dynamic_cast<const AstString*>(idx->key))
+                if (auto* str_node = idx->key->try_as<AstString>())
                 {
-                    ConstIndex k = add_string_constant(C, str_node->view());
+                    ConstIndex k = add_string_constant(C, str_node);
                     if (k <= 511)
                     {
                         idx->table->accept(*this);
@@ -2132,7 +2791,7 @@ namespace behl
             {
                 mem->table->accept(*this);
                 Reg table_reg = C.freereg - 1;
-                const auto k = add_string_constant(C, mem->name->view());
+                const auto k = add_string_constant(C, mem->name);
 
                 // Use SETFIELDS if the constant index fits in 9 bits
                 if (k <= 511)
@@ -2163,13 +2822,13 @@ namespace behl
         C.lastline = node.line;
         C.lastcolumn = node.column;
 
-        int32_t loc = resolve_local(C, node.name->view());
+        int32_t loc = resolve_local(C, node.name->atom);
         if (loc < 0)
         {
             throw ReferenceError(behl::format("Local variable '{}' not found", node.name->view()), get_location(C));
         }
 
-        if (is_local_const(C, node.name->view()))
+        if (is_local_const(C, node.name->atom))
         {
             throw SemanticError(behl::format("Cannot assign to const variable '{}'", node.name->view()), get_location(C));
         }
@@ -2183,7 +2842,7 @@ namespace behl
         node.expr->accept(*this);
         Reg val_reg = C.freereg - 1;
 
-        const auto k = add_string_constant(C, node.name->view());
+        const auto k = add_string_constant(C, node.name);
         emit(C, make_op_setglobal(val_reg, k), C.lastline);
 
         free_reg(C, val_reg);
@@ -2194,13 +2853,13 @@ namespace behl
         node.expr->accept(*this);
         Reg val_reg = C.freereg - 1;
 
-        uint32_t up = resolve_upvalue(C, node.name->view());
+        uint32_t up = resolve_upvalue(C, node.name->atom);
         if (up == kInvalidUpvalue)
         {
             throw ReferenceError(behl::format("Upvalue '{}' not found", node.name->view()));
         }
 
-        if (is_upvalue_const(C, node.name->view()))
+        if (is_upvalue_const(C, node.name->atom))
         {
             throw SemanticError(behl::format("Cannot assign to const upvalue '{}'", node.name->view()), get_location(C));
         }
@@ -2223,13 +2882,13 @@ namespace behl
         C.lastline = node.line;
         C.lastcolumn = node.column;
 
-        int32_t loc = resolve_local(C, node.name->view());
+        int32_t loc = resolve_local(C, node.name->atom);
         if (loc < 0)
         {
             throw ReferenceError(behl::format("Local variable '{}' not found", node.name->view()), get_location(C));
         }
 
-        if (is_local_const(C, node.name->view()))
+        if (is_local_const(C, node.name->atom))
         {
             throw SemanticError(behl::format("Cannot assign to const variable '{}'", node.name->view()), get_location(C));
         }
@@ -2238,7 +2897,7 @@ namespace behl
         {
             if (auto* rhs_ident = node.expr->try_as<AstIdent>())
             {
-                int32_t rhs_loc = resolve_local(C, rhs_ident->name->view());
+                int32_t rhs_loc = resolve_local(C, rhs_ident->name->atom);
                 if (rhs_loc >= 0)
                 {
                     emit(C, make_op_addlocal(static_cast<uint8_t>(loc), static_cast<uint8_t>(rhs_loc)), compound_line,
@@ -2278,7 +2937,11 @@ namespace behl
         node.expr->accept(*this);
         Reg rhs_reg = C.freereg - 1;
 
-        if (node.op == TokenType::kPlus)
+        if (auto typed = make_typed_arithmetic(node.op, node.operand_types, static_cast<uint8_t>(loc), lhs_reg, rhs_reg))
+        {
+            emit(C, *typed, compound_line, compound_column);
+        }
+        else if (node.op == TokenType::kPlus)
         {
             emit(C, make_op_add(static_cast<uint8_t>(loc), lhs_reg, rhs_reg), compound_line, compound_column);
         }
@@ -2304,7 +2967,7 @@ namespace behl
 
     void VisitorAdapter::visit(const AstCompoundGlobal& node)
     {
-        const auto k = add_string_constant(C, node.name->view());
+        const auto k = add_string_constant(C, node.name);
 
         Reg lhs_reg = alloc_reg(C);
         emit(C, make_op_getglobal(lhs_reg, k), C.lastline);
@@ -2341,13 +3004,13 @@ namespace behl
 
     void VisitorAdapter::visit(const AstCompoundUpvalue& node)
     {
-        uint32_t up = resolve_upvalue(C, node.name->view());
+        uint32_t up = resolve_upvalue(C, node.name->atom);
         if (up == kInvalidUpvalue)
         {
             throw ReferenceError(behl::format("Upvalue '{}' not found", node.name->view()));
         }
 
-        if (is_upvalue_const(C, node.name->view()))
+        if (is_upvalue_const(C, node.name->atom))
         {
             throw SemanticError(behl::format("Cannot modify const upvalue '{}'", node.name->view()));
         }
@@ -2392,13 +3055,13 @@ namespace behl
 
     void VisitorAdapter::visit(const AstIncLocal& node)
     {
-        int32_t loc = resolve_local(C, node.name->view());
+        int32_t loc = resolve_local(C, node.name->atom);
         if (loc < 0)
         {
             throw ReferenceError(behl::format("Local variable '{}' not found", node.name->view()), get_location(C));
         }
 
-        if (is_local_const(C, node.name->view()))
+        if (is_local_const(C, node.name->atom))
         {
             throw SemanticError(behl::format("Cannot modify const variable '{}'", node.name->view()), get_location(C));
         }
@@ -2408,20 +3071,20 @@ namespace behl
 
     void VisitorAdapter::visit(const AstIncGlobal& node)
     {
-        const auto k = add_string_constant(C, node.name->view());
+        const auto k = add_string_constant(C, node.name);
 
         emit(C, make_op_incglobal(k), C.lastline);
     }
 
     void VisitorAdapter::visit(const AstIncUpvalue& node)
     {
-        uint32_t up = resolve_upvalue(C, node.name->view());
+        uint32_t up = resolve_upvalue(C, node.name->atom);
         if (up == kInvalidUpvalue)
         {
             throw ReferenceError(behl::format("Upvalue '{}' not found", node.name->view()), get_location(C));
         }
 
-        if (is_upvalue_const(C, node.name->view()))
+        if (is_upvalue_const(C, node.name->atom))
         {
             throw SemanticError(behl::format("Cannot modify const upvalue '{}'", node.name->view()), get_location(C));
         }
@@ -2436,13 +3099,13 @@ namespace behl
 
     void VisitorAdapter::visit(const AstDecLocal& node)
     {
-        int32_t loc = resolve_local(C, node.name->view());
+        int32_t loc = resolve_local(C, node.name->atom);
         if (loc < 0)
         {
             throw ReferenceError(behl::format("Local variable '{}' not found", node.name->view()), get_location(C));
         }
 
-        if (is_local_const(C, node.name->view()))
+        if (is_local_const(C, node.name->atom))
         {
             throw SemanticError(behl::format("Cannot modify const variable '{}'", node.name->view()), get_location(C));
         }
@@ -2452,20 +3115,20 @@ namespace behl
 
     void VisitorAdapter::visit(const AstDecGlobal& node)
     {
-        const auto k = add_string_constant(C, node.name->view());
+        const auto k = add_string_constant(C, node.name);
 
         emit(C, make_op_decglobal(k), C.lastline);
     }
 
     void VisitorAdapter::visit(const AstDecUpvalue& node)
     {
-        uint32_t up = resolve_upvalue(C, node.name->view());
+        uint32_t up = resolve_upvalue(C, node.name->atom);
         if (up == kInvalidUpvalue)
         {
             throw ReferenceError(behl::format("Upvalue '{}' not found", node.name->view()), get_location(C));
         }
 
-        if (is_upvalue_const(C, node.name->view()))
+        if (is_upvalue_const(C, node.name->atom))
         {
             throw SemanticError(behl::format("Cannot modify const upvalue '{}'", node.name->view()), get_location(C));
         }
@@ -2494,6 +3157,7 @@ namespace behl
             auto* name = static_cast<AstString*>(n);
             Local loc;
             loc.name = name->view();
+            loc.atom = name->atom;
             loc.is_const = node.is_const;
             loc.reg = alloc_reg(C);
             loc.start_pc = static_cast<int>(C.current_proto->code.size());
@@ -2569,8 +3233,231 @@ namespace behl
         }
     }
 
+    // Chains shorter than this are as fast as a comparison per arm
+    static constexpr size_t kMinSwitchArms = 4;
+    static constexpr size_t kMaxSwitchSlots = 256;
+
+    // Literal compared by a condition of the form `local == literal` or `literal == local`, nullptr otherwise. The
+    // local must be the same for every arm of the chain, subject holds it once the first arm matched.
+    static const AstNode* switch_case_literal(CompilerState& C, const AstNode* cond, Atom& subject)
+    {
+        const auto* binop = cond ? cond->try_as<AstBinOp>() : nullptr;
+        if (!binop || binop->op != TokenType::kEq)
+        {
+            return nullptr;
+        }
+
+        const AstNode* literal = binop->right;
+        const auto* ident = binop->left->try_as<AstIdent>();
+        if (!ident)
+        {
+            literal = binop->left;
+            ident = binop->right->try_as<AstIdent>();
+        }
+        if (!ident || !(literal->try_as<AstInt>() || literal->try_as<AstString>()))
+        {
+            return nullptr;
+        }
+
+        const Atom atom = ident->name->atom;
+        if (subject == kInvalidAtom)
+        {
+            if (resolve_local(C, atom) == kInvalidLocal)
+            {
+                return nullptr;
+            }
+            subject = atom;
+        }
+        return atom == subject ? literal : nullptr;
+    }
+
+    // Compiles a chain comparing one local against distinct integer or string literals into a SWITCH followed by
+    // one JMP per slot, slot 0 goes to the else block. Returns false without emitting anything for other chains.
+    bool VisitorAdapter::try_compile_switch(const AstIf& node)
+    {
+        struct Arm
+        {
+            const AstNode* literal;
+            const AstBlock* block;
+        };
+
+        if (C.level == OptLevel::kO0 || !node.first_elseif
+            || C.current_proto->switch_tables.size() >= kMaxSwitchTables)
+        {
+            return false;
+        }
+
+        AutoVector<Arm> arms(C.S);
+        Atom subject = kInvalidAtom;
+        const AstNode* literal = switch_case_literal(C, node.cond, subject);
+        if (!literal)
+        {
+            return false;
+        }
+        arms.push_back({ literal, node.then_block });
+        for (const ElseIf* elseif = node.first_elseif; elseif; elseif = static_cast<const ElseIf*>(elseif->next_child))
+        {
+            literal = switch_case_literal(C, elseif->cond, subject);
+            if (!literal)
+            {
+                return false;
+            }
+            arms.push_back({ literal, elseif->block });
+        }
+        if (arms.size() < kMinSwitchArms || arms.size() >= kMaxSwitchSlots)
+        {
+            return false;
+        }
+
+        // Every case is the same kind and appears once, a repeated case could never be reached
+        const bool integers = arms[0].literal->try_as<AstInt>() != nullptr;
+        Integer min = std::numeric_limits<Integer>::max();
+        Integer max = std::numeric_limits<Integer>::min();
+        for (size_t i = 0; i < arms.size(); ++i)
+        {
+            const auto* int_literal = arms[i].literal->try_as<AstInt>();
+            if ((int_literal != nullptr) != integers)
+            {
+                return false;
+            }
+            if (integers)
+            {
+                const Integer value = int_literal->value;
+                if (value < -kMaxSwitchValue || value > kMaxSwitchValue)
+                {
+                    return false;
+                }
+                min = std::min(min, value);
+                max = std::max(max, value);
+            }
+            for (size_t j = 0; j < i; ++j)
+            {
+                const bool same = integers
+                    ? arms[j].literal->as<AstInt>()->value == int_literal->value
+                    : arms[j].literal->as<AstString>()->atom == arms[i].literal->as<AstString>()->atom;
+                if (same)
+                {
+                    return false;
+                }
+            }
+        }
+
+        // Dense tables only pay off when most of the range has a case
+        size_t slot_count = arms.size() + 1;
+        if (integers)
+        {
+            const auto range = static_cast<uint64_t>(max) - static_cast<uint64_t>(min) + 1;
+            if (range > 2 * arms.size() || range >= kMaxSwitchSlots)
+            {
+                return false;
+            }
+            slot_count = static_cast<size_t>(range) + 1;
+        }
+
+        GCProto* proto = C.current_proto;
+        const auto table = static_cast<ConstIndex>(proto->switch_tables.size());
+        const auto offset = static_cast<uint32_t>(proto->switch_data.size());
+        proto->switch_tables.push_back(C.S, offset);
+
+        // Slot of each arm, holes in a dense range take the default slot
+        AutoVector<uint32_t> arm_slots(C.S);
+        if (integers)
+        {
+            proto->switch_data.push_back(C.S, static_cast<uint32_t>(SwitchKind::kDense));
+            proto->switch_data.push_back(C.S, static_cast<uint32_t>(slot_count));
+            proto->switch_data.push_back(C.S, add_integer_constant(C, min));
+            for (const Arm& arm : arms)
+            {
+                arm_slots.push_back(static_cast<uint32_t>(arm.literal->as<AstInt>()->value - min) + 1);
+            }
+        }
+        else
+        {
+            uint32_t capacity = 1;
+            while (capacity < 2 * arms.size())
+            {
+                capacity <<= 1;
+            }
+            proto->switch_data.push_back(C.S, static_cast<uint32_t>(SwitchKind::kHash));
+            proto->switch_data.push_back(C.S, static_cast<uint32_t>(slot_count));
+            proto->switch_data.push_back(C.S, capacity);
+            const size_t entries = proto->switch_data.size();
+            for (uint32_t i = 0; i < 2 * capacity; ++i)
+            {
+                proto->switch_data.push_back(C.S, 0);
+            }
+            for (size_t i = 0; i < arms.size(); ++i)
+            {
+                const auto* str = arms[i].literal->as<AstString>();
+                const ConstIndex key = add_string_constant(C, str);
+                uint32_t h = switch_hash(str->view()) & (capacity - 1);
+                while (proto->switch_data[entries + 2 * h] != 0)
+                {
+                    h = (h + 1) & (capacity - 1);
+                }
+                proto->switch_data[entries + 2 * h] = key + 1;
+                proto->switch_data[entries + 2 * h + 1] = static_cast<uint32_t>(i + 1);
+                arm_slots.push_back(static_cast<uint32_t>(i + 1));
+            }
+        }
+
+        C.lastline = node.line;
+        C.lastcolumn = node.column;
+        const auto subject_reg = static_cast<Reg>(resolve_local(C, subject));
+        emit(C, make_op_switch(subject_reg, table), node.line);
+        const size_t first_slot = proto->code.size();
+        for (size_t i = 0; i < slot_count; ++i)
+        {
+            emit(C, make_op_jmp(0), node.line);
+        }
+
+        const auto patch = [&](size_t pc, size_t target) {
+            proto->code[pc] = make_op_jmp(static_cast<int32_t>(target - pc - 1));
+        };
+
+        AutoVector<size_t> jmp_end_pcs(C.S);
+        for (size_t i = 0; i < arms.size(); ++i)
+        {
+            patch(first_slot + arm_slots[i], proto->code.size());
+            if (arms[i].block)
+            {
+                arms[i].block->accept(*this);
+            }
+            if (!last_instruction_is_terminal())
+            {
+                jmp_end_pcs.push_back(proto->code.size());
+                emit(C, make_op_jmp(0), C.lastline);
+            }
+        }
+
+        // The default slot and the holes run the else block, or continue after the chain
+        const size_t default_pc = proto->code.size();
+        for (size_t slot = 0; slot < slot_count; ++slot)
+        {
+            if (slot == 0 || std::find(arm_slots.begin(), arm_slots.end(), slot) == arm_slots.end())
+            {
+                patch(first_slot + slot, default_pc);
+            }
+        }
+        if (node.else_block)
+        {
+            node.else_block->accept(*this);
+        }
+
+        for (const size_t pc : jmp_end_pcs)
+        {
+            patch(pc, proto->code.size());
+        }
+        return true;
+    }
+
     void VisitorAdapter::visit(const AstIf& node)
     {
+        if (try_compile_switch(node))
+        {
+            return;
+        }
+
         AutoVector<size_t> jmp_false_pcs(C.S);
         AutoVector<size_t> jmp_end_pcs(C.S);
 
@@ -2684,7 +3571,7 @@ namespace behl
     {
         enter_scope(C);
         Reg base = alloc_reg(C);
-        Local var_loc{ node.var->view(), static_cast<int>(C.current_proto->code.size()), base, false };
+        Local var_loc{ node.var->view(), node.var->atom, static_cast<int>(C.current_proto->code.size()), base, false };
         C.scopes.back().push_back(var_loc);
         Reg limit_reg = alloc_reg(C);
         Reg step_reg = alloc_reg(C);
@@ -2709,6 +3596,12 @@ namespace behl
         size_t prep_pc = C.current_proto->code.size();
         emit(C, make_op_forprep(base, 0), C.lastline);
 
+        // Protect loop control registers from being reused
+        if (C.freereg > C.min_freereg)
+        {
+            C.min_freereg = C.freereg;
+        }
+
         // Push loop context for break/continue tracking
         C.loop_stack.emplace_back(C.S);
 
@@ -2811,7 +3704,9 @@ namespace behl
             {
                 auto* name_str = static_cast<const AstString*>(name);
                 Reg var_reg = alloc_reg(C);
-                Local var_loc{ name_str->view(), static_cast<int>(C.current_proto->code.size()), var_reg, false };
+                Local var_loc{
+                    name_str->view(), name_str->atom, static_cast<int>(C.current_proto->code.size()), var_reg, false
+                };
                 C.scopes.back().push_back(var_loc);
                 var_info.push_back({ static_cast<int>(var_reg), kInvalidUpvalue });
             }
@@ -2822,13 +3717,13 @@ namespace behl
             for (const AstNode* name = node.first_name; name != nullptr; name = name->next_child)
             {
                 auto* name_str = static_cast<const AstString*>(name);
-                int32_t loc = resolve_local(C, name_str->view());
+                int32_t loc = resolve_local(C, name_str->atom);
                 uint32_t up = kInvalidUpvalue;
 
                 if (loc < 0)
                 {
                     // Not found as local, try upvalue
-                    up = resolve_upvalue(C, name_str->view());
+                    up = resolve_upvalue(C, name_str->atom);
                     if (up == kInvalidUpvalue)
                     {
                         // Variable not found
@@ -3031,7 +3926,7 @@ namespace behl
 
         enter_scope(C);
         Reg base = alloc_reg(C);
-        Local var_loc{ node.var->view(), static_cast<int>(C.current_proto->code.size()), base, false };
+        Local var_loc{ node.var->view(), node.var->atom, static_cast<int>(C.current_proto->code.size()), base, false };
         C.scopes.back().push_back(var_loc);
         Reg limit_reg = alloc_reg(C);
         Reg step_reg = alloc_reg(C);
@@ -3096,6 +3991,12 @@ namespace behl
         size_t prep_pc = C.current_proto->code.size();
         emit(C, make_op_forprep(base, 0), C.lastline);
 
+        // Protect loop control registers from being reused
+        if (C.freereg > C.min_freereg)
+        {
+            C.min_freereg = C.freereg;
+        }
+
         // Push loop context for break/continue tracking
         C.loop_stack.emplace_back(C.S);
 
@@ -3156,6 +4057,7 @@ namespace behl
             auto* first_name = static_cast<const AstString*>(node.first_name_part);
             Local loc;
             loc.name = first_name->view();
+            loc.atom = first_name->atom;
             loc.is_const = false;
             loc.reg = alloc_reg(C);
             loc.start_pc = static_cast<int>(C.current_proto->code.size());
@@ -3178,7 +4080,7 @@ namespace behl
         if (is_simple_name)
         {
             auto* first_name = static_cast<const AstString*>(node.first_name_part);
-            func_expr.self_name = first_name->view();
+            func_expr.self_name = first_name;
         }
 
         func_expr.block = node.block;
@@ -3188,7 +4090,7 @@ namespace behl
         if (treat_as_local)
         {
             auto* first_name = static_cast<const AstString*>(node.first_name_part);
-            int32_t loc = resolve_local(C, first_name->view());
+            int32_t loc = resolve_local(C, first_name->atom);
             if (loc >= 0)
             {
                 emit(C, make_op_move(static_cast<uint8_t>(loc), func_reg), C.lastline);
@@ -3202,28 +4104,27 @@ namespace behl
         if (name_part_count == 1)
         {
             auto* first_name = static_cast<const AstString*>(node.first_name_part);
-            const auto k = add_string_constant(C, first_name->view());
+            const auto k = add_string_constant(C, first_name);
             emit(C, make_op_setglobal(func_reg, k), C.lastline);
         }
         else
         {
             auto* base_name_node = static_cast<const AstString*>(node.first_name_part);
-            const auto base_name = base_name_node->view();
-            int32_t loc = resolve_local(C, base_name);
+            int32_t loc = resolve_local(C, base_name_node->atom);
             if (loc >= 0)
             {
                 emit(C, make_op_move(dest_reg, static_cast<uint8_t>(loc)), C.lastline);
             }
             else
             {
-                uint32_t up = resolve_upvalue(C, base_name);
+                uint32_t up = resolve_upvalue(C, base_name_node->atom);
                 if (up != kInvalidUpvalue)
                 {
                     emit(C, make_op_getupval(dest_reg, static_cast<uint8_t>(up)), C.lastline);
                 }
                 else
                 {
-                    const auto k = add_string_constant(C, base_name);
+                    const auto k = add_string_constant(C, base_name_node);
                     emit(C, make_op_getglobal(dest_reg, k), C.lastline);
                 }
             }
@@ -3235,7 +4136,7 @@ namespace behl
                 auto* part_name = static_cast<const AstString*>(part);
                 Reg next_reg = alloc_reg(C);
                 Reg key_reg = alloc_reg(C);
-                const auto k = add_string_constant(C, part_name->view());
+                const auto k = add_string_constant(C, part_name);
                 emit(C, make_op_loads(key_reg, k), C.lastline);
                 emit(C, make_op_getfield(next_reg, dest_reg, key_reg), C.lastline);
                 free_reg(C, key_reg);
@@ -3246,7 +4147,7 @@ namespace behl
             // Set the final field
             auto* last_name = static_cast<const AstString*>(last_name_part);
             Reg key_reg = alloc_reg(C);
-            const auto k = add_string_constant(C, last_name->view());
+            const auto k = add_string_constant(C, last_name);
             emit(C, make_op_loads(key_reg, k), C.lastline);
             emit(C, make_op_setfield(dest_reg, key_reg, func_reg), C.lastline);
             free_reg(C, key_reg);
@@ -3413,13 +4314,13 @@ namespace behl
             {
                 if (const auto* ident = node.first_expr->try_as<AstIdent>())
                 {
-                    int32_t loc = resolve_local(C, ident->name->view());
+                    int32_t loc = resolve_local(C, ident->name->atom);
                     if (loc >= 0)
                     {
                         emit(C, make_op_return(static_cast<uint8_t>(loc), 1), C.lastline);
                         return;
                     }
-                    uint32_t up = resolve_upvalue(C, ident->name->view());
+                    uint32_t up = resolve_upvalue(C, ident->name->atom);
                     if (up != kInvalidUpvalue)
                     {
                         Reg reg = alloc_reg(C);
@@ -3634,7 +4535,64 @@ namespace behl
         C.freereg = saved_freereg;
     }
 
-    GCProto* compile(State* state, const AstProgram* program, std::string_view source_name)
+    void compile_lazy(State* state, GCProto* proto)
+    {
+        assert(proto->lazy != nullptr && "compile_lazy: function is already compiled");
+
+        GCPauseGuard gc_pause(state);
+        // The generated code is only reachable through proto, which may live outside the active region.
+        GCRegionSuspendGuard region_suspend(state);
+
+        const auto& lazy = *proto->lazy;
+
+        CompilerState C(state, nullptr, proto);
+        C.ast = lazy.ast;
+        C.level = lazy.level;
+        for (size_t i = 0; i < lazy.upvalues.size(); ++i)
+        {
+            C.upvalues.push_back(lazy.upvalues[i]);
+            C.upvalue_indices.insert_or_assign(lazy.upvalues[i].atom, i);
+        }
+
+        try
+        {
+            compile_function_body(C, lazy.source, lazy.line);
+        }
+        catch (...)
+        {
+            // Leave the function uncompiled, every call reports the error again.
+            proto->code.clear();
+            proto->str_constants.clear();
+            proto->int_constants.clear();
+            proto->fp_constants.clear();
+            proto->table_constants.clear();
+            proto->table_constant_data.clear();
+            proto->switch_tables.clear();
+            proto->switch_data.clear();
+            proto->protos.clear();
+            proto->line_info.clear();
+            proto->column_info.clear();
+            proto->line_table.destroy(state);
+            throw;
+        }
+
+        proto->lazy.reset();
+    }
+
+    void compile_all(State* state, GCProto* proto)
+    {
+        if (proto->lazy)
+        {
+            compile_lazy(state, proto);
+        }
+        for (auto* nested_proto : proto->protos)
+        {
+            compile_all(state, nested_proto);
+        }
+    }
+
+    GCProto* compile(State* state, const AstProgram* program, std::string_view source_name, std::shared_ptr<AstHolder> lazy_ast,
+        OptLevel level)
     {
         GCPauseGuard gc_pause(state);
 
@@ -3647,6 +4605,8 @@ namespace behl
         C.current_proto->name = gc_new_string(state, "<main chunk>");
         C.is_module = program->is_module;
         C.parent = nullptr;
+        C.ast = std::move(lazy_ast);
+        C.level = level;
         C.freereg = 1;
         C.min_freereg = 1;
 
@@ -3658,6 +4618,9 @@ namespace behl
         // Return nothing (0 values) - export transform pass will add explicit return if module
         emit(C, make_op_return(0, 0), 0, 0);
 
+        optimize_bytecode(C);
+        finish_line_table(C);
+
         return proto;
     }
 
@@ -3,13 +3,27 @@
 #include "behl/export.hpp"
 #include "common/string.hpp"
 
+#include <behl/types.hpp>
+#include <memory>
+
 namespace behl
 {
     struct State;
     struct AstProgram;
     struct Proto;
     struct GCProto;
+    class AstHolder;
+
+    // Compiles the program into a function prototype. When lazy_ast is set the holder of the program's AST is kept
+    // alive by the nested functions, which get their bytecode generated by compile_lazy() on their first call.
+    // Above OptLevel::kO0 the bytecode of every function goes through the BytecodeOptimizationPipeline.
+    BEHL_API GCProto* compile(State* state, const AstProgram* program, std::string_view source_name = "<script>",
+        std::shared_ptr<AstHolder> lazy_ast = nullptr, OptLevel level = OptLevel::kO2);
+
+    // Generates the bytecode of a function that was left uncompiled, throws the compile error of its body.
+    BEHL_API void compile_lazy(State* state, GCProto* proto);
 
-    BEHL_API GCProto* compile(State* state, const AstProgram* program, std::string_view source_name = "<script>");
+    // Compiles every function of the prototype tree that is still pending.
+    BEHL_API void compile_all(State* state, GCProto* proto);
 
 } // namespace behl
@@ -134,6 +134,12 @@ namespace behl
                 comment = behl::format("proto #{}", p);
                 break;
             }
+            case OpCode::kOpSwitch:
+            {
+                const auto t = instr.const_or_proto_index();
+                comment = behl::format("switch #{}", t);
+                break;
+            }
             case OpCode::kOpJmp:
             {
                 const auto offset = instr.jump_offset();
@@ -345,9 +351,10 @@ namespace behl
 
             print("{}{:>4} | {:<22} | {} | {}", ind, i, instr_str, operand_info, annotation);
 
-            if (i < proto.line_info.size() && i < proto.column_info.size())
+            if (proto.line_table.contains(i))
             {
-                println(" | line {:>3}, col {:>2}", proto.line_info[i], proto.column_info[i]);
+                const auto position = proto.line_table.lookup(i);
+                println(" | line {:>3}, col {:>2}", position.line, position.column);
             }
             else
             {
@@ -5,6 +5,7 @@
 #include "vm/bytecode.hpp"
 
 #include <behl/behl.hpp>
+#include <behl/profiler.hpp>
 #include <fstream>
 #include <iostream>
 #include <optional>
@@ -24,6 +25,7 @@ enum class Mode
     Interactive, // REPL mode
     Execute,     // Execute code from -e
     Dump,        // Dump bytecode with -b
+    Compile,     // Write precompiled bytecode with -c
     Run          // Run script files
 };
 
@@ -31,6 +33,11 @@ struct Options
 {
     Mode mode = Mode::Interactive;
     std::string execute_code;
+    std::string output_path;        // Bytecode output file for -c
+    std::string alloc_profile_path; // Write an allocation profile here when set
+    bool lazy = false;              // Compile function bodies on their first call
+    bool opt_report = false;        // Print optimizer statistics after loading
+    behl::OptLevel opt_level = behl::OptLevel::kO2;
     std::vector<std::string> scripts;
 };
 
@@ -77,6 +84,22 @@ std::optional<Options> parse_args(int argc, char* argv[], std::string& error_msg
             opts.mode = Mode::Dump;
             mode_set = true;
         }
+        else if (arg == "-c")
+        {
+            if (mode_set)
+            {
+                error_msg = behl::format("cannot combine -c with other modes");
+                return std::nullopt;
+            }
+            if (i + 1 >= argc)
+            {
+                error_msg = behl::format("'-c' requires an output file");
+                return std::nullopt;
+            }
+            opts.mode = Mode::Compile;
+            opts.output_path = argv[++i];
+            mode_set = true;
+        }
         else if (arg == "-e")
         {
             if (mode_set)
@@ -93,6 +116,27 @@ std::optional<Options> parse_args(int argc, char* argv[], std::string& error_msg
             opts.execute_code = argv[++i];
             mode_set = true;
         }
+        else if (arg == "-p")
+        {
+            if (i + 1 >= argc)
+            {
+                error_msg = behl::format("'-p' requires an output file");
+                return std::nullopt;
+            }
+            opts.alloc_profile_path = argv[++i];
+        }
+        else if (arg == "--lazy")
+        {
+            opts.lazy = true;
+        }
+        else if (arg == "-O0" || arg == "-O1" || arg == "-O2")
+        {
+            opts.opt_level = static_cast<behl::OptLevel>(arg[2] - '0');
+        }
+        else if (arg == "--opt-report")
+        {
+            opts.opt_report = true;
+        }
         else if (arg.starts_with('-'))
         {
             error_msg = behl::format("unrecognized option '{}'", arg);
@@ -135,11 +179,34 @@ std::optional<Options> parse_args(int argc, char* argv[], std::string& error_msg
         error_msg = behl::format("-b requires a script file or -e code");
         return std::nullopt;
     }
+    else if (opts.mode == Mode::Compile)
+    {
+        error_msg = behl::format("-c requires a script file");
+        return std::nullopt;
+    }
 
     return opts;
 }
 
-bool load_file(behl::State* S, std::string_view filename, std::string& error_msg)
+static void print_optimization_report(behl::State* S)
+{
+    const auto report = behl::get_optimization_report(S);
+    if (report.empty())
+    {
+        return;
+    }
+
+    println("=== Optimization Report ===");
+    println("{:<30} {:>6} {:>8} {:>12}", "pass", "runs", "changes", "time (us)");
+    for (const auto& pass : report)
+    {
+        const double time_us = static_cast<double>(pass.time_ns) / 1000.0;
+        println("{:<30} {:>6} {:>8} {:>12.1f}", pass.name, pass.runs, pass.changes, time_us);
+    }
+    println("===========================");
+}
+
+bool load_file(behl::State* S, std::string_view filename, const Options& opts, std::string& error_msg)
 {
     std::ifstream file(filename.data(), std::ios::binary);
     if (!file)
@@ -148,6 +215,16 @@ bool load_file(behl::State* S, std::string_view filename, std::string& error_msg
         return false;
     }
 
+    // Precompiled files are mapped instead of read.
+    char signature[4]{};
+    file.read(signature, sizeof(signature));
+    if (behl::is_bytecode(std::string_view(signature, static_cast<size_t>(file.gcount()))))
+    {
+        behl::load_bytecode_file(S, filename);
+        return true;
+    }
+    file.clear();
+
     // Read file contents - avoid istreambuf_iterator due to GCC 13 false positive warnings
     file.seekg(0, std::ios::end);
     std::string content;
@@ -155,7 +232,11 @@ bool load_file(behl::State* S, std::string_view filename, std::string& error_msg
     file.seekg(0, std::ios::beg);
     file.read(&content[0], static_cast<std::streamsize>(content.size()));
 
-    behl::load_buffer(S, content, filename.data(), true);
+    behl::load_buffer(S, content, filename.data(), opts.opt_level);
+    if (opts.opt_report)
+    {
+        print_optimization_report(S);
+    }
 
     return true;
 }
@@ -207,7 +288,7 @@ static void print_results(behl::State* S)
     }
 }
 
-void repl(behl::State* S)
+void repl(behl::State* S, behl::OptLevel opt_level)
 {
     std::string line;
     while (true)
@@ -227,7 +308,7 @@ void repl(behl::State* S)
 
         try
         {
-            behl::load_string(S, line);
+            behl::load_string(S, line, opt_level);
             behl::call(S, 0, behl::kMultRet);
 
             print_results(S);
@@ -243,7 +324,11 @@ void repl(behl::State* S)
 
 static int run_execute_mode(behl::State* S, const Options& opts)
 {
-    behl::load_string(S, opts.execute_code);
+    behl::load_string(S, opts.execute_code, opts.opt_level);
+    if (opts.opt_report)
+    {
+        print_optimization_report(S);
+    }
     behl::call(S, 0, behl::kMultRet);
     print_results(S);
     return 0;
@@ -260,7 +345,7 @@ static int run_dump_mode(behl::State* S, const Options& opts)
         }
 
         std::string load_error;
-        if (!load_file(S, opts.scripts[0], load_error))
+        if (!load_file(S, opts.scripts[0], opts, load_error))
         {
             print_error("{}", load_error);
             return 1;
@@ -268,19 +353,60 @@ static int run_dump_mode(behl::State* S, const Options& opts)
     }
     else
     {
-        behl::load_string(S, opts.execute_code);
+        behl::load_string(S, opts.execute_code, opts.opt_level);
+        if (opts.opt_report)
+        {
+            print_optimization_report(S);
+        }
     }
 
     dump_closure_bytecode(S);
     return 0;
 }
 
+static void write_bytecode_chunk(behl::State*, std::string_view chunk, void* userdata)
+{
+    auto* file = static_cast<std::ofstream*>(userdata);
+    file->write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+}
+
+static int run_compile_mode(behl::State* S, const Options& opts)
+{
+    if (opts.scripts.size() > 1)
+    {
+        print_error("Error: compiling (-c) only works with a single file");
+        return 1;
+    }
+
+    std::string load_error;
+    if (!load_file(S, opts.scripts[0], opts, load_error))
+    {
+        print_error("{}", load_error);
+        return 1;
+    }
+
+    std::ofstream file(opts.output_path, std::ios::binary);
+    if (!file)
+    {
+        print_error("cannot write bytecode to {}", opts.output_path);
+        return 1;
+    }
+
+    behl::dump(S, write_bytecode_chunk, &file);
+    if (!file.flush())
+    {
+        print_error("cannot write bytecode to {}", opts.output_path);
+        return 1;
+    }
+    return 0;
+}
+
 static int run_script_mode(behl::State* S, const Options& opts)
 {
     for (const auto& script : opts.scripts)
     {
         std::string load_error;
-        if (!load_file(S, script, load_error))
+        if (!load_file(S, script, opts, load_error))
         {
             print_error("{}", load_error);
             return 1;
@@ -292,12 +418,29 @@ static int run_script_mode(behl::State* S, const Options& opts)
     return 0;
 }
 
-static int run_interactive_mode(behl::State* S)
+static int run_interactive_mode(behl::State* S, const Options& opts)
 {
-    repl(S);
+    repl(S, opts.opt_level);
     return 0;
 }
 
+static bool write_alloc_profile(behl::State* S, const std::string& path)
+{
+    // pprof profiles are selected by extension, everything else gets folded stacks for flamegraph tools.
+    const std::string_view name = path;
+    const bool is_pprof = name.ends_with(".pb") || name.ends_with(".pprof");
+    const auto profile = behl::profiler_dump(S, is_pprof ? behl::ProfileFormat::kPprof : behl::ProfileFormat::kFolded);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+    {
+        print_error("cannot write allocation profile to {}", path);
+        return false;
+    }
+    file.write(profile.data(), static_cast<std::streamsize>(profile.size()));
+    return true;
+}
+
 static int execute_mode(behl::State* S, const Options& opts)
 {
     switch (opts.mode)
@@ -306,10 +449,12 @@ static int execute_mode(behl::State* S, const Options& opts)
             return run_execute_mode(S, opts);
         case Mode::Dump:
             return run_dump_mode(S, opts);
+        case Mode::Compile:
+            return run_compile_mode(S, opts);
         case Mode::Run:
             return run_script_mode(S, opts);
         case Mode::Interactive:
-            return run_interactive_mode(S);
+            return run_interactive_mode(S, opts);
     }
     return 0;
 }
@@ -335,6 +480,17 @@ int main(int argc, char* argv[])
     behl::load_lib_fs(S);
     behl::load_lib_process(S);
 
+    // The bytecode dump shows every function, which requires them to be compiled up front.
+    if (opts.lazy && opts.mode != Mode::Dump)
+    {
+        behl::set_lazy_compilation(S, true);
+    }
+
+    if (!opts.alloc_profile_path.empty())
+    {
+        behl::profiler_start(S);
+    }
+
     int exit_code = 0;
     try
     {
@@ -345,6 +501,15 @@ int main(int argc, char* argv[])
         fatal_error("{}", ex.what());
     }
 
+    if (!opts.alloc_profile_path.empty())
+    {
+        behl::profiler_stop(S);
+        if (!write_alloc_profile(S, opts.alloc_profile_path))
+        {
+            exit_code = 1;
+        }
+    }
+
     behl::close(S);
     return exit_code;
 }
@@ -236,6 +236,32 @@ namespace behl
             return size_ == 0;
         }
 
+        BEHL_FORCEINLINE size_t tombstones() const
+        {
+            return tombstones_;
+        }
+
+        // Rehashes into the smallest capacity that holds the current entries below the load factor,
+        // dropping all tombstones. Frees the storage entirely when the map is empty.
+        // Iteration order changes, so this must not run while the map is being traversed.
+        void shrink_to_fit(State* state)
+        {
+            if (size_ == 0)
+            {
+                destroy(state);
+                return;
+            }
+
+            const auto min_capacity = static_cast<size_t>(static_cast<double>(size_) / kLoadFactor) + 1;
+            const size_t new_capacity = std::bit_ceil(std::max(min_capacity, kMinCapacity));
+            if (new_capacity >= capacity_ && tombstones_ == 0)
+            {
+                return;
+            }
+
+            rehash(state, std::min(new_capacity, capacity_));
+        }
+
         template<typename KeyType>
         bool contains(KeyType&& key) const
         {
@@ -0,0 +1,122 @@
+#include "mapped_file.hpp"
+
+#include <string>
+
+#ifdef _WIN32
+#    ifndef WIN32_LEAN_AND_MEAN
+#        define WIN32_LEAN_AND_MEAN
+#    endif
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+namespace behl
+{
+#ifdef _WIN32
+    MappedFile::~MappedFile()
+    {
+        if (data_ != nullptr)
+        {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping_ != nullptr)
+        {
+            CloseHandle(mapping_);
+        }
+    }
+
+    std::shared_ptr<MappedFile> MappedFile::open(std::string_view path)
+    {
+        const std::string path_str(path);
+        HANDLE file = CreateFileA(
+            path_str.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return nullptr;
+        }
+
+        LARGE_INTEGER file_size{};
+        if (!GetFileSizeEx(file, &file_size))
+        {
+            CloseHandle(file);
+            return nullptr;
+        }
+
+        auto result = std::make_shared<MappedFile>();
+        if (file_size.QuadPart == 0)
+        {
+            CloseHandle(file);
+            return result;
+        }
+
+        // The view keeps the file alive, the file handle itself is not needed once it exists.
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr)
+        {
+            return nullptr;
+        }
+
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == nullptr)
+        {
+            CloseHandle(mapping);
+            return nullptr;
+        }
+
+        result->mapping_ = mapping;
+        result->data_ = static_cast<std::byte*>(view);
+        result->size_ = static_cast<size_t>(file_size.QuadPart);
+        return result;
+    }
+#else
+    MappedFile::~MappedFile()
+    {
+        if (data_ != nullptr)
+        {
+            munmap(data_, size_);
+        }
+    }
+
+    std::shared_ptr<MappedFile> MappedFile::open(std::string_view path)
+    {
+        const std::string path_str(path);
+        const int fd = ::open(path_str.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+
+        struct stat st{};
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            ::close(fd);
+            return nullptr;
+        }
+
+        auto result = std::make_shared<MappedFile>();
+        if (st.st_size == 0)
+        {
+            ::close(fd);
+            return result;
+        }
+
+        const auto size = static_cast<size_t>(st.st_size);
+        void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (view == MAP_FAILED)
+        {
+            return nullptr;
+        }
+
+        result->data_ = static_cast<std::byte*>(view);
+        result->size_ = size;
+        return result;
+    }
+#endif
+
+} // namespace behl
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+
+namespace behl
+{
+    // Read-only view of a file mapped into memory. The mapping is released when the last reference is dropped.
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        // Maps the whole file, returns nullptr if it can not be opened or mapped.
+        static std::shared_ptr<MappedFile> open(std::string_view path);
+
+        const std::byte* data() const noexcept
+        {
+            return data_;
+        }
+
+        size_t size() const noexcept
+        {
+            return size_;
+        }
+
+    private:
+        std::byte* data_{};
+        size_t size_{};
+#ifdef _WIN32
+        void* mapping_{};
+#endif
+    };
+
+} // namespace behl
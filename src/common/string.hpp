@@ -13,6 +13,19 @@
 
 namespace behl
 {
+    inline constexpr uint64_t kFnv1a64Offset = 14695981039346656037ULL;
+
+    // 64-bit FNV-1a, identical on every platform so it can be stored in files.
+    // Pass a previous result as hash to continue hashing a second piece of data.
+    constexpr uint64_t fnv1a_64(std::string_view data, uint64_t hash = kFnv1a64Offset) noexcept
+    {
+        for (const char c : data)
+        {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
 
     template<typename T>
     concept StringViewLike = requires(T t) {
@@ -104,12 +104,39 @@ namespace behl
                 }
             }
 
-            mem_free_array<T>(state, data_, capacity_);
+            if (!is_external())
+            {
+                mem_free_array<T>(state, data_, capacity_);
+            }
             data_ = nullptr;
             size_ = 0;
             capacity_ = 0;
         }
 
+        // Points the vector at storage it does not own, e.g. a memory mapped file. The storage is never freed
+        // by the vector and is copied into owned memory on the first operation that needs to grow it. It is
+        // read-only and may be shared with other states and threads, elements must not be written in place.
+        void assign_external(State* state, const T* data, size_t size)
+        {
+            static_assert(std::is_trivially_copyable_v<T>, "External storage requires trivially copyable elements");
+
+            destroy(state);
+            if (size == 0)
+            {
+                return;
+            }
+
+            data_ = const_cast<T*>(data);
+            size_ = size;
+        }
+
+        // True when the elements live in storage assigned with assign_external().
+        BEHL_FORCEINLINE
+        bool is_external() const noexcept
+        {
+            return capacity_ == 0 && data_ != nullptr;
+        }
+
         BEHL_FORCEINLINE
         size_t size() const
         {
@@ -135,6 +162,33 @@ namespace behl
             grow(state, min_capacity);
         }
 
+        // Releases unused capacity, the storage is freed entirely when the vector is empty.
+        void shrink_to_fit(State* state)
+        {
+            assert(state != nullptr && "State can not be null");
+
+            if (is_external())
+            {
+                return;
+            }
+
+            if (size_ == 0)
+            {
+                mem_free_array<T>(state, data_, capacity_);
+                data_ = nullptr;
+                capacity_ = 0;
+                return;
+            }
+
+            const size_t new_capacity = std::max(size_t(4), std::bit_ceil(size_));
+            if (new_capacity >= capacity_)
+            {
+                return;
+            }
+
+            reallocate(state, new_capacity);
+        }
+
         BEHL_FORCEINLINE
         void push_back(State* state, const T& value)
         {
@@ -454,11 +508,29 @@ namespace behl
             assert(capacity_ < min_capacity && "grow called when capacity is sufficient");
 
             // Calculate next power of 2, with minimum of 4
-            size_t new_capacity = std::max(size_t(4), std::bit_ceil(min_capacity));
+            reallocate(state, std::max(size_t(4), std::bit_ceil(min_capacity)));
+        }
+
+        void reallocate(State* state, size_t new_capacity)
+        {
+            assert(new_capacity >= size_ && "reallocate would drop elements");
 
             T* new_data;
 
-            if constexpr (std::is_trivially_copyable_v<T> && !kVectorPointerInvalidation)
+            if (is_external())
+            {
+                if constexpr (std::is_trivially_copyable_v<T>)
+                {
+                    new_data = mem_alloc_array<T>(state, new_capacity);
+                    std::memcpy(static_cast<void*>(new_data), data_, size_ * sizeof(T));
+                }
+                else
+                {
+                    assert(false && "External storage requires trivially copyable elements");
+                    return;
+                }
+            }
+            else if constexpr (std::is_trivially_copyable_v<T> && !kVectorPointerInvalidation)
             {
                 // For POD types, we can use realloc which is more efficient
                 new_data = mem_realloc_array<T>(state, data_, capacity_, new_capacity);
@@ -38,13 +38,27 @@ namespace behl
 
     static constexpr size_t kGCPoolStepSize = 128;
 
+    // Closures are pooled per upvalue count, closures capturing this many or more are freed instead.
+    static constexpr size_t kGCClosurePoolBuckets = 8;
+
+    // Automatic compaction once the live heap drops below peak / ratio, ignored for peaks under the minimum.
+    static constexpr bool kGCAutoCompactEnabled = true;
+
+    static constexpr size_t kGCAutoCompactRatio = 4;
+
+    static constexpr size_t kGCAutoCompactMinPeak = 8 * 1024 * 1024;
+
+    // Size and alignment of the bump arena chunks used by region allocation.
+    static constexpr size_t kGCRegionChunkSize = 64 * 1024;
+
     static constexpr bool kGCLoggingEnabled = false;
 
     static constexpr bool kGCEnableValidation = false;
 
-    // Optimization Configuration
-    static constexpr bool kOptimizationPassTiming = false;
+    // Bumped whenever code generation changes, invalidates entries of the compiled module cache.
+    static constexpr uint32_t kCompilerVersion = 7;
 
+    // Optimization Configuration
     static constexpr bool kOptimizationPassDebug = false;
 
 } // namespace behl
@@ -1,20 +1,42 @@
 #include "frontend/lexer.hpp"
 
 #include "common/vector.hpp"
+#include "platform.hpp"
 #include "state.hpp"
 
 #include <algorithm>
 #include <array>
 #include <behl/exceptions.hpp>
+#include <bit>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <ranges>
 #include <stdexcept>
 
+#if defined(__AVX2__)
+#    include <immintrin.h>
+#    define BEHL_LEXER_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define BEHL_LEXER_SSE2 1
+#endif
+
 namespace behl
 {
 
+    static constexpr size_t kKeywordTableSize = 64;
+
+    // Perfect hash over the keyword set, the table construction fails to compile if two keywords collide.
+    static constexpr size_t keyword_hash(std::string_view ident)
+    {
+        const auto first = static_cast<unsigned char>(ident.front());
+        const auto last = static_cast<unsigned char>(ident.back());
+        return (ident.size() + first * 3u + last * 25u) & (kKeywordTableSize - 1);
+    }
+
     static constexpr auto kKeywords = std::invoke([]() {
-        auto entries = std::to_array<std::pair<std::string_view, TokenType>>({
+        constexpr auto entries = std::to_array<std::pair<std::string_view, TokenType>>({
             { "let", TokenType::kLet },
             { "const", TokenType::kConst },
             { "if", TokenType::kIf },
@@ -37,32 +59,110 @@ namespace behl
             { "local", TokenType::kLocal },
         });
 
-        std::ranges::sort(entries, {}, &std::pair<std::string_view, TokenType>::first);
+        std::array<std::pair<std::string_view, TokenType>, kKeywordTableSize> table{};
+        for (const auto& entry : entries)
+        {
+            auto& slot = table[keyword_hash(entry.first)];
+            if (!slot.first.empty())
+            {
+                throw std::logic_error("Keyword hash collision");
+            }
+            slot = entry;
+        }
 
-        return entries;
+        return table;
     });
 
     std::optional<TokenType> find_keyword(std::string_view ident)
     {
-        auto it = std::ranges::lower_bound(kKeywords, ident, {}, &std::pair<std::string_view, TokenType>::first);
-        if (it != kKeywords.end() && it->first == ident)
+        if (ident.size() < 2 || ident.size() > 8)
         {
-            return it->second;
+            return std::nullopt;
+        }
+        const auto& slot = kKeywords[keyword_hash(ident)];
+        if (slot.first == ident)
+        {
+            return slot.second;
         }
         return std::nullopt;
     }
 
-    struct LexerState
+    static constexpr size_t kTextBlockSize = 16 * 1024;
+    static constexpr size_t kDiscardThreshold = 4 * 1024;
+
+    Lexer::Lexer(State* S, std::string_view input, std::string_view name)
+        : source(input)
+        , chunkname(name)
+        , buffer(S)
+        , text(S)
+        , state(S)
     {
-        std::string_view source;
-        size_t pos = 0;
-        int line = 1;
-        int column = 1;
-        std::string_view chunkname;
-    };
+    }
+
+    Lexer::Lexer(State* S, SourceReader read, void* userdata, std::string_view name)
+        : chunkname(name)
+        , reader(read)
+        , reader_userdata(userdata)
+        , buffer(S)
+        , text(S)
+        , state(S)
+    {
+    }
+
+    // Pulls reader input until the buffer extends to end or the reader is exhausted.
+    BEHL_NOINLINE static void fill(Lexer& L, size_t end)
+    {
+        while (L.source.size() < end && !L.reader_done)
+        {
+            const auto chunk = L.reader(L.state, L.reader_userdata);
+            if (chunk.empty())
+            {
+                L.reader_done = true;
+                break;
+            }
+            const auto old_size = L.buffer.size();
+            L.buffer.resize(old_size + chunk.size());
+            std::memcpy(L.buffer.data() + old_size, chunk.data(), chunk.size());
+            L.source = std::string_view(L.buffer.data(), L.buffer.size());
+        }
+    }
+
+    static bool at_end(Lexer& L, size_t pos)
+    {
+        if (pos >= L.source.size() && L.reader) [[unlikely]]
+        {
+            fill(L, pos + 1);
+        }
+        return pos >= L.source.size();
+    }
+
+    // Returns a view of scanned text that stays valid while the lexer lives.
+    static std::string_view token_text(Lexer& L, size_t start, size_t length)
+    {
+        const auto value = L.source.substr(start, length);
+        if (!L.reader || value.empty())
+        {
+            return value;
+        }
+
+        if (L.text.empty() || L.text.back().capacity() - L.text.back().size() < length)
+        {
+            auto& block = L.text.emplace_back(L.state);
+            block.reserve(std::max(kTextBlockSize, length));
+        }
+        auto& block = L.text.back();
+        const auto offset = block.size();
+        block.resize(offset + length);
+        std::memcpy(block.data() + offset, value.data(), length);
+        return std::string_view(block.data() + offset, length);
+    }
 
-    static char32_t decode_codepoint(const LexerState& L, size_t start_pos, size_t& bytes)
+    static char32_t decode_codepoint(Lexer& L, size_t start_pos, size_t& bytes)
     {
+        if (start_pos + 4 > L.source.size() && L.reader) [[unlikely]]
+        {
+            fill(L, start_pos + 4);
+        }
         if (start_pos >= L.source.size())
         {
             bytes = 0;
@@ -112,18 +212,18 @@ namespace behl
         }
     }
 
-    static char32_t current_codepoint(const LexerState& L)
+    static char32_t current_codepoint(Lexer& L)
     {
         size_t bytes = 0;
         return decode_codepoint(L, L.pos, bytes);
     }
 
-    static char32_t peek_codepoint(const LexerState& L)
+    static char32_t peek_codepoint(Lexer& L)
     {
         size_t current_bytes = 0;
         decode_codepoint(L, L.pos, current_bytes);
         size_t peek_pos = L.pos + current_bytes;
-        if (peek_pos >= L.source.size())
+        if (at_end(L, peek_pos))
         {
             return U'\0';
         }
@@ -131,19 +231,19 @@ namespace behl
         return decode_codepoint(L, peek_pos, peek_bytes);
     }
 
-    static char32_t peek2_codepoint(const LexerState& L)
+    static char32_t peek2_codepoint(Lexer& L)
     {
         size_t bytes1 = 0;
         decode_codepoint(L, L.pos, bytes1);
         size_t pos2 = L.pos + bytes1;
-        if (pos2 >= L.source.size())
+        if (at_end(L, pos2))
         {
             return U'\0';
         }
         size_t bytes2 = 0;
         decode_codepoint(L, pos2, bytes2);
         size_t pos3 = pos2 + bytes2;
-        if (pos3 >= L.source.size())
+        if (at_end(L, pos3))
         {
             return U'\0';
         }
@@ -151,7 +251,7 @@ namespace behl
         return decode_codepoint(L, pos3, bytes3);
     }
 
-    static char32_t advance_codepoint(LexerState& L)
+    static char32_t advance_codepoint(Lexer& L)
     {
         size_t bytes = 0;
         char32_t cp = decode_codepoint(L, L.pos, bytes);
@@ -168,15 +268,200 @@ namespace behl
         return cp;
     }
 
-    static void skip_whitespace(LexerState& L)
+    // Classes of ASCII runs the scanners skip in bulk. Bytes with the high bit set always end a run so multi-byte
+    // codepoints, and the line bookkeeping for '\n', go through the codepoint functions above.
+    enum class Run
+    {
+        kIdentifier,   // [A-Za-z0-9_]
+        kBlank,        // Whitespace other than '\n'
+        kLineComment,  // Anything up to '\n'
+        kBlockComment, // Anything up to '*' or '\n'
+        kString,       // Anything up to the quote, '\\' or '\n'
+    };
+
+    template<Run R>
+    static BEHL_FORCEINLINE bool ends_run(unsigned char c, char quote)
     {
-        while (std::isspace(static_cast<int>(current_codepoint(L))))
+        if constexpr (R == Run::kIdentifier)
+        {
+            return !((c | 0x20) >= 'a' && (c | 0x20) <= 'z') && !(c >= '0' && c <= '9') && c != '_';
+        }
+        else if constexpr (R == Run::kBlank)
         {
+            return c != ' ' && c != '\t' && c != '\r' && c != '\v' && c != '\f';
+        }
+        else
+        {
+            // NUL ends comments and strings the same way the end of input does.
+            bool stop = c >= 0x80 || c == '\n' || c == '\0';
+            if constexpr (R == Run::kBlockComment)
+            {
+                stop = stop || c == '*';
+            }
+            else if constexpr (R == Run::kString)
+            {
+                stop = stop || c == static_cast<unsigned char>(quote) || c == '\\';
+            }
+            return stop;
+        }
+    }
+
+#if defined(BEHL_LEXER_AVX2) || defined(BEHL_LEXER_SSE2)
+#    if defined(BEHL_LEXER_AVX2)
+    using SimdBlock = __m256i;
+    static constexpr size_t kSimdWidth = 32;
+
+    static BEHL_FORCEINLINE SimdBlock simd_load(const char* p)
+    {
+        return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    }
+    static BEHL_FORCEINLINE SimdBlock simd_splat(char c)
+    {
+        return _mm256_set1_epi8(c);
+    }
+    static BEHL_FORCEINLINE SimdBlock simd_eq(SimdBlock a, SimdBlock b)
+    {
+        return _mm256_cmpeq_epi8(a, b);
+    }
+    static BEHL_FORCEINLINE SimdBlock simd_gt(SimdBlock a, SimdBlock b)
+    {
+        return _mm256_cmpgt_epi8(a, b);
+    }
+    static BEHL_FORCEINLINE SimdBlock simd_or(SimdBlock a, SimdBlock b)
+    {
+        return _mm256_or_si256(a, b);
+    }
+    static BEHL_FORCEINLINE SimdBlock simd_and(SimdBlock a, SimdBlock b)
+    {
+        return _mm256_and_si256(a, b);
+    }
+    static BEHL_FORCEINLINE uint32_t simd_mask(SimdBlock a)
+    {
+        return static_cast<uint32_t>(_mm256_movemask_epi8(a));
+    }
+#    else
+    using SimdBlock = __m128i;
+    static constexpr size_t kSimdWidth = 16;
+
+    static BEHL_FORCEINLINE SimdBlock simd_load(const char* p)
+    {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    }
+    static BEHL_FORCEINLINE SimdBlock simd_splat(char c)
+    {
+        return _mm_set1_epi8(c);
+    }
+    static BEHL_FORCEINLINE SimdBlock simd_eq(SimdBlock a, SimdBlock b)
+    {
+        return _mm_cmpeq_epi8(a, b);
+    }
+    static BEHL_FORCEINLINE SimdBlock simd_gt(SimdBlock a, SimdBlock b)
+    {
+        return _mm_cmpgt_epi8(a, b);
+    }
+    static BEHL_FORCEINLINE SimdBlock simd_or(SimdBlock a, SimdBlock b)
+    {
+        return _mm_or_si128(a, b);
+    }
+    static BEHL_FORCEINLINE SimdBlock simd_and(SimdBlock a, SimdBlock b)
+    {
+        return _mm_and_si128(a, b);
+    }
+    static BEHL_FORCEINLINE uint32_t simd_mask(SimdBlock a)
+    {
+        return static_cast<uint32_t>(_mm_movemask_epi8(a));
+    }
+#    endif
+
+    static constexpr uint32_t kSimdAllBytes = static_cast<uint32_t>((uint64_t{ 1 } << kSimdWidth) - 1);
+
+    // Byte comparisons are signed, bytes with the high bit set are negative and fall outside every ASCII range.
+    static BEHL_FORCEINLINE SimdBlock simd_in_range(SimdBlock a, char lo, char hi)
+    {
+        return simd_and(simd_gt(a, simd_splat(static_cast<char>(lo - 1))), simd_gt(simd_splat(static_cast<char>(hi + 1)), a));
+    }
+
+    // One bit per byte of the block that ends the run, matching ends_run.
+    template<Run R>
+    static BEHL_FORCEINLINE uint32_t run_stops(SimdBlock block, char quote)
+    {
+        if constexpr (R == Run::kIdentifier)
+        {
+            const auto folded = simd_or(block, simd_splat(0x20));
+            const auto word = simd_or(simd_or(simd_in_range(folded, 'a', 'z'), simd_in_range(block, '0', '9')),
+                simd_eq(block, simd_splat('_')));
+            return ~simd_mask(word) & kSimdAllBytes;
+        }
+        else if constexpr (R == Run::kBlank)
+        {
+            const auto blank = simd_or(simd_or(simd_eq(block, simd_splat(' ')), simd_eq(block, simd_splat('\t'))),
+                simd_or(simd_eq(block, simd_splat('\r')),
+                    simd_or(simd_eq(block, simd_splat('\v')), simd_eq(block, simd_splat('\f')))));
+            return ~simd_mask(blank) & kSimdAllBytes;
+        }
+        else
+        {
+            auto stop = simd_or(simd_eq(block, simd_splat('\n')), simd_eq(block, simd_splat('\0')));
+            if constexpr (R == Run::kBlockComment)
+            {
+                stop = simd_or(stop, simd_eq(block, simd_splat('*')));
+            }
+            else if constexpr (R == Run::kString)
+            {
+                stop = simd_or(stop, simd_or(simd_eq(block, simd_splat(quote)), simd_eq(block, simd_splat('\\'))));
+            }
+            return simd_mask(stop) | simd_mask(block);
+        }
+    }
+#endif
+
+    // Length of the run of class R starting at pos, limited to the text already in the buffer.
+    template<Run R>
+    static size_t ascii_run(const Lexer& L, size_t pos, char quote = '\0')
+    {
+        const std::string_view src = L.source;
+        const size_t start = pos;
+#if defined(BEHL_LEXER_AVX2) || defined(BEHL_LEXER_SSE2)
+        while (src.size() - pos >= kSimdWidth)
+        {
+            const uint32_t stops = run_stops<R>(simd_load(src.data() + pos), quote);
+            if (stops != 0)
+            {
+                return pos - start + static_cast<size_t>(std::countr_zero(stops));
+            }
+            pos += kSimdWidth;
+        }
+#endif
+        while (pos < src.size() && !ends_run<R>(static_cast<unsigned char>(src[pos]), quote))
+        {
+            ++pos;
+        }
+        return pos - start;
+    }
+
+    // Consumes a run of single-byte codepoints that contains no newline.
+    template<Run R>
+    static void skip_run(Lexer& L, char quote = '\0')
+    {
+        const size_t length = ascii_run<R>(L, L.pos, quote);
+        L.pos += length;
+        L.column += static_cast<int>(length);
+    }
+
+    static void skip_whitespace(Lexer& L)
+    {
+        for (;;)
+        {
+            skip_run<Run::kBlank>(L);
+            if (!std::isspace(static_cast<int>(current_codepoint(L))))
+            {
+                break;
+            }
             advance_codepoint(L);
         }
     }
 
-    static void skip_comment(LexerState& L)
+    static void skip_comment(Lexer& L)
     {
         char32_t c = current_codepoint(L);
         char32_t p = peek_codepoint(L);
@@ -186,8 +471,14 @@ namespace behl
             advance_codepoint(L);
             advance_codepoint(L);
 
-            while (current_codepoint(L) != '\n' && current_codepoint(L) != U'\0')
+            for (;;)
             {
+                skip_run<Run::kLineComment>(L);
+                const char32_t cp = current_codepoint(L);
+                if (cp == '\n' || cp == U'\0')
+                {
+                    break;
+                }
                 advance_codepoint(L);
             }
         }
@@ -198,6 +489,7 @@ namespace behl
             advance_codepoint(L);
             while (true)
             {
+                skip_run<Run::kBlockComment>(L);
                 c = current_codepoint(L);
                 if (c == U'\0')
                 {
@@ -214,25 +506,31 @@ namespace behl
         }
     }
 
-    static Token scan_identifier(LexerState& L)
+    static Token scan_identifier(Lexer& L)
     {
         int start_line = L.line;
         int start_col = L.column;
         size_t start_pos = L.pos;
-        while (std::isalnum(static_cast<int>(current_codepoint(L))) || current_codepoint(L) == '_')
+        for (;;)
         {
+            skip_run<Run::kIdentifier>(L);
+            const char32_t cp = current_codepoint(L);
+            if (!std::isalnum(static_cast<int>(cp)) && cp != '_')
+            {
+                break;
+            }
             size_t bytes = 0;
             decode_codepoint(L, L.pos, bytes);
             L.pos += bytes;
             L.column++;
         }
-        std::string_view id = L.source.substr(start_pos, L.pos - start_pos);
+        std::string_view id = token_text(L, start_pos, L.pos - start_pos);
         auto token_type = find_keyword(id);
         TokenType type = token_type.value_or(TokenType::kIdentifier);
         return { type, id, start_line, start_col };
     }
 
-    static Token scan_number(LexerState& L)
+    static Token scan_number(Lexer& L)
     {
         int start_line = L.line;
         int start_col = L.column;
@@ -299,20 +597,25 @@ namespace behl
                 }
             }
         }
-        std::string_view num = L.source.substr(start_pos, L.pos - start_pos);
+        std::string_view num = token_text(L, start_pos, L.pos - start_pos);
         return { TokenType::kNumber, num, start_line, start_col };
     }
 
-    static Token scan_string(LexerState& L)
+    static Token scan_string(Lexer& L)
     {
         int start_line = L.line;
         int start_col = L.column;
         char32_t quote = advance_codepoint(L);
         size_t start_pos = L.pos;
 
-        while (current_codepoint(L) != quote)
+        for (;;)
         {
+            skip_run<Run::kString>(L, static_cast<char>(quote));
             char32_t c = current_codepoint(L);
+            if (c == quote)
+            {
+                break;
+            }
             if (c == U'\0')
             {
                 throw SyntaxError("Unterminated string", SourceLocation(L.chunkname, start_line, start_col));
@@ -332,7 +635,7 @@ namespace behl
         }
 
         size_t end_pos = L.pos;
-        std::string_view str = L.source.substr(start_pos, end_pos - start_pos);
+        std::string_view str = token_text(L, start_pos, end_pos - start_pos);
 
         if (current_codepoint(L) != quote)
         {
@@ -342,7 +645,7 @@ namespace behl
         return { TokenType::kString, str, start_line, start_col };
     }
 
-    static Token scan_operator(LexerState& L)
+    static Token scan_operator(Lexer& L)
     {
         int start_line = L.line;
         int start_col = L.column;
@@ -611,18 +914,24 @@ namespace behl
         return { type, val, start_line, start_col };
     }
 
-    AutoVector<Token> tokenize(State* state, std::string_view source, std::string_view chunkname)
+    Token Lexer::next()
     {
-        LexerState L{ source, 0, 1, 1, chunkname };
+        Lexer& L = *this;
 
-        AutoVector<Token> tokens(state);
-
-        while (L.pos < L.source.size())
+        for (;;)
         {
+            // Text before the current position is no longer referenced, values of earlier tokens were copied.
+            if (L.reader && L.pos >= kDiscardThreshold)
+            {
+                L.buffer.erase(L.buffer.begin(), L.buffer.begin() + static_cast<ptrdiff_t>(L.pos));
+                L.source = std::string_view(L.buffer.data(), L.buffer.size());
+                L.pos = 0;
+            }
+
             skip_whitespace(L);
-            if (L.pos >= L.source.size())
+            if (at_end(L, L.pos))
             {
-                break;
+                return { TokenType::kEOF, "", L.line, L.column };
             }
 
             char32_t c = current_codepoint(L);
@@ -635,22 +944,33 @@ namespace behl
 
             if (std::isalpha(static_cast<int>(c)) || c == '_')
             {
-                tokens.push_back(scan_identifier(L));
+                return scan_identifier(L);
             }
-            else if (std::isdigit(static_cast<int>(c)) || (c == '.' && std::isdigit(static_cast<int>(peek_codepoint(L)))))
+            if (std::isdigit(static_cast<int>(c)) || (c == '.' && std::isdigit(static_cast<int>(peek_codepoint(L)))))
             {
-                tokens.push_back(scan_number(L));
+                return scan_number(L);
             }
-            else if (c == '"' || c == '\'')
+            if (c == '"' || c == '\'')
             {
-                tokens.push_back(scan_string(L));
+                return scan_string(L);
             }
-            else
+            return scan_operator(L);
+        }
+    }
+
+    AutoVector<Token> tokenize(State* state, std::string_view source, std::string_view chunkname)
+    {
+        Lexer L(state, source, chunkname);
+
+        AutoVector<Token> tokens(state);
+        for (;;)
+        {
+            tokens.push_back(L.next());
+            if (tokens.back().type == TokenType::kEOF)
             {
-                tokens.push_back(scan_operator(L));
+                break;
             }
         }
-        tokens.push_back({ TokenType::kEOF, "", L.line, L.column });
         return tokens;
     }
 
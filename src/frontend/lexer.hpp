@@ -4,6 +4,7 @@
 #include "common/vector.hpp"
 
 #include <behl/export.hpp>
+#include <behl/types.hpp>
 #include <string>
 #include <string_view>
 
@@ -93,6 +94,33 @@ namespace behl
         int column;
     };
 
+    // Scans tokens on demand, either from a source held in memory or from chunks delivered by a reader. Token values
+    // point into the source, with a reader they are copied to storage owned by the lexer and live as long as it.
+    struct BEHL_API Lexer
+    {
+        std::string_view source; // Input being scanned, with a reader the buffered text not yet discarded
+        size_t pos = 0;
+        int line = 1;
+        int column = 1;
+        std::string_view chunkname;
+
+        SourceReader reader = nullptr;
+        void* reader_userdata = nullptr;
+        bool reader_done = false;
+        AutoVector<char> buffer;           // Reader input from the start of the current token on
+        AutoVector<AutoVector<char>> text; // Token values copied out of the buffer
+        State* state;
+
+        Lexer(State* S, std::string_view input, std::string_view name = "<script>");
+        Lexer(State* S, SourceReader read, void* userdata, std::string_view name = "<script>");
+
+        Lexer(const Lexer&) = delete;
+        Lexer& operator=(const Lexer&) = delete;
+
+        // Returns the next token, kEOF once the input is exhausted.
+        Token next();
+    };
+
     BEHL_API AutoVector<Token> tokenize(State* state, std::string_view source, std::string_view chunkname = "<script>");
 
 } // namespace behl
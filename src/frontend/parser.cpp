@@ -3,10 +3,14 @@
 #include "ast/ast.hpp"
 #include "ast/ast_holder.hpp"
 #include "common/charconv_compat.hpp"
+#include "common/vector.hpp"
 #include "frontend/lexer.hpp"
 
+#include <algorithm>
 #include <behl/exceptions.hpp>
+#include <cassert>
 #include <charconv>
+#include <cstdint>
 #include <stdexcept>
 
 namespace behl
@@ -33,8 +37,14 @@ namespace behl
     // Process escape sequences in a string_view and return a new String
     static AstString* process_string_escapes(AstHolder& holder, std::string_view raw_str)
     {
-        auto* str = holder.make_string(raw_str);
-        auto* buf = str->data;
+        if (raw_str.find('\\') == std::string_view::npos)
+        {
+            return holder.make_string(raw_str);
+        }
+
+        // Strings are interned, the unescaped text is built aside and interned once complete
+        AutoVector<char> buf(holder.state());
+        buf.resize(raw_str.size());
         size_t write_pos = 0;
 
         for (size_t i = 0; i < raw_str.size(); ++i)
@@ -90,70 +100,129 @@ namespace behl
             }
         }
 
-        // Adjust the length to the actual written size
-        str->length = write_pos;
-
-        return str;
+        return holder.make_string(std::string_view(buf.data(), write_pos));
     }
 
+    // Tokens seen by the parser, either a complete token array or tokens pulled from a lexer on demand. Pulled
+    // tokens are kept in a small window that starts at the oldest position the parser may return to.
+    class TokenWindow
+    {
+    public:
+        explicit TokenWindow(std::span<const Token> tokens)
+            : tokens_(tokens)
+        {
+        }
+
+        explicit TokenWindow(Lexer& lexer)
+            : lexer_(&lexer)
+            , window_(lexer.state)
+        {
+        }
+
+        // Returns the token at the absolute index, nullptr past the end of the input.
+        const Token* get(size_t index)
+        {
+            if (!lexer_)
+            {
+                return index < tokens_.size() ? &tokens_[index] : nullptr;
+            }
+
+            assert(index >= base_ && "Token was released from the window");
+            while (index - base_ >= window_.size())
+            {
+                if (!window_.empty() && window_.back().type == TokenType::kEOF)
+                {
+                    return nullptr;
+                }
+                window_.push_back(lexer_->next());
+            }
+            return &window_[index - base_];
+        }
+
+        // Tokens before the index are not accessed anymore.
+        void release(size_t index)
+        {
+            if (lexer_ && index > base_ && index - base_ >= kReleaseBatch)
+            {
+                const auto count = std::min(index - base_, window_.size());
+                window_.erase(window_.begin(), window_.begin() + static_cast<ptrdiff_t>(count));
+                base_ += count;
+            }
+        }
+
+    private:
+        static constexpr size_t kReleaseBatch = 64;
+
+        std::span<const Token> tokens_;
+        Lexer* lexer_ = nullptr;
+        AutoVector<Token> window_{ nullptr };
+        size_t base_ = 0;
+    };
+
     struct ParserState
     {
         AstHolder& holder;
-        std::span<const Token> tokens;
+        TokenWindow tokens;
         size_t pos = 0;
         std::string_view chunkname;
-        int max_line = -1;   // -1 means parse entire file
-        int max_column = -1; // -1 means parse entire line, otherwise stop at this column
+        int max_line = -1;               // -1 means parse entire file
+        int max_column = -1;             // -1 means parse entire line, otherwise stop at this column
+        size_t backtrack_pos = SIZE_MAX; // Oldest position the parser may rewind to
     };
 
-    static Token current(const ParserState& P)
+    static Token current(ParserState& P)
     {
-        if (P.pos >= P.tokens.size())
+        const Token* tok = P.tokens.get(P.pos);
+        if (!tok)
         {
             return { TokenType::kEOF, "", -1, -1 };
         }
-        return P.tokens[P.pos];
+        return *tok;
     }
 
-    static Token previous(const ParserState& P)
+    static Token previous(ParserState& P)
     {
-        if (P.pos == 0)
+        const Token* tok = P.pos != 0 ? P.tokens.get(P.pos - 1) : nullptr;
+        if (!tok)
         {
             return { TokenType::kEOF, "", -1, -1 };
         }
-        return P.tokens[P.pos - 1];
+        return *tok;
     }
 
-    static Token peek(const ParserState& P)
+    static Token peek(ParserState& P, size_t distance = 1)
     {
-        if (P.pos + 1 >= P.tokens.size())
+        const Token* tok = P.tokens.get(P.pos + distance);
+        if (!tok)
         {
             return { TokenType::kEOF, "", -1, -1 };
         }
-        return P.tokens[P.pos + 1];
+        return *tok;
     }
 
     static Token advance(ParserState& P)
     {
+        const Token* tok = P.tokens.get(P.pos);
+
         // Check if we're about to advance past the cursor position
-        if (P.max_line >= 0 && P.pos < P.tokens.size())
+        if (P.max_line >= 0 && tok)
         {
-            Token tok = P.tokens[P.pos];
-            if (tok.line > P.max_line || (tok.line == P.max_line && P.max_column >= 0 && tok.column >= P.max_column))
+            if (tok->line > P.max_line || (tok->line == P.max_line && P.max_column >= 0 && tok->column >= P.max_column))
             {
                 // Don't advance past cursor - return EOF with cursor position to signal end of parsing
                 return { TokenType::kEOF, "", P.max_line, P.max_column };
             }
         }
 
-        if (P.pos < P.tokens.size())
+        if (tok)
         {
             ++P.pos;
+            P.tokens.release(std::min(P.pos - 1, P.backtrack_pos));
         }
         return previous(P);
     }
 
-    static bool check(const ParserState& P, TokenType type)
+    static bool check(ParserState& P, TokenType type)
     {
         return current(P).type == type;
     }
@@ -182,7 +251,7 @@ namespace behl
         throw SyntaxError(err_msg, loc);
     }
 
-    [[noreturn]] static void error(const ParserState& P, std::string_view msg)
+    [[noreturn]] static void error(ParserState& P, std::string_view msg)
     {
         Token tok = current(P);
         SourceLocation loc(P.chunkname, tok.line, tok.column);
@@ -346,11 +415,9 @@ namespace behl
         }
     }
 
-    AstProgram* parse(
-        AstHolder& holder, std::span<const Token> tokens, std::string_view chunkname, int max_line, int max_column)
+    static AstProgram* parse_program(ParserState& P)
     {
-        ParserState P{ holder, tokens, 0, chunkname, max_line, max_column };
-        auto* prog = holder.make<AstProgram>();
+        auto* prog = P.holder.make<AstProgram>();
 
         // Check for module declaration (must be first statement)
         if (check(P, TokenType::kModule))
@@ -362,7 +429,7 @@ namespace behl
 
         prog->block = parse_block(P);
         // Only check for EOF if parsing entire file
-        if (max_line < 0 && !check(P, TokenType::kEOF))
+        if (P.max_line < 0 && !check(P, TokenType::kEOF))
         {
             error(P, "Unexpected tokens after end of program");
         }
@@ -370,6 +437,19 @@ namespace behl
         return prog;
     }
 
+    AstProgram* parse(
+        AstHolder& holder, std::span<const Token> tokens, std::string_view chunkname, int max_line, int max_column)
+    {
+        ParserState P{ holder, TokenWindow(tokens), 0, chunkname, max_line, max_column };
+        return parse_program(P);
+    }
+
+    AstProgram* parse(AstHolder& holder, Lexer& lexer, std::string_view chunkname)
+    {
+        ParserState P{ holder, TokenWindow(lexer), 0, chunkname };
+        return parse_program(P);
+    }
+
     static AstNode* parse_primary(ParserState& P)
     {
         // Check position limit before accessing tokens
@@ -509,8 +589,7 @@ namespace behl
                 //    Function call results shouldn't use method syntax anyway
                 bool is_func_call_result = (left->type == AstNodeType::kFuncCall);
 
-                if (!is_func_call_result && P.pos + 1 < P.tokens.size() && P.tokens[P.pos + 1].type == TokenType::kIdentifier
-                    && P.pos + 2 < P.tokens.size() && P.tokens[P.pos + 2].type == TokenType::kLParen)
+                if (!is_func_call_result && peek(P, 1).type == TokenType::kIdentifier && peek(P, 2).type == TokenType::kLParen)
                 {
                     // This IS a method call - consume and parse it
                     auto tok = advance(P); // consume ':'
@@ -790,6 +869,7 @@ namespace behl
         if (check(P, TokenType::kLet) || check(P, TokenType::kConst))
         {
             size_t checkpoint = P.pos;
+            P.backtrack_pos = checkpoint;
             advance(P); // consume 'let' or 'const'
 
             // Check if this is for-in syntax (for (let v in expr) or for (let k,v in expr))
@@ -800,6 +880,8 @@ namespace behl
 
                 if (match(P, { TokenType::kIn }))
                 {
+                    P.backtrack_pos = SIZE_MAX;
+
                     // This is a for-in loop with let declaration
                     AstNode* exprs = nullptr;
                     parse_expr_list(P, exprs);
@@ -825,6 +907,7 @@ namespace behl
 
             // Not for-in, restore position and parse as C-style for with declaration
             P.pos = checkpoint;
+            P.backtrack_pos = SIZE_MAX;
 
             // Parse C-style for loop with let declaration
             // Support: let i = 0, j = 10, k = 20
@@ -10,8 +10,12 @@ namespace behl
     class AstHolder;
     struct AstProgram;
     struct Token;
+    struct Lexer;
 
     BEHL_API AstProgram* parse(AstHolder& holder, std::span<const Token> tokens, std::string_view chunkname = "<script>",
         int max_line = -1, int max_column = -1);
 
+    // Parses tokens pulled from the lexer as they are needed, only a few of them are held at a time.
+    BEHL_API AstProgram* parse(AstHolder& holder, Lexer& lexer, std::string_view chunkname = "<script>");
+
 } // namespace behl
@@ -11,7 +11,7 @@ namespace behl
 {
     struct Scope
     {
-        AutoHashMap<std::string_view, bool> locals;
+        AutoHashMap<Atom, bool, AtomHash> locals;
         Scope* parent = nullptr;
         bool is_function_scope = false;
 
@@ -28,7 +28,7 @@ namespace behl
         State* state;
         AstHolder& holder;
         Scope* current_scope = nullptr;
-        std::string_view current_function_name{};  // Name of the function currently being analyzed
+        Atom current_function_name = kInvalidAtom; // Name of the function currently being analyzed
         bool is_module = false;                    // Module mode flag
         AstString** exported_names_tail = nullptr; // Tail pointer for appending to program's exported_names
     };
@@ -78,7 +78,7 @@ namespace behl
         return false;
     }
 
-    void declare_local(SemanticsState& state, std::string_view name)
+    void declare_local(SemanticsState& state, Atom name)
     {
         if (state.current_scope)
         {
@@ -86,7 +86,7 @@ namespace behl
         }
     }
 
-    bool is_local(SemanticsState& state, std::string_view name)
+    bool is_local(SemanticsState& state, Atom name)
     {
         Scope* scope = state.current_scope;
         while (scope)
@@ -105,7 +105,7 @@ namespace behl
         return false;
     }
 
-    bool is_upvalue(SemanticsState& state, std::string_view name)
+    bool is_upvalue(SemanticsState& state, Atom name)
     {
         if (!state.current_scope)
         {
@@ -156,14 +156,14 @@ namespace behl
             return assign;
         }
 
-        const auto var_name = var_ident->name->view();
+        const auto var_atom = var_ident->name->atom;
 
         // In module mode, disallow bare assignments (globals) except to stdlib
-        if (state.is_module && !is_local(state, var_name) && !is_upvalue(state, var_name))
+        if (state.is_module && !is_local(state, var_atom) && !is_upvalue(state, var_atom))
         {
             const auto msg = behl::format(
                 "Cannot assign to undeclared variable '{}' in module mode. Use 'let' or 'const' to declare variables.",
-                var_name);
+                var_ident->name->view());
 
             throw RuntimeError(msg);
         }
@@ -172,19 +172,19 @@ namespace behl
         {
             if (auto* lhs_ident = binop->left->try_as<AstIdent>())
             {
-                if (lhs_ident->name->view() == var_name)
+                if (lhs_ident->name->atom == var_atom)
                 {
                     if (binop->op == TokenType::kPlus || binop->op == TokenType::kMinus || binop->op == TokenType::kStar
                         || binop->op == TokenType::kSlash || binop->op == TokenType::kPercent)
                     {
-                        if (is_local(state, var_name))
+                        if (is_local(state, var_atom))
                         {
                             auto* node = state.holder.make<AstCompoundLocal>(var_ident->name, binop->op, binop->right);
                             node->line = assign->line;
                             node->column = assign->column;
                             return node;
                         }
-                        else if (is_upvalue(state, var_name))
+                        else if (is_upvalue(state, var_atom))
                         {
                             auto* node = state.holder.make<AstCompoundUpvalue>(var_ident->name, binop->op, binop->right);
                             node->line = assign->line;
@@ -203,18 +203,22 @@ namespace behl
             }
         }
 
-        if (is_local(state, var_name))
+        AstNode* node = nullptr;
+        if (is_local(state, var_atom))
         {
-            return state.holder.make<AstAssignLocal>(var_ident->name, assign->first_expr);
+            node = state.holder.make<AstAssignLocal>(var_ident->name, assign->first_expr);
         }
-        else if (is_upvalue(state, var_name))
+        else if (is_upvalue(state, var_atom))
         {
-            return state.holder.make<AstAssignUpvalue>(var_ident->name, assign->first_expr);
+            node = state.holder.make<AstAssignUpvalue>(var_ident->name, assign->first_expr);
         }
         else
         {
-            return state.holder.make<AstAssignGlobal>(var_ident->name, assign->first_expr);
+            node = state.holder.make<AstAssignGlobal>(var_ident->name, assign->first_expr);
         }
+        node->line = assign->line;
+        node->column = assign->column;
+        return node;
     }
 
     AstNode* transform_compound_assign(SemanticsState& state, AstCompoundAssign* compound)
@@ -225,16 +229,16 @@ namespace behl
             return compound;
         }
 
-        const auto var_name = var_ident->name->view();
+        const auto var_atom = var_ident->name->atom;
 
-        if (is_local(state, var_name))
+        if (is_local(state, var_atom))
         {
             auto* node = state.holder.make<AstCompoundLocal>(var_ident->name, compound->op, compound->expr);
             node->line = compound->line;
             node->column = compound->column;
             return node;
         }
-        else if (is_upvalue(state, var_name))
+        else if (is_upvalue(state, var_atom))
         {
             auto* node = state.holder.make<AstCompoundUpvalue>(var_ident->name, compound->op, compound->expr);
             node->line = compound->line;
@@ -258,16 +262,16 @@ namespace behl
             return inc;
         }
 
-        const auto var_name = var_ident->name->view();
+        const auto var_atom = var_ident->name->atom;
 
-        if (is_local(state, var_name))
+        if (is_local(state, var_atom))
         {
             auto* node = state.holder.make<AstIncLocal>(var_ident->name);
             node->line = inc->line;
             node->column = inc->column;
             return node;
         }
-        else if (is_upvalue(state, var_name))
+        else if (is_upvalue(state, var_atom))
         {
             auto* node = state.holder.make<AstIncUpvalue>(var_ident->name);
             node->line = inc->line;
@@ -291,16 +295,16 @@ namespace behl
             return dec;
         }
 
-        const auto var_name = var_ident->name->view();
+        const auto var_atom = var_ident->name->atom;
 
-        if (is_local(state, var_name))
+        if (is_local(state, var_atom))
         {
             auto* node = state.holder.make<AstDecLocal>(var_ident->name);
             node->line = dec->line;
             node->column = dec->column;
             return node;
         }
-        else if (is_upvalue(state, var_name))
+        else if (is_upvalue(state, var_atom))
         {
             auto* node = state.holder.make<AstDecUpvalue>(var_ident->name);
             node->line = dec->line;
@@ -322,12 +326,12 @@ namespace behl
 
         if (func.is_method)
         {
-            declare_local(state, "self");
+            declare_local(state, kAtomSelf);
         }
         for (AstNode* p = func.first_param; p; p = p->next_child)
         {
             auto* param = static_cast<AstString*>(p);
-            declare_local(state, param->view());
+            declare_local(state, param->atom);
         }
 
         if (func.block)
@@ -343,19 +347,19 @@ namespace behl
         if (func.first_name_part)
         {
             auto* first_name = static_cast<AstString*>(func.first_name_part);
-            state.current_function_name = first_name->view();
+            state.current_function_name = first_name->atom;
         }
 
         ScopeGuard scope(state, true);
 
         if (func.is_method)
         {
-            declare_local(state, "self");
+            declare_local(state, kAtomSelf);
         }
         for (AstNode* p = func.first_param; p; p = p->next_child)
         {
             auto* param = static_cast<AstString*>(p);
-            declare_local(state, param->view());
+            declare_local(state, param->atom);
         }
 
         if (func.block)
@@ -381,7 +385,8 @@ namespace behl
             const auto name = ident->name->view();
 
             // In module mode, any non-local, non-upvalue, non-builtin variable is an error
-            if (state.is_module && !is_local(state, name) && !is_upvalue(state, name) && !is_builtin_function(name))
+            if (state.is_module && !is_local(state, ident->name->atom) && !is_upvalue(state, ident->name->atom)
+                && !is_builtin_function(name))
             {
                 const auto msg = behl::format("Variable '{}' is not declared. Use 'let' or 'const' to declare local variables, "
                                               "or 'import()' to load modules.",
@@ -396,7 +401,7 @@ namespace behl
             // Check if calling an identifier that matches the current function name
             if (const auto* ident = call->func->try_as<AstIdent>())
             {
-                if (!state.current_function_name.empty() && ident->name->view() == state.current_function_name)
+                if (ident->name->atom == state.current_function_name)
                 {
                     // This is a self-call!
                     call->is_self_call = true;
@@ -551,7 +556,7 @@ namespace behl
             for (AstNode* n = reinterpret_cast<AstNode*>(local_decl->first_name); n; n = n->next_child)
             {
                 auto* name = static_cast<AstString*>(n);
-                declare_local(state, name->view());
+                declare_local(state, name->atom);
             }
             // Transform initializer expressions
             for (AstNode* init = local_decl->first_init; init; init = init->next_child)
@@ -590,7 +595,7 @@ namespace behl
         else if (auto* for_num = node->try_as<AstForNum>())
         {
             ScopeGuard scope(state);
-            declare_local(state, for_num->var->view());
+            declare_local(state, for_num->var->atom);
             if (for_num->block)
             {
                 transform_block(state, *for_num->block);
@@ -603,7 +608,7 @@ namespace behl
             for (const AstNode* name = for_in->first_name; name != nullptr; name = name->next_child)
             {
                 auto* name_str = static_cast<const AstString*>(name);
-                declare_local(state, name_str->view());
+                declare_local(state, name_str->atom);
             }
             if (for_in->block)
             {
@@ -636,7 +641,7 @@ namespace behl
         {
             // Handle optimized numeric for loops (created by LoopOptimizationPass)
             ScopeGuard scope(state);
-            declare_local(state, for_c_numeric->var->view());
+            declare_local(state, for_c_numeric->var->atom);
             if (for_c_numeric->block)
             {
                 transform_block(state, *for_c_numeric->block);
@@ -648,7 +653,7 @@ namespace behl
             if (func_def->is_local && func_def->first_name_part)
             {
                 auto* first_name = static_cast<AstString*>(func_def->first_name_part);
-                declare_local(state, first_name->view());
+                declare_local(state, first_name->atom);
             }
             transform_function_stat(state, *func_def);
             return node;
@@ -713,7 +718,7 @@ namespace behl
                     if (!func_def->is_local && func_def->first_name_part)
                     {
                         auto* first_name = static_cast<AstString*>(func_def->first_name_part);
-                        declare_local(sem_state, first_name->view());
+                        declare_local(sem_state, first_name->atom);
                     }
                 }
                 else if (auto* export_decl = stat->try_as<AstExportDecl>())
@@ -723,7 +728,7 @@ namespace behl
                         if (export_func_def->first_name_part)
                         {
                             auto* first_name = static_cast<AstString*>(export_func_def->first_name_part);
-                            declare_local(sem_state, first_name->view());
+                            declare_local(sem_state, first_name->atom);
                         }
                     }
                 }
@@ -11,13 +11,21 @@
 #include "gco_table.hpp"
 #include "gco_userdata.hpp"
 #include "memory.hpp"
+#include "profiler.hpp"
 #include "state.hpp"
 #include "vm/bytecode.hpp"
 #include "vm/vm.hpp"
 #include "vm/vm_metatable.hpp"
 
 #include <algorithm>
+#include <cstddef>
 #include <limits>
+#include <new>
+#include <utility>
+
+#if defined(__GLIBC__) || defined(_WIN32)
+#    include <malloc.h>
+#endif
 
 namespace behl
 {
@@ -134,10 +142,91 @@ namespace behl
         }
     }
 
+    // ===== Region Arena =====
+
+    static GCRegionChunk* gc_region_chunk_of(const GCObject* obj)
+    {
+        // Chunks are aligned to their size, masking an object address yields its chunk header.
+        const auto base = reinterpret_cast<uintptr_t>(obj) & ~static_cast<uintptr_t>(kGCRegionChunkSize - 1);
+        return reinterpret_cast<GCRegionChunk*>(base);
+    }
+
+    static void* gc_region_bump(State* S, size_t size, size_t alignment)
+    {
+        const auto align_up = [alignment](size_t offset) { return (offset + alignment - 1) & ~(alignment - 1); };
+
+        GCRegionChunk* chunk = S->gc.gc_region_chunks;
+        if (chunk == nullptr || align_up(chunk->used) + size > kGCRegionChunkSize)
+        {
+            void* mem = mem_alloc_aligned(S, kGCRegionChunkSize, kGCRegionChunkSize);
+            if (mem == nullptr)
+            {
+                throw std::bad_alloc();
+            }
+
+            chunk = std::construct_at(static_cast<GCRegionChunk*>(mem));
+            chunk->next = S->gc.gc_region_chunks;
+            chunk->used = sizeof(GCRegionChunk);
+            chunk->active = true;
+            S->gc.gc_region_chunks = chunk;
+        }
+
+        const size_t offset = align_up(chunk->used);
+        chunk->used = offset + size;
+        return reinterpret_cast<std::byte*>(chunk) + offset;
+    }
+
+    template<typename T>
+    static T* gc_region_allocate_object(State* S, size_t trailing_size)
+    {
+        static_assert(sizeof(T) + sizeof(GCRegionChunk) <= kGCRegionChunkSize, "Object does not fit into a region chunk");
+        assert(sizeof(T) + trailing_size + sizeof(GCRegionChunk) <= kGCRegionChunkSize
+            && "Object does not fit into a region chunk");
+
+        auto* obj = std::construct_at(static_cast<T*>(gc_region_bump(S, sizeof(T) + trailing_size, alignof(T))));
+
+        obj->type = T::kObjectType;
+        obj->color = GCColor::kBlack;
+        obj->in_region = true;
+        obj->in_arena = true;
+
+        S->gc.gc_region_objects.append(obj);
+
+        return obj;
+    }
+
+    // Region objects are released together with their chunk, a promoted object keeps its chunk alive instead.
+    // trailing_size must match the size the object was allocated with.
+    template<typename T>
+    static void gc_free_object(State* S, T* obj, size_t trailing_size = 0)
+    {
+        if (!obj->in_arena)
+        {
+            std::destroy_at(obj);
+            mem_free(S, obj, sizeof(T) + trailing_size);
+            return;
+        }
+
+        GCRegionChunk* chunk = gc_region_chunk_of(obj);
+        const bool promoted = !obj->in_region;
+        std::destroy_at(obj);
+
+        if (promoted && --chunk->live_objects == 0 && !chunk->active)
+        {
+            mem_free_aligned(S, chunk, kGCRegionChunkSize);
+        }
+    }
+
+    // trailing_size bytes are allocated right behind the object for variable sized data.
     template<typename T>
-    static T* gc_allocate_object(State* S)
+    static T* gc_allocate_object(State* S, size_t trailing_size = 0)
     {
-        auto* obj = mem_create<T>(S);
+        if (S->gc.gc_region_depth > 0)
+        {
+            return gc_region_allocate_object<T>(S, trailing_size);
+        }
+
+        auto* obj = std::construct_at(static_cast<T*>(mem_alloc(S, sizeof(T) + trailing_size)));
 
         obj->type = T::kObjectType;
         obj->next = nullptr;
@@ -151,9 +240,11 @@ namespace behl
 
     GCTable* gc_new_table(State* S, size_t initial_array_capacity, size_t initial_hash_capacity)
     {
+        AllocTypeScope alloc_scope(S, "table");
+
         GCTable* new_obj = nullptr;
 
-        if (!S->gc.gc_table_pool.empty())
+        if (S->gc.gc_region_depth == 0 && !S->gc.gc_table_pool.empty())
         {
             S->gc.gc_pool_hits++;
 
@@ -187,6 +278,8 @@ namespace behl
 
     static GCString* gc_new_string_impl(State* S, const std::initializer_list<std::string_view>& str)
     {
+        AllocTypeScope alloc_scope(S, "string");
+
         size_t total_size_required = 0;
         for (auto& s : str)
         {
@@ -195,7 +288,7 @@ namespace behl
 
         GCString* new_obj = nullptr;
 
-        if (!S->gc.gc_string_pool.empty())
+        if (S->gc.gc_region_depth == 0 && !S->gc.gc_string_pool.empty())
         {
             GCString* best_fit = nullptr;
             size_t smallest_capacity_distance = std::numeric_limits<size_t>::max();
@@ -331,6 +424,8 @@ namespace behl
 
     UserdataData* gc_new_userdata(State* S, size_t size)
     {
+        AllocTypeScope alloc_scope(S, "userdata");
+
         auto* new_obj = gc_allocate_object<UserdataData>(S);
         new_obj->size = size;
         new_obj->metatable = nullptr;
@@ -351,13 +446,23 @@ namespace behl
 
     GCClosure* gc_new_closure(State* S, GCProto* proto_owner)
     {
+        AllocTypeScope alloc_scope(S, "closure");
+
+        const auto upvalue_count = static_cast<uint32_t>(proto_owner ? proto_owner->upvalue_names.size() : 0);
+
         GCClosure* new_obj = nullptr;
 
-        if (!S->gc.gc_closure_pool.empty())
+        // Pooled closures keep their upvalue slots, so only the bucket with exactly as many can be reused.
+        if (S->gc.gc_region_depth == 0 && upvalue_count < kGCClosurePoolBuckets)
+        {
+            new_obj = static_cast<GCClosure*>(S->gc.gc_closure_pools[upvalue_count].pop_front());
+        }
+
+        if (new_obj)
         {
             S->gc.gc_pool_hits++;
+            S->gc.gc_closure_pool_count--;
 
-            new_obj = static_cast<GCClosure*>(S->gc.gc_closure_pool.pop_front());
             S->gc.gc_all_objects.append(new_obj);
 
             assert(new_obj->type == GCType::kClosure);
@@ -367,17 +472,12 @@ namespace behl
         {
             S->gc.gc_pool_misses++;
 
-            new_obj = gc_allocate_object<GCClosure>(S);
-            new_obj->upvalue_indices.init(S, 0);
-        }
-
-        // Check if this proto has upvalues to allocate the vector
-        if (proto_owner && proto_owner->has_upvalues && new_obj->upvalue_indices.capacity() == 0)
-        {
-            new_obj->upvalue_indices.init(S, 0);
+            new_obj = gc_allocate_object<GCClosure>(S, GCClosure::trailing_size(upvalue_count));
+            new_obj->upvalue_capacity = upvalue_count;
         }
 
         new_obj->proto = proto_owner;
+        new_obj->upvalue_count = 0;
 
         gc_log("Created GC Object: {}", gc_object_to_string(new_obj));
 
@@ -386,6 +486,8 @@ namespace behl
 
     GCProto* gc_new_proto(State* S)
     {
+        AllocTypeScope alloc_scope(S, "proto");
+
         auto* new_obj = gc_allocate_object<GCProto>(S);
 
         gc_log("Created GC Object: {}", gc_object_to_string(new_obj));
@@ -411,7 +513,7 @@ namespace behl
                 mem_free(S, str->storage.heap.ptr, str->storage.heap.len);
             }
 
-            mem_destroy(S, str);
+            gc_free_object(S, str);
         }
     }
 
@@ -436,14 +538,14 @@ namespace behl
             table->array.destroy(S);
             table->hash.destroy(S);
 
-            mem_destroy(S, table);
+            gc_free_object(S, table);
         }
     }
 
     static void destroy_closure(State* S, GCClosure* closure, bool poolable)
     {
         // Sort upvalue indices in descending order to process from end to beginning
-        auto& indices = closure->upvalue_indices;
+        const auto indices = closure->upvalues();
         std::sort(indices.begin(), indices.end(), std::greater<uint32_t>());
 
         // Process each upvalue: pop if at end, otherwise add to freelist
@@ -469,7 +571,8 @@ namespace behl
             }
         }
 
-        if (poolable && S->gc.gc_closure_pool.count() >= S->gc.gc_pool_limit)
+        if (poolable
+            && (closure->upvalue_capacity >= kGCClosurePoolBuckets || S->gc.gc_closure_pool_count >= S->gc.gc_pool_limit))
         {
             poolable = false;
         }
@@ -477,14 +580,14 @@ namespace behl
         if (poolable)
         {
             closure->proto = nullptr;
-            closure->upvalue_indices.clear();
+            closure->upvalue_count = 0;
 
-            S->gc.gc_closure_pool.append(closure);
+            S->gc.gc_closure_pools[closure->upvalue_capacity].append(closure);
+            S->gc.gc_closure_pool_count++;
         }
         else
         {
-            closure->upvalue_indices.destroy(S);
-            mem_destroy(S, closure);
+            gc_free_object(S, closure, GCClosure::trailing_size(closure->upvalue_capacity));
         }
     }
 
@@ -494,12 +597,17 @@ namespace behl
         proto->str_constants.destroy(S);
         proto->int_constants.destroy(S);
         proto->fp_constants.destroy(S);
+        proto->table_constants.destroy(S);
+        proto->table_constant_data.destroy(S);
+        proto->switch_tables.destroy(S);
+        proto->switch_data.destroy(S);
         proto->protos.destroy(S);
         proto->upvalue_names.destroy(S);
         proto->line_info.destroy(S);
         proto->column_info.destroy(S);
+        proto->line_table.destroy(S);
 
-        mem_destroy(S, proto);
+        gc_free_object(S, proto);
     }
 
     static void destroy_userdata(State* S, UserdataData* userdata)
@@ -509,17 +617,18 @@ namespace behl
             mem_free(S, userdata->data, userdata->size);
         }
 
-        mem_destroy(S, userdata);
+        gc_free_object(S, userdata);
     }
 
-    static void destroy_object(State* S, GCObject* obj, bool poolable)
+    static void destroy_object_data(State* S, GCObject* obj, bool poolable)
     {
-        gc_log("Destroying: {}", gc_object_to_string(obj));
-
-        S->gc.gc_all_objects.remove(obj);
-
         obj->color = GCColor::kFree;
-        // poolable = false;
+
+        // Pooling an arena object would pin its whole chunk.
+        if (obj->in_arena)
+        {
+            poolable = false;
+        }
 
         switch (obj->type)
         {
@@ -543,6 +652,15 @@ namespace behl
         }
     }
 
+    static void destroy_object(State* S, GCObject* obj, bool poolable)
+    {
+        gc_log("Destroying: {}", gc_object_to_string(obj));
+
+        S->gc.gc_all_objects.remove(obj);
+
+        destroy_object_data(S, obj, poolable);
+    }
+
     // ===== Mark Phase =====
 
     static void mark_gray(State* S, GCObject* obj)
@@ -659,6 +777,10 @@ namespace behl
         {
             mark_gray(S, proto->name);
         }
+        if (proto->shared_closure)
+        {
+            mark_gray(S, proto->shared_closure);
+        }
     }
 
     static void blacken_userdata(State* S, UserdataData* userdata)
@@ -714,6 +836,9 @@ namespace behl
         gc_log("Current debt: {}", S->gc.gc_debt);
         gc_log("Current phase before start: {}", S->gc.gc_phase);
 
+        // The heap is at its largest right before a collection starts.
+        S->gc.gc_peak_bytes = std::max(S->gc.gc_peak_bytes, S->gc.gc_total_bytes);
+
         gc_switch_phase(S, GCPhase::kMark);
         S->gc.gc_gray_list = nullptr; // Clear gray list
         S->gc.gc_finalize_queue.clear();
@@ -901,6 +1026,21 @@ namespace behl
         return work_done;
     }
 
+    // Frees pooled closures until at most limit remain, starting with the largest allocations.
+    static void gc_trim_closure_pools(State* S, size_t limit)
+    {
+        for (size_t capacity = kGCClosurePoolBuckets; capacity > 0 && S->gc.gc_closure_pool_count > limit; --capacity)
+        {
+            auto& pool = S->gc.gc_closure_pools[capacity - 1];
+            while (!pool.empty() && S->gc.gc_closure_pool_count > limit)
+            {
+                GCObject* obj = pool.pop_front();
+                S->gc.gc_closure_pool_count--;
+                destroy_object(S, obj, false);
+            }
+        }
+    }
+
     void gc_update_pool_limits(State* S)
     {
         // Pool limit adjustment strategy:
@@ -941,11 +1081,7 @@ namespace behl
                 destroy_object(S, obj, false);
             }
 
-            while (S->gc.gc_closure_pool.count() > S->gc.gc_pool_limit)
-            {
-                GCObject* obj = S->gc.gc_closure_pool.pop_front();
-                destroy_object(S, obj, false);
-            }
+            gc_trim_closure_pools(S, S->gc.gc_pool_limit);
 
             return;
         }
@@ -1000,17 +1136,112 @@ namespace behl
             destroy_object(S, obj, false);
         }
 
-        while (S->gc.gc_closure_pool.count() > S->gc.gc_pool_limit)
-        {
-            GCObject* obj = S->gc.gc_closure_pool.pop_front();
-            destroy_object(S, obj, false);
-        }
+        gc_trim_closure_pools(S, S->gc.gc_pool_limit);
 
         // Reset counters for next cycle
         S->gc.gc_pool_misses = 0;
         S->gc.gc_pool_hits = 0;
     }
 
+    static void gc_destroy_pools(State* S)
+    {
+        while (!S->gc.gc_table_pool.empty())
+        {
+            GCObject* obj = S->gc.gc_table_pool.pop_front();
+            destroy_object(S, obj, false);
+        }
+
+        while (!S->gc.gc_string_pool.empty())
+        {
+            GCObject* obj = S->gc.gc_string_pool.pop_front();
+            destroy_object(S, obj, false);
+        }
+
+        gc_trim_closure_pools(S, 0);
+    }
+
+    static bool gc_table_hash_has_values(const GCTable* table)
+    {
+        for (const auto& [key, val] : table->hash)
+        {
+            if (!val.is_nil())
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Releases unused table storage. Trailing nils left behind by mass deletion are dropped from the array part.
+    // Assigning nil keeps the hash entry, erasing those and rehashing would break an in-progress next() traversal,
+    // so that is only done when requested explicitly; otherwise only hash parts without any values are released.
+    static void gc_compact_table(State* S, GCTable* table, bool rehash)
+    {
+        size_t array_size = table->array.size();
+        while (array_size > 0 && table->array[array_size - 1].is_nil())
+        {
+            array_size--;
+        }
+        table->array.resize(S, array_size);
+        table->array.shrink_to_fit(S);
+
+        if (rehash)
+        {
+            for (auto it = table->hash.begin(); it != table->hash.end();)
+            {
+                if (it->second.is_nil())
+                {
+                    const Value key = it->first;
+                    ++it;
+                    table->hash.erase(key);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            table->hash.shrink_to_fit(S);
+        }
+        else if (table->hash.capacity() > 0 && !gc_table_hash_has_values(table))
+        {
+            table->hash.destroy(S);
+        }
+    }
+
+    static void gc_compact_tables(State* S, bool rehash)
+    {
+        for (GCObject* obj = S->gc.gc_all_objects.head(); obj; obj = obj->next)
+        {
+            if (obj->type == GCType::kTable)
+            {
+                gc_compact_table(S, static_cast<GCTable*>(obj), rehash);
+            }
+        }
+    }
+
+    static void gc_trim_os_heap()
+    {
+#if defined(__GLIBC__)
+        malloc_trim(0);
+#elif defined(_WIN32)
+        _heapmin();
+#endif
+    }
+
+    static void gc_release_memory(State* S, bool trim_os_heap)
+    {
+        gc_destroy_pools(S);
+        S->gc.gc_finalize_queue.shrink_to_fit(S);
+
+        if (trim_os_heap)
+        {
+            gc_trim_os_heap();
+        }
+
+        // Start tracking the high-water mark from the compacted heap.
+        S->gc.gc_peak_bytes = S->gc.gc_total_bytes;
+    }
+
     static void gc_adjust_threshold(State* S)
     {
         size_t total = S->gc.gc_total_bytes;
@@ -1028,6 +1259,38 @@ namespace behl
         S->gc.gc_debt = static_cast<int64_t>(S->gc.gc_total_bytes) - static_cast<int64_t>(S->gc.gc_threshold);
     }
 
+    // Compacts automatically once the live heap fell well below the high-water mark, e.g. after a load spike.
+    // Native frames may be iterating tables through raw storage, so compaction waits until only script frames are active.
+    static void gc_auto_compact(State* S)
+    {
+        if constexpr (!kGCAutoCompactEnabled)
+        {
+            return;
+        }
+
+        const size_t peak = S->gc.gc_peak_bytes;
+        if (peak < kGCAutoCompactMinPeak || S->gc.gc_total_bytes * kGCAutoCompactRatio > peak)
+        {
+            return;
+        }
+
+        for (const auto& frame : S->call_stack)
+        {
+            if (frame.proto == nullptr)
+            {
+                return;
+            }
+        }
+
+        const size_t bytes_before = S->gc.gc_total_bytes;
+
+        gc_compact_tables(S, false);
+        gc_release_memory(S, true);
+        gc_adjust_threshold(S);
+
+        gc_log("Auto compaction: {} -> {} bytes (peak {})", bytes_before, S->gc.gc_total_bytes, peak);
+    }
+
     static size_t gc_sweep(State* S, size_t work_limit)
     {
         size_t work_done = 0;
@@ -1114,6 +1377,7 @@ namespace behl
             gc_switch_phase(S, GCPhase::kIdle);
             gc_adjust_threshold(S);
             gc_update_pool_limits(S);
+            gc_auto_compact(S);
         }
 
         return work_done;
@@ -1151,6 +1415,7 @@ namespace behl
         {
             gc_adjust_threshold(S);
             gc_update_pool_limits(S);
+            gc_auto_compact(S);
         }
     }
 
@@ -1158,8 +1423,8 @@ namespace behl
 
     void gc_step(State* S)
     {
-        // Don't run if GC is paused
-        if (S->gc.gc_paused)
+        // Don't run if GC is paused or a region is active
+        if (S->gc.gc_paused || S->gc.gc_region_depth > 0)
         {
             return;
         }
@@ -1284,29 +1549,14 @@ namespace behl
         S->gc.gc_running = false;
     }
 
-    static void gc_destroy_pools(State* S)
+    void gc_collect(State* S)
     {
-        while (!S->gc.gc_table_pool.empty())
-        {
-            GCObject* obj = S->gc.gc_table_pool.pop_front();
-            destroy_object(S, obj, false);
-        }
-
-        while (!S->gc.gc_string_pool.empty())
-        {
-            GCObject* obj = S->gc.gc_string_pool.pop_front();
-            destroy_object(S, obj, false);
-        }
-
-        while (!S->gc.gc_closure_pool.empty())
+        // Region objects are not traced by the collector, collection resumes once the region ends.
+        if (S->gc.gc_region_depth > 0)
         {
-            GCObject* obj = S->gc.gc_closure_pool.pop_front();
-            destroy_object(S, obj, false);
+            return;
         }
-    }
 
-    void gc_collect(State* S)
-    {
         gc_log("===== FULL COLLECTION STARTED =====");
 
         // Completely reset GC state for a fresh cycle
@@ -1328,11 +1578,262 @@ namespace behl
         gc_log("===== FULL COLLECTION COMPLETE: phase={} =====", static_cast<int>(S->gc.gc_phase));
     }
 
+    void gc_compact(State* S, bool trim_os_heap)
+    {
+        if (S->gc.gc_region_depth > 0)
+        {
+            return;
+        }
+
+        gc_log("===== COMPACTION STARTED =====");
+
+        const size_t bytes_before = S->gc.gc_total_bytes;
+
+        // Collect first so garbage is not compacted, then again to free the keys of dropped nil entries.
+        gc_collect(S);
+        gc_compact_tables(S, true);
+        gc_collect(S);
+        gc_release_memory(S, trim_os_heap);
+        gc_adjust_threshold(S);
+
+        gc_log("===== COMPACTION COMPLETE: {} -> {} bytes =====", bytes_before, S->gc.gc_total_bytes);
+    }
+
+    // ===== Regions =====
+
+    static void region_mark(GCObject* obj, GCObject*& worklist)
+    {
+        // Gray marks region objects found reachable, the collector never sees them while the region is active.
+        if (obj == nullptr || !obj->in_region || obj->color == GCColor::kGray)
+        {
+            return;
+        }
+
+        obj->color = GCColor::kGray;
+        obj->gray_next = worklist;
+        worklist = obj;
+    }
+
+    static void region_mark_value(const Value& val, GCObject*& worklist)
+    {
+        if (val.is_gcobject())
+        {
+            region_mark(val.get_gcobject(), worklist);
+        }
+    }
+
+    static void region_trace_object(State* S, GCObject* obj, GCObject*& worklist)
+    {
+        switch (obj->type)
+        {
+            case GCType::kTable:
+            {
+                auto* table = static_cast<GCTable*>(obj);
+                for (const auto& val : table->array)
+                {
+                    region_mark_value(val, worklist);
+                }
+                for (const auto& [key, val] : table->hash)
+                {
+                    region_mark_value(key, worklist);
+                    region_mark_value(val, worklist);
+                }
+                region_mark(table->metatable, worklist);
+                break;
+            }
+            case GCType::kClosure:
+            {
+                auto* closure = static_cast<GCClosure*>(obj);
+                region_mark(closure->proto, worklist);
+                for (const auto uv_idx : closure->upvalues())
+                {
+                    if (uv_idx < S->upvalues.size() && !S->upvalues[uv_idx].is_open())
+                    {
+                        region_mark_value(S->upvalues[uv_idx].closed_value, worklist);
+                    }
+                }
+                break;
+            }
+            case GCType::kProto:
+            {
+                auto* proto = static_cast<GCProto*>(obj);
+                for (const auto& constant : proto->str_constants)
+                {
+                    region_mark_value(constant, worklist);
+                }
+                for (auto* nested_proto : proto->protos)
+                {
+                    region_mark(nested_proto, worklist);
+                }
+                for (auto* upvalue_name : proto->upvalue_names)
+                {
+                    region_mark(upvalue_name, worklist);
+                }
+                region_mark(proto->source_name, worklist);
+                region_mark(proto->source_path, worklist);
+                region_mark(proto->name, worklist);
+                region_mark(proto->shared_closure, worklist);
+                break;
+            }
+            case GCType::kUserdata:
+                region_mark(static_cast<UserdataData*>(obj)->metatable, worklist);
+                break;
+            case GCType::kString:
+            case GCType::kDead:
+                break;
+        }
+    }
+
+    static bool region_has_finalizer(GCObject* obj)
+    {
+        if (obj->type != GCType::kUserdata)
+        {
+            return false;
+        }
+
+        auto* userdata = static_cast<UserdataData*>(obj);
+        return userdata->metatable != nullptr
+            && metatable_get_method<MetaMethodType::kGC>(Value(userdata)).is_callable();
+    }
+
+    void region_begin(State* S)
+    {
+        if (S->gc.gc_region_depth == 0 && S->gc.gc_phase != GCPhase::kIdle && !S->gc.gc_running)
+        {
+            // Finish the running cycle, the collector stays idle until the region ends.
+            gc_advance_cycles(S);
+        }
+
+        S->gc.gc_region_depth++;
+    }
+
+    void region_end(State* S)
+    {
+        assert(S->gc.gc_region_depth > 0 && "region_end without matching region_begin");
+
+        if (--S->gc.gc_region_depth > 0)
+        {
+            return;
+        }
+
+        GCObject* worklist = nullptr;
+
+        // Objects stored into the outside heap, and userdata that still has to be finalized by the collector.
+        for (GCObject* obj = S->gc.gc_region_objects.head(); obj; obj = obj->next)
+        {
+            if (obj->region_escaped || region_has_finalizer(obj))
+            {
+                region_mark(obj, worklist);
+            }
+        }
+
+        // Same roots as gc_start_cycle.
+        for (auto* path : S->module_paths)
+        {
+            region_mark(path, worklist);
+        }
+        for (auto it = S->module_cache.begin(); it != S->module_cache.end(); ++it)
+        {
+            region_mark(it->first, worklist);
+            region_mark_value(it->second, worklist);
+        }
+        for (auto it = S->metatable_registry.begin(); it != S->metatable_registry.end(); ++it)
+        {
+            region_mark(it->first, worklist);
+            region_mark_value(it->second, worklist);
+        }
+        region_mark_value(S->globals_table, worklist);
+        for (const auto& val : S->stack)
+        {
+            region_mark_value(val, worklist);
+        }
+        for (const auto& val : S->pinned)
+        {
+            region_mark_value(val, worklist);
+        }
+        for (const auto& upvalue : S->upvalues)
+        {
+            if (!upvalue.is_open())
+            {
+                region_mark_value(upvalue.closed_value, worklist);
+            }
+        }
+
+        while (GCObject* obj = worklist)
+        {
+            worklist = obj->gray_next;
+            obj->gray_next = nullptr;
+            region_trace_object(S, obj, worklist);
+        }
+
+        // Promote reachable objects in place, everything else goes away with its chunk.
+        size_t promoted = 0;
+        size_t released = 0;
+        while (GCObject* obj = S->gc.gc_region_objects.pop_front())
+        {
+            if (obj->color == GCColor::kGray)
+            {
+                obj->color = GCColor::kBlack;
+                obj->in_region = false;
+                obj->region_escaped = false;
+                gc_region_chunk_of(obj)->live_objects++;
+                S->gc.gc_all_objects.append(obj);
+                promoted++;
+            }
+            else
+            {
+                destroy_object_data(S, obj, false);
+                released++;
+            }
+        }
+
+        GCRegionChunk* chunk = S->gc.gc_region_chunks;
+        S->gc.gc_region_chunks = nullptr;
+        while (chunk != nullptr)
+        {
+            GCRegionChunk* next = chunk->next;
+            chunk->next = nullptr;
+            chunk->active = false;
+            if (chunk->live_objects == 0)
+            {
+                mem_free_aligned(S, chunk, kGCRegionChunkSize);
+            }
+            chunk = next;
+        }
+
+        gc_log("Region ended: promoted={}, released={}", promoted, released);
+    }
+
+    size_t region_suspend(State* S)
+    {
+        return std::exchange(S->gc.gc_region_depth, 0);
+    }
+
+    void region_resume(State* S, size_t depth)
+    {
+        assert(S->gc.gc_region_depth == 0 && "region_resume inside a region started while suspended");
+        S->gc.gc_region_depth = depth;
+    }
+
     void gc_close(State* S)
     {
         gc_log("===== GC_CLOSE: Final cleanup, destroying all remaining objects =====");
 
         size_t count = 0;
+
+        // An unfinished region, its chunks only hold region objects.
+        while (GCObject* obj = S->gc.gc_region_objects.pop_front())
+        {
+            destroy_object_data(S, obj, false);
+            count++;
+        }
+        while (GCRegionChunk* chunk = S->gc.gc_region_chunks)
+        {
+            S->gc.gc_region_chunks = chunk->next;
+            mem_free_aligned(S, chunk, kGCRegionChunkSize);
+        }
+        S->gc.gc_region_depth = 0;
+
         while (GCObject* obj = S->gc.gc_all_objects.head())
         {
             destroy_object(S, obj, false);
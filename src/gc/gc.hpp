@@ -21,6 +21,11 @@ namespace behl
     void gc_init(State* S);
     BEHL_API void gc_collect(State* S);
     BEHL_API void gc_step(State* S);
+    BEHL_API void gc_compact(State* S, bool trim_os_heap);
+    BEHL_API void region_begin(State* S);
+    BEHL_API void region_end(State* S);
+    size_t region_suspend(State* S);
+    void region_resume(State* S, size_t depth);
     void gc_close(State* S);
     void gc_pause(State* S);
     bool gc_is_paused(State* S);
@@ -66,4 +71,24 @@ namespace behl
         bool paused_ = true;
     };
 
+    // Objects created while the guard is alive go to the regular heap even inside a region, for objects that are
+    // stored into the outside heap without passing a region barrier.
+    struct GCRegionSuspendGuard
+    {
+        explicit GCRegionSuspendGuard(State* S)
+            : S_(S)
+            , depth_(region_suspend(S))
+        {
+        }
+
+        ~GCRegionSuspendGuard()
+        {
+            region_resume(S_, depth_);
+        }
+
+    private:
+        State* S_;
+        size_t depth_;
+    };
+
 } // namespace behl
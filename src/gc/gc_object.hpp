@@ -9,6 +9,9 @@ namespace behl
     {
         GCType type{};
         GCColor color{};
+        bool in_region{};      // Allocated inside the active region, not tracked by gc_all_objects yet
+        bool in_arena{};       // Memory belongs to a region chunk, also true after promotion
+        bool region_escaped{}; // Reachable from outside the region, promoted at region_end
 
         GCObject* next{};
         GCObject* prev{};
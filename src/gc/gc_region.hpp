@@ -0,0 +1,44 @@
+#pragma once
+
+#include "gc_object.hpp"
+#include "platform.hpp"
+#include "state.hpp"
+#include "vm/value.hpp"
+
+namespace behl
+{
+    // Store barrier for region allocation. A region object written into an object that lives outside the
+    // region escapes it and has to be promoted at region_end. Writes between region objects are traced
+    // at region_end instead, and the stack, upvalues, pinned values and registries are scanned as roots.
+    BEHL_FORCEINLINE
+    void gc_region_barrier(State* S, const GCObject* container, const Value& val)
+    {
+        if (S->gc.gc_region_depth == 0) [[likely]]
+        {
+            return;
+        }
+
+        if (container->in_region || !val.is_gcobject())
+        {
+            return;
+        }
+
+        if (GCObject* obj = val.get_gcobject(); obj && obj->in_region)
+        {
+            obj->region_escaped = true;
+        }
+    }
+
+    BEHL_FORCEINLINE
+    void gc_region_barrier(State* S, const GCObject* container, const Value& key, const Value& val)
+    {
+        if (S->gc.gc_region_depth == 0) [[likely]]
+        {
+            return;
+        }
+
+        gc_region_barrier(S, container, key);
+        gc_region_barrier(S, container, val);
+    }
+
+} // namespace behl
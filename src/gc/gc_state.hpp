@@ -14,6 +14,15 @@ namespace behl
     struct GCProto;
     struct Proto;
 
+    // Header of a region arena chunk, objects are bump-allocated after it.
+    struct GCRegionChunk
+    {
+        GCRegionChunk* next{};
+        size_t used{};           // Bytes in use, including this header
+        size_t live_objects{};   // Promoted objects that still live in the chunk
+        bool active{};           // Still owned by the running region
+    };
+
     struct GCState
     {
         GCPhase gc_phase{};
@@ -22,18 +31,23 @@ namespace behl
         GCList gc_all_objects;
         GCList gc_table_pool;
         GCList gc_string_pool;
-        GCList gc_closure_pool;
+        GCList gc_closure_pools[kGCClosurePoolBuckets]; // Indexed by upvalue capacity
+        size_t gc_closure_pool_count = 0;              // Closures across all buckets, bounded by gc_pool_limit
         size_t gc_pool_misses = 0;
         size_t gc_pool_hits = 0;
         size_t gc_pool_limit = kGCMinimumPoolLimit;
         size_t gc_threshold = kGCInitialThreshold;
         size_t gc_step_size = kGCStepSize;
         size_t gc_total_bytes = 0;
+        size_t gc_peak_bytes = 0; // High-water mark since the last compaction
         GCObject* gc_work_current{};
         GCObject* gc_gray_list{};
         Vector<UserdataData*> gc_finalize_queue;
         size_t gc_delay_counter{};
         int64_t gc_debt = 0;
+        size_t gc_region_depth = 0;
+        GCList gc_region_objects;
+        GCRegionChunk* gc_region_chunks{};
     };
 
 } // namespace behl
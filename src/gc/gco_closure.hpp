@@ -1,20 +1,64 @@
 #pragma once
 
 #include "gc_object.hpp"
-#include "vm/upvalue.hpp"
 
-#include <vector>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <span>
 
 namespace behl
 {
     struct GCProto;
 
+    // The indices into State::upvalues of the captured variables follow the closure in the same allocation, sized
+    // for the upvalues of its proto.
     struct GCClosure : GCObject
     {
         static constexpr auto kObjectType = GCType::kClosure;
 
         GCProto* proto{};
-        UpvalueIndexVector upvalue_indices{};
+        uint32_t upvalue_count{};
+        uint32_t upvalue_capacity{}; // Slots allocated behind the closure, fixed for the lifetime of the allocation
+
+        static constexpr size_t trailing_size(size_t capacity) noexcept
+        {
+            return capacity * sizeof(uint32_t);
+        }
+
+        uint32_t upvalue_index(size_t i) const noexcept
+        {
+            assert(i < upvalue_count && "GCClosure::upvalue_index: upvalue index out of bounds");
+            return upvalue_indices()[i];
+        }
+
+        void push_upvalue_index(uint32_t index) noexcept
+        {
+            assert(upvalue_count < upvalue_capacity && "GCClosure::push_upvalue_index: closure is full");
+            upvalue_indices()[upvalue_count++] = index;
+        }
+
+        std::span<uint32_t> upvalues() noexcept
+        {
+            return { upvalue_indices(), upvalue_count };
+        }
+
+        std::span<const uint32_t> upvalues() const noexcept
+        {
+            return { upvalue_indices(), upvalue_count };
+        }
+
+    private:
+        uint32_t* upvalue_indices() noexcept
+        {
+            return reinterpret_cast<uint32_t*>(this + 1);
+        }
+
+        const uint32_t* upvalue_indices() const noexcept
+        {
+            return reinterpret_cast<const uint32_t*>(this + 1);
+        }
     };
+    static_assert(sizeof(GCClosure) % alignof(uint32_t) == 0);
 
 } // namespace behl
@@ -4,6 +4,7 @@
 #include "gc_object.hpp"
 #include "gco_string.hpp"
 #include "vm/bytecode.hpp"
+#include "vm/line_table.hpp"
 #include "vm/value.hpp"
 
 #include <cstdint>
@@ -13,6 +14,8 @@
 
 namespace behl
 {
+    struct GCClosure;
+    struct LazyFunction;
 
     struct GCProto : GCObject
     {
@@ -22,17 +25,32 @@ namespace behl
         Vector<Value> str_constants;
         Vector<Value> int_constants;
         Vector<Value> fp_constants;
+        // Tables built by kOpNewTableK, each starts at its offset into table_constant_data with the array size and
+        // the number of keyed entries, followed by the array values and then a key and a value per keyed entry.
+        // Every value is an entry made by make_table_constant_entry() referring to the constant pools above.
+        Vector<uint32_t> table_constants;
+        Vector<uint32_t> table_constant_data;
+        // Jump tables of kOpSwitch, each starts at its offset into switch_data, see SwitchKind for the layout.
+        Vector<uint32_t> switch_tables;
+        Vector<uint32_t> switch_data;
         Vector<GCProto*> protos;
         Vector<GCString*> upvalue_names;
+        // Position of every instruction while the function is generated and optimized, the finished function
+        // keeps them encoded in line_table and frees these.
         Vector<int> line_info;
         Vector<int> column_info;
+        LineTable line_table;
         GCString* source_name;
         GCString* source_path; // Absolute path to source file for module resolution
         GCString* name;        // Function name for debugging
+        // Returned by every kOpClosure of a function without upvalues, created by the first one.
+        GCClosure* shared_closure{};
         uint32_t num_params{};
         uint32_t max_stack_size{};
         bool is_vararg{};
         bool has_upvalues{}; // True if function or any nested function uses upvalues
+        std::shared_ptr<const void> backing;      // Keeps external storage of code and line tables alive (mapped bytecode)
+        std::shared_ptr<const LazyFunction> lazy; // Set until the function is compiled on its first call
     };
 
 } // namespace behl
@@ -258,19 +258,18 @@ namespace behl
             return 1;
         }
 
-        // Load module file
-        std::ifstream file(resolved_path);
-        if (!file.is_open())
+        // Compile the module, possibly from the compiled module cache
+        if (!load_module(S, resolved_path))
         {
-            error(S, behl::format("Failed to open module file: {}", resolved_path));
+            // The memoized location may be stale, resolve once more before giving up.
+            forget_module_path(S, module_name, importing_file);
+            resolved_path = resolve_module_path(S, module_name, importing_file);
+            if (!load_module(S, resolved_path))
+            {
+                error(S, behl::format("Failed to open module file: {}", resolved_path));
+            }
         }
 
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        std::string source = buffer.str();
-
-        // Compile and execute module using load_buffer
-        load_buffer(S, source, resolved_path, true);
         call(S, 0, 1);
 
         // Top of stack should be the module exports (or nil for non-modules)
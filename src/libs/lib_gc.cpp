@@ -18,6 +18,13 @@ namespace behl
         return 0;
     }
 
+    static int gc_compact_fn(State* S)
+    {
+        const bool trim_os_heap = get_top(S) < 1 || to_boolean(S, 0);
+        gc_compact(S, trim_os_heap);
+        return 0;
+    }
+
     static int gc_count_fn(State* S)
     {
         size_t count = 0;
@@ -85,6 +92,7 @@ namespace behl
         static constexpr ModuleReg gc_funcs[] = {
             { "collect", gc_collect_fn },
             { "step", gc_step_fn },
+            { "compact", gc_compact_fn },
             { "count", gc_count_fn },
             { "countall", gc_countall_fn },
             { "countfree", gc_countfree_fn },
@@ -1,11 +1,16 @@
 #include "memory.hpp"
 
+#include "profiler.hpp"
 #include "state.hpp"
 
 #include <cassert>
 #include <cstddef>
 #include <cstdlib>
 
+#ifdef _WIN32
+#    include <malloc.h>
+#endif
+
 namespace behl
 {
     static constexpr size_t kMemoryLimitBytes = ((1024u * 1024u) * 1024u) * 2; // 2 GB
@@ -44,6 +49,7 @@ namespace behl
         if (ptr)
         {
             adjust_gc_bytes(S, static_cast<ptrdiff_t>(size));
+            profiler_track_allocation(S, size);
         }
         return ptr;
     }
@@ -64,6 +70,10 @@ namespace behl
         if (new_ptr || new_size == 0)
         {
             adjust_gc_bytes(S, delta);
+            if (delta > 0)
+            {
+                profiler_track_allocation(S, static_cast<size_t>(delta));
+            }
         }
 
         return new_ptr;
@@ -80,4 +90,39 @@ namespace behl
         }
     }
 
+    void* mem_alloc_aligned(State* S, size_t size, size_t alignment)
+    {
+        assert(S != nullptr);
+        assert((alignment & (alignment - 1)) == 0 && size % alignment == 0);
+
+        check_memory_limit(S, static_cast<ptrdiff_t>(size));
+
+#ifdef _WIN32
+        void* ptr = _aligned_malloc(size, alignment);
+#else
+        void* ptr = std::aligned_alloc(alignment, size);
+#endif
+        if (ptr)
+        {
+            adjust_gc_bytes(S, static_cast<ptrdiff_t>(size));
+            profiler_track_allocation(S, size);
+        }
+        return ptr;
+    }
+
+    void mem_free_aligned(State* S, void* ptr, size_t size)
+    {
+        assert(S != nullptr);
+
+        if (ptr)
+        {
+#ifdef _WIN32
+            _aligned_free(ptr);
+#else
+            std::free(ptr);
+#endif
+            adjust_gc_bytes(S, -static_cast<ptrdiff_t>(size));
+        }
+    }
+
 } // namespace behl
@@ -32,6 +32,11 @@ namespace behl
 
     BEHL_API void mem_free(State* S, void* ptr, size_t size);
 
+    // Alignment must be a power of two and size a multiple of it.
+    void* mem_alloc_aligned(State* S, size_t size, size_t alignment);
+
+    void mem_free_aligned(State* S, void* ptr, size_t size);
+
     template<typename T>
     void mem_free_array(State* S, void* ptr, size_t count)
     {
@@ -1,18 +1,35 @@
 #include "modules.hpp"
 
+#include "backend/bytecode_file.hpp"
 #include "behl.hpp"
 #include "common/format.hpp"
+#include "common/mapped_file.hpp"
 #include "common/print.hpp"
+#include "config_internal.hpp"
+#include "frontend/lexer.hpp"
+#include "gc/gc.hpp"
+#include "gc/gco_closure.hpp"
 #include "state.hpp"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <behl/exceptions.hpp>
+#include <cassert>
+#include <cstring>
 #include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
 
 namespace behl
 {
 
-    std::string resolve_module_path(State* S, std::string_view module_name, std::string_view importing_file)
+    static std::string resolve_module_path_uncached(State* S, std::string_view module_name, std::string_view importing_file)
     {
         std::string filename{ module_name };
 
@@ -121,4 +138,338 @@ namespace behl
         return std::string(); // Not found
     }
 
+    static std::string module_path_memo_key(std::string_view module_name, std::string_view importing_file)
+    {
+        std::string key(importing_file);
+        key.push_back('\0');
+        key.append(module_name);
+        return key;
+    }
+
+    std::string resolve_module_path(State* S, std::string_view module_name, std::string_view importing_file)
+    {
+        // Resolution probes the file system several times, remember successful results for the lifetime of the state.
+        auto key = module_path_memo_key(module_name, importing_file);
+        if (auto it = S->module_path_memo.find(key); it != S->module_path_memo.end())
+        {
+            return it->second;
+        }
+
+        auto resolved = resolve_module_path_uncached(S, module_name, importing_file);
+        if (!resolved.empty())
+        {
+            S->module_path_memo.emplace(std::move(key), resolved);
+        }
+        return resolved;
+    }
+
+    void forget_module_path(State* S, std::string_view module_name, std::string_view importing_file)
+    {
+        S->module_path_memo.erase(module_path_memo_key(module_name, importing_file));
+    }
+
+    // Compiled module cache
+    //
+    // Every module gets one entry named after the hash of its absolute path. An entry starts with a ModuleCacheHeader
+    // followed by the module path, padded to 8 bytes, and the bytecode image produced by dump().
+    struct ModuleCacheHeader
+    {
+        std::array<char, 4> signature;
+        uint32_t cache_version;
+        uint32_t compiler_version;
+        uint32_t path_size;
+        uint64_t source_size;
+        int64_t source_mtime;
+        uint64_t source_hash;
+    };
+    static_assert(sizeof(ModuleCacheHeader) == 40);
+
+    static constexpr std::array<char, 4> kModuleCacheSignature = { 'B', 'H', 'M', 'C' };
+    static constexpr uint32_t kModuleCacheVersion = 1;
+
+    static size_t module_cache_image_offset(size_t path_size)
+    {
+        // The bytecode image keeps its arrays aligned relative to its own start.
+        return (sizeof(ModuleCacheHeader) + path_size + 7) & ~size_t(7);
+    }
+
+    static bool load_cached_module(State* S, const std::filesystem::path& entry, const ModuleCacheHeader& expected,
+        std::string_view resolved_path)
+    {
+        auto file = MappedFile::open(entry.string());
+        if (!file || file->size() < sizeof(ModuleCacheHeader))
+        {
+            return false;
+        }
+
+        ModuleCacheHeader header;
+        std::memcpy(&header, file->data(), sizeof(header));
+        if (header.signature != expected.signature || header.cache_version != expected.cache_version
+            || header.compiler_version != expected.compiler_version || header.path_size != expected.path_size
+            || header.source_size != expected.source_size || header.source_mtime != expected.source_mtime
+            || header.source_hash != expected.source_hash)
+        {
+            return false;
+        }
+
+        const size_t image_offset = module_cache_image_offset(header.path_size);
+        if (image_offset > file->size())
+        {
+            return false;
+        }
+
+        const auto* data = reinterpret_cast<const char*>(file->data());
+        if (std::string_view(data + sizeof(header), header.path_size) != resolved_path)
+        {
+            return false; // Hash collision with another module
+        }
+
+        GCPauseGuard gc_pause(S);
+
+        GCProto* proto = nullptr;
+        try
+        {
+            const std::string_view image(data + image_offset, file->size() - image_offset);
+            proto = read_bytecode(S, image, file, resolved_path);
+        }
+        catch (const RuntimeError&)
+        {
+            return false; // Damaged entry, rebuilt by the caller
+        }
+
+        auto* closure = gc_new_closure(S, proto);
+        S->stack.push_back(S, Value(closure));
+        return true;
+    }
+
+    static void append_chunk(State*, std::string_view chunk, void* userdata)
+    {
+        static_cast<std::string*>(userdata)->append(chunk);
+    }
+
+    // Writes the function at the top of the stack to the cache. Failures are ignored, the cache is only an accelerator.
+    static void store_cached_module(
+        State* S, const std::filesystem::path& entry, const ModuleCacheHeader& header, std::string_view resolved_path)
+    {
+        std::string data(reinterpret_cast<const char*>(&header), sizeof(header));
+        data.append(resolved_path);
+        data.resize(module_cache_image_offset(resolved_path.size()), '\0');
+        dump(S, append_chunk, &data);
+
+        std::error_code ec;
+        std::filesystem::create_directories(entry.parent_path(), ec);
+
+        // Written under a unique name and renamed into place, so concurrent readers never observe a partial entry
+        // and states that still map the previous entry keep their own copy of it.
+        auto temp_path = entry;
+        temp_path += behl::format(".{}.tmp", std::random_device{}());
+        {
+            std::ofstream out(temp_path, std::ios::binary);
+            if (!out || !out.write(data.data(), static_cast<std::streamsize>(data.size())))
+            {
+                out.close();
+                std::filesystem::remove(temp_path, ec);
+                return;
+            }
+        }
+
+        std::filesystem::rename(temp_path, entry, ec);
+        if (ec)
+        {
+            std::filesystem::remove(temp_path, ec);
+        }
+    }
+
+    bool load_module(State* S, const std::string& resolved_path)
+    {
+        if (auto it = S->preloaded_modules.find(resolved_path); it != S->preloaded_modules.end())
+        {
+            const auto script = std::move(it->second);
+            S->preloaded_modules.erase(it);
+            load_compiled(S, script);
+            return true;
+        }
+
+        std::ifstream file(resolved_path);
+        if (!file.is_open())
+        {
+            return false;
+        }
+
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        const std::string source = buffer.str();
+
+        if (S->module_cache_dir.empty())
+        {
+            load_buffer(S, source, resolved_path);
+            return true;
+        }
+
+        std::error_code ec;
+        const auto mtime = std::filesystem::last_write_time(resolved_path, ec);
+
+        ModuleCacheHeader header{};
+        header.signature = kModuleCacheSignature;
+        header.cache_version = kModuleCacheVersion;
+        header.compiler_version = (static_cast<uint32_t>(kBytecodeFormatVersion) << 16) | kCompilerVersion;
+        header.path_size = static_cast<uint32_t>(resolved_path.size());
+        header.source_size = source.size();
+        header.source_mtime = ec ? 0 : static_cast<int64_t>(mtime.time_since_epoch().count());
+        header.source_hash = fnv1a_64(source);
+
+        const auto entry = std::filesystem::path(S->module_cache_dir) / behl::format("{:016x}.behlc", fnv1a_64(resolved_path));
+        if (load_cached_module(S, entry, header, resolved_path))
+        {
+            return true;
+        }
+
+        load_buffer(S, source, resolved_path);
+        store_cached_module(S, entry, header, resolved_path);
+        return true;
+    }
+
+    // Module preloading
+    //
+    // The import graph is discovered breadth first, every level is read and scanned in parallel while the calling
+    // thread resolves the names it found. All modules are then compiled in one parallel batch, each in a scratch state.
+    struct PreloadModule
+    {
+        std::string path;
+        std::string source;
+        std::vector<std::string> imports;
+        std::shared_ptr<const CompiledScript> script; // Null when the module does not compile
+        bool readable = false;
+    };
+
+    // Runs task(i) for every i below count on the calling thread and up to threads - 1 additional threads.
+    template<typename Task>
+    static void parallel_for(size_t count, size_t threads, const Task& task)
+    {
+        std::atomic<size_t> next{ 0 };
+        const auto worker = [&]() {
+            for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1))
+            {
+                task(i);
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (size_t i = 1; i < std::min(threads, count); ++i)
+        {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto& thread : pool)
+        {
+            thread.join();
+        }
+    }
+
+    static void scan_module(PreloadModule& module)
+    {
+        std::ifstream file(module.path);
+        if (!file.is_open())
+        {
+            return;
+        }
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        module.source = buffer.str();
+        module.readable = true;
+
+        // Errors are left to import(), which reports them the same way as without preloading.
+        State* scratch = new_state();
+        try
+        {
+            const auto tokens = tokenize(scratch, module.source, module.path);
+            for (size_t i = 0; i + 2 < tokens.size(); ++i)
+            {
+                if (tokens[i].type == TokenType::kIdentifier && tokens[i].value == "import"
+                    && tokens[i + 1].type == TokenType::kLParen && tokens[i + 2].type == TokenType::kString
+                    && tokens[i + 2].value.find('\\') == std::string_view::npos)
+                {
+                    module.imports.emplace_back(tokens[i + 2].value);
+                }
+            }
+        }
+        catch (...)
+        {
+        }
+        close(scratch);
+    }
+
+    size_t preload_modules(State* S, std::string_view entry_path, size_t threads)
+    {
+        assert(S != nullptr && "State can not be null");
+
+        if (threads == 0)
+        {
+            threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+        }
+
+        // The entry script is only scanned, it is loaded by the host.
+        std::vector<PreloadModule> modules(1);
+        modules[0].path = std::string(entry_path);
+        std::unordered_set<std::string> seen;
+
+        for (size_t level_begin = 0; level_begin < modules.size();)
+        {
+            const size_t level_end = modules.size();
+            parallel_for(level_end - level_begin, threads, [&modules, level_begin](size_t i) {
+                scan_module(modules[level_begin + i]);
+            });
+
+            for (size_t m = level_begin; m < level_end; ++m)
+            {
+                const auto importer = modules[m].path;
+                const auto imports = std::move(modules[m].imports);
+                for (const auto& name : imports)
+                {
+                    if (S->module_cache.find(name) != S->module_cache.end())
+                    {
+                        continue; // Built-in module
+                    }
+
+                    auto resolved = resolve_module_path(S, name, importer);
+                    if (resolved.empty() || S->module_cache.find(resolved) != S->module_cache.end()
+                        || S->preloaded_modules.contains(resolved) || !seen.insert(resolved).second)
+                    {
+                        continue;
+                    }
+                    modules.emplace_back().path = std::move(resolved);
+                }
+            }
+            level_begin = level_end;
+        }
+
+        parallel_for(modules.size() - 1, threads, [&modules](size_t i) {
+            auto& module = modules[i + 1];
+            if (!module.readable)
+            {
+                return;
+            }
+            try
+            {
+                module.script = compile_shared(module.source, module.path);
+            }
+            catch (...)
+            {
+                module.script = nullptr;
+            }
+            module.source = {};
+        });
+
+        size_t preloaded = 0;
+        for (auto& module : modules)
+        {
+            if (module.script)
+            {
+                S->preloaded_modules.insert_or_assign(module.path, std::move(module.script));
+                ++preloaded;
+            }
+        }
+        return preloaded;
+    }
+
 } // namespace behl
@@ -11,4 +11,11 @@ namespace behl
 
     std::string resolve_module_path(State* S, std::string_view module_name, std::string_view importing_file);
 
+    // Drops the memoized resolution of module_name, used when the resolved file disappeared.
+    void forget_module_path(State* S, std::string_view module_name, std::string_view importing_file);
+
+    // Compiles the module at resolved_path and pushes its main function onto the stack. Uses the compiled module
+    // cache when one is configured. Returns false if the source file can not be read.
+    bool load_module(State* S, const std::string& resolved_path);
+
 } // namespace behl
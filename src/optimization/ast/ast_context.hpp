@@ -2,6 +2,10 @@
 
 #include "ast/ast.hpp"
 #include "ast/ast_holder.hpp"
+#include "ast/ast_transformer.hpp"
+
+#include <behl/types.hpp>
+#include <vector>
 
 namespace behl
 {
@@ -10,10 +14,20 @@ namespace behl
     {
         AstHolder& holder;
         AstProgram* program;
+        OptLevel level;
+        std::vector<OptimizationPassStats>* report;
+
+        // Maintained by the pipeline, see OptimizationPipeline.
+        uint32_t step = 0;
+        uint32_t revisit_from = 0;
+        bool changed_outside_functions = false;
 
-        AstOptimizationContext(AstHolder& h, AstProgram* p)
+        AstOptimizationContext(
+            AstHolder& h, AstProgram* p, OptLevel lvl = OptLevel::kO2, std::vector<OptimizationPassStats>* r = nullptr)
             : holder(h)
             , program(p)
+            , level(lvl)
+            , report(r)
         {
         }
 
@@ -21,6 +35,20 @@ namespace behl
         {
             return program;
         }
+
+        // Runs a transformer over the program, skipping function bodies unchanged since the pass last ran.
+        bool transform_program(AstTransformer& transformer)
+        {
+            transformer.set_change_tracking(step, revisit_from);
+
+            if (program->block)
+            {
+                transformer.transform_block(program->block);
+            }
+
+            changed_outside_functions = transformer.has_changed_outside_functions();
+            return transformer.has_changed();
+        }
     };
 
 } // namespace behl
@@ -0,0 +1,170 @@
+#include "common_subexpression_elimination.hpp"
+
+#include "common/print.hpp"
+#include "common/vector.hpp"
+#include "config_internal.hpp"
+#include "pure_expressions.hpp"
+
+namespace behl
+{
+    // Every shared expression occupies a register for the rest of the enclosing block
+    static constexpr size_t kMaxSharedPerStatement = 4;
+    static constexpr size_t kMaxSharedPerFunction = 16;
+
+    // Statements that evaluate all of their expressions before anything else happens, a local declared in front of
+    // them sees the same values.
+    static bool is_simple_statement(const AstNode* stat)
+    {
+        switch (stat->type)
+        {
+            case AstNodeType::kLocalDecl:
+            case AstNodeType::kAssign:
+            case AstNodeType::kAssignLocal:
+            case AstNodeType::kAssignGlobal:
+            case AstNodeType::kAssignUpvalue:
+            case AstNodeType::kCompoundAssign:
+            case AstNodeType::kCompoundLocal:
+            case AstNodeType::kCompoundGlobal:
+            case AstNodeType::kCompoundUpvalue:
+            case AstNodeType::kReturn:
+            case AstNodeType::kExprStat:
+            case AstNodeType::kIf:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static bool names_local(AstNode* node)
+    {
+        if (node->is(AstNodeType::kIdent))
+        {
+            return true;
+        }
+        bool found = false;
+        for_each_subexpression(node, [&](AstNode*& child) { found = found || names_local(child); });
+        return found;
+    }
+
+    static void collect_candidates(const LocalFacts& facts, AstNode*& slot, AutoVector<AstNode**>& candidates)
+    {
+        switch (slot->type)
+        {
+            case AstNodeType::kNil:
+            case AstNodeType::kBool:
+            case AstNodeType::kInteger:
+            case AstNodeType::kFP:
+            case AstNodeType::kString:
+            case AstNodeType::kIdent:
+                return;
+            default:
+                break;
+        }
+        if (is_pure_expression(facts, slot) && names_local(slot))
+        {
+            candidates.push_back(&slot);
+        }
+        for_each_subexpression(slot, [&](AstNode*& child) { collect_candidates(facts, child, candidates); });
+    }
+
+    // Picks the largest expression occurring more than once, returns its index or SIZE_MAX.
+    static size_t find_repeated(const AutoVector<AstNode**>& candidates)
+    {
+        size_t best = SIZE_MAX;
+        size_t best_size = 0;
+        for (size_t i = 0; i < candidates.size(); ++i)
+        {
+            const size_t size = expression_size(*candidates[i]);
+            if (size <= best_size)
+            {
+                continue;
+            }
+            for (size_t j = i + 1; j < candidates.size(); ++j)
+            {
+                if (same_expression(*candidates[i], *candidates[j]))
+                {
+                    best = i;
+                    best_size = size;
+                    break;
+                }
+            }
+        }
+        return best;
+    }
+
+    static size_t eliminate_in_function(AstOptimizationContext& context, const FunctionBody& function, size_t& next_temp)
+    {
+        State* vm_state = context.holder.state();
+        LocalFacts facts(vm_state);
+        collect_local_facts(vm_state, function, context.program->is_module, facts);
+
+        AutoVector<AstBlock*> blocks(vm_state);
+        collect_blocks(function.block, blocks);
+
+        size_t shared = 0;
+        AutoVector<AstNode**> candidates(vm_state);
+        for (AstBlock* block : blocks)
+        {
+            for (AstNode** link = &block->first_stat; *link; link = &(*link)->next_child)
+            {
+                AstNode* stat = *link;
+                if (!is_simple_statement(stat))
+                {
+                    continue;
+                }
+
+                for (size_t round = 0; round < kMaxSharedPerStatement && shared < kMaxSharedPerFunction; ++round)
+                {
+                    candidates.clear();
+                    for_each_statement_expression(
+                        stat, [&](AstNode*& expr) { collect_candidates(facts, expr, candidates); });
+                    const size_t best = find_repeated(candidates);
+                    if (best == SIZE_MAX)
+                    {
+                        break;
+                    }
+
+                    // Occurrences never nest, an expression can not contain a copy of itself
+                    const AstString* name = make_temporary_name(context.holder, "cse", context.step, next_temp++);
+                    AstNode* value = *candidates[best];
+                    for (size_t i = best + 1; i < candidates.size(); ++i)
+                    {
+                        if (same_expression(value, *candidates[i]))
+                        {
+                            replace_with_local(context.holder, *candidates[i], name);
+                        }
+                    }
+                    replace_with_local(context.holder, *candidates[best], name);
+                    link = insert_local(context.holder, link, name, value);
+                    shared++;
+                }
+            }
+        }
+
+        return shared;
+    }
+
+    bool CommonSubexpressionEliminationPass::apply(AstOptimizationContext& context)
+    {
+        AutoVector<FunctionBody> functions(context.holder.state());
+        collect_functions(context.program, functions);
+
+        size_t shared = 0;
+        size_t next_temp = 0;
+        for (const FunctionBody& function : functions)
+        {
+            shared += eliminate_in_function(context, function, next_temp);
+        }
+
+        if constexpr (kOptimizationPassDebug)
+        {
+            if (shared > 0)
+            {
+                println("    Shared {} common subexpressions", shared);
+            }
+        }
+
+        return shared > 0;
+    }
+
+} // namespace behl
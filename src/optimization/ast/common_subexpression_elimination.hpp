@@ -0,0 +1,19 @@
+#pragma once
+
+#include "ast_context.hpp"
+
+namespace behl
+{
+    // Common subexpression elimination pass
+    // Evaluates a pure expression that occurs several times in one statement once, into a local declared right before
+    // the statement. Uses the same notion of pure expressions as loop invariant code motion.
+    struct CommonSubexpressionEliminationPass
+    {
+        static constexpr std::string_view kName = "CommonSubexpressionElimination";
+        static constexpr OptLevel kMinLevel = OptLevel::kO2;
+        static constexpr bool kTracksChanges = false;
+
+        static bool apply(AstOptimizationContext& context);
+    };
+
+} // namespace behl
@@ -260,11 +260,7 @@ namespace behl
     bool ConstantFoldingPass::apply(AstOptimizationContext& context)
     {
         ConstantFolder folder(context.holder);
-
-        if (context.program->block)
-        {
-            folder.transform_block(context.program->block);
-        }
+        const bool changed = context.transform_program(folder);
 
         if constexpr (kOptimizationPassDebug)
         {
@@ -272,10 +268,10 @@ namespace behl
             {
                 println("    Folded {} constant expressions", folder.get_fold_count());
             }
-            println("    Returning changed = {}", folder.has_changed());
+            println("    Returning changed = {}", changed);
         }
 
-        return folder.has_changed();
+        return changed;
     }
 
 } // namespace behl
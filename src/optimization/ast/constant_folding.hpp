@@ -9,6 +9,8 @@ namespace behl
     struct ConstantFoldingPass
     {
         static constexpr std::string_view kName = "ConstantFolding";
+        static constexpr OptLevel kMinLevel = OptLevel::kO1;
+        static constexpr bool kTracksChanges = true;
 
         static bool apply(AstOptimizationContext& context);
     };
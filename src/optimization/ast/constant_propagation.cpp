@@ -0,0 +1,490 @@
+#include "constant_propagation.hpp"
+
+#include "common/hash_map.hpp"
+#include "common/print.hpp"
+#include "common/vector.hpp"
+#include "config_internal.hpp"
+#include "pure_expressions.hpp"
+
+namespace behl
+{
+    namespace
+    {
+        // Local variable visible at the current point of the walk. A local never assigned after its declaration keeps
+        // the literal it was initialized with.
+        struct Binding
+        {
+            Atom name = kInvalidAtom;
+            const AstNode* value = nullptr;
+        };
+
+        struct PropagationState
+        {
+            AstHolder& holder;
+            bool is_module = false;
+            // The first walk only records how variables are used anywhere in the program, the second one rewrites.
+            bool collecting = true;
+            AutoVector<Binding> bindings;
+            // Names assigned anywhere, locals and globals alike
+            AutoHashMap<Atom, bool, AtomHash> written;
+            size_t propagated = 0;
+
+            PropagationState(AstHolder& h, bool module)
+                : holder(h)
+                , is_module(module)
+                , bindings(h.state())
+                , written(h.state())
+            {
+            }
+        };
+    } // namespace
+
+    static void propagate_block(PropagationState& state, AstBlock* block);
+    static void propagate_statement(PropagationState& state, AstNode* stat);
+    static void propagate_expression(PropagationState& state, AstNode*& expr);
+
+    static bool is_literal(const AstNode* node)
+    {
+        switch (node->type)
+        {
+            case AstNodeType::kNil:
+            case AstNodeType::kBool:
+            case AstNodeType::kInteger:
+            case AstNodeType::kFP:
+            case AstNodeType::kString:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static const Binding* resolve(const PropagationState& state, Atom name)
+    {
+        for (size_t i = state.bindings.size(); i > 0; --i)
+        {
+            if (state.bindings[i - 1].name == name)
+            {
+                return &state.bindings[i - 1];
+            }
+        }
+        return nullptr;
+    }
+
+    static void replace(AstNode*& slot, AstNode* value)
+    {
+        value->line = slot->line;
+        value->column = slot->column;
+        value->next_child = slot->next_child;
+        slot = value;
+    }
+
+    static void declare(PropagationState& state, Atom name, const AstNode* init = nullptr)
+    {
+        Binding binding{ name, nullptr };
+        if (init && !state.collecting && !state.written.contains(name) && is_literal(init))
+        {
+            binding.value = init;
+        }
+        state.bindings.push_back(binding);
+    }
+
+    static void record_write(PropagationState& state, Atom name)
+    {
+        if (state.collecting)
+        {
+            state.written.insert_or_assign(name, true);
+        }
+    }
+
+    // Operand positions where a variable is looked into rather than used as a value.
+    static void propagate_table(PropagationState& state, AstNode*& table)
+    {
+        if (!table->is(AstNodeType::kIdent))
+        {
+            propagate_expression(state, table);
+        }
+    }
+
+    static void propagate_function(
+        PropagationState& state, const AstString* first_param, AstBlock* block, const AstString* self_name, bool is_method)
+    {
+        const size_t mark = state.bindings.size();
+        if (is_method)
+        {
+            declare(state, kAtomSelf);
+        }
+        else if (self_name)
+        {
+            declare(state, self_name->atom);
+        }
+        for (const AstNode* p = first_param; p; p = p->next_child)
+        {
+            declare(state, static_cast<const AstString*>(p)->atom);
+        }
+        propagate_block(state, block);
+        state.bindings.resize(mark);
+    }
+
+    static void propagate_expression(PropagationState& state, AstNode*& expr)
+    {
+        switch (expr->type)
+        {
+            case AstNodeType::kIdent:
+            {
+                const Binding* binding = state.collecting ? nullptr : resolve(state, expr->as<AstIdent>()->name->atom);
+                if (binding && binding->value)
+                {
+                    replace(expr, binding->value->clone(state.holder));
+                    state.propagated++;
+                }
+                break;
+            }
+            case AstNodeType::kMember:
+                propagate_table(state, expr->as<AstMember>()->table);
+                break;
+            case AstNodeType::kIndex:
+                propagate_table(state, expr->as<AstIndex>()->table);
+                propagate_expression(state, expr->as<AstIndex>()->key);
+                break;
+            case AstNodeType::kFuncCall:
+            {
+                auto* call = expr->as<AstFuncCall>();
+                if (auto* member = call->func->try_as<AstMember>())
+                {
+                    propagate_table(state, member->table);
+                }
+                else
+                {
+                    propagate_table(state, call->func);
+                }
+                for (AstNode** arg = &call->first_arg; *arg; arg = &(*arg)->next_child)
+                {
+                    propagate_expression(state, *arg);
+                }
+                break;
+            }
+            case AstNodeType::kFuncDef:
+            {
+                auto* func = expr->as<AstFuncDef>();
+                propagate_function(state, func->first_param, func->block, func->self_name, func->is_method);
+                break;
+            }
+            default:
+                for_each_subexpression(expr, [&](AstNode*& child) { propagate_expression(state, child); });
+                break;
+        }
+    }
+
+    // Assigned variables lose their constant.
+    static void propagate_target(PropagationState& state, AstNode*& target)
+    {
+        if (auto* ident = target->try_as<AstIdent>())
+        {
+            record_write(state, ident->name->atom);
+            return;
+        }
+
+        AstNode** table = nullptr;
+        if (auto* member = target->try_as<AstMember>())
+        {
+            table = &member->table;
+        }
+        else if (auto* index = target->try_as<AstIndex>())
+        {
+            table = &index->table;
+            propagate_expression(state, index->key);
+        }
+        if (!table)
+        {
+            propagate_expression(state, target);
+            return;
+        }
+        propagate_table(state, *table);
+    }
+
+    static void propagate_block(PropagationState& state, AstBlock* block)
+    {
+        if (!block)
+        {
+            return;
+        }
+
+        const size_t mark = state.bindings.size();
+        for (AstNode* stat = block->first_stat; stat; stat = stat->next_child)
+        {
+            propagate_statement(state, stat);
+        }
+        state.bindings.resize(mark);
+    }
+
+    static void propagate_scoped_block(PropagationState& state, AstBlock* block, const AstNode* first_name)
+    {
+        const size_t mark = state.bindings.size();
+        for (const AstNode* name = first_name; name; name = name->next_child)
+        {
+            declare(state, static_cast<const AstString*>(name)->atom);
+        }
+        propagate_block(state, block);
+        state.bindings.resize(mark);
+    }
+
+    static void propagate_function_stat(PropagationState& state, AstFuncDefStat* func)
+    {
+        const AstNode* first = func->first_name_part;
+        const AstString* self_name = nullptr;
+        Atom name = kInvalidAtom;
+        if (first && !first->next_child && !func->is_method)
+        {
+            self_name = static_cast<const AstString*>(first);
+            name = self_name->atom;
+            // Module functions live in the module scope, other functions without let assign a variable
+            if (func->is_local || state.is_module)
+            {
+                declare(state, name);
+            }
+            else
+            {
+                record_write(state, name);
+            }
+        }
+
+        propagate_function(state, func->first_param, func->block, self_name, func->is_method);
+    }
+
+    static void propagate_statement(PropagationState& state, AstNode* stat)
+    {
+        switch (stat->type)
+        {
+            case AstNodeType::kLocalDecl:
+            {
+                auto* decl = stat->as<AstLocalDecl>();
+                for (AstNode** init = &decl->first_init; *init; init = &(*init)->next_child)
+                {
+                    propagate_expression(state, *init);
+                }
+                const AstNode* init = decl->first_init;
+                for (const AstNode* name = decl->first_name; name; name = name->next_child)
+                {
+                    declare(state, static_cast<const AstString*>(name)->atom, init);
+                    init = init ? init->next_child : nullptr;
+                }
+                break;
+            }
+            case AstNodeType::kFuncDefStat:
+                propagate_function_stat(state, stat->as<AstFuncDefStat>());
+                break;
+            case AstNodeType::kAssign:
+            {
+                auto* assign = stat->as<AstAssign>();
+                for (AstNode** var = &assign->first_var; *var; var = &(*var)->next_child)
+                {
+                    propagate_target(state, *var);
+                }
+                for (AstNode** expr = &assign->first_expr; *expr; expr = &(*expr)->next_child)
+                {
+                    propagate_expression(state, *expr);
+                }
+                break;
+            }
+            case AstNodeType::kAssignLocal:
+                record_write(state, stat->as<AstAssignLocal>()->name->atom);
+                propagate_expression(state, stat->as<AstAssignLocal>()->expr);
+                break;
+            case AstNodeType::kAssignUpvalue:
+                record_write(state, stat->as<AstAssignUpvalue>()->name->atom);
+                propagate_expression(state, stat->as<AstAssignUpvalue>()->expr);
+                break;
+            case AstNodeType::kAssignGlobal:
+                record_write(state, stat->as<AstAssignGlobal>()->name->atom);
+                propagate_expression(state, stat->as<AstAssignGlobal>()->expr);
+                break;
+            case AstNodeType::kCompoundAssign:
+                propagate_target(state, stat->as<AstCompoundAssign>()->target);
+                propagate_expression(state, stat->as<AstCompoundAssign>()->expr);
+                break;
+            case AstNodeType::kCompoundLocal:
+                record_write(state, stat->as<AstCompoundLocal>()->name->atom);
+                propagate_expression(state, stat->as<AstCompoundLocal>()->expr);
+                break;
+            case AstNodeType::kCompoundUpvalue:
+                record_write(state, stat->as<AstCompoundUpvalue>()->name->atom);
+                propagate_expression(state, stat->as<AstCompoundUpvalue>()->expr);
+                break;
+            case AstNodeType::kCompoundGlobal:
+                record_write(state, stat->as<AstCompoundGlobal>()->name->atom);
+                propagate_expression(state, stat->as<AstCompoundGlobal>()->expr);
+                break;
+            case AstNodeType::kIncrement:
+                propagate_target(state, stat->as<AstIncrement>()->target);
+                break;
+            case AstNodeType::kDecrement:
+                propagate_target(state, stat->as<AstDecrement>()->target);
+                break;
+            case AstNodeType::kIncLocal:
+                record_write(state, stat->as<AstIncLocal>()->name->atom);
+                break;
+            case AstNodeType::kIncUpvalue:
+                record_write(state, stat->as<AstIncUpvalue>()->name->atom);
+                break;
+            case AstNodeType::kIncGlobal:
+                record_write(state, stat->as<AstIncGlobal>()->name->atom);
+                break;
+            case AstNodeType::kDecLocal:
+                record_write(state, stat->as<AstDecLocal>()->name->atom);
+                break;
+            case AstNodeType::kDecUpvalue:
+                record_write(state, stat->as<AstDecUpvalue>()->name->atom);
+                break;
+            case AstNodeType::kDecGlobal:
+                record_write(state, stat->as<AstDecGlobal>()->name->atom);
+                break;
+            case AstNodeType::kIf:
+            {
+                auto* if_stat = stat->as<AstIf>();
+                propagate_expression(state, if_stat->cond);
+                propagate_block(state, if_stat->then_block);
+                for (ElseIf* elseif = if_stat->first_elseif; elseif; elseif = static_cast<ElseIf*>(elseif->next_child))
+                {
+                    propagate_expression(state, elseif->cond);
+                    propagate_block(state, elseif->block);
+                }
+                propagate_block(state, if_stat->else_block);
+                break;
+            }
+            case AstNodeType::kWhile:
+                propagate_expression(state, stat->as<AstWhile>()->cond);
+                propagate_block(state, stat->as<AstWhile>()->block);
+                break;
+            case AstNodeType::kForNum:
+            {
+                auto* for_num = stat->as<AstForNum>();
+                propagate_expression(state, for_num->start);
+                propagate_expression(state, for_num->end);
+                if (for_num->step)
+                {
+                    propagate_expression(state, for_num->step);
+                }
+                propagate_scoped_block(state, for_num->block, for_num->var);
+                break;
+            }
+            case AstNodeType::kForCNumeric:
+            {
+                auto* for_c_numeric = stat->as<AstForCNumeric>();
+                propagate_expression(state, for_c_numeric->start);
+                propagate_expression(state, for_c_numeric->end);
+                if (for_c_numeric->step)
+                {
+                    propagate_expression(state, for_c_numeric->step);
+                }
+                propagate_scoped_block(state, for_c_numeric->block, for_c_numeric->var);
+                break;
+            }
+            case AstNodeType::kForIn:
+            {
+                auto* for_in = stat->as<AstForIn>();
+                for (AstNode** expr = &for_in->first_expr; *expr; expr = &(*expr)->next_child)
+                {
+                    propagate_expression(state, *expr);
+                }
+                if (for_in->declares_variables)
+                {
+                    propagate_scoped_block(state, for_in->block, for_in->first_name);
+                    break;
+                }
+                // Without let the loop assigns variables declared before it
+                for (const AstNode* name = for_in->first_name; name; name = name->next_child)
+                {
+                    record_write(state, static_cast<const AstString*>(name)->atom);
+                }
+                propagate_block(state, for_in->block);
+                break;
+            }
+            case AstNodeType::kForC:
+            {
+                auto* for_c = stat->as<AstForC>();
+                const size_t mark = state.bindings.size();
+                if (for_c->init)
+                {
+                    propagate_statement(state, for_c->init);
+                }
+                if (for_c->condition)
+                {
+                    propagate_expression(state, for_c->condition);
+                }
+                if (for_c->update)
+                {
+                    propagate_statement(state, for_c->update);
+                }
+                propagate_block(state, for_c->block);
+                state.bindings.resize(mark);
+                break;
+            }
+            case AstNodeType::kReturn:
+                for (AstNode** expr = &stat->as<AstReturn>()->first_expr; *expr; expr = &(*expr)->next_child)
+                {
+                    propagate_expression(state, *expr);
+                }
+                break;
+            case AstNodeType::kDefer:
+                if (stat->as<AstDefer>()->body)
+                {
+                    propagate_statement(state, stat->as<AstDefer>()->body);
+                }
+                break;
+            case AstNodeType::kScope:
+                propagate_block(state, stat->as<AstScope>()->block);
+                break;
+            case AstNodeType::kBlock:
+                propagate_block(state, stat->as<AstBlock>());
+                break;
+            case AstNodeType::kExprStat:
+            {
+                // A call made for its side effects is kept as a call
+                auto* expr_stat = stat->as<AstExprStat>();
+                if (auto* call = expr_stat->expr->try_as<AstFuncCall>())
+                {
+                    propagate_table(state, call->func);
+                    for (AstNode** arg = &call->first_arg; *arg; arg = &(*arg)->next_child)
+                    {
+                        propagate_expression(state, *arg);
+                    }
+                }
+                else
+                {
+                    propagate_expression(state, expr_stat->expr);
+                }
+                break;
+            }
+            case AstNodeType::kExportDecl:
+                propagate_statement(state, stat->as<AstExportDecl>()->declaration);
+                break;
+            default:
+                break;
+        }
+    }
+
+    bool ConstantPropagationPass::apply(AstOptimizationContext& context)
+    {
+        if (!context.program->block)
+        {
+            return false;
+        }
+
+        PropagationState state(context.holder, context.program->is_module);
+        propagate_block(state, context.program->block);
+
+        state.collecting = false;
+        propagate_block(state, context.program->block);
+
+        if constexpr (kOptimizationPassDebug)
+        {
+            if (state.propagated > 0)
+            {
+                println("    Propagated {} constants", state.propagated);
+            }
+        }
+
+        return state.propagated > 0;
+    }
+
+} // namespace behl
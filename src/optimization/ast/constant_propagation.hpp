@@ -0,0 +1,19 @@
+#pragma once
+
+#include "ast_context.hpp"
+
+namespace behl
+{
+    // Constant propagation pass
+    // Replaces reads of locals that are never assigned after being initialized with a literal by the literal. Calls of
+    // library functions are left alone, module tables are ordinary tables that any script can modify at runtime.
+    struct ConstantPropagationPass
+    {
+        static constexpr std::string_view kName = "ConstantPropagation";
+        static constexpr OptLevel kMinLevel = OptLevel::kO2;
+        static constexpr bool kTracksChanges = false;
+
+        static bool apply(AstOptimizationContext& context);
+    };
+
+} // namespace behl
@@ -8,7 +8,7 @@
 
 namespace behl
 {
-    static bool reads_variable(const AstNode* node, std::string_view var_name);
+    static bool reads_variable(const AstNode* node, Atom var_name);
 
     struct DSEState
     {
@@ -109,9 +109,9 @@ namespace behl
         return false;
     }
 
-    static bool statement_reads_variable(const AstNode* stat, const std::string_view var_name);
+    static bool statement_reads_variable(const AstNode* stat, const Atom var_name);
 
-    static bool block_reads_variable(const AstBlock* block, const std::string_view var_name)
+    static bool block_reads_variable(const AstBlock* block, const Atom var_name)
     {
         for (const AstNode* stat = block ? block->first_stat : nullptr; stat != nullptr; stat = stat->next_child)
         {
@@ -123,7 +123,7 @@ namespace behl
         return false;
     }
 
-    static bool statement_reads_variable(const AstNode* stat, const std::string_view var_name)
+    static bool statement_reads_variable(const AstNode* stat, const Atom var_name)
     {
         if (!stat)
         {
@@ -177,15 +177,15 @@ namespace behl
         }
         if (auto* compound_local = stat->try_as<AstCompoundLocal>())
         {
-            return compound_local->name->view() == var_name || reads_variable(compound_local->expr, var_name);
+            return compound_local->name->atom == var_name || reads_variable(compound_local->expr, var_name);
         }
         if (auto* compound_global = stat->try_as<AstCompoundGlobal>())
         {
-            return compound_global->name->view() == var_name || reads_variable(compound_global->expr, var_name);
+            return compound_global->name->atom == var_name || reads_variable(compound_global->expr, var_name);
         }
         if (auto* compound_upvalue = stat->try_as<AstCompoundUpvalue>())
         {
-            return compound_upvalue->name->view() == var_name || reads_variable(compound_upvalue->expr, var_name);
+            return compound_upvalue->name->atom == var_name || reads_variable(compound_upvalue->expr, var_name);
         }
         if (auto* inc = stat->try_as<AstIncrement>())
         {
@@ -193,27 +193,27 @@ namespace behl
         }
         if (auto* inc_local = stat->try_as<AstIncLocal>())
         {
-            return inc_local->name->view() == var_name;
+            return inc_local->name->atom == var_name;
         }
         if (auto* inc_global = stat->try_as<AstIncGlobal>())
         {
-            return inc_global->name->view() == var_name;
+            return inc_global->name->atom == var_name;
         }
         if (auto* inc_upvalue = stat->try_as<AstIncUpvalue>())
         {
-            return inc_upvalue->name->view() == var_name;
+            return inc_upvalue->name->atom == var_name;
         }
         if (auto* dec_local = stat->try_as<AstDecLocal>())
         {
-            return dec_local->name->view() == var_name;
+            return dec_local->name->atom == var_name;
         }
         if (auto* dec_global = stat->try_as<AstDecGlobal>())
         {
-            return dec_global->name->view() == var_name;
+            return dec_global->name->atom == var_name;
         }
         if (auto* dec_upvalue = stat->try_as<AstDecUpvalue>())
         {
-            return dec_upvalue->name->view() == var_name;
+            return dec_upvalue->name->atom == var_name;
         }
         if (auto* return_stat = stat->try_as<AstReturn>())
         {
@@ -322,7 +322,7 @@ namespace behl
     }
 
     // Check if an expression reads a variable
-    static bool reads_variable(const AstNode* node, const std::string_view var_name)
+    static bool reads_variable(const AstNode* node, const Atom var_name)
     {
         if (!node)
         {
@@ -331,7 +331,7 @@ namespace behl
 
         if (auto* ident = node->try_as<AstIdent>())
         {
-            return ident->name->view() == var_name;
+            return ident->name->atom == var_name;
         }
         else if (auto* binop = node->try_as<AstBinOp>())
         {
@@ -386,10 +386,10 @@ namespace behl
 
     static void eliminate_in_block(DSEState& state, AstBlock& block)
     {
-        Vector<std::pair<std::string_view, PendingStore>> pending;
+        Vector<std::pair<Atom, PendingStore>> pending;
         pending.init(state.holder.state(), 4);
 
-        auto find_entry = [&](const std::string_view name) -> PendingStore* {
+        auto find_entry = [&](const Atom name) -> PendingStore* {
             for (auto& entry : pending)
             {
                 if (entry.first == name)
@@ -400,7 +400,7 @@ namespace behl
             return nullptr;
         };
 
-        auto erase_entry = [&](const std::string_view name) {
+        auto erase_entry = [&](const Atom name) {
             for (size_t i = 0; i < pending.size(); ++i)
             {
                 if (pending[i].first == name)
@@ -433,7 +433,7 @@ namespace behl
             }
         };
 
-        auto try_eliminate_previous = [&](const std::string_view name, AstNode* expr) {
+        auto try_eliminate_previous = [&](const Atom name, AstNode* expr) {
             PendingStore* prev = find_entry(name);
             if (!prev)
             {
@@ -483,7 +483,7 @@ namespace behl
                 if (!local_decl->is_const && local_decl->first_name && !local_decl->first_name->next_child
                     && local_decl->first_init && !local_decl->first_init->next_child)
                 {
-                    const std::string_view name = local_decl->first_name->view();
+                    const Atom name = local_decl->first_name->atom;
                     AstNode* init_expr = local_decl->first_init;
 
                     // If this declaration reads the variable, earlier value is required.
@@ -509,7 +509,7 @@ namespace behl
             }
             else if (auto* assign_local = stat->try_as<AstAssignLocal>())
             {
-                const std::string_view name = assign_local->name->view();
+                const Atom name = assign_local->name->atom;
                 AstNode* expr = assign_local->expr;
 
                 if (!reads_variable(expr, name))
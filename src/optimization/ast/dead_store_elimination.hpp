@@ -9,6 +9,8 @@ namespace behl
     struct DeadStoreEliminationPass
     {
         static constexpr std::string_view kName = "DeadStoreElimination";
+        static constexpr OptLevel kMinLevel = OptLevel::kO2;
+        static constexpr bool kTracksChanges = false;
 
         static bool apply(AstOptimizationContext& context);
     };
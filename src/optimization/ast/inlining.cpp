@@ -0,0 +1,879 @@
+#include "inlining.hpp"
+
+#include "common/hash_map.hpp"
+#include "common/print.hpp"
+#include "common/vector.hpp"
+#include "config_internal.hpp"
+
+#include <array>
+
+namespace behl
+{
+    // Bodies larger than this many nodes are not copied into the call sites
+    static constexpr size_t kMaxInlineNodes = 16;
+    static constexpr size_t kMaxInlineParams = 8;
+
+    namespace
+    {
+        // Local variable visible at the current point of the walk. Candidates are numbered from 1, 0 means the
+        // variable does not hold an inlinable function.
+        struct Binding
+        {
+            Atom name = kInvalidAtom;
+            uint32_t id = 0;
+            uint32_t function_level = 0;
+            uint32_t candidate = 0;
+        };
+
+        // Name used by a function body that is not one of its parameters, along with the binding it refers to. Id 0
+        // stands for a global.
+        struct FreeName
+        {
+            Atom name = kInvalidAtom;
+            uint32_t binding = 0;
+        };
+
+        struct InlineCandidate
+        {
+            const AstString* first_param = nullptr;
+            size_t param_count = 0;
+            const AstNode* body = nullptr;
+            size_t first_free = 0;
+            size_t free_count = 0;
+        };
+
+        struct InlineState
+        {
+            AstHolder& holder;
+            bool is_module = false;
+            // The first walk only records the variables written anywhere in the program, the second one inlines.
+            bool collecting = true;
+            AutoVector<Binding> bindings;
+            AutoVector<InlineCandidate> candidates;
+            AutoVector<FreeName> free_names;
+            AutoHashMap<Atom, bool, AtomHash> written;
+            AutoHashMap<Atom, bool, AtomHash> written_by_closures;
+            uint32_t next_id = 1;
+            uint32_t function_level = 0;
+            size_t inlined = 0;
+
+            InlineState(AstHolder& h, bool module)
+                : holder(h)
+                , is_module(module)
+                , bindings(h.state())
+                , candidates(h.state())
+                , free_names(h.state())
+                , written(h.state())
+                , written_by_closures(h.state())
+            {
+            }
+        };
+    } // namespace
+
+    static void inline_block(InlineState& state, AstBlock* block);
+    static void inline_statement(InlineState& state, AstNode* stat);
+    static void inline_expression(InlineState& state, AstNode*& expr);
+
+    static size_t declare(InlineState& state, Atom name, uint32_t candidate = 0)
+    {
+        state.bindings.push_back({ name, state.next_id++, state.function_level, candidate });
+        return state.bindings.size() - 1;
+    }
+
+    static const Binding* resolve(const InlineState& state, Atom name)
+    {
+        for (size_t i = state.bindings.size(); i > 0; --i)
+        {
+            if (state.bindings[i - 1].name == name)
+            {
+                return &state.bindings[i - 1];
+            }
+        }
+        return nullptr;
+    }
+
+    static void record_write(InlineState& state, Atom name, bool from_closure)
+    {
+        if (!state.collecting)
+        {
+            return;
+        }
+        state.written.insert_or_assign(name, true);
+        if (from_closure)
+        {
+            state.written_by_closures.insert_or_assign(name, true);
+        }
+    }
+
+    static void record_target(InlineState& state, const AstNode* target)
+    {
+        // Assignments the semantics pass left unresolved may write a local or an upvalue
+        if (auto* ident = target->try_as<AstIdent>())
+        {
+            record_write(state, ident->name->atom, true);
+        }
+    }
+
+    static const AstString* find_param(const AstString* first_param, Atom name, size_t& index)
+    {
+        const AstString* found = nullptr;
+        size_t i = 0;
+        for (const AstNode* p = first_param; p; p = p->next_child, ++i)
+        {
+            auto* param = static_cast<const AstString*>(p);
+            if (param->atom == name)
+            {
+                found = param;
+                index = i;
+            }
+        }
+        return found;
+    }
+
+    // Checks that the expression only consists of nodes that can be copied into another function and counts them.
+    static bool is_inlinable_body(const AstNode* node, size_t& count)
+    {
+        if (++count > kMaxInlineNodes)
+        {
+            return false;
+        }
+
+        switch (node->type)
+        {
+            case AstNodeType::kNil:
+            case AstNodeType::kBool:
+            case AstNodeType::kInteger:
+            case AstNodeType::kFP:
+            case AstNodeType::kString:
+            case AstNodeType::kIdent:
+                return true;
+            case AstNodeType::kBinOp:
+            {
+                auto* binop = node->as<AstBinOp>();
+                return is_inlinable_body(binop->left, count) && is_inlinable_body(binop->right, count);
+            }
+            case AstNodeType::kUnOp:
+                return is_inlinable_body(node->as<AstUnOp>()->expr, count);
+            case AstNodeType::kTernary:
+            {
+                auto* ternary = node->as<AstTernary>();
+                return is_inlinable_body(ternary->condition, count) && is_inlinable_body(ternary->true_expr, count)
+                    && is_inlinable_body(ternary->false_expr, count);
+            }
+            case AstNodeType::kIndex:
+            {
+                auto* index = node->as<AstIndex>();
+                return is_inlinable_body(index->table, count) && is_inlinable_body(index->key, count);
+            }
+            case AstNodeType::kMember:
+                return is_inlinable_body(node->as<AstMember>()->table, count);
+            case AstNodeType::kFuncCall:
+            {
+                auto* call = node->as<AstFuncCall>();
+                if (call->is_self_call || !is_inlinable_body(call->func, count))
+                {
+                    return false;
+                }
+                for (const AstNode* arg = call->first_arg; arg; arg = arg->next_child)
+                {
+                    if (!is_inlinable_body(arg, count))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            case AstNodeType::kTableCtor:
+                for (const AstNode* n = node->as<AstTableCtor>()->first_field; n; n = n->next_child)
+                {
+                    auto* field = static_cast<const TableField*>(n);
+                    if ((field->key && !is_inlinable_body(field->key, count)) || !is_inlinable_body(field->value, count))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            default:
+                // Closures would capture the caller's variables, varargs belong to the caller
+                return false;
+        }
+    }
+
+    // Resolves the names the body uses besides its parameters. Names bound inside the function itself, like the
+    // name of a local function referring to itself, can not be resolved from a call site.
+    static bool collect_free_names(InlineState& state, const AstNode* node, const AstString* first_param, size_t scope_mark)
+    {
+        switch (node->type)
+        {
+            case AstNodeType::kIdent:
+            {
+                const Atom name = node->as<AstIdent>()->name->atom;
+                size_t index = 0;
+                if (find_param(first_param, name, index))
+                {
+                    return true;
+                }
+                const Binding* binding = resolve(state, name);
+                if (binding && static_cast<size_t>(binding - &state.bindings[0]) >= scope_mark)
+                {
+                    return false;
+                }
+                state.free_names.push_back({ name, binding ? binding->id : 0 });
+                return true;
+            }
+            case AstNodeType::kBinOp:
+            {
+                auto* binop = node->as<AstBinOp>();
+                return collect_free_names(state, binop->left, first_param, scope_mark)
+                    && collect_free_names(state, binop->right, first_param, scope_mark);
+            }
+            case AstNodeType::kUnOp:
+                return collect_free_names(state, node->as<AstUnOp>()->expr, first_param, scope_mark);
+            case AstNodeType::kTernary:
+            {
+                auto* ternary = node->as<AstTernary>();
+                return collect_free_names(state, ternary->condition, first_param, scope_mark)
+                    && collect_free_names(state, ternary->true_expr, first_param, scope_mark)
+                    && collect_free_names(state, ternary->false_expr, first_param, scope_mark);
+            }
+            case AstNodeType::kIndex:
+            {
+                auto* index = node->as<AstIndex>();
+                return collect_free_names(state, index->table, first_param, scope_mark)
+                    && collect_free_names(state, index->key, first_param, scope_mark);
+            }
+            case AstNodeType::kMember:
+                return collect_free_names(state, node->as<AstMember>()->table, first_param, scope_mark);
+            case AstNodeType::kFuncCall:
+            {
+                auto* call = node->as<AstFuncCall>();
+                if (!collect_free_names(state, call->func, first_param, scope_mark))
+                {
+                    return false;
+                }
+                for (const AstNode* arg = call->first_arg; arg; arg = arg->next_child)
+                {
+                    if (!collect_free_names(state, arg, first_param, scope_mark))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            case AstNodeType::kTableCtor:
+                for (const AstNode* n = node->as<AstTableCtor>()->first_field; n; n = n->next_child)
+                {
+                    auto* field = static_cast<const TableField*>(n);
+                    // Identifier keys name the field, they do not refer to a variable
+                    const bool variable_key = field->key && !field->key->is(AstNodeType::kIdent);
+                    if ((variable_key && !collect_free_names(state, field->key, first_param, scope_mark))
+                        || !collect_free_names(state, field->value, first_param, scope_mark))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            default:
+                return true;
+        }
+    }
+
+    // Registers the function as a candidate when its body is a single small return, must be called while the
+    // bindings of the function are still visible.
+    static uint32_t make_candidate(
+        InlineState& state, const AstString* first_param, const AstBlock* block, bool is_vararg, bool is_method, size_t mark)
+    {
+        if (state.collecting || is_vararg || is_method || !block || !block->first_stat || block->first_stat->next_child)
+        {
+            return 0;
+        }
+
+        auto* ret = block->first_stat->try_as<AstReturn>();
+        if (!ret || !ret->first_expr || ret->first_expr->next_child)
+        {
+            return 0;
+        }
+
+        size_t param_count = 0;
+        for (const AstNode* p = first_param; p; p = p->next_child)
+        {
+            param_count++;
+        }
+        size_t node_count = 0;
+        if (param_count > kMaxInlineParams || !is_inlinable_body(ret->first_expr, node_count))
+        {
+            return 0;
+        }
+
+        const size_t first_free = state.free_names.size();
+        if (!collect_free_names(state, ret->first_expr, first_param, mark))
+        {
+            state.free_names.resize(first_free);
+            return 0;
+        }
+
+        state.candidates.push_back(
+            { first_param, param_count, ret->first_expr, first_free, state.free_names.size() - first_free });
+        return static_cast<uint32_t>(state.candidates.size());
+    }
+
+    // Walks a function body, returns the candidate number when the function can be inlined.
+    static uint32_t inline_function(InlineState& state, const AstString* first_param, AstBlock* block,
+        const AstString* self_name, bool is_method, bool is_vararg)
+    {
+        const size_t mark = state.bindings.size();
+        state.function_level++;
+
+        if (is_method)
+        {
+            declare(state, kAtomSelf);
+        }
+        else if (self_name)
+        {
+            declare(state, self_name->atom);
+        }
+        for (const AstNode* p = first_param; p; p = p->next_child)
+        {
+            declare(state, static_cast<const AstString*>(p)->atom);
+        }
+
+        inline_block(state, block);
+        const uint32_t candidate = make_candidate(state, first_param, block, is_vararg, is_method, mark);
+
+        state.function_level--;
+        state.bindings.resize(mark);
+        return candidate;
+    }
+
+    static bool is_literal(const AstNode* node)
+    {
+        switch (node->type)
+        {
+            case AstNodeType::kNil:
+            case AstNodeType::kBool:
+            case AstNodeType::kInteger:
+            case AstNodeType::kFP:
+            case AstNodeType::kString:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Arguments are substituted for the parameters and may be evaluated several times or not at all, so they have to
+    // be constants or locals whose value the body can not change through a closure.
+    static bool is_stable_argument(const InlineState& state, const AstNode* arg)
+    {
+        if (is_literal(arg))
+        {
+            return true;
+        }
+
+        auto* ident = arg->try_as<AstIdent>();
+        if (!ident)
+        {
+            return false;
+        }
+        const Atom name = ident->name->atom;
+        const Binding* binding = resolve(state, name);
+        if (!binding || state.written_by_closures.contains(name))
+        {
+            return false;
+        }
+        return binding->function_level == state.function_level || !state.written.contains(name);
+    }
+
+    // Copies the body with the parameters replaced, the copied nodes report the position of the call.
+    static AstNode* instantiate(InlineState& state, const AstNode* node, const InlineCandidate& candidate,
+        const std::array<AstNode*, kMaxInlineParams>& args, const AstNode* call)
+    {
+        if (auto* ident = node->try_as<AstIdent>())
+        {
+            size_t index = 0;
+            if (find_param(candidate.first_param, ident->name->atom, index))
+            {
+                if (args[index])
+                {
+                    return args[index]->clone(state.holder);
+                }
+                auto* nil = state.holder.make<AstNil>();
+                nil->line = call->line;
+                nil->column = call->column;
+                return nil;
+            }
+        }
+
+        AstNode* copy = nullptr;
+        switch (node->type)
+        {
+            case AstNodeType::kBinOp:
+            {
+                auto* binop = node->as<AstBinOp>();
+                copy = state.holder.make<AstBinOp>(binop->op, instantiate(state, binop->left, candidate, args, call),
+                    instantiate(state, binop->right, candidate, args, call));
+                break;
+            }
+            case AstNodeType::kUnOp:
+            {
+                auto* unop = node->as<AstUnOp>();
+                copy = state.holder.make<AstUnOp>(unop->op, instantiate(state, unop->expr, candidate, args, call));
+                break;
+            }
+            case AstNodeType::kTernary:
+            {
+                auto* ternary = node->as<AstTernary>();
+                copy = state.holder.make<AstTernary>(instantiate(state, ternary->condition, candidate, args, call),
+                    instantiate(state, ternary->true_expr, candidate, args, call),
+                    instantiate(state, ternary->false_expr, candidate, args, call));
+                break;
+            }
+            case AstNodeType::kIndex:
+            {
+                auto* index = node->as<AstIndex>();
+                copy = state.holder.make<AstIndex>(instantiate(state, index->table, candidate, args, call),
+                    instantiate(state, index->key, candidate, args, call));
+                break;
+            }
+            case AstNodeType::kMember:
+            {
+                auto* member = node->as<AstMember>();
+                copy = state.holder.make<AstMember>(instantiate(state, member->table, candidate, args, call),
+                    static_cast<AstString*>(member->name->clone(state.holder)));
+                break;
+            }
+            case AstNodeType::kFuncCall:
+            {
+                auto* func_call = node->as<AstFuncCall>();
+                auto* call_copy = state.holder.make<AstFuncCall>(instantiate(state, func_call->func, candidate, args, call));
+                AstNode** tail = &call_copy->first_arg;
+                for (const AstNode* arg = func_call->first_arg; arg; arg = arg->next_child)
+                {
+                    *tail = instantiate(state, arg, candidate, args, call);
+                    tail = &(*tail)->next_child;
+                }
+                copy = call_copy;
+                break;
+            }
+            case AstNodeType::kTableCtor:
+            {
+                auto* ctor = state.holder.make<AstTableCtor>();
+                AstNode** tail = reinterpret_cast<AstNode**>(&ctor->first_field);
+                for (const AstNode* n = node->as<AstTableCtor>()->first_field; n; n = n->next_child)
+                {
+                    auto* field = static_cast<const TableField*>(n);
+                    AstNode* key = nullptr;
+                    if (field->key)
+                    {
+                        key = field->key->is(AstNodeType::kIdent) ? field->key->clone(state.holder)
+                                                                  : instantiate(state, field->key, candidate, args, call);
+                    }
+                    auto* field_copy =
+                        state.holder.make<TableField>(key, instantiate(state, field->value, candidate, args, call));
+                    field_copy->line = call->line;
+                    field_copy->column = call->column;
+                    *tail = field_copy;
+                    tail = &field_copy->next_child;
+                }
+                copy = ctor;
+                break;
+            }
+            default:
+                copy = node->clone(state.holder);
+                break;
+        }
+
+        copy->line = call->line;
+        copy->column = call->column;
+        return copy;
+    }
+
+    static AstNode* try_inline(InlineState& state, AstFuncCall* call)
+    {
+        auto* callee = call->func->try_as<AstIdent>();
+        if (call->is_self_call || !callee)
+        {
+            return nullptr;
+        }
+        const Binding* binding = resolve(state, callee->name->atom);
+        if (!binding || binding->candidate == 0)
+        {
+            return nullptr;
+        }
+        const InlineCandidate& candidate = state.candidates[binding->candidate - 1];
+
+        std::array<AstNode*, kMaxInlineParams> args{};
+        size_t arg_count = 0;
+        for (AstNode* arg = call->first_arg; arg; arg = arg->next_child)
+        {
+            if (arg_count == candidate.param_count || !is_stable_argument(state, arg))
+            {
+                return nullptr;
+            }
+            args[arg_count++] = arg;
+        }
+
+        // The names used by the body have to refer to the same variables here as where the function was defined
+        for (size_t i = 0; i < candidate.free_count; ++i)
+        {
+            const FreeName& free_name = state.free_names[candidate.first_free + i];
+            const Binding* resolved = resolve(state, free_name.name);
+            if ((resolved ? resolved->id : 0) != free_name.binding)
+            {
+                return nullptr;
+            }
+        }
+
+        state.inlined++;
+        return instantiate(state, candidate.body, candidate, args, call);
+    }
+
+    static void inline_expression(InlineState& state, AstNode*& expr)
+    {
+        if (!expr)
+        {
+            return;
+        }
+
+        switch (expr->type)
+        {
+            case AstNodeType::kBinOp:
+            {
+                auto* binop = expr->as<AstBinOp>();
+                inline_expression(state, binop->left);
+                inline_expression(state, binop->right);
+                break;
+            }
+            case AstNodeType::kUnOp:
+                inline_expression(state, expr->as<AstUnOp>()->expr);
+                break;
+            case AstNodeType::kTernary:
+            {
+                auto* ternary = expr->as<AstTernary>();
+                inline_expression(state, ternary->condition);
+                inline_expression(state, ternary->true_expr);
+                inline_expression(state, ternary->false_expr);
+                break;
+            }
+            case AstNodeType::kIndex:
+            {
+                auto* index = expr->as<AstIndex>();
+                inline_expression(state, index->table);
+                inline_expression(state, index->key);
+                break;
+            }
+            case AstNodeType::kMember:
+                inline_expression(state, expr->as<AstMember>()->table);
+                break;
+            case AstNodeType::kTableCtor:
+                for (AstNode* n = expr->as<AstTableCtor>()->first_field; n; n = n->next_child)
+                {
+                    auto* field = static_cast<TableField*>(n);
+                    inline_expression(state, field->key);
+                    inline_expression(state, field->value);
+                }
+                break;
+            case AstNodeType::kFuncDef:
+            {
+                auto* func = expr->as<AstFuncDef>();
+                inline_function(state, func->first_param, func->block, func->self_name, func->is_method, func->is_vararg);
+                break;
+            }
+            case AstNodeType::kFuncCall:
+            {
+                auto* call = expr->as<AstFuncCall>();
+                inline_expression(state, call->func);
+                for (AstNode** arg = &call->first_arg; *arg; arg = &(*arg)->next_child)
+                {
+                    inline_expression(state, *arg);
+                }
+                if (state.collecting)
+                {
+                    break;
+                }
+                if (AstNode* inlined = try_inline(state, call))
+                {
+                    inlined->next_child = expr->next_child;
+                    expr = inlined;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    static void inline_block(InlineState& state, AstBlock* block)
+    {
+        if (!block)
+        {
+            return;
+        }
+
+        const size_t mark = state.bindings.size();
+        for (AstNode* stat = block->first_stat; stat; stat = stat->next_child)
+        {
+            inline_statement(state, stat);
+        }
+        state.bindings.resize(mark);
+    }
+
+    static void inline_scoped_block(InlineState& state, AstBlock* block, const AstNode* first_name)
+    {
+        const size_t mark = state.bindings.size();
+        for (const AstNode* name = first_name; name; name = name->next_child)
+        {
+            declare(state, static_cast<const AstString*>(name)->atom);
+        }
+        inline_block(state, block);
+        state.bindings.resize(mark);
+    }
+
+    static void inline_function_stat(InlineState& state, AstFuncDefStat* func)
+    {
+        const bool is_simple_name = func->first_name_part && !func->first_name_part->next_child && !func->is_method;
+        const AstString* self_name = nullptr;
+        Atom name = kInvalidAtom;
+        if (is_simple_name)
+        {
+            self_name = static_cast<const AstString*>(func->first_name_part);
+            name = self_name->atom;
+        }
+
+        // Module functions live in the module scope, a local function is visible inside its own body
+        size_t binding = SIZE_MAX;
+        if (is_simple_name && (func->is_local || state.is_module))
+        {
+            binding = declare(state, name);
+        }
+
+        const uint32_t candidate =
+            inline_function(state, func->first_param, func->block, self_name, func->is_method, func->is_vararg);
+        if (func->is_local && binding != SIZE_MAX && !state.written.contains(name))
+        {
+            state.bindings[binding].candidate = candidate;
+        }
+    }
+
+    static void inline_statement(InlineState& state, AstNode* stat)
+    {
+        switch (stat->type)
+        {
+            case AstNodeType::kLocalDecl:
+            {
+                auto* decl = stat->as<AstLocalDecl>();
+                auto* func = decl->first_init ? decl->first_init->try_as<AstFuncDef>() : nullptr;
+                uint32_t candidate = 0;
+                if (decl->is_const && func && !decl->first_name->next_child && !func->next_child)
+                {
+                    candidate = inline_function(
+                        state, func->first_param, func->block, func->self_name, func->is_method, func->is_vararg);
+                }
+                else
+                {
+                    for (AstNode** init = &decl->first_init; *init; init = &(*init)->next_child)
+                    {
+                        inline_expression(state, *init);
+                    }
+                }
+                for (const AstNode* name = decl->first_name; name; name = name->next_child)
+                {
+                    declare(state, static_cast<const AstString*>(name)->atom, candidate);
+                }
+                break;
+            }
+            case AstNodeType::kFuncDefStat:
+                inline_function_stat(state, stat->as<AstFuncDefStat>());
+                break;
+            case AstNodeType::kAssign:
+            {
+                auto* assign = stat->as<AstAssign>();
+                for (AstNode** var = &assign->first_var; *var; var = &(*var)->next_child)
+                {
+                    record_target(state, *var);
+                    inline_expression(state, *var);
+                }
+                for (AstNode** expr = &assign->first_expr; *expr; expr = &(*expr)->next_child)
+                {
+                    inline_expression(state, *expr);
+                }
+                break;
+            }
+            case AstNodeType::kAssignLocal:
+                record_write(state, stat->as<AstAssignLocal>()->name->atom, false);
+                inline_expression(state, stat->as<AstAssignLocal>()->expr);
+                break;
+            case AstNodeType::kAssignUpvalue:
+                record_write(state, stat->as<AstAssignUpvalue>()->name->atom, true);
+                inline_expression(state, stat->as<AstAssignUpvalue>()->expr);
+                break;
+            case AstNodeType::kAssignGlobal:
+                inline_expression(state, stat->as<AstAssignGlobal>()->expr);
+                break;
+            case AstNodeType::kCompoundAssign:
+                record_target(state, stat->as<AstCompoundAssign>()->target);
+                inline_expression(state, stat->as<AstCompoundAssign>()->target);
+                inline_expression(state, stat->as<AstCompoundAssign>()->expr);
+                break;
+            case AstNodeType::kCompoundLocal:
+                record_write(state, stat->as<AstCompoundLocal>()->name->atom, false);
+                inline_expression(state, stat->as<AstCompoundLocal>()->expr);
+                break;
+            case AstNodeType::kCompoundUpvalue:
+                record_write(state, stat->as<AstCompoundUpvalue>()->name->atom, true);
+                inline_expression(state, stat->as<AstCompoundUpvalue>()->expr);
+                break;
+            case AstNodeType::kCompoundGlobal:
+                inline_expression(state, stat->as<AstCompoundGlobal>()->expr);
+                break;
+            case AstNodeType::kIncrement:
+                record_target(state, stat->as<AstIncrement>()->target);
+                inline_expression(state, stat->as<AstIncrement>()->target);
+                break;
+            case AstNodeType::kDecrement:
+                record_target(state, stat->as<AstDecrement>()->target);
+                inline_expression(state, stat->as<AstDecrement>()->target);
+                break;
+            case AstNodeType::kIncLocal:
+                record_write(state, stat->as<AstIncLocal>()->name->atom, false);
+                break;
+            case AstNodeType::kDecLocal:
+                record_write(state, stat->as<AstDecLocal>()->name->atom, false);
+                break;
+            case AstNodeType::kIncUpvalue:
+                record_write(state, stat->as<AstIncUpvalue>()->name->atom, true);
+                break;
+            case AstNodeType::kDecUpvalue:
+                record_write(state, stat->as<AstDecUpvalue>()->name->atom, true);
+                break;
+            case AstNodeType::kIf:
+            {
+                auto* if_stat = stat->as<AstIf>();
+                inline_expression(state, if_stat->cond);
+                inline_block(state, if_stat->then_block);
+                for (ElseIf* elseif = if_stat->first_elseif; elseif; elseif = static_cast<ElseIf*>(elseif->next_child))
+                {
+                    inline_expression(state, elseif->cond);
+                    inline_block(state, elseif->block);
+                }
+                inline_block(state, if_stat->else_block);
+                break;
+            }
+            case AstNodeType::kWhile:
+                inline_expression(state, stat->as<AstWhile>()->cond);
+                inline_block(state, stat->as<AstWhile>()->block);
+                break;
+            case AstNodeType::kForNum:
+            {
+                auto* for_num = stat->as<AstForNum>();
+                inline_expression(state, for_num->start);
+                inline_expression(state, for_num->end);
+                inline_expression(state, for_num->step);
+                inline_scoped_block(state, for_num->block, for_num->var);
+                break;
+            }
+            case AstNodeType::kForCNumeric:
+            {
+                auto* for_c_numeric = stat->as<AstForCNumeric>();
+                inline_expression(state, for_c_numeric->start);
+                inline_expression(state, for_c_numeric->end);
+                inline_expression(state, for_c_numeric->step);
+                inline_scoped_block(state, for_c_numeric->block, for_c_numeric->var);
+                break;
+            }
+            case AstNodeType::kForIn:
+            {
+                auto* for_in = stat->as<AstForIn>();
+                for (AstNode** expr = &for_in->first_expr; *expr; expr = &(*expr)->next_child)
+                {
+                    inline_expression(state, *expr);
+                }
+                inline_scoped_block(state, for_in->block, for_in->first_name);
+                break;
+            }
+            case AstNodeType::kForC:
+            {
+                auto* for_c = stat->as<AstForC>();
+                const size_t mark = state.bindings.size();
+                if (for_c->init)
+                {
+                    inline_statement(state, for_c->init);
+                }
+                inline_expression(state, for_c->condition);
+                if (for_c->update)
+                {
+                    inline_statement(state, for_c->update);
+                }
+                inline_block(state, for_c->block);
+                state.bindings.resize(mark);
+                break;
+            }
+            case AstNodeType::kReturn:
+                for (AstNode** expr = &stat->as<AstReturn>()->first_expr; *expr; expr = &(*expr)->next_child)
+                {
+                    inline_expression(state, *expr);
+                }
+                break;
+            case AstNodeType::kDefer:
+                if (stat->as<AstDefer>()->body)
+                {
+                    inline_statement(state, stat->as<AstDefer>()->body);
+                }
+                break;
+            case AstNodeType::kScope:
+                inline_block(state, stat->as<AstScope>()->block);
+                break;
+            case AstNodeType::kBlock:
+                inline_block(state, stat->as<AstBlock>());
+                break;
+            case AstNodeType::kExprStat:
+            {
+                // A call made for its side effects is kept as a call
+                auto* expr_stat = stat->as<AstExprStat>();
+                if (auto* call = expr_stat->expr->try_as<AstFuncCall>())
+                {
+                    inline_expression(state, call->func);
+                    for (AstNode** arg = &call->first_arg; *arg; arg = &(*arg)->next_child)
+                    {
+                        inline_expression(state, *arg);
+                    }
+                }
+                else
+                {
+                    inline_expression(state, expr_stat->expr);
+                }
+                break;
+            }
+            case AstNodeType::kExportDecl:
+                inline_statement(state, stat->as<AstExportDecl>()->declaration);
+                break;
+            default:
+                break;
+        }
+    }
+
+    bool InliningPass::apply(AstOptimizationContext& context)
+    {
+        if (!context.program->block)
+        {
+            return false;
+        }
+
+        InlineState state(context.holder, context.program->is_module);
+        inline_block(state, context.program->block);
+
+        state.collecting = false;
+        state.next_id = 1;
+        inline_block(state, context.program->block);
+
+        if constexpr (kOptimizationPassDebug)
+        {
+            if (state.inlined > 0)
+            {
+                println("    Inlined {} calls", state.inlined);
+            }
+        }
+
+        return state.inlined > 0;
+    }
+
+} // namespace behl
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "ast_context.hpp"
+
+namespace behl
+{
+    // Inlining optimization pass
+    // Replaces calls of small local functions that only return a single expression with that expression. Only
+    // functions bound to a const or a local function that is never reassigned are inlined, the call has to see the
+    // same binding and its arguments have to be constants or locals.
+    struct InliningPass
+    {
+        static constexpr std::string_view kName = "Inlining";
+        static constexpr OptLevel kMinLevel = OptLevel::kO2;
+        static constexpr bool kTracksChanges = false;
+
+        static bool apply(AstOptimizationContext& context);
+    };
+
+} // namespace behl
@@ -0,0 +1,387 @@
+#include "loop_invariant_code_motion.hpp"
+
+#include "common/hash_map.hpp"
+#include "common/print.hpp"
+#include "common/vector.hpp"
+#include "config_internal.hpp"
+#include "pure_expressions.hpp"
+
+namespace behl
+{
+    // Every moved expression occupies a register for the rest of the enclosing block
+    static constexpr size_t kMaxHoistedPerLoop = 8;
+    static constexpr size_t kMaxHoistedPerFunction = 16;
+
+    namespace
+    {
+        // Expression moved in front of the loop and the local holding its value.
+        struct HoistedExpression
+        {
+            AstNode* expr = nullptr;
+            const AstString* name = nullptr;
+        };
+
+        // Stores made by the statements of one loop. Field stores keep the Member or Index node, a field store with a
+        // key that is not a constant may write any field.
+        struct LoopRegion
+        {
+            AutoHashMap<Atom, bool, AtomHash> changed;
+            AutoVector<Atom> stored_tables;
+            AutoVector<const AstNode*> stored_fields;
+            AutoVector<HoistedExpression> hoisted;
+
+            explicit LoopRegion(State* state)
+                : changed(state)
+                , stored_tables(state)
+                , stored_fields(state)
+                , hoisted(state)
+            {
+            }
+        };
+
+        struct LicmState
+        {
+            AstHolder& holder;
+            const LocalFacts& facts;
+            uint32_t step = 0;
+            size_t& next_temp;
+            size_t hoisted = 0;
+        };
+
+        enum class KeyKind : uint8_t
+        {
+            kString,
+            kConstant,
+            kUnknown,
+        };
+    } // namespace
+
+    static bool is_loop(const AstNode* stat)
+    {
+        switch (stat->type)
+        {
+            case AstNodeType::kWhile:
+            case AstNodeType::kForNum:
+            case AstNodeType::kForCNumeric:
+            case AstNodeType::kForIn:
+            case AstNodeType::kForC:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static bool is_constant(const AstNode* node)
+    {
+        switch (node->type)
+        {
+            case AstNodeType::kBool:
+            case AstNodeType::kInteger:
+            case AstNodeType::kFP:
+            case AstNodeType::kString:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static KeyKind field_key(const AstNode* access, Atom& name)
+    {
+        if (auto* member = access->try_as<AstMember>())
+        {
+            name = member->name->atom;
+            return KeyKind::kString;
+        }
+        const AstNode* key = access->as<AstIndex>()->key;
+        if (auto* str = key->try_as<AstString>())
+        {
+            name = str->atom;
+            return KeyKind::kString;
+        }
+        return is_constant(key) ? KeyKind::kConstant : KeyKind::kUnknown;
+    }
+
+    // Numbers and booleans never share a field with a string key, numeric keys are not told apart.
+    static bool may_store_field(const AstNode* store, const AstNode* read)
+    {
+        Atom store_name = kInvalidAtom;
+        Atom read_name = kInvalidAtom;
+        const KeyKind store_kind = field_key(store, store_name);
+        const KeyKind read_kind = field_key(read, read_name);
+        if (store_kind == KeyKind::kString && read_kind == KeyKind::kString)
+        {
+            return store_name == read_name;
+        }
+        return store_kind == KeyKind::kUnknown || read_kind == KeyKind::kUnknown || store_kind == read_kind;
+    }
+
+    static void record_store(LoopRegion& region, const AstNode* target)
+    {
+        if (auto* ident = target->try_as<AstIdent>())
+        {
+            region.changed.insert_or_assign(ident->name->atom, true);
+            return;
+        }
+
+        const AstNode* table = nullptr;
+        if (auto* member = target->try_as<AstMember>())
+        {
+            table = member->table;
+        }
+        else if (auto* index = target->try_as<AstIndex>())
+        {
+            table = index->table;
+        }
+        if (auto* ident = table ? table->try_as<AstIdent>() : nullptr)
+        {
+            region.stored_tables.push_back(ident->name->atom);
+            region.stored_fields.push_back(target);
+        }
+    }
+
+    static void scan_statement(LoopRegion& region, AstNode* stat)
+    {
+        switch (stat->type)
+        {
+            case AstNodeType::kLocalDecl:
+                for (const AstNode* name = stat->as<AstLocalDecl>()->first_name; name; name = name->next_child)
+                {
+                    region.changed.insert_or_assign(static_cast<const AstString*>(name)->atom, true);
+                }
+                break;
+            case AstNodeType::kFuncDefStat:
+            {
+                const AstNode* first = stat->as<AstFuncDefStat>()->first_name_part;
+                if (first && !first->next_child)
+                {
+                    region.changed.insert_or_assign(static_cast<const AstString*>(first)->atom, true);
+                }
+                break;
+            }
+            case AstNodeType::kAssign:
+                for (const AstNode* var = stat->as<AstAssign>()->first_var; var; var = var->next_child)
+                {
+                    record_store(region, var);
+                }
+                break;
+            case AstNodeType::kAssignLocal:
+                region.changed.insert_or_assign(stat->as<AstAssignLocal>()->name->atom, true);
+                break;
+            case AstNodeType::kCompoundLocal:
+                region.changed.insert_or_assign(stat->as<AstCompoundLocal>()->name->atom, true);
+                break;
+            case AstNodeType::kIncLocal:
+                region.changed.insert_or_assign(stat->as<AstIncLocal>()->name->atom, true);
+                break;
+            case AstNodeType::kDecLocal:
+                region.changed.insert_or_assign(stat->as<AstDecLocal>()->name->atom, true);
+                break;
+            case AstNodeType::kCompoundAssign:
+                record_store(region, stat->as<AstCompoundAssign>()->target);
+                break;
+            case AstNodeType::kIncrement:
+                record_store(region, stat->as<AstIncrement>()->target);
+                break;
+            case AstNodeType::kDecrement:
+                record_store(region, stat->as<AstDecrement>()->target);
+                break;
+            case AstNodeType::kForNum:
+                region.changed.insert_or_assign(stat->as<AstForNum>()->var->atom, true);
+                break;
+            case AstNodeType::kForCNumeric:
+                region.changed.insert_or_assign(stat->as<AstForCNumeric>()->var->atom, true);
+                break;
+            case AstNodeType::kForIn:
+                for (const AstNode* name = stat->as<AstForIn>()->first_name; name; name = name->next_child)
+                {
+                    region.changed.insert_or_assign(static_cast<const AstString*>(name)->atom, true);
+                }
+                break;
+            case AstNodeType::kExportDecl:
+                scan_statement(region, stat->as<AstExportDecl>()->declaration);
+                break;
+            default:
+                break;
+        }
+
+        for_each_child_statement(stat, [&](AstNode* child) { scan_statement(region, child); });
+    }
+
+    static bool is_invariant(const LoopRegion& region, AstNode* node)
+    {
+        const AstNode* table = nullptr;
+        switch (node->type)
+        {
+            case AstNodeType::kIdent:
+                return !region.changed.contains(node->as<AstIdent>()->name->atom);
+            case AstNodeType::kMember:
+                table = node->as<AstMember>()->table;
+                break;
+            case AstNodeType::kIndex:
+                table = node->as<AstIndex>()->table;
+                break;
+            default:
+            {
+                bool invariant = true;
+                for_each_subexpression(node, [&](AstNode*& child) { invariant = invariant && is_invariant(region, child); });
+                return invariant;
+            }
+        }
+
+        // Pure field reads always read a local table directly
+        const Atom name = table->as<AstIdent>()->name->atom;
+        if (region.changed.contains(name))
+        {
+            return false;
+        }
+        for (size_t i = 0; i < region.stored_tables.size(); ++i)
+        {
+            if (region.stored_tables[i] == name && may_store_field(region.stored_fields[i], node))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static bool names_local(AstNode* node)
+    {
+        if (node->is(AstNodeType::kIdent))
+        {
+            return true;
+        }
+        bool found = false;
+        for_each_subexpression(node, [&](AstNode*& child) { found = found || names_local(child); });
+        return found;
+    }
+
+    static bool should_hoist(const LicmState& state, const LoopRegion& region, AstNode* node)
+    {
+        // Plain locals and constants are as cheap to read as the local holding them
+        if (node->is(AstNodeType::kIdent) || is_constant(node) || node->is(AstNodeType::kNil))
+        {
+            return false;
+        }
+        return is_pure_expression(state.facts, node) && names_local(node) && is_invariant(region, node);
+    }
+
+    static void hoist_expression(LicmState& state, LoopRegion& region, AstNode*& slot)
+    {
+        if (should_hoist(state, region, slot))
+        {
+            for (const HoistedExpression& hoisted : region.hoisted)
+            {
+                if (same_expression(hoisted.expr, slot))
+                {
+                    replace_with_local(state.holder, slot, hoisted.name);
+                    return;
+                }
+            }
+            if (region.hoisted.size() < kMaxHoistedPerLoop && state.hoisted < kMaxHoistedPerFunction)
+            {
+                const AstString* name = make_temporary_name(state.holder, "licm", state.step, state.next_temp++);
+                state.hoisted++;
+                region.hoisted.push_back({ replace_with_local(state.holder, slot, name), name });
+                return;
+            }
+        }
+
+        for_each_subexpression(slot, [&](AstNode*& child) { hoist_expression(state, region, child); });
+    }
+
+    static void hoist_statement(LicmState& state, LoopRegion& region, AstNode* stat)
+    {
+        for_each_statement_expression(stat, [&](AstNode*& expr) { hoist_expression(state, region, expr); });
+        for_each_child_statement(stat, [&](AstNode* child) { hoist_statement(state, region, child); });
+    }
+
+    // Only the parts of the loop evaluated on every iteration are searched, the bounds of numeric loops and the
+    // iterator of a for-in loop are evaluated once anyway.
+    static void hoist_loop(LicmState& state, LoopRegion& region, AstNode* loop)
+    {
+        switch (loop->type)
+        {
+            case AstNodeType::kWhile:
+                hoist_expression(state, region, loop->as<AstWhile>()->cond);
+                hoist_statement(state, region, loop->as<AstWhile>()->block);
+                break;
+            case AstNodeType::kForC:
+            {
+                auto* for_c = loop->as<AstForC>();
+                if (for_c->condition)
+                {
+                    hoist_expression(state, region, for_c->condition);
+                }
+                if (for_c->update)
+                {
+                    hoist_statement(state, region, for_c->update);
+                }
+                if (for_c->block)
+                {
+                    hoist_statement(state, region, for_c->block);
+                }
+                break;
+            }
+            default:
+                for_each_child_statement(loop, [&](AstNode* child) { hoist_statement(state, region, child); });
+                break;
+        }
+    }
+
+    static size_t hoist_function(AstOptimizationContext& context, const FunctionBody& function, size_t& next_temp)
+    {
+        State* vm_state = context.holder.state();
+        LocalFacts facts(vm_state);
+        collect_local_facts(vm_state, function, context.program->is_module, facts);
+
+        AutoVector<AstBlock*> blocks(vm_state);
+        collect_blocks(function.block, blocks);
+
+        // Outer loops come first, what stays inside them is then tried against the inner loops
+        LicmState state{ context.holder, facts, context.step, next_temp };
+        for (AstBlock* block : blocks)
+        {
+            for (AstNode** link = &block->first_stat; *link; link = &(*link)->next_child)
+            {
+                if (!is_loop(*link))
+                {
+                    continue;
+                }
+
+                LoopRegion region(vm_state);
+                scan_statement(region, *link);
+                hoist_loop(state, region, *link);
+                for (const HoistedExpression& hoisted : region.hoisted)
+                {
+                    link = insert_local(context.holder, link, hoisted.name, hoisted.expr);
+                }
+            }
+        }
+
+        return state.hoisted;
+    }
+
+    bool LoopInvariantCodeMotionPass::apply(AstOptimizationContext& context)
+    {
+        AutoVector<FunctionBody> functions(context.holder.state());
+        collect_functions(context.program, functions);
+
+        size_t hoisted = 0;
+        size_t next_temp = 0;
+        for (const FunctionBody& function : functions)
+        {
+            hoisted += hoist_function(context, function, next_temp);
+        }
+
+        if constexpr (kOptimizationPassDebug)
+        {
+            if (hoisted > 0)
+            {
+                println("    Hoisted {} loop invariant expressions", hoisted);
+            }
+        }
+
+        return hoisted > 0;
+    }
+
+} // namespace behl
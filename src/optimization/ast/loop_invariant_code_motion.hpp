@@ -0,0 +1,20 @@
+#pragma once
+
+#include "ast_context.hpp"
+
+namespace behl
+{
+    // Loop invariant code motion pass
+    // Moves pure expressions whose operands do not change inside a loop into locals declared right before the loop.
+    // Arithmetic on locals known to hold numbers and field reads of local tables nothing else can reach are moved, see
+    // pure_expressions.hpp.
+    struct LoopInvariantCodeMotionPass
+    {
+        static constexpr std::string_view kName = "LoopInvariantCodeMotion";
+        static constexpr OptLevel kMinLevel = OptLevel::kO2;
+        static constexpr bool kTracksChanges = false;
+
+        static bool apply(AstOptimizationContext& context);
+    };
+
+} // namespace behl
@@ -53,7 +53,7 @@ namespace behl
 
             // Left side must be the loop variable
             auto* left_ident = cond_binop->left->try_as<AstIdent>();
-            if (!left_ident || left_ident->name->view() != loop_var->view())
+            if (!left_ident || left_ident->name->atom != loop_var->atom)
             {
                 return nullptr;
             }
@@ -92,7 +92,7 @@ namespace behl
             // Check post-transformation nodes first
             if (auto* inc_local = for_c->update->try_as<AstIncLocal>())
             {
-                if (inc_local->name->view() != loop_var->view())
+                if (inc_local->name->atom != loop_var->atom)
                 {
                     return nullptr;
                 }
@@ -100,7 +100,7 @@ namespace behl
             }
             else if (auto* dec_local = for_c->update->try_as<AstDecLocal>())
             {
-                if (dec_local->name->view() != loop_var->view())
+                if (dec_local->name->atom != loop_var->atom)
                 {
                     return nullptr;
                 }
@@ -108,7 +108,7 @@ namespace behl
             }
             else if (auto* compound_local = for_c->update->try_as<AstCompoundLocal>())
             {
-                if (compound_local->name->view() != loop_var->view())
+                if (compound_local->name->atom != loop_var->atom)
                 {
                     return nullptr;
                 }
@@ -129,7 +129,7 @@ namespace behl
             }
             else if (auto* assign_local = for_c->update->try_as<AstAssignLocal>())
             {
-                if (assign_local->name->view() != loop_var->view())
+                if (assign_local->name->atom != loop_var->atom)
                 {
                     return nullptr;
                 }
@@ -139,7 +139,7 @@ namespace behl
                     return nullptr;
                 }
                 auto* rhs_left = rhs_binop->left->try_as<AstIdent>();
-                if (!rhs_left || rhs_left->name->view() != loop_var->view())
+                if (!rhs_left || rhs_left->name->atom != loop_var->atom)
                 {
                     return nullptr;
                 }
@@ -162,7 +162,7 @@ namespace behl
             else if (auto* inc = for_c->update->try_as<AstIncrement>())
             {
                 auto* target_ident = inc->target->try_as<AstIdent>();
-                if (!target_ident || target_ident->name->view() != loop_var->view())
+                if (!target_ident || target_ident->name->atom != loop_var->atom)
                 {
                     return nullptr;
                 }
@@ -171,7 +171,7 @@ namespace behl
             else if (auto* dec = for_c->update->try_as<AstDecrement>())
             {
                 auto* target_ident = dec->target->try_as<AstIdent>();
-                if (!target_ident || target_ident->name->view() != loop_var->view())
+                if (!target_ident || target_ident->name->atom != loop_var->atom)
                 {
                     return nullptr;
                 }
@@ -180,7 +180,7 @@ namespace behl
             else if (auto* compound = for_c->update->try_as<AstCompoundAssign>())
             {
                 auto* target_ident = compound->target->try_as<AstIdent>();
-                if (!target_ident || target_ident->name->view() != loop_var->view())
+                if (!target_ident || target_ident->name->atom != loop_var->atom)
                 {
                     return nullptr;
                 }
@@ -202,7 +202,7 @@ namespace behl
             else if (auto* assign = for_c->update->try_as<AstAssign>())
             {
                 auto* target_ident = assign->first_var->try_as<AstIdent>();
-                if (!target_ident || target_ident->name->view() != loop_var->view())
+                if (!target_ident || target_ident->name->atom != loop_var->atom)
                 {
                     return nullptr;
                 }
@@ -216,7 +216,7 @@ namespace behl
                     return nullptr;
                 }
                 auto* rhs_left = rhs_binop->left->try_as<AstIdent>();
-                if (!rhs_left || rhs_left->name->view() != loop_var->view())
+                if (!rhs_left || rhs_left->name->atom != loop_var->atom)
                 {
                     return nullptr;
                 }
@@ -282,12 +282,7 @@ namespace behl
     {
         LoopOptimizer optimizer(context.holder);
 
-        if (context.program->block)
-        {
-            optimizer.transform_block(context.program->block);
-        }
-
-        return optimizer.has_changed();
+        return context.transform_program(optimizer);
     }
 
 } // namespace behl
@@ -10,6 +10,8 @@ namespace behl
     struct LoopOptimizationPass
     {
         static constexpr std::string_view kName = "LoopOptimization";
+        static constexpr OptLevel kMinLevel = OptLevel::kO1;
+        static constexpr bool kTracksChanges = true;
 
         static bool apply(AstOptimizationContext& context);
     };
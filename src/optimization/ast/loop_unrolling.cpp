@@ -0,0 +1,214 @@
+#include "loop_unrolling.hpp"
+
+#include "common/print.hpp"
+#include "common/vector.hpp"
+#include "config_internal.hpp"
+#include "pure_expressions.hpp"
+
+namespace behl
+{
+    // Every copy costs code size and keeps the registers of its locals until the copy ends
+    static constexpr int64_t kMaxUnrolledIterations = 8;
+    static constexpr size_t kMaxUnrolledSize = 160;
+    // Larger bounds are left to the loop, the trip count computed from smaller ones never overflows
+    static constexpr int64_t kMaxUnrolledBound = int64_t{ 1 } << 31;
+
+    static bool get_bound(const AstNode* node, int64_t& value)
+    {
+        auto* int_node = node->try_as<AstInt>();
+        if (!int_node || int_node->value < -kMaxUnrolledBound || int_node->value > kMaxUnrolledBound)
+        {
+            return false;
+        }
+        value = int_node->value;
+        return true;
+    }
+
+    // Iterations of a loop whose bounds and step are integer literals, the step is returned with its direction.
+    // Mirrors the inclusive limit the compiler passes to FORLOOP.
+    static bool get_trip_count(const AstForCNumeric* loop, int64_t& first, int64_t& step, int64_t& trips)
+    {
+        int64_t end = 0;
+        step = 1;
+        if (!get_bound(loop->start, first) || !get_bound(loop->end, end) || (loop->step && !get_bound(loop->step, step))
+            || step <= 0)
+        {
+            return false;
+        }
+
+        if (loop->ascending)
+        {
+            const int64_t last = loop->inclusive ? end : end - 1;
+            trips = last < first ? 0 : (last - first) / step + 1;
+        }
+        else
+        {
+            const int64_t last = loop->inclusive ? end : end + 1;
+            trips = first < last ? 0 : (first - last) / step + 1;
+            step = -step;
+        }
+        return true;
+    }
+
+    // Break and continue only leave the loops nested in the body, which stay loops
+    static bool can_copy(AstNode* stat, bool in_loop)
+    {
+        switch (stat->type)
+        {
+            case AstNodeType::kBreak:
+            case AstNodeType::kContinue:
+                return in_loop;
+            case AstNodeType::kDefer:
+                return false;
+            case AstNodeType::kWhile:
+            case AstNodeType::kForNum:
+            case AstNodeType::kForCNumeric:
+            case AstNodeType::kForIn:
+            case AstNodeType::kForC:
+                in_loop = true;
+                break;
+            default:
+                break;
+        }
+
+        bool copyable = true;
+        for_each_child_statement(stat, [&](AstNode* child) { copyable = copyable && can_copy(child, in_loop); });
+        return copyable;
+    }
+
+    static size_t statement_size(AstNode* stat)
+    {
+        size_t size = 1;
+        for_each_statement_expression(stat, [&](AstNode*& expr) { size += expression_size(expr); });
+        for_each_child_statement(stat, [&](AstNode* child) { size += statement_size(child); });
+        return size;
+    }
+
+    static void collect_children(AstNode* node, AutoVector<AstNode*>& children)
+    {
+        for_each_statement_expression(node, [&](AstNode*& expr) { children.push_back(expr); });
+        for_each_child_statement(node, [&](AstNode* child) { children.push_back(child); });
+        for_each_subexpression(node, [&](AstNode*& child) { children.push_back(child); });
+    }
+
+    // Clones start without a source location, errors raised in a copy report the location inside the loop body
+    static void copy_locations(State* state, AstNode* from, AstNode* to)
+    {
+        to->line = from->line;
+        to->column = from->column;
+
+        AutoVector<AstNode*> from_children(state);
+        AutoVector<AstNode*> to_children(state);
+        collect_children(from, from_children);
+        collect_children(to, to_children);
+        for (size_t i = 0; i < from_children.size() && i < to_children.size(); ++i)
+        {
+            copy_locations(state, from_children[i], to_children[i]);
+        }
+    }
+
+    static void replace_reads(AstHolder& holder, AstNode*& expr, Atom var, Integer value)
+    {
+        auto* ident = expr->try_as<AstIdent>();
+        if (ident && ident->name->atom == var)
+        {
+            auto* literal = holder.make<AstInt>(value);
+            literal->line = expr->line;
+            literal->column = expr->column;
+            literal->next_child = expr->next_child;
+            expr = literal;
+            return;
+        }
+        for_each_subexpression(expr, [&](AstNode*& child) { replace_reads(holder, child, var, value); });
+    }
+
+    static void replace_statement_reads(AstHolder& holder, AstNode* stat, Atom var, Integer value)
+    {
+        for_each_statement_expression(stat, [&](AstNode*& expr) { replace_reads(holder, expr, var, value); });
+        for_each_child_statement(stat, [&](AstNode* child) { replace_statement_reads(holder, child, var, value); });
+    }
+
+    // Puts the copies in place of the loop and moves the link past them
+    static bool try_unroll(AstHolder& holder, AstNode**& link, AstForCNumeric* loop)
+    {
+        int64_t first = 0;
+        int64_t step = 0;
+        int64_t trips = 0;
+        if (!get_trip_count(loop, first, step, trips) || trips > kMaxUnrolledIterations)
+        {
+            return false;
+        }
+
+        size_t size = 0;
+        for (AstNode* stat = loop->block ? loop->block->first_stat : nullptr; stat; stat = stat->next_child)
+        {
+            if (!can_copy(stat, false) || !keeps_local(stat, loop->var->atom))
+            {
+                return false;
+            }
+            size += statement_size(stat);
+        }
+        if (size * static_cast<size_t>(trips) > kMaxUnrolledSize)
+        {
+            return false;
+        }
+
+        // The bounds are literals, a loop running zero times or without a body leaves nothing behind
+        AstNode* next = loop->next_child;
+        *link = next;
+        for (int64_t n = 0; loop->block && n < trips; ++n)
+        {
+            auto* copy = holder.make<AstScope>();
+            copy->line = loop->line;
+            copy->column = loop->column;
+            copy->block = static_cast<AstBlock*>(loop->block->clone(holder));
+            copy_locations(holder.state(), loop->block, copy->block);
+            replace_statement_reads(holder, copy->block, loop->var->atom, first + n * step);
+
+            copy->next_child = next;
+            *link = copy;
+            link = &copy->next_child;
+        }
+        return true;
+    }
+
+    bool LoopUnrollingPass::apply(AstOptimizationContext& context)
+    {
+        AutoVector<FunctionBody> functions(context.holder.state());
+        collect_functions(context.program, functions);
+
+        // Loops nested in a copy are tried again on the next run
+        size_t unrolled = 0;
+        AutoVector<AstBlock*> blocks(context.holder.state());
+        for (const FunctionBody& function : functions)
+        {
+            blocks.clear();
+            collect_blocks(function.block, blocks);
+            for (AstBlock* block : blocks)
+            {
+                AstNode** link = &block->first_stat;
+                while (*link)
+                {
+                    auto* loop = (*link)->try_as<AstForCNumeric>();
+                    if (loop && try_unroll(context.holder, link, loop))
+                    {
+                        unrolled++;
+                        continue;
+                    }
+                    link = &(*link)->next_child;
+                }
+            }
+        }
+
+        if constexpr (kOptimizationPassDebug)
+        {
+            if (unrolled > 0)
+            {
+                println("    Unrolled {} loops", unrolled);
+            }
+        }
+
+        return unrolled > 0;
+    }
+
+} // namespace behl
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "ast_context.hpp"
+
+namespace behl
+{
+    // Loop unrolling pass
+    // Replaces a numeric for loop with a small constant trip count by one scope per iteration holding a copy of the
+    // body, each copy reads the loop variable as a literal. Bodies containing break, continue, defer or a nested
+    // function, or changing the loop variable, are left alone.
+    struct LoopUnrollingPass
+    {
+        static constexpr std::string_view kName = "LoopUnrolling";
+        static constexpr OptLevel kMinLevel = OptLevel::kO2;
+        static constexpr bool kTracksChanges = false;
+
+        static bool apply(AstOptimizationContext& context);
+    };
+
+} // namespace behl
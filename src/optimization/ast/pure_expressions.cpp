@@ -0,0 +1,1007 @@
+#include "pure_expressions.hpp"
+
+#include "common/format.hpp"
+
+#include <cmath>
+
+namespace behl
+{
+    bool LocalFacts::is_number(Atom name) const
+    {
+        auto it = locals.find(name);
+        return it != locals.end() && it->second.number;
+    }
+
+    bool LocalFacts::is_integer(Atom name) const
+    {
+        auto it = locals.find(name);
+        return it != locals.end() && it->second.integer;
+    }
+
+    bool LocalFacts::is_float(Atom name) const
+    {
+        auto it = locals.find(name);
+        return it != locals.end() && it->second.fp;
+    }
+
+    bool LocalFacts::is_table(Atom name) const
+    {
+        auto it = locals.find(name);
+        return it != locals.end() && it->second.table;
+    }
+
+    bool LocalFacts::is_known(Atom name) const
+    {
+        auto it = locals.find(name);
+        return it != locals.end() && it->second.declarations == 1 && !it->second.unusable;
+    }
+
+    static void collect_functions_in_statement(AstNode* stat, AutoVector<FunctionBody>& functions);
+
+    static void collect_functions_in_expression(AstNode* node, AutoVector<FunctionBody>& functions)
+    {
+        if (auto* func = node->try_as<AstFuncDef>())
+        {
+            functions.push_back({ func->first_param, func->self_name, func->is_method, false, func->block });
+            if (func->block)
+            {
+                collect_functions_in_statement(func->block, functions);
+            }
+            return;
+        }
+        for_each_subexpression(node, [&](AstNode*& child) { collect_functions_in_expression(child, functions); });
+    }
+
+    static void collect_functions_in_statement(AstNode* stat, AutoVector<FunctionBody>& functions)
+    {
+        AstNode* decl = stat;
+        if (auto* export_decl = stat->try_as<AstExportDecl>())
+        {
+            decl = export_decl->declaration;
+        }
+        if (auto* func = decl->try_as<AstFuncDefStat>())
+        {
+            const AstString* name = nullptr;
+            if (func->first_name_part && !func->first_name_part->next_child)
+            {
+                name = static_cast<const AstString*>(func->first_name_part);
+            }
+            functions.push_back({ func->first_param, name, func->is_method, false, func->block });
+            if (func->block)
+            {
+                collect_functions_in_statement(func->block, functions);
+            }
+            return;
+        }
+
+        for_each_statement_expression(stat, [&](AstNode*& expr) { collect_functions_in_expression(expr, functions); });
+        for_each_child_statement(stat, [&](AstNode* child) { collect_functions_in_statement(child, functions); });
+    }
+
+    void collect_functions(AstProgram* program, AutoVector<FunctionBody>& functions)
+    {
+        if (!program->block)
+        {
+            return;
+        }
+        functions.push_back({ nullptr, {}, false, true, program->block });
+        collect_functions_in_statement(program->block, functions);
+    }
+
+    static void collect_blocks_in_statement(AstNode* stat, AutoVector<AstBlock*>& blocks)
+    {
+        if (auto* block = stat->try_as<AstBlock>())
+        {
+            blocks.push_back(block);
+        }
+        for_each_child_statement(stat, [&](AstNode* child) { collect_blocks_in_statement(child, blocks); });
+    }
+
+    void collect_blocks(AstBlock* block, AutoVector<AstBlock*>& blocks)
+    {
+        if (block)
+        {
+            collect_blocks_in_statement(block, blocks);
+        }
+    }
+
+    namespace
+    {
+        enum class SourceKind : uint8_t
+        {
+            kUnknown,
+            kStep,       // The previous value stepped by one
+            kLoop,       // expr is the numeric for loop counting the variable
+            kExpression, // expr is the value
+            kCompound,   // expr is combined with the previous value by the arithmetic operator op
+        };
+
+        // Value given to a local by a declaration or an assignment.
+        struct ValueSource
+        {
+            Atom name = kInvalidAtom;
+            SourceKind kind = SourceKind::kUnknown;
+            TokenType op = TokenType::kPlus;
+            const AstNode* expr = nullptr;
+        };
+
+        // Walks one function, the bodies of nested functions are only searched for the names they use.
+        struct FactsCollector
+        {
+            LocalFacts& facts;
+            bool is_module = false;
+            AutoVector<ValueSource> sources;
+            AutoVector<Atom> scope;
+            AutoHashMap<Atom, uint32_t, AtomHash> visible;
+            uint32_t nested = 0;
+            uint32_t block_depth = 0;
+
+            FactsCollector(LocalFacts& f, State* state, bool module)
+                : facts(f)
+                , is_module(module)
+                , sources(state)
+                , scope(state)
+                , visible(state)
+            {
+            }
+
+            LocalInfo& info(Atom name)
+            {
+                auto it = facts.locals.find(name);
+                if (it == facts.locals.end())
+                {
+                    it = facts.locals.insert_or_assign(name, LocalInfo{});
+                }
+                return it->second;
+            }
+
+            bool is_visible(Atom name) const
+            {
+                auto it = visible.find(name);
+                return it != visible.end() && it->second > 0;
+            }
+
+            void declare(Atom name, SourceKind kind, const AstNode* expr = nullptr)
+            {
+                if (nested > 0)
+                {
+                    return;
+                }
+                info(name).declarations++;
+                auto it = visible.find(name);
+                visible.insert_or_assign(name, it == visible.end() ? 1u : it->second + 1);
+                scope.push_back(name);
+                sources.push_back({ name, kind, TokenType::kPlus, expr });
+            }
+
+            void close_scope(size_t mark)
+            {
+                while (scope.size() > mark)
+                {
+                    visible.find(scope.back())->second--;
+                    scope.pop_back();
+                }
+            }
+
+            void use(Atom name, bool as_table)
+            {
+                if (nested > 0 || !is_visible(name))
+                {
+                    info(name).unusable = true;
+                }
+                else if (!as_table)
+                {
+                    info(name).escapes = true;
+                }
+            }
+
+            void write(Atom name, SourceKind kind, const AstNode* expr = nullptr,
+                TokenType op = TokenType::kPlus)
+            {
+                if (nested > 0 || !is_visible(name))
+                {
+                    info(name).unusable = true;
+                    return;
+                }
+                sources.push_back({ name, kind, op, expr });
+            }
+        };
+    } // namespace
+
+    static void collect_statement(FactsCollector& collector, const AstNode* stat);
+
+    static void collect_expression(FactsCollector& collector, const AstNode* node, bool as_table = false)
+    {
+        switch (node->type)
+        {
+            case AstNodeType::kIdent:
+                collector.use(node->as<AstIdent>()->name->atom, as_table);
+                break;
+            case AstNodeType::kMember:
+                collect_expression(collector, node->as<AstMember>()->table, true);
+                break;
+            case AstNodeType::kIndex:
+                collect_expression(collector, node->as<AstIndex>()->table, true);
+                collect_expression(collector, node->as<AstIndex>()->key);
+                break;
+            case AstNodeType::kFuncDef:
+            {
+                // Every name a nested function uses may be captured
+                auto* func = node->as<AstFuncDef>();
+                if (func->block)
+                {
+                    collector.nested++;
+                    collect_statement(collector, func->block);
+                    collector.nested--;
+                }
+                break;
+            }
+            default:
+                for_each_subexpression(const_cast<AstNode*>(node),
+                    [&](AstNode*& child) { collect_expression(collector, child); });
+                break;
+        }
+    }
+
+    static void collect_target(FactsCollector& collector, const AstNode* target, SourceKind kind,
+        const AstNode* expr = nullptr, TokenType op = TokenType::kPlus)
+    {
+        if (auto* ident = target->try_as<AstIdent>())
+        {
+            collector.write(ident->name->atom, kind, expr, op);
+        }
+        else
+        {
+            collect_expression(collector, target);
+        }
+    }
+
+    static void collect_function_stat(FactsCollector& collector, const AstFuncDefStat* func)
+    {
+        const AstNode* first = func->first_name_part;
+        if (first && !first->next_child && !func->is_method)
+        {
+            const Atom name = static_cast<const AstString*>(first)->atom;
+            if (func->is_local || (collector.is_module && collector.block_depth == 1))
+            {
+                collector.declare(name, SourceKind::kUnknown);
+            }
+            else if (collector.is_visible(name))
+            {
+                collector.write(name, SourceKind::kUnknown);
+            }
+        }
+        else if (first)
+        {
+            // The function is stored into the table, which may then call it with the table
+            collector.use(static_cast<const AstString*>(first)->atom, false);
+        }
+
+        if (func->block)
+        {
+            collector.nested++;
+            collect_statement(collector, func->block);
+            collector.nested--;
+        }
+    }
+
+    static void collect_local_decl(FactsCollector& collector, const AstLocalDecl* decl)
+    {
+        for (const AstNode* init = decl->first_init; init; init = init->next_child)
+        {
+            collect_expression(collector, init);
+        }
+        const AstNode* init = decl->first_init;
+        for (const AstNode* name = decl->first_name; name; name = name->next_child)
+        {
+            // Names without a value of their own start out nil or take one of several results of a call
+            collector.declare(
+                static_cast<const AstString*>(name)->atom, init ? SourceKind::kExpression : SourceKind::kUnknown, init);
+            if (init)
+            {
+                init = init->next_child;
+            }
+        }
+    }
+
+    static void collect_statement(FactsCollector& collector, const AstNode* stat)
+    {
+        switch (stat->type)
+        {
+            case AstNodeType::kBlock:
+            {
+                const size_t mark = collector.scope.size();
+                collector.block_depth++;
+                for (const AstNode* child = stat->as<AstBlock>()->first_stat; child; child = child->next_child)
+                {
+                    collect_statement(collector, child);
+                }
+                collector.block_depth--;
+                collector.close_scope(mark);
+                return;
+            }
+            case AstNodeType::kLocalDecl:
+                collect_local_decl(collector, stat->as<AstLocalDecl>());
+                return;
+            case AstNodeType::kFuncDefStat:
+                collect_function_stat(collector, stat->as<AstFuncDefStat>());
+                return;
+            case AstNodeType::kAssign:
+            {
+                auto* assign = stat->as<AstAssign>();
+                const bool single = !assign->first_var->next_child && !assign->first_expr->next_child;
+                for (const AstNode* expr = assign->first_expr; expr; expr = expr->next_child)
+                {
+                    collect_expression(collector, expr);
+                }
+                for (const AstNode* var = assign->first_var; var; var = var->next_child)
+                {
+                    collect_target(collector, var, single ? SourceKind::kExpression : SourceKind::kUnknown,
+                        assign->first_expr);
+                }
+                return;
+            }
+            case AstNodeType::kAssignLocal:
+                collect_expression(collector, stat->as<AstAssignLocal>()->expr);
+                collector.write(stat->as<AstAssignLocal>()->name->atom, SourceKind::kExpression,
+                    stat->as<AstAssignLocal>()->expr);
+                return;
+            case AstNodeType::kAssignUpvalue:
+                collect_expression(collector, stat->as<AstAssignUpvalue>()->expr);
+                collector.write(stat->as<AstAssignUpvalue>()->name->atom, SourceKind::kUnknown);
+                return;
+            case AstNodeType::kCompoundAssign:
+            {
+                auto* compound = stat->as<AstCompoundAssign>();
+                collect_expression(collector, compound->expr);
+                collect_target(collector, compound->target, SourceKind::kCompound, compound->expr, compound->op);
+                return;
+            }
+            case AstNodeType::kCompoundLocal:
+            {
+                auto* compound = stat->as<AstCompoundLocal>();
+                collect_expression(collector, compound->expr);
+                collector.write(compound->name->atom, SourceKind::kCompound, compound->expr, compound->op);
+                return;
+            }
+            case AstNodeType::kCompoundUpvalue:
+                collect_expression(collector, stat->as<AstCompoundUpvalue>()->expr);
+                collector.write(stat->as<AstCompoundUpvalue>()->name->atom, SourceKind::kUnknown);
+                return;
+            // Stepping a number by one gives a number of the same kind
+            case AstNodeType::kIncrement:
+                collect_target(collector, stat->as<AstIncrement>()->target, SourceKind::kStep);
+                return;
+            case AstNodeType::kDecrement:
+                collect_target(collector, stat->as<AstDecrement>()->target, SourceKind::kStep);
+                return;
+            case AstNodeType::kIncLocal:
+                collector.write(stat->as<AstIncLocal>()->name->atom, SourceKind::kStep);
+                return;
+            case AstNodeType::kDecLocal:
+                collector.write(stat->as<AstDecLocal>()->name->atom, SourceKind::kStep);
+                return;
+            case AstNodeType::kIncUpvalue:
+                collector.write(stat->as<AstIncUpvalue>()->name->atom, SourceKind::kUnknown);
+                return;
+            case AstNodeType::kDecUpvalue:
+                collector.write(stat->as<AstDecUpvalue>()->name->atom, SourceKind::kUnknown);
+                return;
+            case AstNodeType::kForNum:
+            {
+                auto* for_num = stat->as<AstForNum>();
+                for_each_statement_expression(
+                    const_cast<AstNode*>(stat), [&](AstNode*& expr) { collect_expression(collector, expr); });
+                const size_t mark = collector.scope.size();
+                collector.declare(for_num->var->atom, SourceKind::kLoop, stat);
+                collect_statement(collector, for_num->block);
+                collector.close_scope(mark);
+                return;
+            }
+            case AstNodeType::kForCNumeric:
+            {
+                auto* for_c_numeric = stat->as<AstForCNumeric>();
+                for_each_statement_expression(
+                    const_cast<AstNode*>(stat), [&](AstNode*& expr) { collect_expression(collector, expr); });
+                const size_t mark = collector.scope.size();
+                collector.declare(for_c_numeric->var->atom, SourceKind::kLoop, stat);
+                collect_statement(collector, for_c_numeric->block);
+                collector.close_scope(mark);
+                return;
+            }
+            case AstNodeType::kForIn:
+            {
+                auto* for_in = stat->as<AstForIn>();
+                for_each_statement_expression(
+                    const_cast<AstNode*>(stat), [&](AstNode*& expr) { collect_expression(collector, expr); });
+                const size_t mark = collector.scope.size();
+                for (const AstNode* name = for_in->first_name; name; name = name->next_child)
+                {
+                    // Without let the loop assigns variables declared before it
+                    const Atom atom = static_cast<const AstString*>(name)->atom;
+                    if (for_in->declares_variables)
+                    {
+                        collector.declare(atom, SourceKind::kUnknown);
+                    }
+                    else
+                    {
+                        collector.write(atom, SourceKind::kUnknown);
+                    }
+                }
+                collect_statement(collector, for_in->block);
+                collector.close_scope(mark);
+                return;
+            }
+            case AstNodeType::kForC:
+            {
+                auto* for_c = stat->as<AstForC>();
+                const size_t mark = collector.scope.size();
+                if (for_c->init)
+                {
+                    collect_statement(collector, for_c->init);
+                }
+                if (for_c->condition)
+                {
+                    collect_expression(collector, for_c->condition);
+                }
+                if (for_c->update)
+                {
+                    collect_statement(collector, for_c->update);
+                }
+                collect_statement(collector, for_c->block);
+                collector.close_scope(mark);
+                return;
+            }
+            case AstNodeType::kExportDecl:
+            {
+                // Exported values are read by the importing code
+                const AstNode* decl = stat->as<AstExportDecl>()->declaration;
+                collect_statement(collector, decl);
+                if (auto* local_decl = decl->try_as<AstLocalDecl>())
+                {
+                    for (const AstNode* name = local_decl->first_name; name; name = name->next_child)
+                    {
+                        collector.use(static_cast<const AstString*>(name)->atom, false);
+                    }
+                }
+                return;
+            }
+            case AstNodeType::kExportList:
+                for (const AstNode* name = stat->as<AstExportList>()->first_name; name; name = name->next_child)
+                {
+                    collector.use(static_cast<const AstString*>(name)->atom, false);
+                }
+                return;
+            default:
+                break;
+        }
+
+        AstNode* mutable_stat = const_cast<AstNode*>(stat);
+        for_each_statement_expression(mutable_stat, [&](AstNode*& expr) { collect_expression(collector, expr); });
+        for_each_child_statement(mutable_stat, [&](AstNode* child) { collect_statement(collector, child); });
+    }
+
+    static bool is_arithmetic(TokenType op)
+    {
+        switch (op)
+        {
+            case TokenType::kPlus:
+            case TokenType::kMinus:
+            case TokenType::kStar:
+            case TokenType::kSlash:
+            case TokenType::kPercent:
+            case TokenType::kPower:
+            case TokenType::kPlusAssign:
+            case TokenType::kMinusAssign:
+            case TokenType::kStarAssign:
+            case TokenType::kSlashAssign:
+            case TokenType::kPercentAssign:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static bool is_division(TokenType op)
+    {
+        return op == TokenType::kSlash || op == TokenType::kSlashAssign;
+    }
+
+    // Integers stay integers except through division, a float operand makes the result a float
+    static NumberKind arithmetic_kind(TokenType op, NumberKind lhs, NumberKind rhs)
+    {
+        if (!is_arithmetic(op) || lhs == NumberKind::kNone || rhs == NumberKind::kNone)
+        {
+            return NumberKind::kNone;
+        }
+        if (is_division(op) || lhs == NumberKind::kFloat || rhs == NumberKind::kFloat)
+        {
+            return NumberKind::kFloat;
+        }
+        return lhs == NumberKind::kInteger && rhs == NumberKind::kInteger ? NumberKind::kInteger : NumberKind::kNumber;
+    }
+
+    // The counter of a numeric for loop only stays an integer when its start, limit and step are integers
+    static NumberKind loop_kind(const LocalFacts& facts, const AstNode* loop)
+    {
+        const AstNode* bounds[3] = {};
+        if (auto* for_num = loop->try_as<AstForNum>())
+        {
+            bounds[0] = for_num->start;
+            bounds[1] = for_num->end;
+            bounds[2] = for_num->step;
+        }
+        else if (auto* for_c_numeric = loop->try_as<AstForCNumeric>())
+        {
+            bounds[0] = for_c_numeric->start;
+            bounds[1] = for_c_numeric->end;
+            bounds[2] = for_c_numeric->step;
+        }
+
+        NumberKind kind = NumberKind::kInteger;
+        for (const AstNode* bound : bounds)
+        {
+            if (bound)
+            {
+                kind = arithmetic_kind(TokenType::kPlus, kind, number_kind(facts, bound));
+            }
+        }
+        return kind;
+    }
+
+    // Kind of the value the source gives the local, previous is the kind the local is assumed to have before
+    static NumberKind source_kind(const LocalFacts& facts, const ValueSource& source, NumberKind previous)
+    {
+        switch (source.kind)
+        {
+            case SourceKind::kStep:
+                return previous;
+            case SourceKind::kLoop:
+                return loop_kind(facts, source.expr);
+            case SourceKind::kExpression:
+                return number_kind(facts, source.expr);
+            case SourceKind::kCompound:
+                return arithmetic_kind(source.op, previous, number_kind(facts, source.expr));
+            default:
+                return NumberKind::kNone;
+        }
+    }
+
+    static bool source_is_number(const LocalFacts& facts, const ValueSource& source)
+    {
+        switch (source.kind)
+        {
+            case SourceKind::kStep:
+            case SourceKind::kLoop:
+                return true;
+            case SourceKind::kExpression:
+                return is_number_expression(facts, source.expr);
+            case SourceKind::kCompound:
+                return is_arithmetic(source.op) && is_number_expression(facts, source.expr);
+            default:
+                return false;
+        }
+    }
+
+    void collect_local_facts(State* state, const FunctionBody& function, bool is_module, LocalFacts& facts)
+    {
+        FactsCollector collector(facts, state, is_module && function.is_chunk);
+        if (function.is_method)
+        {
+            collector.declare(kAtomSelf, SourceKind::kUnknown);
+        }
+        else if (function.self_name)
+        {
+            collector.declare(function.self_name->atom, SourceKind::kUnknown);
+        }
+        for (const AstNode* p = function.first_param; p; p = p->next_child)
+        {
+            collector.declare(static_cast<const AstString*>(p)->atom, SourceKind::kUnknown);
+        }
+        collect_statement(collector, function.block);
+
+        for (auto& [name, info] : facts.locals)
+        {
+            info.number = info.declarations == 1 && !info.unusable;
+        }
+        for (const ValueSource& source : collector.sources)
+        {
+            LocalInfo& info = facts.locals.find(source.name)->second;
+            info.sources++;
+            info.table = info.table || (source.kind == SourceKind::kExpression && source.expr->is(AstNodeType::kTableCtor));
+        }
+        for (auto& [name, info] : facts.locals)
+        {
+            info.table = info.table && info.sources == 1 && info.declarations == 1 && !info.unusable && !info.escapes;
+        }
+
+        // A local holds numbers when all of its values are numbers, assuming so for the locals not yet disproven
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (const ValueSource& source : collector.sources)
+            {
+                LocalInfo& info = facts.locals.find(source.name)->second;
+                if (info.number && !source_is_number(facts, source))
+                {
+                    info.number = false;
+                    changed = true;
+                }
+            }
+        }
+
+        // Numbers are split into integers and floats the same way, every value has to keep the kind assumed
+        const auto refine = [&](bool LocalInfo::*flag, NumberKind kind) {
+            bool refined = true;
+            while (refined)
+            {
+                refined = false;
+                for (const ValueSource& source : collector.sources)
+                {
+                    LocalInfo& info = facts.locals.find(source.name)->second;
+                    if (info.*flag && source_kind(facts, source, kind) != kind)
+                    {
+                        info.*flag = false;
+                        refined = true;
+                    }
+                }
+            }
+        };
+        for (auto& [name, info] : facts.locals)
+        {
+            info.integer = info.number;
+        }
+        refine(&LocalInfo::integer, NumberKind::kInteger);
+        for (auto& [name, info] : facts.locals)
+        {
+            info.fp = info.number && !info.integer;
+        }
+        refine(&LocalInfo::fp, NumberKind::kFloat);
+    }
+
+    bool is_number_expression(const LocalFacts& facts, const AstNode* node)
+    {
+        return number_kind(facts, node) != NumberKind::kNone;
+    }
+
+    NumberKind number_kind(const LocalFacts& facts, const AstNode* node)
+    {
+        switch (node->type)
+        {
+            case AstNodeType::kInteger:
+                return NumberKind::kInteger;
+            case AstNodeType::kFP:
+                return NumberKind::kFloat;
+            case AstNodeType::kIdent:
+            {
+                const Atom name = node->as<AstIdent>()->name->atom;
+                if (facts.is_integer(name))
+                {
+                    return NumberKind::kInteger;
+                }
+                if (facts.is_float(name))
+                {
+                    return NumberKind::kFloat;
+                }
+                return facts.is_number(name) ? NumberKind::kNumber : NumberKind::kNone;
+            }
+            case AstNodeType::kBinOp:
+            {
+                auto* binop = node->as<AstBinOp>();
+                return arithmetic_kind(binop->op, number_kind(facts, binop->left), number_kind(facts, binop->right));
+            }
+            case AstNodeType::kUnOp:
+            {
+                auto* unop = node->as<AstUnOp>();
+                return unop->op == TokenType::kMinus ? number_kind(facts, unop->expr) : NumberKind::kNone;
+            }
+            default:
+                return NumberKind::kNone;
+        }
+    }
+
+    static bool is_literal(const AstNode* node)
+    {
+        switch (node->type)
+        {
+            case AstNodeType::kNil:
+            case AstNodeType::kBool:
+            case AstNodeType::kInteger:
+            case AstNodeType::kFP:
+            case AstNodeType::kString:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // Integer remainder by zero raises an error, and so does the smallest integer by -1 on some machines
+    static bool is_safe_divisor(const AstNode* node)
+    {
+        if (auto* int_node = node->try_as<AstInt>())
+        {
+            return int_node->value > 0;
+        }
+        if (auto* fp_node = node->try_as<AstFP>())
+        {
+            return fp_node->value != 0;
+        }
+        return false;
+    }
+
+    static bool is_table_read(const LocalFacts& facts, const AstNode* table)
+    {
+        auto* ident = table->try_as<AstIdent>();
+        return ident && facts.is_table(ident->name->atom);
+    }
+
+    bool is_pure_expression(const LocalFacts& facts, const AstNode* node)
+    {
+        switch (node->type)
+        {
+            case AstNodeType::kNil:
+            case AstNodeType::kBool:
+            case AstNodeType::kInteger:
+            case AstNodeType::kFP:
+            case AstNodeType::kString:
+                return true;
+            case AstNodeType::kIdent:
+                return facts.is_known(node->as<AstIdent>()->name->atom);
+            case AstNodeType::kBinOp:
+            {
+                auto* binop = node->as<AstBinOp>();
+                switch (binop->op)
+                {
+                    case TokenType::kPercent:
+                        if (!is_safe_divisor(binop->right))
+                        {
+                            return false;
+                        }
+                        [[fallthrough]];
+                    case TokenType::kPlus:
+                    case TokenType::kMinus:
+                    case TokenType::kStar:
+                    case TokenType::kSlash:
+                    case TokenType::kPower:
+                    case TokenType::kLt:
+                    case TokenType::kLe:
+                    case TokenType::kGt:
+                    case TokenType::kGe:
+                        return is_number_expression(facts, binop->left) && is_number_expression(facts, binop->right)
+                            && is_pure_expression(facts, binop->left) && is_pure_expression(facts, binop->right);
+                    default:
+                        return false;
+                }
+            }
+            case AstNodeType::kUnOp:
+            {
+                auto* unop = node->as<AstUnOp>();
+                return unop->op == TokenType::kMinus && is_number_expression(facts, unop->expr)
+                    && is_pure_expression(facts, unop->expr);
+            }
+            case AstNodeType::kMember:
+                return is_table_read(facts, node->as<AstMember>()->table);
+            case AstNodeType::kIndex:
+            {
+                // A nil key raises an error
+                auto* index = node->as<AstIndex>();
+                return is_table_read(facts, index->table) && is_literal(index->key) && !index->key->is(AstNodeType::kNil);
+            }
+            default:
+                return false;
+        }
+    }
+
+    bool same_expression(const AstNode* lhs, const AstNode* rhs)
+    {
+        if (lhs->type != rhs->type)
+        {
+            return false;
+        }
+
+        switch (lhs->type)
+        {
+            case AstNodeType::kNil:
+                return true;
+            case AstNodeType::kBool:
+                return lhs->as<AstBool>()->value == rhs->as<AstBool>()->value;
+            case AstNodeType::kInteger:
+                return lhs->as<AstInt>()->value == rhs->as<AstInt>()->value;
+            case AstNodeType::kFP:
+            {
+                // 0.0 and -0.0 compare equal but divide differently
+                const FP a = lhs->as<AstFP>()->value;
+                const FP b = rhs->as<AstFP>()->value;
+                return a == b && std::signbit(a) == std::signbit(b);
+            }
+            case AstNodeType::kString:
+                return lhs->as<AstString>()->atom == rhs->as<AstString>()->atom;
+            case AstNodeType::kIdent:
+                return lhs->as<AstIdent>()->name->atom == rhs->as<AstIdent>()->name->atom;
+            case AstNodeType::kBinOp:
+            {
+                auto* a = lhs->as<AstBinOp>();
+                auto* b = rhs->as<AstBinOp>();
+                return a->op == b->op && same_expression(a->left, b->left) && same_expression(a->right, b->right);
+            }
+            case AstNodeType::kUnOp:
+            {
+                auto* a = lhs->as<AstUnOp>();
+                auto* b = rhs->as<AstUnOp>();
+                return a->op == b->op && same_expression(a->expr, b->expr);
+            }
+            case AstNodeType::kMember:
+            {
+                auto* a = lhs->as<AstMember>();
+                auto* b = rhs->as<AstMember>();
+                return a->name->atom == b->name->atom && same_expression(a->table, b->table);
+            }
+            case AstNodeType::kIndex:
+            {
+                auto* a = lhs->as<AstIndex>();
+                auto* b = rhs->as<AstIndex>();
+                return same_expression(a->table, b->table) && same_expression(a->key, b->key);
+            }
+            default:
+                return false;
+        }
+    }
+
+    size_t expression_size(const AstNode* node)
+    {
+        size_t size = 1;
+        for_each_subexpression(const_cast<AstNode*>(node), [&](AstNode*& child) { size += expression_size(child); });
+        return size;
+    }
+
+    static bool defines_function(AstNode* node)
+    {
+        if (node->is(AstNodeType::kFuncDef))
+        {
+            return true;
+        }
+        bool found = false;
+        for_each_subexpression(node, [&](AstNode*& child) { found = found || defines_function(child); });
+        return found;
+    }
+
+    static bool is_local_target(const AstNode* target, Atom name)
+    {
+        auto* ident = target->try_as<AstIdent>();
+        return ident && ident->name->atom == name;
+    }
+
+    static bool names_atom(const AstNode* first, Atom name)
+    {
+        for (const AstNode* node = first; node; node = node->next_child)
+        {
+            if (static_cast<const AstString*>(node)->atom == name)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool keeps_local(AstNode* stat, Atom name)
+    {
+        switch (stat->type)
+        {
+            case AstNodeType::kLocalDecl:
+                if (names_atom(stat->as<AstLocalDecl>()->first_name, name))
+                {
+                    return false;
+                }
+                break;
+            case AstNodeType::kAssign:
+                for (const AstNode* var = stat->as<AstAssign>()->first_var; var; var = var->next_child)
+                {
+                    if (is_local_target(var, name))
+                    {
+                        return false;
+                    }
+                }
+                break;
+            case AstNodeType::kAssignLocal:
+                if (stat->as<AstAssignLocal>()->name->atom == name)
+                {
+                    return false;
+                }
+                break;
+            case AstNodeType::kCompoundLocal:
+                if (stat->as<AstCompoundLocal>()->name->atom == name)
+                {
+                    return false;
+                }
+                break;
+            case AstNodeType::kIncLocal:
+                if (stat->as<AstIncLocal>()->name->atom == name)
+                {
+                    return false;
+                }
+                break;
+            case AstNodeType::kDecLocal:
+                if (stat->as<AstDecLocal>()->name->atom == name)
+                {
+                    return false;
+                }
+                break;
+            case AstNodeType::kCompoundAssign:
+                if (is_local_target(stat->as<AstCompoundAssign>()->target, name))
+                {
+                    return false;
+                }
+                break;
+            case AstNodeType::kIncrement:
+                if (is_local_target(stat->as<AstIncrement>()->target, name))
+                {
+                    return false;
+                }
+                break;
+            case AstNodeType::kDecrement:
+                if (is_local_target(stat->as<AstDecrement>()->target, name))
+                {
+                    return false;
+                }
+                break;
+            case AstNodeType::kForNum:
+                if (stat->as<AstForNum>()->var->atom == name)
+                {
+                    return false;
+                }
+                break;
+            case AstNodeType::kForCNumeric:
+                if (stat->as<AstForCNumeric>()->var->atom == name)
+                {
+                    return false;
+                }
+                break;
+            case AstNodeType::kForIn:
+                if (names_atom(stat->as<AstForIn>()->first_name, name))
+                {
+                    return false;
+                }
+                break;
+            case AstNodeType::kFuncDefStat:
+            case AstNodeType::kExportDecl:
+                return false;
+            default:
+                break;
+        }
+
+        bool keeps = true;
+        for_each_statement_expression(stat, [&](AstNode*& expr) { keeps = keeps && !defines_function(expr); });
+        for_each_child_statement(stat, [&](AstNode* child) { keeps = keeps && keeps_local(child, name); });
+        return keeps;
+    }
+
+    const AstString* make_temporary_name(AstHolder& holder, std::string_view pass, uint32_t step, size_t index)
+    {
+        return holder.make_string(behl::format("({} {}.{})", pass, step, index));
+    }
+
+    AstNode* replace_with_local(AstHolder& holder, AstNode*& slot, const AstString* name)
+    {
+        AstNode* expr = slot;
+        auto* ident = holder.make<AstIdent>(static_cast<AstString*>(name->clone(holder)));
+        ident->line = expr->line;
+        ident->column = expr->column;
+        ident->next_child = expr->next_child;
+        expr->next_child = nullptr;
+        slot = ident;
+        return expr;
+    }
+
+    AstNode** insert_local(AstHolder& holder, AstNode** link, const AstString* name, AstNode* value)
+    {
+        AstNode* stat = *link;
+        auto* decl = holder.make<AstLocalDecl>(false, static_cast<AstString*>(name->clone(holder)), value);
+        decl->line = stat->line;
+        decl->column = stat->column;
+        decl->next_child = stat;
+        *link = decl;
+        return &decl->next_child;
+    }
+
+} // namespace behl
@@ -0,0 +1,344 @@
+#pragma once
+
+#include "ast_context.hpp"
+#include "common/hash_map.hpp"
+#include "common/vector.hpp"
+
+#include <string_view>
+
+namespace behl
+{
+    // Body of the program or of a function inside it, the program counts as a function without parameters.
+    struct FunctionBody
+    {
+        const AstString* first_param = nullptr;
+        const AstString* self_name = nullptr;
+        bool is_method = false;
+        bool is_chunk = false;
+        AstBlock* block = nullptr;
+    };
+
+    struct LocalInfo
+    {
+        uint32_t declarations = 0;
+        uint32_t sources = 0;
+        bool unusable = false; // Named outside of its scope or by a nested function
+        bool escapes = false;  // Used for more than the table of a field access
+        bool number = false;
+        bool integer = false;
+        bool fp = false;
+        bool table = false;
+    };
+
+    enum class NumberKind : uint8_t
+    {
+        kNone, // May not be a number
+        kNumber,
+        kInteger,
+        kFloat,
+    };
+
+    // What the passes moving expressions around may assume about the locals of one function. Only locals declared
+    // once and never named by a nested function are described, nothing but the function itself can change them.
+    struct LocalFacts
+    {
+        AutoHashMap<Atom, LocalInfo, AtomHash> locals;
+
+        explicit LocalFacts(State* state)
+            : locals(state)
+        {
+        }
+
+        // The local only ever holds numbers
+        bool is_number(Atom name) const;
+        // The local only ever holds integers, or only ever holds floats
+        bool is_integer(Atom name) const;
+        bool is_float(Atom name) const;
+        // The local holds a table made by a constructor that is only indexed directly. No other code can reach the
+        // table, so it has no metatable and only changes through the assignments of the function.
+        bool is_table(Atom name) const;
+        bool is_known(Atom name) const;
+    };
+
+    // Calls fn for every expression the statement evaluates itself. Of assignment targets only the parts evaluated
+    // before the store are visited, nested blocks and statements are left to for_each_child_statement.
+    template<typename Fn>
+    void for_each_statement_expression(AstNode* stat, Fn&& fn)
+    {
+        const auto target = [&](AstNode*& node) {
+            if (auto* member = node->try_as<AstMember>())
+            {
+                fn(member->table);
+            }
+            else if (auto* index = node->try_as<AstIndex>())
+            {
+                fn(index->table);
+                fn(index->key);
+            }
+            else if (!node->is(AstNodeType::kIdent))
+            {
+                fn(node);
+            }
+        };
+
+        switch (stat->type)
+        {
+            case AstNodeType::kLocalDecl:
+                for (AstNode** init = &stat->as<AstLocalDecl>()->first_init; *init; init = &(*init)->next_child)
+                {
+                    fn(*init);
+                }
+                break;
+            case AstNodeType::kAssign:
+                for (AstNode** var = &stat->as<AstAssign>()->first_var; *var; var = &(*var)->next_child)
+                {
+                    target(*var);
+                }
+                for (AstNode** expr = &stat->as<AstAssign>()->first_expr; *expr; expr = &(*expr)->next_child)
+                {
+                    fn(*expr);
+                }
+                break;
+            case AstNodeType::kAssignLocal:
+                fn(stat->as<AstAssignLocal>()->expr);
+                break;
+            case AstNodeType::kAssignGlobal:
+                fn(stat->as<AstAssignGlobal>()->expr);
+                break;
+            case AstNodeType::kAssignUpvalue:
+                fn(stat->as<AstAssignUpvalue>()->expr);
+                break;
+            case AstNodeType::kCompoundAssign:
+                target(stat->as<AstCompoundAssign>()->target);
+                fn(stat->as<AstCompoundAssign>()->expr);
+                break;
+            case AstNodeType::kCompoundLocal:
+                fn(stat->as<AstCompoundLocal>()->expr);
+                break;
+            case AstNodeType::kCompoundGlobal:
+                fn(stat->as<AstCompoundGlobal>()->expr);
+                break;
+            case AstNodeType::kCompoundUpvalue:
+                fn(stat->as<AstCompoundUpvalue>()->expr);
+                break;
+            case AstNodeType::kIncrement:
+                target(stat->as<AstIncrement>()->target);
+                break;
+            case AstNodeType::kDecrement:
+                target(stat->as<AstDecrement>()->target);
+                break;
+            case AstNodeType::kIf:
+            {
+                auto* if_stat = stat->as<AstIf>();
+                fn(if_stat->cond);
+                for (ElseIf* elseif = if_stat->first_elseif; elseif; elseif = static_cast<ElseIf*>(elseif->next_child))
+                {
+                    fn(elseif->cond);
+                }
+                break;
+            }
+            case AstNodeType::kWhile:
+                fn(stat->as<AstWhile>()->cond);
+                break;
+            case AstNodeType::kForNum:
+            {
+                auto* for_num = stat->as<AstForNum>();
+                fn(for_num->start);
+                fn(for_num->end);
+                if (for_num->step)
+                {
+                    fn(for_num->step);
+                }
+                break;
+            }
+            case AstNodeType::kForCNumeric:
+            {
+                auto* for_c_numeric = stat->as<AstForCNumeric>();
+                fn(for_c_numeric->start);
+                fn(for_c_numeric->end);
+                if (for_c_numeric->step)
+                {
+                    fn(for_c_numeric->step);
+                }
+                break;
+            }
+            case AstNodeType::kForIn:
+                for (AstNode** expr = &stat->as<AstForIn>()->first_expr; *expr; expr = &(*expr)->next_child)
+                {
+                    fn(*expr);
+                }
+                break;
+            case AstNodeType::kForC:
+                if (stat->as<AstForC>()->condition)
+                {
+                    fn(stat->as<AstForC>()->condition);
+                }
+                break;
+            case AstNodeType::kReturn:
+                for (AstNode** expr = &stat->as<AstReturn>()->first_expr; *expr; expr = &(*expr)->next_child)
+                {
+                    fn(*expr);
+                }
+                break;
+            case AstNodeType::kExprStat:
+                fn(stat->as<AstExprStat>()->expr);
+                break;
+            case AstNodeType::kExportDecl:
+                for_each_statement_expression(stat->as<AstExportDecl>()->declaration, fn);
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Calls fn for the statements running as part of the statement in the same function: its blocks, passed as
+    // AstBlock nodes, the init and update of a C style for loop and the body of a defer.
+    template<typename Fn>
+    void for_each_child_statement(AstNode* stat, Fn&& fn)
+    {
+        const auto block = [&](AstBlock* child) {
+            if (child)
+            {
+                fn(static_cast<AstNode*>(child));
+            }
+        };
+
+        switch (stat->type)
+        {
+            case AstNodeType::kBlock:
+                for (AstNode* child = stat->as<AstBlock>()->first_stat; child; child = child->next_child)
+                {
+                    fn(child);
+                }
+                break;
+            case AstNodeType::kIf:
+            {
+                auto* if_stat = stat->as<AstIf>();
+                block(if_stat->then_block);
+                for (ElseIf* elseif = if_stat->first_elseif; elseif; elseif = static_cast<ElseIf*>(elseif->next_child))
+                {
+                    block(elseif->block);
+                }
+                block(if_stat->else_block);
+                break;
+            }
+            case AstNodeType::kWhile:
+                block(stat->as<AstWhile>()->block);
+                break;
+            case AstNodeType::kForNum:
+                block(stat->as<AstForNum>()->block);
+                break;
+            case AstNodeType::kForCNumeric:
+                block(stat->as<AstForCNumeric>()->block);
+                break;
+            case AstNodeType::kForIn:
+                block(stat->as<AstForIn>()->block);
+                break;
+            case AstNodeType::kForC:
+            {
+                auto* for_c = stat->as<AstForC>();
+                if (for_c->init)
+                {
+                    fn(for_c->init);
+                }
+                if (for_c->update)
+                {
+                    fn(for_c->update);
+                }
+                block(for_c->block);
+                break;
+            }
+            case AstNodeType::kScope:
+                block(stat->as<AstScope>()->block);
+                break;
+            case AstNodeType::kDefer:
+                if (stat->as<AstDefer>()->body)
+                {
+                    fn(stat->as<AstDefer>()->body);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Calls fn for the operands of the expression, function bodies are not entered.
+    template<typename Fn>
+    void for_each_subexpression(AstNode* node, Fn&& fn)
+    {
+        switch (node->type)
+        {
+            case AstNodeType::kBinOp:
+                fn(node->as<AstBinOp>()->left);
+                fn(node->as<AstBinOp>()->right);
+                break;
+            case AstNodeType::kUnOp:
+                fn(node->as<AstUnOp>()->expr);
+                break;
+            case AstNodeType::kTernary:
+            {
+                auto* ternary = node->as<AstTernary>();
+                fn(ternary->condition);
+                fn(ternary->true_expr);
+                fn(ternary->false_expr);
+                break;
+            }
+            case AstNodeType::kIndex:
+                fn(node->as<AstIndex>()->table);
+                fn(node->as<AstIndex>()->key);
+                break;
+            case AstNodeType::kMember:
+                fn(node->as<AstMember>()->table);
+                break;
+            case AstNodeType::kFuncCall:
+            {
+                auto* call = node->as<AstFuncCall>();
+                fn(call->func);
+                for (AstNode** arg = &call->first_arg; *arg; arg = &(*arg)->next_child)
+                {
+                    fn(*arg);
+                }
+                break;
+            }
+            case AstNodeType::kTableCtor:
+                for (AstNode* n = node->as<AstTableCtor>()->first_field; n; n = n->next_child)
+                {
+                    auto* field = static_cast<TableField*>(n);
+                    // Identifier keys name the field, they are not evaluated
+                    if (field->key && !field->key->is(AstNodeType::kIdent))
+                    {
+                        fn(field->key);
+                    }
+                    fn(field->value);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    void collect_functions(AstProgram* program, AutoVector<FunctionBody>& functions);
+    // Blocks of the function outside of nested functions, every block comes before the blocks nested inside it.
+    void collect_blocks(AstBlock* block, AutoVector<AstBlock*>& blocks);
+    void collect_local_facts(State* state, const FunctionBody& function, bool is_module, LocalFacts& facts);
+
+    bool is_number_expression(const LocalFacts& facts, const AstNode* node);
+    NumberKind number_kind(const LocalFacts& facts, const AstNode* node);
+    // Expressions without side effects that can not raise an error, their value only depends on the locals they name
+    // and on the fields of local tables.
+    bool is_pure_expression(const LocalFacts& facts, const AstNode* node);
+    bool same_expression(const AstNode* lhs, const AstNode* rhs);
+    size_t expression_size(const AstNode* node);
+    // The statement neither assigns nor declares the local and defines no function. The variable of a numeric loop
+    // whose body keeps it only ever holds the values the loop gives it.
+    bool keeps_local(AstNode* stat, Atom name);
+
+    // Names of the locals introduced by the passes, they can not clash with names written in the source. The node is
+    // only a template, every use of the name gets a copy of it.
+    const AstString* make_temporary_name(AstHolder& holder, std::string_view pass, uint32_t step, size_t index);
+    // Puts a read of the local in place of the expression and returns the expression taken out of its list.
+    AstNode* replace_with_local(AstHolder& holder, AstNode*& slot, const AstString* name);
+    // Declares the local with the value right before the statement the link points to, returns the link to it again.
+    AstNode** insert_local(AstHolder& holder, AstNode** link, const AstString* name, AstNode* value);
+
+} // namespace behl
@@ -0,0 +1,495 @@
+#include "scalar_replacement.hpp"
+
+#include "common/hash_map.hpp"
+#include "common/print.hpp"
+#include "common/vector.hpp"
+#include "config_internal.hpp"
+#include "pure_expressions.hpp"
+
+namespace behl
+{
+    // Every field of a replaced table occupies a register for the rest of the enclosing block
+    static constexpr size_t kMaxFieldsPerTable = 8;
+    static constexpr size_t kMaxFieldsPerFunction = 32;
+
+    namespace
+    {
+        // Field of a replaced table and the local holding it, init is the entry of the constructor setting it.
+        struct ScalarField
+        {
+            Atom table = kInvalidAtom;
+            Atom key = kInvalidAtom;
+            const AstString* local = nullptr;
+            TableField* init = nullptr;
+        };
+
+        struct Candidate
+        {
+            AstTableCtor* ctor = nullptr;
+            size_t field_count = 0;
+            bool rejected = false;
+        };
+
+        struct ReplacementState
+        {
+            AstHolder& holder;
+            size_t& next_temp;
+            AutoHashMap<Atom, Candidate, AtomHash> candidates;
+            AutoVector<ScalarField> fields;
+
+            ReplacementState(AstHolder& h, size_t& temp)
+                : holder(h)
+                , next_temp(temp)
+                , candidates(h.state())
+                , fields(h.state())
+            {
+            }
+        };
+
+        enum class AccessKind : uint8_t
+        {
+            kNone,
+            kField,
+            kUnknownKey,
+        };
+    } // namespace
+
+    // Reads and stores through a candidate local, key is the field name for accesses with a constant string key.
+    static AccessKind classify_access(
+        ReplacementState& state, const AstNode* node, Candidate*& candidate, Atom& table, Atom& key)
+    {
+        const AstNode* table_node = nullptr;
+        if (auto* member = node->try_as<AstMember>())
+        {
+            table_node = member->table;
+            key = member->name->atom;
+        }
+        else if (auto* index = node->try_as<AstIndex>())
+        {
+            table_node = index->table;
+            auto* str = index->key->try_as<AstString>();
+            key = str ? str->atom : kInvalidAtom;
+        }
+        auto* ident = table_node ? table_node->try_as<AstIdent>() : nullptr;
+        if (!ident)
+        {
+            return AccessKind::kNone;
+        }
+
+        auto it = state.candidates.find(ident->name->atom);
+        if (it == state.candidates.end() || it->second.rejected)
+        {
+            return AccessKind::kNone;
+        }
+        candidate = &it->second;
+        table = it->first;
+        return node->is(AstNodeType::kIndex) && !node->as<AstIndex>()->key->is(AstNodeType::kString)
+            ? AccessKind::kUnknownKey
+            : AccessKind::kField;
+    }
+
+    static ScalarField* find_field(ReplacementState& state, Atom table, Atom key)
+    {
+        for (ScalarField& field : state.fields)
+        {
+            if (field.table == table && field.key == key)
+            {
+                return &field;
+            }
+        }
+        return nullptr;
+    }
+
+    // Only tables whose fields all have constant string keys can be split, positional entries would need the array
+    // part of the table.
+    static bool add_constructor_fields(ReplacementState& state, Atom table, AstTableCtor* ctor)
+    {
+        const size_t mark = state.fields.size();
+        for (AstNode* n = ctor->first_field; n; n = n->next_child)
+        {
+            auto* field = static_cast<TableField*>(n);
+            Atom key = kInvalidAtom;
+            if (auto* ident = field->key ? field->key->try_as<AstIdent>() : nullptr)
+            {
+                key = ident->name->atom;
+            }
+            else if (auto* str = field->key ? field->key->try_as<AstString>() : nullptr)
+            {
+                key = str->atom;
+            }
+            else
+            {
+                state.fields.resize(mark);
+                return false;
+            }
+
+            if (find_field(state, table, key) || state.fields.size() - mark == kMaxFieldsPerTable)
+            {
+                state.fields.resize(mark);
+                return false;
+            }
+            state.fields.push_back({ table, key, nullptr, field });
+        }
+        return true;
+    }
+
+    static void find_candidates(ReplacementState& state, const LocalFacts& facts, AstBlock* body)
+    {
+        AutoVector<AstBlock*> blocks(state.holder.state());
+        collect_blocks(body, blocks);
+        for (AstBlock* block : blocks)
+        {
+            for (AstNode* stat = block->first_stat; stat; stat = stat->next_child)
+            {
+                auto* decl = stat->try_as<AstLocalDecl>();
+                if (!decl || decl->first_name->next_child || !decl->first_init || decl->first_init->next_child)
+                {
+                    continue;
+                }
+                auto* ctor = decl->first_init->try_as<AstTableCtor>();
+                const Atom name = decl->first_name->atom;
+                if (ctor && facts.is_table(name) && add_constructor_fields(state, name, ctor))
+                {
+                    state.candidates.insert_or_assign(name, Candidate{ ctor, 0, false });
+                }
+            }
+        }
+    }
+
+    static void reject(ReplacementState& state, Candidate& candidate, Atom table)
+    {
+        candidate.rejected = true;
+        size_t kept = 0;
+        for (size_t i = 0; i < state.fields.size(); ++i)
+        {
+            if (state.fields[i].table != table)
+            {
+                state.fields[kept++] = state.fields[i];
+            }
+        }
+        state.fields.resize(kept);
+    }
+
+    static void scan_access(ReplacementState& state, const AstNode* node)
+    {
+        Candidate* candidate = nullptr;
+        Atom table = kInvalidAtom;
+        Atom key = kInvalidAtom;
+        switch (classify_access(state, node, candidate, table, key))
+        {
+            case AccessKind::kNone:
+                return;
+            case AccessKind::kUnknownKey:
+                reject(state, *candidate, table);
+                return;
+            case AccessKind::kField:
+                break;
+        }
+
+        // Fields the constructor does not set start out as nil
+        if (!find_field(state, table, key))
+        {
+            size_t count = 0;
+            for (const ScalarField& field : state.fields)
+            {
+                count += field.table == table ? 1u : 0u;
+            }
+            if (count == kMaxFieldsPerTable)
+            {
+                reject(state, *candidate, table);
+                return;
+            }
+            state.fields.push_back({ table, key, nullptr, nullptr });
+        }
+    }
+
+    static void scan_expression(ReplacementState& state, AstNode*& node)
+    {
+        // Nested functions never name a candidate, see LocalFacts
+        if (node->is(AstNodeType::kFuncDef))
+        {
+            return;
+        }
+        scan_access(state, node);
+        for_each_subexpression(node, [&](AstNode*& child) { scan_expression(state, child); });
+    }
+
+    // Compound assignments and increments of fields do not compile, the table is kept so the error stays the same
+    static void reject_target(ReplacementState& state, const AstNode* target)
+    {
+        Candidate* candidate = nullptr;
+        Atom table = kInvalidAtom;
+        Atom key = kInvalidAtom;
+        if (classify_access(state, target, candidate, table, key) != AccessKind::kNone)
+        {
+            reject(state, *candidate, table);
+        }
+    }
+
+    static void scan_statement(ReplacementState& state, AstNode* stat)
+    {
+        switch (stat->type)
+        {
+            case AstNodeType::kAssign:
+                for (const AstNode* var = stat->as<AstAssign>()->first_var; var; var = var->next_child)
+                {
+                    scan_access(state, var);
+                }
+                break;
+            case AstNodeType::kCompoundAssign:
+                reject_target(state, stat->as<AstCompoundAssign>()->target);
+                break;
+            case AstNodeType::kIncrement:
+                reject_target(state, stat->as<AstIncrement>()->target);
+                break;
+            case AstNodeType::kDecrement:
+                reject_target(state, stat->as<AstDecrement>()->target);
+                break;
+            default:
+                break;
+        }
+        for_each_statement_expression(stat, [&](AstNode*& expr) { scan_expression(state, expr); });
+        for_each_child_statement(stat, [&](AstNode* child) { scan_statement(state, child); });
+    }
+
+    static void rewrite_block(ReplacementState& state, AstBlock* block);
+
+    static void replace_access(ReplacementState& state, AstNode*& node)
+    {
+        Candidate* candidate = nullptr;
+        Atom table = kInvalidAtom;
+        Atom key = kInvalidAtom;
+        if (classify_access(state, node, candidate, table, key) != AccessKind::kField)
+        {
+            return;
+        }
+        if (const ScalarField* field = find_field(state, table, key))
+        {
+            replace_with_local(state.holder, node, field->local);
+        }
+    }
+
+    static void rewrite_expression(ReplacementState& state, AstNode*& node)
+    {
+        if (node->is(AstNodeType::kFuncDef))
+        {
+            return;
+        }
+        for_each_subexpression(node, [&](AstNode*& child) { rewrite_expression(state, child); });
+        replace_access(state, node);
+    }
+
+    static void rewrite_target(ReplacementState& state, AstNode*& target)
+    {
+        if (auto* member = target->try_as<AstMember>())
+        {
+            rewrite_expression(state, member->table);
+        }
+        else if (auto* index = target->try_as<AstIndex>())
+        {
+            rewrite_expression(state, index->table);
+            rewrite_expression(state, index->key);
+        }
+        replace_access(state, target);
+    }
+
+    // Declares the fields in constructor order in place of the table, the constructor evaluated its values in that order
+    // as well. Returns the link to the statement following the declaration.
+    static AstNode** split_declaration(ReplacementState& state, AstNode** link)
+    {
+        auto* decl = (*link)->try_as<AstLocalDecl>();
+        auto it = decl && !decl->first_name->next_child ? state.candidates.find(decl->first_name->atom)
+                                                        : state.candidates.end();
+        if (it == state.candidates.end() || it->second.rejected || decl->first_init != it->second.ctor)
+        {
+            return &(*link)->next_child;
+        }
+
+        AstNode** decl_link = link;
+        for (ScalarField& field : state.fields)
+        {
+            if (field.table == it->first)
+            {
+                AstNode* value = field.init ? field.init->value : nullptr;
+                if (value)
+                {
+                    value->next_child = nullptr;
+                }
+                decl_link = insert_local(state.holder, decl_link, field.local, value);
+            }
+        }
+        *decl_link = decl->next_child;
+        return decl_link;
+    }
+
+    static void rewrite_statement(ReplacementState& state, AstNode*& stat)
+    {
+        switch (stat->type)
+        {
+            case AstNodeType::kLocalDecl:
+                for (AstNode** init = &stat->as<AstLocalDecl>()->first_init; *init; init = &(*init)->next_child)
+                {
+                    rewrite_expression(state, *init);
+                }
+                return;
+            case AstNodeType::kAssign:
+            {
+                auto* assign = stat->as<AstAssign>();
+                for (AstNode** var = &assign->first_var; *var; var = &(*var)->next_child)
+                {
+                    rewrite_target(state, *var);
+                }
+                for (AstNode** expr = &assign->first_expr; *expr; expr = &(*expr)->next_child)
+                {
+                    rewrite_expression(state, *expr);
+                }
+                return;
+            }
+            case AstNodeType::kExportDecl:
+                rewrite_statement(state, stat->as<AstExportDecl>()->declaration);
+                return;
+            default:
+                break;
+        }
+
+        for_each_statement_expression(stat, [&](AstNode*& expr) { rewrite_expression(state, expr); });
+        switch (stat->type)
+        {
+            case AstNodeType::kBlock:
+                rewrite_block(state, stat->as<AstBlock>());
+                break;
+            case AstNodeType::kIf:
+            {
+                auto* if_stat = stat->as<AstIf>();
+                rewrite_block(state, if_stat->then_block);
+                for (ElseIf* elseif = if_stat->first_elseif; elseif; elseif = static_cast<ElseIf*>(elseif->next_child))
+                {
+                    rewrite_block(state, elseif->block);
+                }
+                rewrite_block(state, if_stat->else_block);
+                break;
+            }
+            case AstNodeType::kWhile:
+                rewrite_block(state, stat->as<AstWhile>()->block);
+                break;
+            case AstNodeType::kForNum:
+                rewrite_block(state, stat->as<AstForNum>()->block);
+                break;
+            case AstNodeType::kForCNumeric:
+                rewrite_block(state, stat->as<AstForCNumeric>()->block);
+                break;
+            case AstNodeType::kForIn:
+                rewrite_block(state, stat->as<AstForIn>()->block);
+                break;
+            case AstNodeType::kForC:
+            {
+                auto* for_c = stat->as<AstForC>();
+                if (for_c->init)
+                {
+                    rewrite_statement(state, for_c->init);
+                }
+                if (for_c->update)
+                {
+                    rewrite_statement(state, for_c->update);
+                }
+                rewrite_block(state, for_c->block);
+                break;
+            }
+            case AstNodeType::kScope:
+                rewrite_block(state, stat->as<AstScope>()->block);
+                break;
+            case AstNodeType::kDefer:
+                if (stat->as<AstDefer>()->body)
+                {
+                    rewrite_statement(state, stat->as<AstDefer>()->body);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    static void rewrite_block(ReplacementState& state, AstBlock* block)
+    {
+        if (!block)
+        {
+            return;
+        }
+        for (AstNode** link = &block->first_stat; *link;)
+        {
+            rewrite_statement(state, *link);
+            link = split_declaration(state, link);
+        }
+    }
+
+    static size_t replace_in_function(AstOptimizationContext& context, const FunctionBody& function, size_t& next_temp)
+    {
+        State* vm_state = context.holder.state();
+        LocalFacts facts(vm_state);
+        collect_local_facts(vm_state, function, context.program->is_module, facts);
+
+        ReplacementState state(context.holder, next_temp);
+        find_candidates(state, facts, function.block);
+        if (state.candidates.size() == 0)
+        {
+            return 0;
+        }
+        scan_statement(state, function.block);
+
+        // Tables are kept as long as their fields would not fit the register budget
+        size_t replaced = 0;
+        size_t used = 0;
+        for (auto& [name, candidate] : state.candidates)
+        {
+            if (candidate.rejected)
+            {
+                continue;
+            }
+            for (const ScalarField& field : state.fields)
+            {
+                candidate.field_count += field.table == name ? 1u : 0u;
+            }
+            if (used + candidate.field_count > kMaxFieldsPerFunction)
+            {
+                reject(state, candidate, name);
+                continue;
+            }
+            used += candidate.field_count;
+            replaced++;
+        }
+        for (ScalarField& field : state.fields)
+        {
+            field.local = make_temporary_name(context.holder, "sra", context.step, state.next_temp++);
+        }
+
+        if (replaced > 0)
+        {
+            rewrite_block(state, function.block);
+        }
+        return replaced;
+    }
+
+    bool ScalarReplacementPass::apply(AstOptimizationContext& context)
+    {
+        AutoVector<FunctionBody> functions(context.holder.state());
+        collect_functions(context.program, functions);
+
+        size_t replaced = 0;
+        size_t next_temp = 0;
+        for (const FunctionBody& function : functions)
+        {
+            replaced += replace_in_function(context, function, next_temp);
+        }
+
+        if constexpr (kOptimizationPassDebug)
+        {
+            if (replaced > 0)
+            {
+                println("    Replaced {} tables by their fields", replaced);
+            }
+        }
+
+        return replaced > 0;
+    }
+
+} // namespace behl
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "ast_context.hpp"
+
+namespace behl
+{
+    // Scalar replacement of aggregates pass
+    // Splits tables made by a constructor that never leave the function into one local per field, field reads and
+    // stores become plain local accesses and the table is never allocated. Uses the escape analysis of
+    // pure_expressions.hpp, inlined helpers returning a table constructor become candidates as well.
+    struct ScalarReplacementPass
+    {
+        static constexpr std::string_view kName = "ScalarReplacement";
+        static constexpr OptLevel kMinLevel = OptLevel::kO2;
+        static constexpr bool kTracksChanges = false;
+
+        static bool apply(AstOptimizationContext& context);
+    };
+
+} // namespace behl
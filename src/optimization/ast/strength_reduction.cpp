@@ -0,0 +1,195 @@
+#include "strength_reduction.hpp"
+
+#include "common/print.hpp"
+#include "common/vector.hpp"
+#include "config_internal.hpp"
+#include "frontend/lexer.hpp"
+#include "pure_expressions.hpp"
+
+namespace behl
+{
+    // Every induction variable occupies a register for the rest of the enclosing block
+    static constexpr size_t kMaxInductionVariables = 4;
+
+    namespace
+    {
+        // Local holding the product of the loop variable and the factor
+        struct InductionVariable
+        {
+            Integer factor = 0;
+            const AstString* name = nullptr;
+        };
+
+        struct ReductionState
+        {
+            AstHolder& holder;
+            uint32_t step = 0;
+            size_t& next_temp;
+            Atom var = kInvalidAtom;
+            AutoVector<InductionVariable> variables;
+        };
+    } // namespace
+
+    static Integer wrapping_mul(Integer lhs, Integer rhs)
+    {
+        return static_cast<Integer>(static_cast<uint64_t>(lhs) * static_cast<uint64_t>(rhs));
+    }
+
+    // Factor of `var * k` or `k * var`
+    static bool get_factor(const AstNode* node, Atom var, Integer& factor)
+    {
+        auto* binop = node->try_as<AstBinOp>();
+        if (!binop || binop->op != TokenType::kStar)
+        {
+            return false;
+        }
+
+        const AstNode* other = binop->right;
+        auto* ident = binop->left->try_as<AstIdent>();
+        if (!ident || ident->name->atom != var)
+        {
+            other = binop->left;
+            ident = binop->right->try_as<AstIdent>();
+        }
+        auto* literal = other->try_as<AstInt>();
+        if (!ident || ident->name->atom != var || !literal)
+        {
+            return false;
+        }
+        factor = literal->value;
+        return true;
+    }
+
+    static void reduce_expression(ReductionState& state, AstNode*& slot)
+    {
+        Integer factor = 0;
+        if (get_factor(slot, state.var, factor))
+        {
+            for (const InductionVariable& variable : state.variables)
+            {
+                if (variable.factor == factor)
+                {
+                    replace_with_local(state.holder, slot, variable.name);
+                    return;
+                }
+            }
+            if (state.variables.size() < kMaxInductionVariables)
+            {
+                const AstString* name = make_temporary_name(state.holder, "sr", state.step, state.next_temp++);
+                state.variables.push_back({ factor, name });
+                replace_with_local(state.holder, slot, name);
+                return;
+            }
+        }
+
+        for_each_subexpression(slot, [&](AstNode*& child) { reduce_expression(state, child); });
+    }
+
+    static void reduce_statement(ReductionState& state, AstNode* stat)
+    {
+        for_each_statement_expression(stat, [&](AstNode*& expr) { reduce_expression(state, expr); });
+        for_each_child_statement(stat, [&](AstNode* child) { reduce_statement(state, child); });
+    }
+
+    // The variable only stays an integer when the start, the limit and the step are integers, FORLOOP switches to
+    // floats as soon as one of them is not. The start is evaluated once more for the first product.
+    static bool is_integer_loop(const LocalFacts& facts, const AstForCNumeric* loop)
+    {
+        return number_kind(facts, loop->start) == NumberKind::kInteger && is_pure_expression(facts, loop->start)
+            && number_kind(facts, loop->end) == NumberKind::kInteger && (!loop->step || loop->step->is(AstNodeType::kInteger));
+    }
+
+    // Declares the induction variables before the loop and advances them first thing in the body, so continue does
+    // not skip the update. Moves the link past the declarations.
+    static size_t try_reduce(ReductionState& state, const LocalFacts& facts, AstNode**& link, AstForCNumeric* loop)
+    {
+        if (!loop->block || !is_integer_loop(facts, loop))
+        {
+            return 0;
+        }
+        for (AstNode* stat = loop->block->first_stat; stat; stat = stat->next_child)
+        {
+            if (!keeps_local(stat, loop->var->atom))
+            {
+                return 0;
+            }
+        }
+
+        state.var = loop->var->atom;
+        state.variables.clear();
+        for (AstNode* stat = loop->block->first_stat; stat; stat = stat->next_child)
+        {
+            reduce_statement(state, stat);
+        }
+
+        Integer step = loop->step ? loop->step->as<AstInt>()->value : 1;
+        step = loop->ascending ? step : wrapping_mul(step, -1);
+        for (const InductionVariable& variable : state.variables)
+        {
+            const Integer delta = wrapping_mul(step, variable.factor);
+
+            auto* product = state.holder.make<AstBinOp>(
+                TokenType::kStar, loop->start->clone(state.holder), state.holder.make<AstInt>(variable.factor));
+            auto* first = state.holder.make<AstBinOp>(TokenType::kMinus, product, state.holder.make<AstInt>(delta));
+            product->line = first->line = loop->line;
+            product->column = first->column = loop->column;
+            link = insert_local(state.holder, link, variable.name, first);
+
+            auto* target = static_cast<AstString*>(variable.name->clone(state.holder));
+            auto* advance = state.holder.make<AstCompoundLocal>(target, TokenType::kPlus, state.holder.make<AstInt>(delta));
+            advance->line = loop->line;
+            advance->column = loop->column;
+            advance->next_child = loop->block->first_stat;
+            loop->block->first_stat = advance;
+        }
+        return state.variables.size();
+    }
+
+    static size_t reduce_function(AstOptimizationContext& context, const FunctionBody& function, size_t& next_temp)
+    {
+        State* vm_state = context.holder.state();
+        LocalFacts facts(vm_state);
+        collect_local_facts(vm_state, function, context.program->is_module, facts);
+
+        AutoVector<AstBlock*> blocks(vm_state);
+        collect_blocks(function.block, blocks);
+
+        ReductionState state{ context.holder, context.step, next_temp, kInvalidAtom, AutoVector<InductionVariable>(vm_state) };
+        size_t reduced = 0;
+        for (AstBlock* block : blocks)
+        {
+            for (AstNode** link = &block->first_stat; *link; link = &(*link)->next_child)
+            {
+                if (auto* loop = (*link)->try_as<AstForCNumeric>())
+                {
+                    reduced += try_reduce(state, facts, link, loop);
+                }
+            }
+        }
+        return reduced;
+    }
+
+    bool StrengthReductionPass::apply(AstOptimizationContext& context)
+    {
+        AutoVector<FunctionBody> functions(context.holder.state());
+        collect_functions(context.program, functions);
+
+        size_t reduced = 0;
+        size_t next_temp = 0;
+        for (const FunctionBody& function : functions)
+        {
+            reduced += reduce_function(context, function, next_temp);
+        }
+
+        if constexpr (kOptimizationPassDebug)
+        {
+            if (reduced > 0)
+            {
+                println("    Introduced {} induction variables", reduced);
+            }
+        }
+
+        return reduced > 0;
+    }
+
+} // namespace behl
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "ast_context.hpp"
+
+namespace behl
+{
+    // Strength reduction pass
+    // Replaces products of the variable of a numeric for loop and an integer literal by a local declared before the
+    // loop and advanced by a constant at the start of every iteration. Only loops whose variable provably stays an
+    // integer are rewritten, integer additions wrap around exactly like the products they replace.
+    struct StrengthReductionPass
+    {
+        static constexpr std::string_view kName = "StrengthReduction";
+        static constexpr OptLevel kMinLevel = OptLevel::kO2;
+        static constexpr bool kTracksChanges = false;
+
+        static bool apply(AstOptimizationContext& context);
+    };
+
+} // namespace behl
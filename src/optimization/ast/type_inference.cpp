@@ -0,0 +1,136 @@
+#include "type_inference.hpp"
+
+#include "common/print.hpp"
+#include "common/vector.hpp"
+#include "config_internal.hpp"
+#include "pure_expressions.hpp"
+
+namespace behl
+{
+    static bool has_typed_opcodes(TokenType op)
+    {
+        switch (op)
+        {
+            case TokenType::kPlus:
+            case TokenType::kMinus:
+            case TokenType::kStar:
+            case TokenType::kSlash:
+            case TokenType::kLt:
+            case TokenType::kLe:
+            case TokenType::kGt:
+            case TokenType::kGe:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    static OperandTypes operand_types(NumberKind lhs, NumberKind rhs)
+    {
+        if (lhs == NumberKind::kInteger && rhs == NumberKind::kInteger)
+        {
+            return OperandTypes::kIntegers;
+        }
+        if (lhs == NumberKind::kFloat && rhs == NumberKind::kFloat)
+        {
+            return OperandTypes::kFloats;
+        }
+        return OperandTypes::kUnknown;
+    }
+
+    namespace
+    {
+        struct InferenceState
+        {
+            const LocalFacts& facts;
+            size_t marked = 0;
+            size_t changed = 0;
+        };
+    } // namespace
+
+    static void mark(InferenceState& state, OperandTypes& slot, OperandTypes types)
+    {
+        state.marked += types != OperandTypes::kUnknown ? 1u : 0u;
+        state.changed += slot != types ? 1u : 0u;
+        slot = types;
+    }
+
+    static void infer_expression(InferenceState& state, AstNode* node)
+    {
+        // Nested functions have locals of their own and are visited separately
+        if (node->is(AstNodeType::kFuncDef))
+        {
+            return;
+        }
+        for_each_subexpression(node, [&](AstNode*& child) { infer_expression(state, child); });
+
+        if (auto* binop = node->try_as<AstBinOp>())
+        {
+            // Integer division gives a float, only floats divide without checks
+            OperandTypes types = OperandTypes::kUnknown;
+            if (has_typed_opcodes(binop->op))
+            {
+                types = operand_types(number_kind(state.facts, binop->left), number_kind(state.facts, binop->right));
+            }
+            if (binop->op == TokenType::kSlash && types == OperandTypes::kIntegers)
+            {
+                types = OperandTypes::kUnknown;
+            }
+            mark(state, binop->operand_types, types);
+        }
+    }
+
+    static void infer_statement(InferenceState& state, AstNode* stat)
+    {
+        if (auto* compound = stat->try_as<AstCompoundLocal>())
+        {
+            OperandTypes types = OperandTypes::kUnknown;
+            if (compound->op != TokenType::kPercent)
+            {
+                const NumberKind local = state.facts.is_integer(compound->name->atom) ? NumberKind::kInteger
+                    : state.facts.is_float(compound->name->atom)                      ? NumberKind::kFloat
+                                                                                        : NumberKind::kNone;
+                types = operand_types(local, number_kind(state.facts, compound->expr));
+            }
+            if (compound->op == TokenType::kSlash && types == OperandTypes::kIntegers)
+            {
+                types = OperandTypes::kUnknown;
+            }
+            mark(state, compound->operand_types, types);
+        }
+        for_each_statement_expression(stat, [&](AstNode*& expr) { infer_expression(state, expr); });
+        for_each_child_statement(stat, [&](AstNode* child) { infer_statement(state, child); });
+    }
+
+    bool TypeInferencePass::apply(AstOptimizationContext& context)
+    {
+        AutoVector<FunctionBody> functions(context.holder.state());
+        collect_functions(context.program, functions);
+
+        size_t marked = 0;
+        size_t changed = 0;
+        for (const FunctionBody& function : functions)
+        {
+            State* vm_state = context.holder.state();
+            LocalFacts facts(vm_state);
+            collect_local_facts(vm_state, function, context.program->is_module, facts);
+
+            InferenceState state{ facts, 0, 0 };
+            infer_statement(state, function.block);
+            marked += state.marked;
+            changed += state.changed;
+        }
+
+        if constexpr (kOptimizationPassDebug)
+        {
+            if (changed > 0)
+            {
+                println("    Proved the operand types of {} operations", marked);
+            }
+        }
+
+        // Marks only steer code generation, running again without changes in between finds the same types
+        return changed > 0;
+    }
+
+} // namespace behl
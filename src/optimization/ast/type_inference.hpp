@@ -0,0 +1,21 @@
+#pragma once
+
+#include "ast_context.hpp"
+
+namespace behl
+{
+    // Type inference pass
+    // Marks arithmetic operations and comparisons whose operands are proven to be two integers or two floats, the
+    // compiler emits opcodes without runtime type checks for them. Types come from the local facts of
+    // pure_expressions.hpp: literals, numeric for loop counters and locals that are only ever assigned such values.
+    // The facts hold for the whole function, a local is not typed at some points and untyped at others.
+    struct TypeInferencePass
+    {
+        static constexpr std::string_view kName = "TypeInference";
+        static constexpr OptLevel kMinLevel = OptLevel::kO2;
+        static constexpr bool kTracksChanges = false;
+
+        static bool apply(AstOptimizationContext& context);
+    };
+
+} // namespace behl
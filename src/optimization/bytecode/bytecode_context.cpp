@@ -0,0 +1,686 @@
+#include "bytecode_context.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace behl
+{
+    static void set_range(RegisterSet& set, size_t first, size_t last)
+    {
+        const size_t bits = set.size();
+        if (first > last || first >= bits)
+        {
+            return;
+        }
+        const size_t count = std::min(last, bits - 1) - first + 1;
+        set |= (~RegisterSet{} >> (bits - count)) << first;
+    }
+
+    static void set_from(RegisterSet& set, size_t first)
+    {
+        set_range(set, first, set.size() - 1);
+    }
+
+    static constexpr size_t kMultValues = static_cast<uint8_t>(kMultRet);
+
+    // Reads count registers from first, kMultValues reads up to frame.top set by a previous instruction.
+    static void read_values(RegisterSet& set, size_t first, size_t count)
+    {
+        if (count == kMultValues)
+        {
+            set_from(set, first);
+        }
+        else if (count > 0)
+        {
+            set_range(set, first, first + count - 1);
+        }
+    }
+
+    static size_t capture_count(const GCProto& proto, Instruction instr)
+    {
+        const auto index = instr.const_or_proto_index();
+        assert(index < proto.protos.size() && "capture_count: proto index out of bounds");
+        return proto.protos[index]->upvalue_names.size();
+    }
+
+    static size_t switch_slot_count(const GCProto& proto, Instruction instr)
+    {
+        const auto index = instr.const_or_proto_index();
+        assert(index < proto.switch_tables.size() && "switch_slot_count: switch table index out of bounds");
+        return proto.switch_data[proto.switch_tables[index] + 1];
+    }
+
+    bool may_skip_next(Instruction instr)
+    {
+        switch (instr.op())
+        {
+            case OpCode::kOpEq:
+            case OpCode::kOpNe:
+            case OpCode::kOpLt:
+            case OpCode::kOpGe:
+            case OpCode::kOpLe:
+            case OpCode::kOpGt:
+            case OpCode::kOpLTII:
+            case OpCode::kOpLEII:
+            case OpCode::kOpLTFF:
+            case OpCode::kOpLEFF:
+            case OpCode::kOpLTI:
+            case OpCode::kOpGEI:
+            case OpCode::kOpLEI:
+            case OpCode::kOpGTI:
+            case OpCode::kOpLTF:
+            case OpCode::kOpGEF:
+            case OpCode::kOpLEF:
+            case OpCode::kOpGTF:
+            case OpCode::kOpLTImm:
+            case OpCode::kOpGeImm:
+            case OpCode::kOpLEImm:
+            case OpCode::kOpGtImm:
+            case OpCode::kOpEqImm:
+            case OpCode::kOpNeImm:
+            case OpCode::kOpTest:
+            case OpCode::kOpTestSet:
+                return true;
+            case OpCode::kOpLoadBool:
+                return instr.skip_next();
+            default:
+                return false;
+        }
+    }
+
+    size_t jump_target(Instruction instr, size_t pc)
+    {
+        const auto base = static_cast<int64_t>(pc);
+        switch (instr.op())
+        {
+            case OpCode::kOpJmp:
+                return static_cast<size_t>(base + 1 + instr.jump_offset());
+            case OpCode::kOpForPrep:
+                return static_cast<size_t>(base + 1 + instr.signed_offset());
+            case OpCode::kOpForLoop:
+                return static_cast<size_t>(base + instr.signed_offset());
+            default:
+                return CodeInfo::kNoTarget;
+        }
+    }
+
+    Instruction with_jump_target(Instruction instr, size_t pc, size_t target)
+    {
+        const auto offset = static_cast<int64_t>(target) - static_cast<int64_t>(pc);
+        switch (instr.op())
+        {
+            case OpCode::kOpJmp:
+                return make_op_jmp(static_cast<int32_t>(offset - 1));
+            case OpCode::kOpForPrep:
+                return make_op_forprep(instr.a(), static_cast<int32_t>(offset - 1));
+            case OpCode::kOpForLoop:
+                return make_op_forloop(instr.a(), static_cast<int32_t>(offset));
+            default:
+                assert(false && "with_jump_target: not a jump");
+                return instr;
+        }
+    }
+
+    RegisterEffects register_effects(Instruction instr)
+    {
+        RegisterEffects fx;
+        const size_t a = instr.a();
+        const size_t b = instr.b();
+        const size_t c = instr.c();
+
+        switch (instr.op())
+        {
+            case OpCode::kOpMove:
+            case OpCode::kOpUnm:
+            case OpCode::kOpBnot:
+            case OpCode::kOpLen:
+            case OpCode::kOpToString:
+            case OpCode::kOpToNumber:
+            case OpCode::kOpAddImm:
+            case OpCode::kOpSubImm:
+            case OpCode::kOpAddKI:
+            case OpCode::kOpAddKF:
+            case OpCode::kOpSubKI:
+            case OpCode::kOpSubKF:
+            case OpCode::kOpGetFieldI:
+            case OpCode::kOpGetFieldS:
+                fx.writes.set(a);
+                fx.reads.set(b);
+                break;
+
+            case OpCode::kOpAdd:
+            case OpCode::kOpSub:
+            case OpCode::kOpMul:
+            case OpCode::kOpDiv:
+            case OpCode::kOpMod:
+            case OpCode::kOpPow:
+            case OpCode::kOpBand:
+            case OpCode::kOpBor:
+            case OpCode::kOpBxor:
+            case OpCode::kOpShl:
+            case OpCode::kOpShr:
+            case OpCode::kOpAddII:
+            case OpCode::kOpSubII:
+            case OpCode::kOpMulII:
+            case OpCode::kOpAddFF:
+            case OpCode::kOpSubFF:
+            case OpCode::kOpMulFF:
+            case OpCode::kOpDivFF:
+            case OpCode::kOpGetField:
+                fx.writes.set(a);
+                fx.reads.set(b);
+                fx.reads.set(c);
+                break;
+
+            case OpCode::kOpLoadI:
+            case OpCode::kOpLoadF:
+            case OpCode::kOpLoadS:
+            case OpCode::kOpLoadImm:
+            case OpCode::kOpLoadBool:
+            case OpCode::kOpGetGlobal:
+            case OpCode::kOpGetUpval:
+            case OpCode::kOpNewTable:
+            case OpCode::kOpNewTableK:
+            case OpCode::kOpClosure:
+                fx.writes.set(a);
+                break;
+
+            case OpCode::kOpLoadNil:
+                set_range(fx.writes, a, a + b);
+                break;
+
+            case OpCode::kOpAddLocal:
+                fx.reads.set(a);
+                fx.reads.set(b);
+                fx.writes.set(a);
+                break;
+
+            case OpCode::kOpIncLocal:
+            case OpCode::kOpDecLocal:
+                fx.reads.set(a);
+                fx.writes.set(a);
+                break;
+
+            case OpCode::kOpSetGlobal:
+            case OpCode::kOpSetUpval:
+            case OpCode::kOpTest:
+            case OpCode::kOpLTImm:
+            case OpCode::kOpGeImm:
+            case OpCode::kOpLEImm:
+            case OpCode::kOpGtImm:
+            case OpCode::kOpEqImm:
+            case OpCode::kOpNeImm:
+            case OpCode::kOpVarargExpand:
+            case OpCode::kOpSwitch:
+                fx.reads.set(a);
+                break;
+
+            case OpCode::kOpSetFieldI:
+            case OpCode::kOpSetFieldS:
+                fx.reads.set(a);
+                fx.reads.set(b);
+                break;
+
+            case OpCode::kOpSetField:
+                fx.reads.set(a);
+                fx.reads.set(b);
+                fx.reads.set(c);
+                break;
+
+            case OpCode::kOpEq:
+            case OpCode::kOpNe:
+            case OpCode::kOpLt:
+            case OpCode::kOpGe:
+            case OpCode::kOpLe:
+            case OpCode::kOpGt:
+            case OpCode::kOpLTII:
+            case OpCode::kOpLEII:
+            case OpCode::kOpLTFF:
+            case OpCode::kOpLEFF:
+                fx.reads.set(b);
+                fx.reads.set(c);
+                break;
+
+            case OpCode::kOpLTI:
+            case OpCode::kOpGEI:
+            case OpCode::kOpLEI:
+            case OpCode::kOpGTI:
+            case OpCode::kOpLTF:
+            case OpCode::kOpGEF:
+            case OpCode::kOpLEF:
+            case OpCode::kOpGTF:
+                fx.reads.set(b);
+                break;
+
+            case OpCode::kOpTestSet:
+                fx.reads.set(b);
+                fx.clobbers.set(a);
+                break;
+
+            case OpCode::kOpSelf:
+                fx.reads.set(b);
+                fx.reads.set(c);
+                set_range(fx.clobbers, a, a + 1);
+                break;
+
+            case OpCode::kOpForPrep:
+            case OpCode::kOpForLoop:
+                set_range(fx.reads, a, a + 3);
+                set_range(fx.clobbers, a, a + 3);
+                break;
+
+            // B counts the function and its arguments, the callee frame overlaps every register from A upwards
+            case OpCode::kOpCall:
+                read_values(fx.reads, a, b);
+                set_from(fx.clobbers, a);
+                if (c > 0 && c != kMultValues)
+                {
+                    // Results the callee did not return are filled with nil
+                    set_range(fx.writes, a, a + c - 1);
+                }
+                break;
+
+            case OpCode::kOpTailCall:
+                read_values(fx.reads, a, b);
+                set_from(fx.clobbers, a);
+                break;
+
+            case OpCode::kOpReturn:
+                read_values(fx.reads, a, b);
+                break;
+
+            case OpCode::kOpSetList:
+                fx.reads.set(a);
+                read_values(fx.reads, a + 2, b == 0 ? kMultValues : b);
+                break;
+
+            case OpCode::kOpVararg:
+                set_from(fx.clobbers, a);
+                break;
+
+            case OpCode::kOpJmp:
+            case OpCode::kOpIncGlobal:
+            case OpCode::kOpDecGlobal:
+            case OpCode::kOpIncUpvalue:
+            case OpCode::kOpDecUpvalue:
+            case OpCode::kOpVarargPrep:
+                break;
+        }
+
+        fx.clobbers |= fx.writes;
+        return fx;
+    }
+
+    uint8_t register_fields(Instruction instr)
+    {
+        switch (instr.op())
+        {
+            case OpCode::kOpLoadI:
+            case OpCode::kOpLoadF:
+            case OpCode::kOpLoadS:
+            case OpCode::kOpLoadImm:
+            case OpCode::kOpLoadBool:
+            case OpCode::kOpLoadNil:
+            case OpCode::kOpGetGlobal:
+            case OpCode::kOpGetUpval:
+            case OpCode::kOpNewTable:
+            case OpCode::kOpNewTableK:
+            case OpCode::kOpClosure:
+            case OpCode::kOpSetGlobal:
+            case OpCode::kOpSetUpval:
+            case OpCode::kOpIncLocal:
+            case OpCode::kOpDecLocal:
+            case OpCode::kOpTest:
+            case OpCode::kOpLTImm:
+            case OpCode::kOpGeImm:
+            case OpCode::kOpLEImm:
+            case OpCode::kOpGtImm:
+            case OpCode::kOpEqImm:
+            case OpCode::kOpNeImm:
+            case OpCode::kOpForPrep:
+            case OpCode::kOpForLoop:
+            case OpCode::kOpCall:
+            case OpCode::kOpTailCall:
+            case OpCode::kOpReturn:
+            case OpCode::kOpSetList:
+            case OpCode::kOpVararg:
+            case OpCode::kOpVarargExpand:
+            case OpCode::kOpSwitch:
+                return kFieldA;
+
+            case OpCode::kOpMove:
+            case OpCode::kOpUnm:
+            case OpCode::kOpBnot:
+            case OpCode::kOpLen:
+            case OpCode::kOpToString:
+            case OpCode::kOpToNumber:
+            case OpCode::kOpAddImm:
+            case OpCode::kOpSubImm:
+            case OpCode::kOpAddKI:
+            case OpCode::kOpAddKF:
+            case OpCode::kOpSubKI:
+            case OpCode::kOpSubKF:
+            case OpCode::kOpGetFieldI:
+            case OpCode::kOpGetFieldS:
+            case OpCode::kOpSetFieldI:
+            case OpCode::kOpSetFieldS:
+            case OpCode::kOpAddLocal:
+            case OpCode::kOpTestSet:
+                return kFieldA | kFieldB;
+
+            case OpCode::kOpAdd:
+            case OpCode::kOpSub:
+            case OpCode::kOpMul:
+            case OpCode::kOpDiv:
+            case OpCode::kOpMod:
+            case OpCode::kOpPow:
+            case OpCode::kOpBand:
+            case OpCode::kOpBor:
+            case OpCode::kOpBxor:
+            case OpCode::kOpShl:
+            case OpCode::kOpShr:
+            case OpCode::kOpGetField:
+            case OpCode::kOpSetField:
+            case OpCode::kOpSelf:
+            case OpCode::kOpAddII:
+            case OpCode::kOpSubII:
+            case OpCode::kOpMulII:
+            case OpCode::kOpAddFF:
+            case OpCode::kOpSubFF:
+            case OpCode::kOpMulFF:
+            case OpCode::kOpDivFF:
+                return kFieldA | kFieldB | kFieldC;
+
+            case OpCode::kOpLTI:
+            case OpCode::kOpGEI:
+            case OpCode::kOpLEI:
+            case OpCode::kOpGTI:
+            case OpCode::kOpLTF:
+            case OpCode::kOpGEF:
+            case OpCode::kOpLEF:
+            case OpCode::kOpGTF:
+                return kFieldB;
+
+            case OpCode::kOpEq:
+            case OpCode::kOpNe:
+            case OpCode::kOpLt:
+            case OpCode::kOpGe:
+            case OpCode::kOpLe:
+            case OpCode::kOpGt:
+            case OpCode::kOpLTII:
+            case OpCode::kOpLEII:
+            case OpCode::kOpLTFF:
+            case OpCode::kOpLEFF:
+                return kFieldB | kFieldC;
+
+            case OpCode::kOpJmp:
+            case OpCode::kOpIncGlobal:
+            case OpCode::kOpDecGlobal:
+            case OpCode::kOpIncUpvalue:
+            case OpCode::kOpDecUpvalue:
+            case OpCode::kOpVarargPrep:
+                return 0;
+        }
+        return 0;
+    }
+
+    Instruction with_field(Instruction instr, uint32_t shift, Reg reg)
+    {
+        instr.raw = (instr.raw & ~(0xFFu << shift)) | (static_cast<uint32_t>(reg) << shift);
+        return instr;
+    }
+
+    size_t successors(const GCProto& proto, const CodeInfo& info, size_t pc, size_t (&out)[2])
+    {
+        const Instruction instr = proto.code[pc];
+        const size_t size = proto.code.size();
+        size_t count = 0;
+
+        const auto add = [&](size_t target) {
+            if (target < size)
+            {
+                out[count++] = target;
+            }
+        };
+
+        switch (instr.op())
+        {
+            case OpCode::kOpJmp:
+                add(info.targets[pc]);
+                if (info.is_switch_slot[pc] && pc + 1 < size && info.is_switch_slot[pc + 1])
+                {
+                    add(pc + 1);
+                }
+                break;
+            case OpCode::kOpForPrep:
+                add(info.targets[pc]);
+                break;
+            case OpCode::kOpSwitch:
+                add(pc + 1);
+                break;
+            case OpCode::kOpForLoop:
+                add(pc + 1);
+                add(info.targets[pc]);
+                break;
+            case OpCode::kOpReturn:
+                break;
+            case OpCode::kOpLoadBool:
+                add(instr.skip_next() ? pc + 2 : pc + 1);
+                break;
+            case OpCode::kOpClosure:
+                add(pc + 1 + capture_count(proto, instr));
+                break;
+            default:
+                add(pc + 1);
+                if (may_skip_next(instr))
+                {
+                    add(pc + 2);
+                }
+                break;
+        }
+
+        return count;
+    }
+
+    void analyze_code(const GCProto& proto, CodeInfo& info)
+    {
+        const size_t size = proto.code.size();
+
+        info.captured.reset();
+        info.targets.assign(size, CodeInfo::kNoTarget);
+        info.is_capture.assign(size, false);
+        info.is_switch_slot.assign(size, false);
+        info.is_branch_target.assign(size, false);
+        info.in_skip_slot.assign(size, false);
+        info.effects.assign(size, RegisterEffects{});
+
+        for (size_t pc = 0; pc < size; ++pc)
+        {
+            const Instruction instr = proto.code[pc];
+            if (instr.op() != OpCode::kOpClosure)
+            {
+                continue;
+            }
+            const size_t count = capture_count(proto, instr);
+            for (size_t i = 1; i <= count && pc + i < size; ++i)
+            {
+                info.is_capture[pc + i] = true;
+                if (proto.code[pc + i].op() == OpCode::kOpMove)
+                {
+                    info.captured.set(proto.code[pc + i].b());
+                }
+            }
+            pc += count;
+        }
+
+        for (size_t pc = 0; pc < size; ++pc)
+        {
+            if (info.is_capture[pc])
+            {
+                continue;
+            }
+
+            // Slots are entered by the SWITCH only, they must stay in place as jumps
+            if (proto.code[pc].op() == OpCode::kOpSwitch)
+            {
+                const size_t count = switch_slot_count(proto, proto.code[pc]);
+                for (size_t i = 1; i <= count && pc + i < size; ++i)
+                {
+                    info.is_switch_slot[pc + i] = true;
+                    info.is_branch_target[pc + i] = true;
+                    info.in_skip_slot[pc + i] = true;
+                }
+            }
+
+            const Instruction instr = proto.code[pc];
+            info.effects[pc] = register_effects(instr);
+
+            const size_t target = jump_target(instr, pc);
+            if (target != CodeInfo::kNoTarget)
+            {
+                info.targets[pc] = target;
+                if (target < size)
+                {
+                    info.is_branch_target[target] = true;
+                }
+            }
+
+            if (may_skip_next(instr))
+            {
+                if (pc + 1 < size)
+                {
+                    info.in_skip_slot[pc + 1] = true;
+                }
+                if (pc + 2 < size)
+                {
+                    info.is_branch_target[pc + 2] = true;
+                }
+            }
+        }
+    }
+
+    void compute_liveness(const GCProto& proto, CodeInfo& info)
+    {
+        const size_t size = proto.code.size();
+
+        info.live_in.assign(size, RegisterSet{});
+        info.live_out.assign(size, RegisterSet{});
+        std::vector<RegisterSet>& live_in = info.live_in;
+
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (size_t pc = size; pc-- > 0;)
+            {
+                if (info.is_capture[pc])
+                {
+                    continue;
+                }
+
+                size_t succ[2];
+                const size_t count = successors(proto, info, pc, succ);
+
+                RegisterSet out;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    out |= live_in[succ[i]];
+                }
+
+                const RegisterSet in = info.effects[pc].reads | (out & ~info.effects[pc].writes);
+                if (in != live_in[pc] || out != info.live_out[pc])
+                {
+                    live_in[pc] = in;
+                    info.live_out[pc] = out;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    const CodeInfo& BytecodeOptimizationContext::code_info()
+    {
+        if (!has_info)
+        {
+            analyze_code(*proto, info);
+            has_info = true;
+            has_liveness = false;
+        }
+        return info;
+    }
+
+    const CodeInfo& BytecodeOptimizationContext::code_liveness()
+    {
+        code_info();
+        if (!has_liveness)
+        {
+            compute_liveness(*proto, info);
+            has_liveness = true;
+        }
+        return info;
+    }
+
+    void remove_instructions(BytecodeOptimizationContext& context, const std::vector<bool>& removed)
+    {
+        context.has_info = false;
+        context.has_liveness = false;
+
+        GCProto& proto = *context.proto;
+        const size_t size = proto.code.size();
+        assert(removed.size() == size);
+
+        // New position of every instruction, removed ones continue at the next kept instruction.
+        std::vector<size_t> new_index(size + 1);
+        size_t kept = 0;
+        for (size_t pc = 0; pc < size; ++pc)
+        {
+            new_index[pc] = kept;
+            if (!removed[pc])
+            {
+                kept++;
+            }
+        }
+        new_index[size] = kept;
+
+        const bool has_lines = proto.line_info.size() == size;
+        const bool has_columns = proto.column_info.size() == size;
+
+        for (size_t pc = 0; pc < size; ++pc)
+        {
+            if (removed[pc])
+            {
+                continue;
+            }
+
+            // Captures are MOVE or GETUPVAL, they never decode as a jump
+            const size_t to = new_index[pc];
+            Instruction instr = proto.code[pc];
+            const size_t target = jump_target(instr, pc);
+            if (target != CodeInfo::kNoTarget)
+            {
+                instr = with_jump_target(instr, to, new_index[std::min(target, size)]);
+            }
+
+            proto.code[to] = instr;
+            if (has_lines)
+            {
+                proto.line_info[to] = proto.line_info[pc];
+            }
+            if (has_columns)
+            {
+                proto.column_info[to] = proto.column_info[pc];
+            }
+        }
+
+        proto.code.resize(context.S, kept);
+        if (has_lines)
+        {
+            proto.line_info.resize(context.S, kept);
+        }
+        if (has_columns)
+        {
+            proto.column_info.resize(context.S, kept);
+        }
+    }
+
+} // namespace behl
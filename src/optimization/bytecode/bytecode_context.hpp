@@ -0,0 +1,128 @@
+#pragma once
+
+#include "gc/gco_proto.hpp"
+#include "vm/bytecode.hpp"
+
+#include <behl/types.hpp>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace behl
+{
+    struct State;
+
+    // Registers tracked by the analyses, functions with a larger frame are left as generated.
+    static constexpr size_t kMaxTrackedRegisters = 64;
+
+    using RegisterSet = std::bitset<kMaxTrackedRegisters>;
+
+    // Registers an instruction accesses. Instructions taking their values up to frame.top read every register from
+    // their first value upwards, calls clobber every register from A upwards.
+    struct RegisterEffects
+    {
+        RegisterSet reads;    // May be read
+        RegisterSet writes;   // Always written
+        RegisterSet clobbers; // May be written, includes writes
+    };
+
+    // Control flow facts of a function's code, recomputed whenever a pass moved instructions around.
+    struct CodeInfo
+    {
+        static constexpr size_t kNoTarget = SIZE_MAX;
+
+        std::vector<size_t> targets;        // Explicit target of JMP, FORPREP and FORLOOP
+        std::vector<bool> is_capture;       // Upvalue capture following a CLOSURE, never executed
+        std::vector<bool> is_switch_slot;   // JMP following a SWITCH, entered when the SWITCH selects it
+        std::vector<bool> is_branch_target; // Entered other than by falling through from the previous instruction
+        std::vector<bool> in_skip_slot;     // Follows an instruction that may skip it
+        std::vector<RegisterEffects> effects;
+        std::vector<RegisterSet> live_in;   // Registers read from here on some path, see compute_liveness
+        std::vector<RegisterSet> live_out;  // Registers read later on some path
+        RegisterSet captured;               // Registers captured by closures, their lifetime is unknown
+    };
+
+    struct BytecodeOptimizationContext
+    {
+        State* S;
+        GCProto* proto;
+        OptLevel level;
+        std::vector<OptimizationPassStats>* report;
+
+        // Maintained by the pipeline, see OptimizationPipeline.
+        uint32_t step = 0;
+        uint32_t revisit_from = 0;
+        bool changed_outside_functions = false;
+
+        // Analysis of the current code shared by the passes until one of them changes the code.
+        CodeInfo info;
+        bool has_info = false;
+        bool has_liveness = false;
+
+        BytecodeOptimizationContext(
+            State* state, GCProto* p, OptLevel lvl = OptLevel::kO2, std::vector<OptimizationPassStats>* r = nullptr)
+            : S(state)
+            , proto(p)
+            , level(lvl)
+            , report(r)
+        {
+        }
+
+        GCProto* result() const
+        {
+            return proto;
+        }
+
+        const CodeInfo& code_info();
+
+        // To be called by passes that rewrote instructions without removing any.
+        void invalidate_analysis()
+        {
+            has_info = false;
+            has_liveness = false;
+        }
+
+        // Same as code_info() with CodeInfo::live_out filled in.
+        const CodeInfo& code_liveness();
+    };
+
+    // Returns true for instructions that conditionally or unconditionally skip the next one.
+    bool may_skip_next(Instruction instr);
+
+    // Jump target of JMP, FORPREP and FORLOOP at pc or CodeInfo::kNoTarget.
+    size_t jump_target(Instruction instr, size_t pc);
+
+    // Re-encodes the jump offset of the instruction at pc so that it jumps to target.
+    Instruction with_jump_target(Instruction instr, size_t pc, size_t target);
+
+    RegisterEffects register_effects(Instruction instr);
+
+    enum RegisterField : uint8_t
+    {
+        kFieldA = 1 << 0,
+        kFieldB = 1 << 1,
+        kFieldC = 1 << 2,
+    };
+
+    // Fields holding a register, instructions accessing a range of registers only name its first one.
+    uint8_t register_fields(Instruction instr);
+
+    // Replaces the register in the field starting at bit shift.
+    Instruction with_field(Instruction instr, uint32_t shift, Reg reg);
+
+    // Writes the successors of the executable instruction at pc to out, returns their number. The slots of a SWITCH
+    // are chained, each one continues at its target and at the next slot.
+    size_t successors(const GCProto& proto, const CodeInfo& info, size_t pc, size_t (&out)[2]);
+
+    // Fills info from scratch, reusing its storage.
+    void analyze_code(const GCProto& proto, CodeInfo& info);
+
+    // Backward dataflow filling CodeInfo::live_in and live_out, captured registers are not included.
+    void compute_liveness(const GCProto& proto, CodeInfo& info);
+
+    // Removes the flagged instructions together with their line and column entries. Jumps to a removed instruction
+    // continue at the next one that is kept. Invalidates the analysis of the context.
+    void remove_instructions(BytecodeOptimizationContext& context, const std::vector<bool>& removed);
+
+} // namespace behl
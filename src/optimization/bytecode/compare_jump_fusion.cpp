@@ -0,0 +1,146 @@
+#include "compare_jump_fusion.hpp"
+
+#include "common/print.hpp"
+#include "config_internal.hpp"
+
+namespace behl
+{
+    static bool is_comparison(Instruction instr)
+    {
+        switch (instr.op())
+        {
+            case OpCode::kOpTest:
+            case OpCode::kOpTestSet:
+            case OpCode::kOpLoadBool:
+                return false;
+            default:
+                return may_skip_next(instr);
+        }
+    }
+
+    static bool is_loadbool(Instruction instr, Reg reg, bool value, bool skip)
+    {
+        return instr.op() == OpCode::kOpLoadBool && instr.a() == reg && instr.bool_value() == value
+            && instr.skip_next() == skip;
+    }
+
+    static bool is_movable(Instruction instr)
+    {
+        return instr.op() != OpCode::kOpClosure && !may_skip_next(instr);
+    }
+
+    // Moves an instruction backwards together with its line and column, keeping its jump target.
+    static void move_instruction(GCProto& proto, size_t from, size_t to)
+    {
+        Instruction instr = proto.code[from];
+        const size_t target = jump_target(instr, from);
+        if (target != CodeInfo::kNoTarget)
+        {
+            instr = with_jump_target(instr, to, target);
+        }
+        proto.code[to] = instr;
+
+        const size_t size = proto.code.size();
+        if (proto.line_info.size() == size)
+        {
+            proto.line_info[to] = proto.line_info[from];
+        }
+        if (proto.column_info.size() == size)
+        {
+            proto.column_info[to] = proto.column_info[from];
+        }
+    }
+
+    bool CompareJumpFusionPass::apply(BytecodeOptimizationContext& context)
+    {
+        GCProto& proto = *context.proto;
+        const size_t size = proto.code.size();
+        const CodeInfo& info = context.code_liveness();
+
+        // The pattern is entered only through the comparison, skips inside it come from its own instructions.
+        std::vector<bool> jumped_to(size, false);
+        for (size_t pc = 0; pc < size; ++pc)
+        {
+            if (info.targets[pc] < size)
+            {
+                jumped_to[info.targets[pc]] = true;
+            }
+        }
+
+        std::vector<bool> removed(size, false);
+        size_t fused = 0;
+
+        for (size_t pc = 0; pc + 4 < size; ++pc)
+        {
+            if (info.is_capture[pc] || !is_comparison(proto.code[pc]))
+            {
+                continue;
+            }
+
+            const Reg temp = proto.code[pc + 1].a();
+            if (!is_loadbool(proto.code[pc + 1], temp, true, true) || !is_loadbool(proto.code[pc + 2], temp, false, false))
+            {
+                continue;
+            }
+
+            size_t test_pc = pc + 3;
+            Reg tested = temp;
+            if (proto.code[test_pc].op() == OpCode::kOpMove && proto.code[test_pc].b() == temp)
+            {
+                tested = proto.code[test_pc].a();
+                test_pc++;
+            }
+
+            // The instruction the TEST guards, usually the JMP of the condition
+            const size_t guarded_pc = test_pc + 1;
+            if (guarded_pc >= size || proto.code[test_pc].op() != OpCode::kOpTest || proto.code[test_pc].a() != tested
+                || !is_movable(proto.code[guarded_pc]))
+            {
+                continue;
+            }
+
+            bool entered = false;
+            for (size_t i = pc + 1; i <= guarded_pc; ++i)
+            {
+                entered = entered || jumped_to[i] || info.is_capture[i];
+            }
+            const RegisterSet& live = info.live_out[test_pc];
+            if (entered || live.test(temp) || live.test(tested) || info.captured.test(temp) || info.captured.test(tested))
+            {
+                continue;
+            }
+
+            // With an inverted TEST the guarded instruction runs when the comparison fails, the comparison skips
+            // a jump over it instead.
+            size_t slot = pc + 1;
+            if (proto.code[test_pc].b() != 0)
+            {
+                proto.code[slot] = with_jump_target(make_op_jmp(0), slot, guarded_pc + 1);
+                slot++;
+            }
+            move_instruction(proto, guarded_pc, slot);
+            for (size_t i = slot + 1; i <= guarded_pc; ++i)
+            {
+                removed[i] = true;
+            }
+
+            fused++;
+            pc = guarded_pc;
+        }
+
+        if (fused == 0)
+        {
+            return false;
+        }
+
+        remove_instructions(context, removed);
+
+        if constexpr (kOptimizationPassDebug)
+        {
+            println("  [CompareJumpFusion] Fused {} comparisons", fused);
+        }
+
+        return true;
+    }
+
+} // namespace behl
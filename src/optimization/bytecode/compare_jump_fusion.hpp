@@ -0,0 +1,21 @@
+#pragma once
+
+#include "bytecode_context.hpp"
+
+namespace behl
+{
+    // Compare and jump fusion pass
+    // A comparison used as a condition is materialized as a boolean and tested again:
+    //   CMP; LOADBOOL Rt true skip; LOADBOOL Rt false; [MOVE Rx Rt]; TEST Rx; JMP L
+    // When the boolean is not used afterwards the comparison jumps directly. Comparisons are never inverted,
+    // their metamethods make `!(a < b)` and `a >= b` different.
+    struct CompareJumpFusionPass
+    {
+        static constexpr std::string_view kName = "CompareJumpFusion";
+        static constexpr OptLevel kMinLevel = OptLevel::kO1;
+        static constexpr bool kTracksChanges = false;
+
+        static bool apply(BytecodeOptimizationContext& context);
+    };
+
+} // namespace behl
@@ -0,0 +1,117 @@
+#include "dead_code_elimination.hpp"
+
+#include "common/print.hpp"
+#include "config_internal.hpp"
+
+namespace behl
+{
+    // Instructions without effects besides writing registers. LOADNIL is kept, assigning nil is how scripts drop the
+    // last reference to an object before a collection.
+    static bool is_pure_load(Instruction instr)
+    {
+        switch (instr.op())
+        {
+            case OpCode::kOpMove:
+            case OpCode::kOpLoadI:
+            case OpCode::kOpLoadF:
+            case OpCode::kOpLoadS:
+            case OpCode::kOpLoadImm:
+            case OpCode::kOpGetUpval:
+            case OpCode::kOpNewTable:
+            case OpCode::kOpNewTableK:
+                return true;
+            case OpCode::kOpLoadBool:
+                return !instr.skip_next();
+            default:
+                return false;
+        }
+    }
+
+    static std::vector<bool> reachable_code(const GCProto& proto, const CodeInfo& info)
+    {
+        const size_t size = proto.code.size();
+        std::vector<bool> reached(size, false);
+        std::vector<size_t> worklist;
+        if (size > 0)
+        {
+            reached[0] = true;
+            worklist.push_back(0);
+        }
+
+        while (!worklist.empty())
+        {
+            const size_t pc = worklist.back();
+            worklist.pop_back();
+
+            // Captures belong to their CLOSURE
+            for (size_t i = pc + 1; i < size && info.is_capture[i]; ++i)
+            {
+                reached[i] = true;
+            }
+
+            size_t succ[2];
+            const size_t count = successors(proto, info, pc, succ);
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (!reached[succ[i]])
+                {
+                    reached[succ[i]] = true;
+                    worklist.push_back(succ[i]);
+                }
+            }
+        }
+
+        return reached;
+    }
+
+    bool DeadCodeEliminationPass::apply(BytecodeOptimizationContext& context)
+    {
+        GCProto& proto = *context.proto;
+        const size_t size = proto.code.size();
+        const CodeInfo& info = context.code_liveness();
+
+        const std::vector<bool> reached = reachable_code(proto, info);
+
+        std::vector<bool> removed(size, false);
+        size_t unreachable = 0;
+        size_t dead_loads = 0;
+
+        for (size_t pc = 0; pc < size; ++pc)
+        {
+            if (!reached[pc])
+            {
+                removed[pc] = true;
+                unreachable++;
+                continue;
+            }
+
+            const Instruction instr = proto.code[pc];
+            if (info.is_capture[pc] || info.in_skip_slot[pc] || !is_pure_load(instr))
+            {
+                continue;
+            }
+
+            const RegisterSet& written = info.effects[pc].writes;
+            if ((written & (info.live_out[pc] | info.captured)).none())
+            {
+                removed[pc] = true;
+                dead_loads++;
+            }
+        }
+
+        if (unreachable == 0 && dead_loads == 0)
+        {
+            return false;
+        }
+
+        remove_instructions(context, removed);
+
+        if constexpr (kOptimizationPassDebug)
+        {
+            println("  [DeadCodeElimination] Removed {} unreachable instructions and {} dead loads", unreachable, dead_loads);
+        }
+
+        return true;
+    }
+
+} // namespace behl
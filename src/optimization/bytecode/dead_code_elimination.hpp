@@ -0,0 +1,18 @@
+#pragma once
+
+#include "bytecode_context.hpp"
+
+namespace behl
+{
+    // Bytecode dead code elimination pass
+    // Removes instructions that can not be reached and loads into registers that are never read.
+    struct DeadCodeEliminationPass
+    {
+        static constexpr std::string_view kName = "DeadCodeElimination";
+        static constexpr OptLevel kMinLevel = OptLevel::kO1;
+        static constexpr bool kTracksChanges = false;
+
+        static bool apply(BytecodeOptimizationContext& context);
+    };
+
+} // namespace behl
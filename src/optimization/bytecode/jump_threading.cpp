@@ -0,0 +1,163 @@
+#include "jump_threading.hpp"
+
+#include "common/print.hpp"
+#include "config_internal.hpp"
+
+namespace behl
+{
+    // Follows a chain of JMPs starting at target, stops at the first other instruction or when the chain loops.
+    static size_t final_target(const GCProto& proto, size_t target)
+    {
+        const size_t size = proto.code.size();
+        for (size_t hops = 0; hops < size && target < size; ++hops)
+        {
+            const Instruction instr = proto.code[target];
+            if (instr.op() != OpCode::kOpJmp)
+            {
+                break;
+            }
+            const size_t next = jump_target(instr, target);
+            if (next == target)
+            {
+                break;
+            }
+            target = next;
+        }
+        return target;
+    }
+
+    static bool is_test_jump(const GCProto& proto, size_t pc)
+    {
+        return pc + 1 < proto.code.size() && proto.code[pc].op() == OpCode::kOpTest
+            && proto.code[pc + 1].op() == OpCode::kOpJmp;
+    }
+
+    // The JMP at pc + 1 runs only when the TEST at pc passed. Landing on a TEST of the same register decides it again.
+    static size_t thread_test(const GCProto& proto, size_t pc, size_t target)
+    {
+        const Instruction test = proto.code[pc];
+        if (target + 1 >= proto.code.size() || proto.code[target].op() != OpCode::kOpTest
+            || proto.code[target].a() != test.a())
+        {
+            return target;
+        }
+
+        if (proto.code[target].b() != test.b())
+        {
+            // Opposite condition, fails and skips its jump
+            return target + 2;
+        }
+
+        if (proto.code[target + 1].op() == OpCode::kOpJmp)
+        {
+            return jump_target(proto.code[target + 1], target + 1);
+        }
+
+        return target;
+    }
+
+    bool JumpThreadingPass::apply(BytecodeOptimizationContext& context)
+    {
+        GCProto& proto = *context.proto;
+        const size_t size = proto.code.size();
+        const CodeInfo& info = context.code_info();
+        const bool has_lines = proto.line_info.size() == size;
+        const bool has_columns = proto.column_info.size() == size;
+
+        std::vector<bool> removed(size, false);
+        size_t threaded = 0;
+
+        for (size_t pc = 0; pc < size; ++pc)
+        {
+            if (info.is_capture[pc])
+            {
+                continue;
+            }
+
+            // A TEST whose outcomes both continue at the same instruction does nothing.
+            if (is_test_jump(proto, pc) && !info.in_skip_slot[pc] && jump_target(proto.code[pc + 1], pc + 1) == pc + 2)
+            {
+                removed[pc] = true;
+                removed[pc + 1] = true;
+                threaded++;
+                pc++;
+                continue;
+            }
+
+            const Instruction instr = proto.code[pc];
+            if (instr.op() != OpCode::kOpJmp)
+            {
+                continue;
+            }
+
+            const size_t original = jump_target(instr, pc);
+            size_t target = final_target(proto, original);
+            if (pc > 0 && !info.is_branch_target[pc] && is_test_jump(proto, pc - 1) && !info.is_capture[pc - 1])
+            {
+                for (size_t hops = 0; hops < size; ++hops)
+                {
+                    const size_t next = final_target(proto, thread_test(proto, pc - 1, target));
+                    if (next == target || next == pc - 1)
+                    {
+                        break;
+                    }
+                    target = next;
+                }
+            }
+
+            // A slot of a SWITCH may only be retargeted
+            if (info.is_switch_slot[pc])
+            {
+                if (target != original)
+                {
+                    proto.code[pc] = with_jump_target(instr, pc, target);
+                    threaded++;
+                }
+                continue;
+            }
+
+            if (target < size && proto.code[target].op() == OpCode::kOpReturn)
+            {
+                proto.code[pc] = proto.code[target];
+                if (has_lines)
+                {
+                    proto.line_info[pc] = proto.line_info[target];
+                }
+                if (has_columns)
+                {
+                    proto.column_info[pc] = proto.column_info[target];
+                }
+                threaded++;
+                continue;
+            }
+
+            if (target == pc + 1 && !info.in_skip_slot[pc])
+            {
+                removed[pc] = true;
+                threaded++;
+                continue;
+            }
+
+            if (target != original)
+            {
+                proto.code[pc] = with_jump_target(instr, pc, target);
+                threaded++;
+            }
+        }
+
+        if (threaded == 0)
+        {
+            return false;
+        }
+
+        remove_instructions(context, removed);
+
+        if constexpr (kOptimizationPassDebug)
+        {
+            println("  [JumpThreading] Threaded {} jumps", threaded);
+        }
+
+        return true;
+    }
+
+} // namespace behl
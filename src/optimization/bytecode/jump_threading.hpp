@@ -0,0 +1,19 @@
+#pragma once
+
+#include "bytecode_context.hpp"
+
+namespace behl
+{
+    // Jump threading pass
+    // Retargets jumps that land on another jump, or on a TEST deciding the same condition again, to their final
+    // destination. Jumps to a RETURN are replaced by a copy of it and jumps to the next instruction are removed.
+    struct JumpThreadingPass
+    {
+        static constexpr std::string_view kName = "JumpThreading";
+        static constexpr OptLevel kMinLevel = OptLevel::kO1;
+        static constexpr bool kTracksChanges = false;
+
+        static bool apply(BytecodeOptimizationContext& context);
+    };
+
+} // namespace behl
@@ -0,0 +1,262 @@
+#include "move_coalescing.hpp"
+
+#include "common/print.hpp"
+#include "config_internal.hpp"
+
+namespace behl
+{
+    // Fields holding a register that is only read, the value can come from any other register.
+    static uint8_t read_fields(Instruction instr)
+    {
+        switch (instr.op())
+        {
+            case OpCode::kOpSetGlobal:
+            case OpCode::kOpSetUpval:
+            case OpCode::kOpTest:
+            case OpCode::kOpLTImm:
+            case OpCode::kOpGeImm:
+            case OpCode::kOpLEImm:
+            case OpCode::kOpGtImm:
+            case OpCode::kOpEqImm:
+            case OpCode::kOpNeImm:
+            case OpCode::kOpSwitch:
+                return kFieldA;
+
+            case OpCode::kOpMove:
+            case OpCode::kOpUnm:
+            case OpCode::kOpBnot:
+            case OpCode::kOpLen:
+            case OpCode::kOpToString:
+            case OpCode::kOpToNumber:
+            case OpCode::kOpAddImm:
+            case OpCode::kOpSubImm:
+            case OpCode::kOpAddKI:
+            case OpCode::kOpAddKF:
+            case OpCode::kOpSubKI:
+            case OpCode::kOpSubKF:
+            case OpCode::kOpGetFieldI:
+            case OpCode::kOpGetFieldS:
+            case OpCode::kOpLTI:
+            case OpCode::kOpGEI:
+            case OpCode::kOpLEI:
+            case OpCode::kOpGTI:
+            case OpCode::kOpLTF:
+            case OpCode::kOpGEF:
+            case OpCode::kOpLEF:
+            case OpCode::kOpGTF:
+            case OpCode::kOpTestSet:
+                return kFieldB;
+
+            case OpCode::kOpAdd:
+            case OpCode::kOpSub:
+            case OpCode::kOpMul:
+            case OpCode::kOpDiv:
+            case OpCode::kOpMod:
+            case OpCode::kOpPow:
+            case OpCode::kOpBand:
+            case OpCode::kOpBor:
+            case OpCode::kOpBxor:
+            case OpCode::kOpShl:
+            case OpCode::kOpShr:
+            case OpCode::kOpGetField:
+            case OpCode::kOpEq:
+            case OpCode::kOpNe:
+            case OpCode::kOpLt:
+            case OpCode::kOpGe:
+            case OpCode::kOpLe:
+            case OpCode::kOpGt:
+            case OpCode::kOpAddII:
+            case OpCode::kOpSubII:
+            case OpCode::kOpMulII:
+            case OpCode::kOpAddFF:
+            case OpCode::kOpSubFF:
+            case OpCode::kOpMulFF:
+            case OpCode::kOpDivFF:
+            case OpCode::kOpLTII:
+            case OpCode::kOpLEII:
+            case OpCode::kOpLTFF:
+            case OpCode::kOpLEFF:
+                return kFieldB | kFieldC;
+
+            case OpCode::kOpSetFieldI:
+            case OpCode::kOpSetFieldS:
+                return kFieldA | kFieldB;
+
+            case OpCode::kOpSetField:
+                return kFieldA | kFieldB | kFieldC;
+
+            default:
+                return 0;
+        }
+    }
+
+    // Instructions that only write register A from their operands, the result can be stored anywhere.
+    static bool is_retargetable(Instruction instr)
+    {
+        switch (instr.op())
+        {
+            case OpCode::kOpMove:
+            case OpCode::kOpLoadI:
+            case OpCode::kOpLoadF:
+            case OpCode::kOpLoadS:
+            case OpCode::kOpLoadImm:
+            case OpCode::kOpGetGlobal:
+            case OpCode::kOpGetUpval:
+            case OpCode::kOpNewTable:
+            case OpCode::kOpNewTableK:
+            case OpCode::kOpGetField:
+            case OpCode::kOpGetFieldI:
+            case OpCode::kOpGetFieldS:
+            case OpCode::kOpAdd:
+            case OpCode::kOpSub:
+            case OpCode::kOpMul:
+            case OpCode::kOpDiv:
+            case OpCode::kOpMod:
+            case OpCode::kOpPow:
+            case OpCode::kOpBand:
+            case OpCode::kOpBor:
+            case OpCode::kOpBxor:
+            case OpCode::kOpShl:
+            case OpCode::kOpShr:
+            case OpCode::kOpAddImm:
+            case OpCode::kOpSubImm:
+            case OpCode::kOpAddKI:
+            case OpCode::kOpAddKF:
+            case OpCode::kOpSubKI:
+            case OpCode::kOpSubKF:
+            case OpCode::kOpUnm:
+            case OpCode::kOpBnot:
+            case OpCode::kOpLen:
+            case OpCode::kOpToString:
+            case OpCode::kOpToNumber:
+                return true;
+            case OpCode::kOpLoadBool:
+                return !instr.skip_next();
+            default:
+                return false;
+        }
+    }
+
+    static Instruction substitute_reads(Instruction instr, Reg from, Reg to)
+    {
+        const uint8_t fields = read_fields(instr);
+        if ((fields & kFieldA) && instr.a() == from)
+        {
+            instr = with_field(instr, 0, to);
+        }
+        if ((fields & kFieldB) && instr.b() == from)
+        {
+            instr = with_field(instr, 8, to);
+        }
+        if ((fields & kFieldC) && instr.c() == from)
+        {
+            instr = with_field(instr, 16, to);
+        }
+        return instr;
+    }
+
+    bool MoveCoalescingPass::apply(BytecodeOptimizationContext& context)
+    {
+        GCProto& proto = *context.proto;
+        const size_t size = proto.code.size();
+        const CodeInfo& info = context.code_liveness();
+
+        // Instructions rewritten in this sweep, the liveness facts no longer hold for them.
+        std::vector<bool> touched(size, false);
+        std::vector<bool> removed(size, false);
+        size_t coalesced = 0;
+
+        for (size_t pc = 0; pc + 1 < size; ++pc)
+        {
+            if (info.is_capture[pc] || info.is_capture[pc + 1] || touched[pc] || touched[pc + 1])
+            {
+                continue;
+            }
+
+            const Instruction instr = proto.code[pc];
+            const Instruction next = proto.code[pc + 1];
+            const bool next_entered = info.is_branch_target[pc + 1] || info.in_skip_slot[pc + 1];
+
+            // MOVE Ra Ra
+            if (instr.op() == OpCode::kOpMove && instr.a() == instr.b())
+            {
+                if (!info.in_skip_slot[pc])
+                {
+                    removed[pc] = true;
+                    touched[pc] = true;
+                    coalesced++;
+                }
+                continue;
+            }
+
+            // MOVE Ra Rb; MOVE Rb Ra, the second move copies the value back unchanged
+            if (instr.op() == OpCode::kOpMove && next.op() == OpCode::kOpMove && next.a() == instr.b()
+                && next.b() == instr.a() && !next_entered)
+            {
+                removed[pc + 1] = true;
+                touched[pc] = touched[pc + 1] = true;
+                coalesced++;
+                continue;
+            }
+
+            // OP Rt ...; MOVE Rx Rt becomes OP Rx ...
+            if (is_retargetable(instr) && next.op() == OpCode::kOpMove && next.b() == instr.a() && !next_entered)
+            {
+                const Reg temp = instr.a();
+                const Reg dest = next.a();
+                if (temp != dest && !info.live_out[pc + 1].test(temp) && !info.captured.test(temp)
+                    && !info.captured.test(dest) && !register_effects(instr).reads.test(dest))
+                {
+                    proto.code[pc] = with_field(instr, 0, dest);
+                    removed[pc + 1] = true;
+                    touched[pc] = touched[pc + 1] = true;
+                    coalesced++;
+                    continue;
+                }
+            }
+
+            // MOVE Rt Rs; OP ... Rt ... becomes OP ... Rs ...
+            if (instr.op() == OpCode::kOpMove && !info.in_skip_slot[pc] && !info.is_branch_target[pc + 1])
+            {
+                const Reg temp = instr.a();
+                const Reg source = instr.b();
+                if (info.captured.test(temp) || info.captured.test(source))
+                {
+                    continue;
+                }
+
+                const Instruction rewritten = substitute_reads(next, temp, source);
+                if (rewritten.raw == next.raw)
+                {
+                    continue;
+                }
+
+                const RegisterEffects fx = register_effects(rewritten);
+                if (fx.reads.test(temp) || (info.live_out[pc + 1].test(temp) && !fx.writes.test(temp)))
+                {
+                    continue;
+                }
+
+                proto.code[pc + 1] = rewritten;
+                removed[pc] = true;
+                touched[pc] = touched[pc + 1] = true;
+                coalesced++;
+            }
+        }
+
+        if (coalesced == 0)
+        {
+            return false;
+        }
+
+        remove_instructions(context, removed);
+
+        if constexpr (kOptimizationPassDebug)
+        {
+            println("  [MoveCoalescing] Coalesced {} moves", coalesced);
+        }
+
+        return true;
+    }
+
+} // namespace behl
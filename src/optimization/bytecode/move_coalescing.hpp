@@ -0,0 +1,19 @@
+#pragma once
+
+#include "bytecode_context.hpp"
+
+namespace behl
+{
+    // Move coalescing pass
+    // Removes MOVEs through temporaries: the source of a MOVE is used directly by the next instruction, and the
+    // instruction producing a temporary writes the MOVE destination instead.
+    struct MoveCoalescingPass
+    {
+        static constexpr std::string_view kName = "MoveCoalescing";
+        static constexpr OptLevel kMinLevel = OptLevel::kO1;
+        static constexpr bool kTracksChanges = false;
+
+        static bool apply(BytecodeOptimizationContext& context);
+    };
+
+} // namespace behl
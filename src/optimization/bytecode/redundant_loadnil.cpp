@@ -0,0 +1,137 @@
+#include "redundant_loadnil.hpp"
+
+#include "common/print.hpp"
+#include "config_internal.hpp"
+
+#include <algorithm>
+
+namespace behl
+{
+    static RegisterSet loadnil_range(Instruction instr)
+    {
+        RegisterSet range;
+        for (size_t r = instr.a(); r <= static_cast<size_t>(instr.a()) + instr.b() && r < range.size(); ++r)
+        {
+            range.set(r);
+        }
+        return range;
+    }
+
+    // Forward dataflow of the registers holding nil on every path into each instruction. Registers start out
+    // uninitialized, so nothing is known at the entry. Captured registers may be changed by any call.
+    static std::vector<RegisterSet> known_nil(const GCProto& proto, const CodeInfo& info)
+    {
+        const size_t size = proto.code.size();
+
+        std::vector<RegisterSet> nil_in(size);
+        std::vector<bool> reached(size, false);
+        if (size == 0)
+        {
+            return nil_in;
+        }
+        reached[0] = true;
+
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            for (size_t pc = 0; pc < size; ++pc)
+            {
+                if (!reached[pc] || info.is_capture[pc])
+                {
+                    continue;
+                }
+
+                const Instruction instr = proto.code[pc];
+                RegisterSet out = nil_in[pc] & ~info.effects[pc].clobbers;
+                if (instr.op() == OpCode::kOpLoadNil)
+                {
+                    out |= loadnil_range(instr);
+                }
+                out &= ~info.captured;
+
+                size_t succ[2];
+                const size_t count = successors(proto, info, pc, succ);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const size_t next = succ[i];
+                    const RegisterSet merged = reached[next] ? (nil_in[next] & out) : out;
+                    if (!reached[next] || merged != nil_in[next])
+                    {
+                        reached[next] = true;
+                        nil_in[next] = merged;
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        return nil_in;
+    }
+
+    bool RedundantLoadNilPass::apply(BytecodeOptimizationContext& context)
+    {
+        GCProto& proto = *context.proto;
+        const size_t size = proto.code.size();
+        const CodeInfo& info = context.code_info();
+        const std::vector<RegisterSet> nil_in = known_nil(proto, info);
+
+        std::vector<bool> removed(size, false);
+        size_t eliminated = 0;
+
+        for (size_t pc = 0; pc < size; ++pc)
+        {
+            const Instruction instr = proto.code[pc];
+            if (info.is_capture[pc] || info.in_skip_slot[pc] || instr.op() != OpCode::kOpLoadNil)
+            {
+                continue;
+            }
+
+            const RegisterSet range = loadnil_range(instr);
+            if ((range & ~nil_in[pc]).none())
+            {
+                removed[pc] = true;
+                eliminated++;
+                continue;
+            }
+
+            // LOADNIL Ra n; LOADNIL Rb m with overlapping or adjacent ranges
+            if (pc + 1 >= size || info.is_branch_target[pc + 1] || info.in_skip_slot[pc + 1])
+            {
+                continue;
+            }
+            const Instruction next = proto.code[pc + 1];
+            if (next.op() != OpCode::kOpLoadNil)
+            {
+                continue;
+            }
+
+            const size_t first = std::min(instr.a(), next.a());
+            const size_t last = std::max<size_t>(instr.a() + instr.b(), next.a() + next.b());
+            if (next.a() > instr.a() + instr.b() + 1 || instr.a() > next.a() + next.b() + 1 || last - first > 0xFF)
+            {
+                continue;
+            }
+
+            proto.code[pc] = make_op_loadnil(static_cast<Reg>(first), static_cast<Reg>(last - first));
+            removed[pc + 1] = true;
+            eliminated++;
+            pc++;
+        }
+
+        if (eliminated == 0)
+        {
+            return false;
+        }
+
+        remove_instructions(context, removed);
+
+        if constexpr (kOptimizationPassDebug)
+        {
+            println("  [RedundantLoadNil] Removed {} LOADNILs", eliminated);
+        }
+
+        return true;
+    }
+
+} // namespace behl
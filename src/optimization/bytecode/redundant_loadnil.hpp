@@ -0,0 +1,18 @@
+#pragma once
+
+#include "bytecode_context.hpp"
+
+namespace behl
+{
+    // Redundant LOADNIL elimination pass
+    // Removes LOADNILs of registers that are nil on every path and merges adjacent LOADNILs of contiguous ranges.
+    struct RedundantLoadNilPass
+    {
+        static constexpr std::string_view kName = "RedundantLoadNil";
+        static constexpr OptLevel kMinLevel = OptLevel::kO1;
+        static constexpr bool kTracksChanges = false;
+
+        static bool apply(BytecodeOptimizationContext& context);
+    };
+
+} // namespace behl
@@ -0,0 +1,402 @@
+#include "register_allocation.hpp"
+
+#include "common/print.hpp"
+#include "config_internal.hpp"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+namespace behl
+{
+    static constexpr size_t kMultValues = static_cast<uint8_t>(kMultRet);
+    static constexpr uint8_t kUnassigned = 0xFF;
+
+    using InterferenceGraph = std::array<RegisterSet, kMaxTrackedRegisters>;
+
+    // Registers the instruction accesses relative to each other, they have to stay contiguous. Returns false when the
+    // instruction only accesses the registers named in its fields.
+    static bool register_block(Instruction instr, size_t frame_size, size_t& first, size_t& last)
+    {
+        const size_t a = instr.a();
+        const size_t b = instr.b();
+        const size_t c = instr.c();
+        const size_t top = frame_size - 1;
+
+        first = a;
+        switch (instr.op())
+        {
+            case OpCode::kOpLoadNil:
+                last = a + b;
+                break;
+            case OpCode::kOpSelf:
+                last = a + 1;
+                break;
+            case OpCode::kOpForPrep:
+            case OpCode::kOpForLoop:
+                last = a + 3;
+                break;
+            // Values counted up to frame.top belong to the block as well, the whole rest of the frame is kept
+            case OpCode::kOpCall:
+                last = (b == kMultValues || c == kMultValues) ? top : a + std::max(b, c) - 1;
+                break;
+            case OpCode::kOpTailCall:
+                last = b == kMultValues ? top : a + b - 1;
+                break;
+            case OpCode::kOpReturn:
+                if (b < 2)
+                {
+                    return false;
+                }
+                last = b == kMultValues ? top : a + b - 1;
+                break;
+            case OpCode::kOpSetList:
+                last = b == 0 ? top : a + 1 + b;
+                break;
+            case OpCode::kOpVararg:
+                last = top;
+                break;
+            default:
+                return false;
+        }
+
+        last = std::min(std::max(last, first), top);
+        return true;
+    }
+
+    // Calls overwrite every register from their base upwards with the frame of the callee.
+    static bool clobbers_upwards(Instruction instr)
+    {
+        return instr.op() == OpCode::kOpCall || instr.op() == OpCode::kOpTailCall || instr.op() == OpCode::kOpVararg;
+    }
+
+    static size_t find_root(std::array<uint8_t, kMaxTrackedRegisters>& parent, size_t reg)
+    {
+        while (parent[reg] != reg)
+        {
+            parent[reg] = parent[parent[reg]];
+            reg = parent[reg];
+        }
+        return reg;
+    }
+
+    static RegisterSet frame_mask(size_t frame_size)
+    {
+        return ~RegisterSet{} >> (kMaxTrackedRegisters - std::min(frame_size, kMaxTrackedRegisters));
+    }
+
+    namespace
+    {
+        // Registers that have to move together, offsets are relative to the lowest member.
+        struct RegisterUnit
+        {
+            uint8_t first = 0;
+            RegisterSet members;
+            bool fixed = false;
+        };
+
+        // Value live across a call, has to stay below the base of the callee frame.
+        struct BelowCall
+        {
+            uint8_t reg;
+            uint8_t base;
+        };
+    } // namespace
+
+    bool RegisterAllocationPass::apply(BytecodeOptimizationContext& context)
+    {
+        GCProto& proto = *context.proto;
+        const size_t size = proto.code.size();
+        const size_t frame_size = proto.max_stack_size;
+        if (size == 0 || frame_size <= proto.num_params + 1 || frame_size > kMaxTrackedRegisters)
+        {
+            return false;
+        }
+
+        const CodeInfo& info = context.code_liveness();
+        const RegisterSet in_frame = frame_mask(frame_size);
+
+        // R0 holds the closure the upvalue instructions read, captured registers stay open until the function returns
+        // and registers read before any write rely on the frame starting out nil.
+        RegisterSet params;
+        for (size_t r = 0; r <= proto.num_params; ++r)
+        {
+            params.set(r);
+        }
+        RegisterSet reserved = info.captured | (info.live_in[0] & in_frame & ~params);
+        reserved.set(0);
+        const RegisterSet fixed = reserved | params;
+
+        std::array<uint8_t, kMaxTrackedRegisters> parent{};
+        for (size_t r = 0; r < kMaxTrackedRegisters; ++r)
+        {
+            parent[r] = static_cast<uint8_t>(r);
+        }
+
+        InterferenceGraph interference{};
+        std::vector<BelowCall> below_calls;
+        RegisterSet used = fixed;
+        InterferenceGraph move_partners{};
+
+        for (size_t pc = 0; pc < size; ++pc)
+        {
+            if (info.is_capture[pc])
+            {
+                continue;
+            }
+
+            const Instruction instr = proto.code[pc];
+            const uint8_t fields = register_fields(instr);
+            if (((fields & kFieldA) && instr.a() >= frame_size) || ((fields & kFieldB) && instr.b() >= frame_size)
+                || ((fields & kFieldC) && instr.c() >= frame_size))
+            {
+                return false;
+            }
+
+            const RegisterEffects& fx = info.effects[pc];
+            const RegisterSet reads = fx.reads & in_frame;
+            RegisterSet defs = fx.clobbers & in_frame;
+
+            RegisterSet block;
+            size_t first = 0;
+            size_t last = 0;
+            if (register_block(instr, frame_size, first, last))
+            {
+                for (size_t r = first + 1; r <= last; ++r)
+                {
+                    const size_t root_a = find_root(parent, first);
+                    const size_t root_b = find_root(parent, r);
+                    parent[std::max(root_a, root_b)] = static_cast<uint8_t>(std::min(root_a, root_b));
+                }
+                for (size_t r = first; r <= last; ++r)
+                {
+                    block.set(r);
+                }
+            }
+
+            if (clobbers_upwards(instr))
+            {
+                // Registers above the block are overwritten by the callee but never read afterwards
+                defs = block;
+                const RegisterSet across = (info.live_out[pc] | (reserved & ~block)) & ~block;
+                for (size_t r = 0; r < first; ++r)
+                {
+                    if (across.test(r))
+                    {
+                        below_calls.push_back({ static_cast<uint8_t>(r), static_cast<uint8_t>(first) });
+                    }
+                }
+            }
+
+            // Results never share a register with the operands of the same instruction, except for a copy where both
+            // hold the same value.
+            RegisterSet live = info.live_out[pc] & in_frame;
+            if (instr.op() == OpCode::kOpMove && instr.a() != instr.b())
+            {
+                live.reset(instr.b());
+                move_partners[instr.a()].set(instr.b());
+                move_partners[instr.b()].set(instr.a());
+            }
+            else
+            {
+                live |= reads;
+            }
+
+            for (size_t r = 0; r < frame_size; ++r)
+            {
+                if (defs.test(r))
+                {
+                    interference[r] |= live;
+                }
+            }
+
+            used |= reads | defs | block;
+        }
+
+        for (size_t r = 0; r < frame_size; ++r)
+        {
+            if (reserved.test(r))
+            {
+                interference[r] = in_frame;
+            }
+        }
+        for (size_t r = 0; r < frame_size; ++r)
+        {
+            for (size_t other = 0; other < frame_size; ++other)
+            {
+                if (interference[r].test(other))
+                {
+                    interference[other].set(r);
+                }
+            }
+        }
+        for (size_t r = 0; r < frame_size; ++r)
+        {
+            interference[r].reset(r);
+        }
+
+        // Group the registers into units, a unit containing a fixed register keeps its place
+        std::vector<RegisterUnit> units;
+        std::array<uint8_t, kMaxTrackedRegisters> unit_of{};
+        unit_of.fill(kUnassigned);
+        for (size_t r = 0; r < frame_size; ++r)
+        {
+            if (!used.test(r))
+            {
+                continue;
+            }
+            const size_t root = find_root(parent, r);
+            if (unit_of[root] == kUnassigned)
+            {
+                unit_of[root] = static_cast<uint8_t>(units.size());
+                units.push_back({ static_cast<uint8_t>(r), {}, false });
+            }
+            RegisterUnit& unit = units[unit_of[root]];
+            unit.members.set(r);
+            unit.fixed = unit.fixed || fixed.test(r);
+        }
+        std::stable_sort(units.begin(), units.end(),
+            [](const RegisterUnit& lhs, const RegisterUnit& rhs) { return lhs.fixed && !rhs.fixed; });
+
+        std::array<uint8_t, kMaxTrackedRegisters> assigned{};
+        assigned.fill(kUnassigned);
+        InterferenceGraph occupants{};
+
+        const auto fits = [&](const RegisterUnit& unit, size_t base) {
+            for (size_t r = unit.first; r < frame_size; ++r)
+            {
+                if (!unit.members.test(r))
+                {
+                    continue;
+                }
+                const size_t slot = base + r - unit.first;
+                if (slot >= frame_size || (occupants[slot] & interference[r]).any())
+                {
+                    return false;
+                }
+            }
+            for (const BelowCall& constraint : below_calls)
+            {
+                const bool reg_in_unit = unit.members.test(constraint.reg);
+                const bool base_in_unit = unit.members.test(constraint.base);
+                if (reg_in_unit && !base_in_unit && assigned[constraint.base] != kUnassigned
+                    && base + constraint.reg - unit.first >= assigned[constraint.base])
+                {
+                    return false;
+                }
+                if (base_in_unit && !reg_in_unit && assigned[constraint.reg] != kUnassigned
+                    && base + constraint.base - unit.first <= assigned[constraint.reg])
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        for (const RegisterUnit& unit : units)
+        {
+            size_t base = unit.first;
+            if (!unit.fixed)
+            {
+                // A copy between the only member and a register already placed disappears when both share a slot
+                bool placed = false;
+                if (unit.members.count() == 1)
+                {
+                    for (size_t partner = 0; partner < frame_size && !placed; ++partner)
+                    {
+                        if (move_partners[unit.first].test(partner) && assigned[partner] != kUnassigned
+                            && fits(unit, assigned[partner]))
+                        {
+                            base = assigned[partner];
+                            placed = true;
+                        }
+                    }
+                }
+                for (size_t candidate = 0; candidate < frame_size && !placed; ++candidate)
+                {
+                    if (fits(unit, candidate))
+                    {
+                        base = candidate;
+                        placed = true;
+                    }
+                }
+                if (!placed)
+                {
+                    return false;
+                }
+            }
+
+            for (size_t r = unit.first; r < frame_size; ++r)
+            {
+                if (unit.members.test(r))
+                {
+                    assigned[r] = static_cast<uint8_t>(base + r - unit.first);
+                    occupants[assigned[r]].set(r);
+                }
+            }
+        }
+
+        size_t new_frame_size = 0;
+        for (size_t r = 0; r < frame_size; ++r)
+        {
+            if (assigned[r] != kUnassigned)
+            {
+                new_frame_size = std::max<size_t>(new_frame_size, assigned[r] + 1);
+            }
+        }
+
+        size_t joined_moves = 0;
+        for (size_t pc = 0; pc < size; ++pc)
+        {
+            const Instruction instr = proto.code[pc];
+            if (!info.is_capture[pc] && instr.op() == OpCode::kOpMove && instr.a() != instr.b()
+                && assigned[instr.a()] != kUnassigned && assigned[instr.a()] == assigned[instr.b()])
+            {
+                joined_moves++;
+            }
+        }
+
+        if (new_frame_size >= frame_size && joined_moves == 0)
+        {
+            return false;
+        }
+
+        // Fields naming a register the instruction does not access, like the base of RETURN without values, keep it
+        const auto rename = [&](Reg reg) { return assigned[reg] == kUnassigned ? reg : assigned[reg]; };
+        for (size_t pc = 0; pc < size; ++pc)
+        {
+            if (info.is_capture[pc])
+            {
+                continue;
+            }
+
+            Instruction instr = proto.code[pc];
+            const uint8_t fields = register_fields(instr);
+            if (fields & kFieldA)
+            {
+                instr = with_field(instr, 0, rename(instr.a()));
+            }
+            if (fields & kFieldB)
+            {
+                instr = with_field(instr, 8, rename(instr.b()));
+            }
+            if (fields & kFieldC)
+            {
+                instr = with_field(instr, 16, rename(instr.c()));
+            }
+            proto.code[pc] = instr;
+        }
+
+        proto.max_stack_size = static_cast<uint32_t>(new_frame_size);
+        context.invalidate_analysis();
+
+        if constexpr (kOptimizationPassDebug)
+        {
+            println("  [RegisterAllocation] Frame {} -> {} registers, {} moves joined", frame_size, new_frame_size,
+                joined_moves);
+        }
+
+        return true;
+    }
+
+} // namespace behl
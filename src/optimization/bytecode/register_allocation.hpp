@@ -0,0 +1,20 @@
+#pragma once
+
+#include "bytecode_context.hpp"
+
+namespace behl
+{
+    // Register allocation pass
+    // Code generation gives every local its own register for its whole scope. This pass renames registers based on
+    // their liveness so that values whose lifetimes do not overlap share a register, which shrinks the frame and
+    // turns copies between such values into self moves that move coalescing removes.
+    struct RegisterAllocationPass
+    {
+        static constexpr std::string_view kName = "RegisterAllocation";
+        static constexpr OptLevel kMinLevel = OptLevel::kO2;
+        static constexpr bool kTracksChanges = false;
+
+        static bool apply(BytecodeOptimizationContext& context);
+    };
+
+} // namespace behl
@@ -1,16 +1,45 @@
 #pragma once
 
 #include "ast/ast_context.hpp"
+#include "ast/common_subexpression_elimination.hpp"
 #include "ast/constant_folding.hpp"
+#include "ast/constant_propagation.hpp"
 #include "ast/dead_store_elimination.hpp"
+#include "ast/inlining.hpp"
+#include "ast/loop_invariant_code_motion.hpp"
 #include "ast/loop_optimization.hpp"
+#include "ast/loop_unrolling.hpp"
+#include "ast/scalar_replacement.hpp"
+#include "ast/strength_reduction.hpp"
+#include "ast/type_inference.hpp"
+#include "bytecode/bytecode_context.hpp"
+#include "bytecode/compare_jump_fusion.hpp"
+#include "bytecode/dead_code_elimination.hpp"
+#include "bytecode/jump_threading.hpp"
+#include "bytecode/move_coalescing.hpp"
+#include "bytecode/redundant_loadnil.hpp"
+#include "bytecode/register_allocation.hpp"
 #include "optimization_pass.hpp"
 
 namespace behl
 {
     // Standard AST optimization pipeline (does not include semantics pass - that always runs)
     // Loop optimization should run before other optimizations to expose more optimization opportunities
-    using ASTOptimizationPipeline = OptimizationPipeline<AstOptimizationContext, LoopOptimizationPass, ConstantFoldingPass,
-        DeadStoreEliminationPass>;
+    // Inlining runs before constant folding so that calls with constant arguments fold completely
+    // Scalar replacement follows inlining, which exposes tables built by small helpers, its field locals get propagated
+    // Propagated constants and library results feed constant folding, whose results are propagated on the next round
+    // Loop unrolling needs folded bounds, the literals it puts into the copies are folded on the next round
+    // Code motion and subexpression elimination see folded expressions, their temporaries are never dead stores
+    // Strength reduction sees the products subexpression elimination left in the loops
+    // Type inference marks the final tree for code generation and runs again whenever another pass changes it
+    using ASTOptimizationPipeline = OptimizationPipeline<AstOptimizationContext, LoopOptimizationPass, InliningPass,
+        ScalarReplacementPass, ConstantPropagationPass, ConstantFoldingPass, LoopUnrollingPass, LoopInvariantCodeMotionPass,
+        CommonSubexpressionEliminationPass, StrengthReductionPass, DeadStoreEliminationPass, TypeInferencePass>;
+
+    // Peephole pipeline over the bytecode of a single function, runs once code generation of the function finished
+    // Jump threading first exposes the compare and jump idioms, dead code elimination cleans up what others left
+    // Register allocation comes last, it works best on code without dead loads and leaves self moves behind
+    using BytecodeOptimizationPipeline = OptimizationPipeline<BytecodeOptimizationContext, JumpThreadingPass,
+        CompareJumpFusionPass, MoveCoalescingPass, RedundantLoadNilPass, DeadCodeEliminationPass, RegisterAllocationPass>;
 
 } // namespace behl
@@ -3,7 +3,11 @@
 #include "common/print.hpp"
 #include "config_internal.hpp"
 
+#include <array>
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
 
 namespace behl
 {
@@ -11,81 +15,152 @@ namespace behl
     // Context is passed to each Pass::apply(Context&)
     //
     // All passes must return bool indicating whether changes were made.
-    // Pipeline runs passes in a loop until fixpoint (no changes).
+    // Passes are kept on a worklist: a pass runs again only after some pass changed the program since its last run,
+    // until no pass is pending. Passes below the context level (Pass::kMinLevel) never run.
+    //
+    // Passes with Pass::kTracksChanges only revisit function bodies changed after their previous run, the context
+    // passes the step counter and the step to revisit from. Any change made by a pass that does not track its changes,
+    // or made outside function bodies, forces the next run of every pass to revisit the whole program.
     template<typename Context, typename... Passes>
     class OptimizationPipeline
     {
+        static constexpr size_t kPassCount = sizeof...(Passes);
+
+        struct PassState
+        {
+            bool pending = true;
+            uint32_t last_run = 0;
+            uint32_t runs = 0;
+            uint32_t changes = 0;
+            uint64_t time_ns = 0;
+        };
+
+        struct Worklist
+        {
+            std::array<PassState, kPassCount> passes{};
+            uint32_t program_change = 0; // Last step that requires a full revisit
+            uint32_t total_runs = 0;
+        };
+
     public:
         template<typename... Args>
         static auto apply(Args&&... args)
         {
-            if constexpr (kOptimizationPassTiming || kOptimizationPassDebug)
+            if constexpr (kOptimizationPassDebug)
             {
-                println("[Optimization Pipeline] Starting {} passes", sizeof...(Passes));
+                println("[Optimization Pipeline] Starting {} passes", kPassCount);
             }
 
             Context context{ std::forward<Args>(args)... };
-            run_until_fixpoint(context);
+            run_worklist(context);
 
             return context.result();
         }
 
     private:
-        static void run_until_fixpoint(Context& context)
+        static void run_worklist(Context& context)
         {
-            bool changed = true;
-            int iteration = 0;
-            constexpr int kMaxIterations = 100; // Safety limit
+            // Safety limit, every pass is expected to settle after a handful of runs
+            constexpr uint32_t kMaxRuns = 100 * kPassCount;
 
-            while (changed && iteration < kMaxIterations)
-            {
-                if constexpr (kOptimizationPassTiming || kOptimizationPassDebug)
-                {
-                    println("  [Iteration {}]", iteration++);
-                }
-                else
-                {
-                    iteration++;
-                }
+            Worklist worklist;
+            bool pending = true;
 
-                changed = false;
-                changed = (apply_with_timing<Passes>(context) || ...);
+            while (pending && worklist.total_runs < kMaxRuns)
+            {
+                pending = false;
+                run_pending(context, worklist, std::index_sequence_for<Passes...>{});
 
-                if constexpr (kOptimizationPassTiming || kOptimizationPassDebug)
+                for (const PassState& pass : worklist.passes)
                 {
-                    if (changed)
-                    {
-                        println("  Changes detected, running another iteration");
-                    }
+                    pending = pending || pass.pending;
                 }
             }
 
-            if (iteration >= kMaxIterations)
+            if (pending)
             {
-                println("  WARNING: Hit maximum iteration limit ({}), optimization may not have converged!", kMaxIterations);
+                println("  WARNING: Hit maximum pass run limit ({}), optimization may not have converged!", kMaxRuns);
             }
-            else if constexpr (kOptimizationPassTiming || kOptimizationPassDebug)
+            else if constexpr (kOptimizationPassDebug)
             {
-                println("  Reached fixpoint after {} iterations", iteration);
+                println("  Reached fixpoint after {} pass runs", worklist.total_runs);
             }
+
+            if (context.report)
+            {
+                report(context, worklist, std::index_sequence_for<Passes...>{});
+            }
+        }
+
+        template<size_t... Is>
+        static void run_pending(Context& context, Worklist& worklist, std::index_sequence<Is...>)
+        {
+            (run_pass<Passes>(context, worklist, worklist.passes[Is]), ...);
         }
 
         template<typename Pass>
-        static bool apply_with_timing(Context& context)
+        static void run_pass(Context& context, Worklist& worklist, PassState& state)
         {
-            if constexpr (kOptimizationPassTiming)
+            if (!state.pending)
+            {
+                return;
+            }
+            state.pending = false;
+
+            if (context.level < Pass::kMinLevel)
             {
-                auto start = std::chrono::high_resolution_clock::now();
-                bool changed = Pass::apply(context);
-                auto end = std::chrono::high_resolution_clock::now();
-                auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-                println("    [{}] completed in {} μs (changed: {})", Pass::kName, duration.count(), changed);
-                return changed;
+                return;
             }
-            else
+
+            const uint32_t step = ++context.step;
+            const bool full = state.last_run == 0 || worklist.program_change >= state.last_run;
+            context.revisit_from = full ? 0 : state.last_run;
+            context.changed_outside_functions = false;
+
+            const auto start = std::chrono::steady_clock::now();
+            const bool changed = Pass::apply(context);
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+
+            state.last_run = step;
+            state.runs++;
+            state.time_ns += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            worklist.total_runs++;
+
+            if constexpr (kOptimizationPassDebug)
+            {
+                println("    [{}] step {} {} (changed: {})", Pass::kName, step, full ? "full" : "incremental", changed);
+            }
+
+            if (!changed)
+            {
+                return;
+            }
+
+            state.changes++;
+            if (!Pass::kTracksChanges || context.changed_outside_functions)
+            {
+                worklist.program_change = step;
+            }
+            for (PassState& other : worklist.passes)
+            {
+                other.pending = true;
+            }
+        }
+
+        template<size_t... Is>
+        static void report(Context& context, const Worklist& worklist, std::index_sequence<Is...>)
+        {
+            (report_pass<Passes>(context, worklist.passes[Is]), ...);
+        }
+
+        template<typename Pass>
+        static void report_pass(Context& context, const PassState& state)
+        {
+            if (context.level < Pass::kMinLevel)
             {
-                return Pass::apply(context);
+                return;
             }
+            context.report->push_back({ Pass::kName, state.runs, state.changes, state.time_ns });
         }
     };
 
@@ -0,0 +1,317 @@
+#include "profiler.hpp"
+
+#include "common/format.hpp"
+#include "gc/gco_proto.hpp"
+#include "gc/gco_string.hpp"
+#include "gc/gco_table.hpp"
+#include "state.hpp"
+#include "vm/vm_debug.hpp"
+#include "vm/vm_detail.hpp"
+
+#include <algorithm>
+#include <map>
+#include <utility>
+
+namespace behl
+{
+    static AllocFrame make_alloc_frame(State* S, const CallFrame& frame)
+    {
+        AllocFrame result;
+
+        if (frame.proto)
+        {
+            const auto loc = get_current_location(frame);
+            result.function = frame.proto->name ? std::string(frame.proto->name->view()) : std::string("<unknown>");
+            result.source = loc.filename;
+            result.line = loc.line;
+            return result;
+        }
+
+        // Native frame, the callee may not be on the stack yet while the frame is being set up.
+        result.function = frame.base < S->stack.size() ? get_function_name(S, frame) : std::string("<native>");
+        result.source = "<native>";
+        return result;
+    }
+
+    static void append_folded_frame(std::string& out, const AllocFrame& frame)
+    {
+        if (frame.line > 0)
+        {
+            out += behl::format("{} ({}:{})", frame.function, frame.source, frame.line);
+        }
+        else
+        {
+            out += behl::format("{} ({})", frame.function, frame.source);
+        }
+    }
+
+    void profiler_take_sample(State* S)
+    {
+        auto& prof = S->profiler;
+
+        // Large allocations may span several sampling intervals, each one counts as a sample.
+        size_t intervals = 0;
+        while (prof.bytes_until_sample <= 0)
+        {
+            prof.bytes_until_sample += static_cast<int64_t>(prof.sample_interval);
+            ++intervals;
+        }
+
+        if (prof.sampling)
+        {
+            return;
+        }
+        prof.sampling = true;
+
+        std::vector<AllocFrame> frames;
+        frames.reserve(S->call_stack.size());
+        for (size_t i = S->call_stack.size(); i-- > 0;)
+        {
+            frames.push_back(make_alloc_frame(S, S->call_stack[i]));
+        }
+
+        // Key is the folded stack, outermost frame first, with the object type as the leaf.
+        std::string key;
+        for (auto it = frames.rbegin(); it != frames.rend(); ++it)
+        {
+            append_folded_frame(key, *it);
+            key += ';';
+        }
+        key += behl::format("[{}]", prof.alloc_type);
+
+        auto [it, inserted] = prof.sites.try_emplace(std::move(key));
+        AllocSite& site = it->second;
+        if (inserted)
+        {
+            site.frames = std::move(frames);
+            site.object_type = prof.alloc_type;
+        }
+
+        site.samples += intervals;
+        site.bytes += intervals * prof.sample_interval;
+        prof.total_samples += intervals;
+
+        prof.sampling = false;
+    }
+
+    std::string profiler_format_folded(const ProfilerState& prof)
+    {
+        // std::map keeps the output sorted and therefore stable between runs.
+        std::map<std::string_view, size_t> lines;
+        for (const auto& [key, site] : prof.sites)
+        {
+            lines.emplace(key, site.bytes);
+        }
+
+        std::string out;
+        for (const auto& [key, bytes] : lines)
+        {
+            out += behl::format("{} {}\n", key, bytes);
+        }
+        return out;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    // pprof
+
+    // Minimal protobuf writer covering the wire types used by profile.proto.
+    class ProtoWriter
+    {
+    public:
+        void varint(uint64_t value)
+        {
+            while (value >= 0x80)
+            {
+                buffer_ += static_cast<char>((value & 0x7F) | 0x80);
+                value >>= 7;
+            }
+            buffer_ += static_cast<char>(value);
+        }
+
+        void field_varint(uint32_t field, uint64_t value)
+        {
+            varint((static_cast<uint64_t>(field) << 3) | 0);
+            varint(value);
+        }
+
+        void field_bytes(uint32_t field, std::string_view bytes)
+        {
+            varint((static_cast<uint64_t>(field) << 3) | 2);
+            varint(bytes.size());
+            buffer_ += bytes;
+        }
+
+        void field_packed(uint32_t field, const std::vector<uint64_t>& values)
+        {
+            ProtoWriter packed;
+            for (const auto value : values)
+            {
+                packed.varint(value);
+            }
+            field_bytes(field, packed.str());
+        }
+
+        const std::string& str() const
+        {
+            return buffer_;
+        }
+
+    private:
+        std::string buffer_;
+    };
+
+    class PprofBuilder
+    {
+    public:
+        PprofBuilder()
+        {
+            string_index("");
+        }
+
+        uint64_t string_index(std::string_view str)
+        {
+            auto it = string_ids_.find(std::string(str));
+            if (it != string_ids_.end())
+            {
+                return it->second;
+            }
+            const auto id = static_cast<uint64_t>(strings_.size());
+            strings_.emplace_back(str);
+            string_ids_.emplace(std::string(str), id);
+            return id;
+        }
+
+        uint64_t function_id(const AllocFrame& frame)
+        {
+            auto key = std::make_pair(frame.function, frame.source);
+            auto it = function_ids_.find(key);
+            if (it != function_ids_.end())
+            {
+                return it->second;
+            }
+
+            const auto id = static_cast<uint64_t>(function_ids_.size() + 1);
+            function_ids_.emplace(std::move(key), id);
+
+            ProtoWriter fn;
+            fn.field_varint(1, id);
+            fn.field_varint(2, string_index(frame.function));
+            fn.field_varint(3, string_index(frame.function));
+            fn.field_varint(4, string_index(frame.source));
+            functions_.push_back(fn.str());
+            return id;
+        }
+
+        uint64_t location_id(const AllocFrame& frame)
+        {
+            const auto fn_id = function_id(frame);
+            auto key = std::make_pair(fn_id, frame.line);
+            auto it = location_ids_.find(key);
+            if (it != location_ids_.end())
+            {
+                return it->second;
+            }
+
+            const auto id = static_cast<uint64_t>(location_ids_.size() + 1);
+            location_ids_.emplace(key, id);
+
+            ProtoWriter line;
+            line.field_varint(1, fn_id);
+            line.field_varint(2, static_cast<uint64_t>(frame.line));
+
+            ProtoWriter loc;
+            loc.field_varint(1, id);
+            loc.field_bytes(4, line.str());
+            locations_.push_back(loc.str());
+            return id;
+        }
+
+        void add_sample(const AllocSite& site)
+        {
+            std::vector<uint64_t> location_ids;
+            location_ids.reserve(site.frames.size());
+            // pprof expects the leaf frame first, which matches the frame order of the site.
+            for (const auto& frame : site.frames)
+            {
+                location_ids.push_back(location_id(frame));
+            }
+
+            ProtoWriter label;
+            label.field_varint(1, string_index("object"));
+            label.field_varint(2, string_index(site.object_type));
+
+            ProtoWriter sample;
+            sample.field_packed(1, location_ids);
+            sample.field_packed(2, { static_cast<uint64_t>(site.samples), static_cast<uint64_t>(site.bytes) });
+            sample.field_bytes(3, label.str());
+            samples_.push_back(sample.str());
+        }
+
+        std::string finish(size_t sample_interval)
+        {
+            const auto value_type = [&](std::string_view type, std::string_view unit) {
+                ProtoWriter vt;
+                vt.field_varint(1, string_index(type));
+                vt.field_varint(2, string_index(unit));
+                return vt.str();
+            };
+
+            // Intern every string before the table is written.
+            const auto samples_type = value_type("alloc_samples", "count");
+            const auto space_type = value_type("alloc_space", "bytes");
+            const auto period_type = value_type("space", "bytes");
+
+            ProtoWriter profile;
+            profile.field_bytes(1, samples_type);
+            profile.field_bytes(1, space_type);
+            for (const auto& sample : samples_)
+            {
+                profile.field_bytes(2, sample);
+            }
+            for (const auto& location : locations_)
+            {
+                profile.field_bytes(4, location);
+            }
+            for (const auto& function : functions_)
+            {
+                profile.field_bytes(5, function);
+            }
+            for (const auto& str : strings_)
+            {
+                profile.field_bytes(6, str);
+            }
+            profile.field_bytes(11, period_type);
+            profile.field_varint(12, sample_interval);
+            return profile.str();
+        }
+
+    private:
+        std::vector<std::string> strings_;
+        std::map<std::string, uint64_t> string_ids_;
+        std::map<std::pair<std::string, std::string>, uint64_t> function_ids_;
+        std::map<std::pair<uint64_t, int>, uint64_t> location_ids_;
+        std::vector<std::string> functions_;
+        std::vector<std::string> locations_;
+        std::vector<std::string> samples_;
+    };
+
+    std::string profiler_format_pprof(const ProfilerState& prof)
+    {
+        // Emit sites in key order so the output is deterministic.
+        std::vector<const std::pair<const std::string, AllocSite>*> sorted;
+        sorted.reserve(prof.sites.size());
+        for (const auto& entry : prof.sites)
+        {
+            sorted.push_back(&entry);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+
+        PprofBuilder builder;
+        for (const auto* entry : sorted)
+        {
+            builder.add_sample(entry->second);
+        }
+        return builder.finish(prof.sample_interval);
+    }
+
+} // namespace behl
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "platform.hpp"
+#include "state.hpp"
+
+#include <behl/profiler.hpp>
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+namespace behl
+{
+    // Records a sample for the allocation that crossed the sampling boundary.
+    BEHL_NOINLINE void profiler_take_sample(State* S);
+
+    // Called for every allocated byte range, cheap when the profiler is disabled.
+    BEHL_FORCEINLINE
+    void profiler_track_allocation(State* S, size_t size)
+    {
+        auto& prof = S->profiler;
+        if (!prof.enabled) [[likely]]
+        {
+            return;
+        }
+
+        prof.bytes_until_sample -= static_cast<int64_t>(size);
+        if (prof.bytes_until_sample <= 0)
+        {
+            profiler_take_sample(S);
+        }
+    }
+
+    // Attributes allocations made during its lifetime to the given object type.
+    struct AllocTypeScope
+    {
+        AllocTypeScope(State* S, std::string_view type)
+            : S_(S)
+            , prev_(S->profiler.alloc_type)
+        {
+            S_->profiler.alloc_type = type;
+        }
+
+        ~AllocTypeScope()
+        {
+            S_->profiler.alloc_type = prev_;
+        }
+
+        AllocTypeScope(const AllocTypeScope&) = delete;
+        AllocTypeScope& operator=(const AllocTypeScope&) = delete;
+
+    private:
+        State* S_;
+        std::string_view prev_;
+    };
+
+    std::string profiler_format_folded(const ProfilerState& prof);
+
+    std::string profiler_format_pprof(const ProfilerState& prof);
+
+} // namespace behl
@@ -10,10 +10,15 @@
 #include "gc/gc_types.hpp"
 #include "gc/gco_string.hpp"
 #include "state_debug.hpp"
+#include "state_profiler.hpp"
 #include "vm/frame.hpp"
 #include "vm/upvalue.hpp"
 #include "vm/value.hpp"
 
+#include <behl/types.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace behl
@@ -38,6 +43,10 @@ namespace behl
         // Module system
         HashMap<GCString*, Value, GCStringHash, GCStringEq> module_cache; // Cached module exports
         Vector<GCString*> module_paths;                                   // Module search paths
+        std::unordered_map<std::string, std::string> module_path_memo;    // (importer, name) -> resolved path
+        std::string module_cache_dir;                                     // Compiled module cache, empty when disabled
+        // Modules compiled by preload_modules, instantiated and removed by the first import() of each
+        std::unordered_map<std::string, std::shared_ptr<const CompiledScript>> preloaded_modules;
 
         // Metatable registry for C modules
         HashMap<GCString*, Value, GCStringHash, GCStringEq> metatable_registry; // Named metatables
@@ -45,7 +54,15 @@ namespace behl
         // Debug state
         DebugState debug{};
 
+        // Allocation profiler state
+        ProfilerState profiler{};
+
         PrintHandler print_handler{};
+
+        bool lazy_compilation = false; // Function bodies are compiled on their first call when set
+        bool column_info = true;      // Line tables of loaded functions keep the column of every instruction
+
+        std::vector<OptimizationPassStats> optimization_report; // Optimizer statistics of the last loaded source
     };
 
     ptrdiff_t resolve_index(const State* S, int idx);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace behl
+{
+    // A single script frame of a sampled call stack.
+    struct AllocFrame
+    {
+        std::string function;
+        std::string source;
+        int line = 0;
+    };
+
+    // Aggregated samples of one unique (call stack, object type) pair.
+    struct AllocSite
+    {
+        std::vector<AllocFrame> frames; // Innermost frame first
+        std::string_view object_type;
+        size_t samples = 0;
+        size_t bytes = 0; // Estimated bytes, samples * sample interval
+    };
+
+    struct ProfilerState
+    {
+        bool enabled = false;
+        bool sampling = false; // Guards against re-entrant samples
+
+        size_t sample_interval = 0;
+        int64_t bytes_until_sample = 0;
+
+        // Type attributed to the allocation in flight, set by the GC allocation functions.
+        std::string_view alloc_type = "buffer";
+
+        // Keyed by the folded stack string of the site.
+        std::unordered_map<std::string, AllocSite> sites;
+        size_t total_samples = 0;
+    };
+
+} // namespace behl
@@ -78,6 +78,12 @@ namespace behl
             case OpCode::kOpNewTable:
                 opcode_str = behl::format("{:<9} R{} {} {}", meta.name, instr.a(), instr.b(), instr.c());
                 break;
+            case OpCode::kOpNewTableK:
+                opcode_str = behl::format("{:<9} R{} KT{}", meta.name, instr.a(), instr.const_or_proto_index());
+                break;
+            case OpCode::kOpSwitch:
+                opcode_str = behl::format("{:<9} R{} SW{}", meta.name, instr.a(), instr.const_or_proto_index());
+                break;
             case OpCode::kOpSelf:
                 opcode_str = behl::format("{:<9} R{} R{} R{}", meta.name, instr.a(), instr.b(), instr.c());
                 break;
@@ -121,36 +127,23 @@ namespace behl
                 opcode_str = behl::format("{:<9} U{}", meta.name, instr.a());
                 break;
             case OpCode::kOpAdd:
-                opcode_str = behl::format("{:<9} R{} R{} R{}", meta.name, instr.a(), instr.b(), instr.c());
-                break;
             case OpCode::kOpSub:
-                opcode_str = behl::format("{:<9} R{} R{} R{}", meta.name, instr.a(), instr.b(), instr.c());
-                break;
             case OpCode::kOpMul:
-                opcode_str = behl::format("{:<9} R{} R{} R{}", meta.name, instr.a(), instr.b(), instr.c());
-                break;
             case OpCode::kOpDiv:
-                opcode_str = behl::format("{:<9} R{} R{} R{}", meta.name, instr.a(), instr.b(), instr.c());
-                break;
             case OpCode::kOpMod:
-                opcode_str = behl::format("{:<9} R{} R{} R{}", meta.name, instr.a(), instr.b(), instr.c());
-                break;
             case OpCode::kOpPow:
-                opcode_str = behl::format("{:<9} R{} R{} R{}", meta.name, instr.a(), instr.b(), instr.c());
-                break;
             case OpCode::kOpBand:
-                opcode_str = behl::format("{:<9} R{} R{} R{}", meta.name, instr.a(), instr.b(), instr.c());
-                break;
             case OpCode::kOpBor:
-                opcode_str = behl::format("{:<9} R{} R{} R{}", meta.name, instr.a(), instr.b(), instr.c());
-                break;
             case OpCode::kOpBxor:
-                opcode_str = behl::format("{:<9} R{} R{} R{}", meta.name, instr.a(), instr.b(), instr.c());
-                break;
             case OpCode::kOpShl:
-                opcode_str = behl::format("{:<9} R{} R{} R{}", meta.name, instr.a(), instr.b(), instr.c());
-                break;
             case OpCode::kOpShr:
+            case OpCode::kOpAddII:
+            case OpCode::kOpSubII:
+            case OpCode::kOpMulII:
+            case OpCode::kOpAddFF:
+            case OpCode::kOpSubFF:
+            case OpCode::kOpMulFF:
+            case OpCode::kOpDivFF:
                 opcode_str = behl::format("{:<9} R{} R{} R{}", meta.name, instr.a(), instr.b(), instr.c());
                 break;
             case OpCode::kOpUnm:
@@ -172,21 +165,15 @@ namespace behl
                 opcode_str = behl::format("{:<9} {}", meta.name, instr.jump_offset());
                 break;
             case OpCode::kOpEq:
-                opcode_str = behl::format("{:<9} R{} R{}", meta.name, instr.b(), instr.c());
-                break;
             case OpCode::kOpNe:
-                opcode_str = behl::format("{:<9} R{} R{}", meta.name, instr.b(), instr.c());
-                break;
             case OpCode::kOpLt:
-                opcode_str = behl::format("{:<9} R{} R{}", meta.name, instr.b(), instr.c());
-                break;
             case OpCode::kOpGe:
-                opcode_str = behl::format("{:<9} R{} R{}", meta.name, instr.b(), instr.c());
-                break;
             case OpCode::kOpLe:
-                opcode_str = behl::format("{:<9} R{} R{}", meta.name, instr.b(), instr.c());
-                break;
             case OpCode::kOpGt:
+            case OpCode::kOpLTII:
+            case OpCode::kOpLEII:
+            case OpCode::kOpLTFF:
+            case OpCode::kOpLEFF:
                 opcode_str = behl::format("{:<9} R{} R{}", meta.name, instr.b(), instr.c());
                 break;
             case OpCode::kOpLTI:
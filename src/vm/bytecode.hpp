@@ -14,6 +14,65 @@ namespace behl
     using ConstIndex = uint32_t;
     using ProtoIndex = uint32_t;
 
+    // Entry of a constant table built by kOpNewTableK. The kind is kept in the low bits, the index into the constant
+    // pool of that kind above them. Nil and booleans have no pool.
+    enum class TableConstantKind : uint32_t
+    {
+        kNil,
+        kFalse,
+        kTrue,
+        kInteger,
+        kFP,
+        kString,
+    };
+
+    static constexpr uint32_t kTableConstantKindBits = 3;
+    static constexpr ConstIndex kMaxTableConstantIndex = (1u << (32 - kTableConstantKindBits)) - 1;
+
+    constexpr uint32_t make_table_constant_entry(TableConstantKind kind, ConstIndex index = 0) noexcept
+    {
+        return static_cast<uint32_t>(kind) | (index << kTableConstantKindBits);
+    }
+
+    constexpr TableConstantKind table_constant_kind(uint32_t entry) noexcept
+    {
+        return static_cast<TableConstantKind>(entry & ((1u << kTableConstantKindBits) - 1));
+    }
+
+    constexpr ConstIndex table_constant_index(uint32_t entry) noexcept
+    {
+        return entry >> kTableConstantKindBits;
+    }
+
+    // Jump table of a kOpSwitch, the instruction is followed by one JMP per slot and slot 0 is taken when no case
+    // matches. Every table starts with its kind and its number of slots. Dense tables map the integers from the
+    // constant KI(index) on to slots 1 and up, hashed tables hold a power of two capacity followed by a string
+    // constant index + 1 (0 for an empty entry) and a slot per entry.
+    enum class SwitchKind : uint32_t
+    {
+        kDense,
+        kHash,
+    };
+
+    static constexpr uint32_t kSwitchHeaderSize = 3;
+    static constexpr size_t kMaxSwitchTables = size_t{ 1 } << 17;
+
+    // Integer cases stay within the range floats represent exactly, an integral float then selects the same case EQ
+    // would.
+    static constexpr int64_t kMaxSwitchValue = int64_t{ 1 } << 53;
+
+    // FNV-1a over 32 bits, the same on every platform so hashed switch tables can be stored in bytecode files.
+    constexpr uint32_t switch_hash(std::string_view str) noexcept
+    {
+        uint32_t h = 2166136261u;
+        for (const char c : str)
+        {
+            h ^= static_cast<unsigned char>(c);
+            h *= 16777619u;
+        }
+        return h;
+    }
+
     enum class OpCode : uint8_t
     {
         kOpCall,
@@ -28,6 +87,7 @@ namespace behl
         kOpDecLocal,
         kOpDecUpvalue,
         kOpDiv,
+        kOpDivFF,
         kOpForLoop,
         kOpForPrep,
         kOpIncGlobal,
@@ -38,10 +98,14 @@ namespace behl
         kOpAddKF,
         kOpAddKI,
         kOpAddLocal,
+        kOpAddFF,
+        kOpAddII,
         kOpSub,
         kOpSubImm,
         kOpSubKF,
         kOpSubKI,
+        kOpSubFF,
+        kOpSubII,
         kOpEqImm,
         kOpGEF,
         kOpGEI,
@@ -55,9 +119,13 @@ namespace behl
         kOpLEF,
         kOpLEI,
         kOpLEImm,
+        kOpLEFF,
+        kOpLEII,
         kOpLTF,
         kOpLTI,
         kOpLTImm,
+        kOpLTFF,
+        kOpLTII,
         kOpLe,
         kOpLt,
         kOpNeImm,
@@ -71,8 +139,11 @@ namespace behl
         kOpMod,
         kOpMove,
         kOpMul,
+        kOpMulFF,
+        kOpMulII,
         kOpNe,
         kOpNewTable,
+        kOpNewTableK,
         kOpPow,
         kOpSelf,
         kOpGetField,
@@ -88,6 +159,7 @@ namespace behl
         kOpSetUpval,
         kOpShl,
         kOpShr,
+        kOpSwitch,
         kOpTailCall,
         kOpTest,
         kOpTestSet,
@@ -342,6 +414,20 @@ namespace behl
         return i;
     }
 
+    constexpr Instruction make_op_newtablek(Reg a, ConstIndex k) noexcept
+    {
+        Instruction i{};
+        i.raw = (static_cast<uint32_t>(OpCode::kOpNewTableK) << 25) | static_cast<uint32_t>(a) | (k << 8);
+        return i;
+    }
+
+    constexpr Instruction make_op_switch(Reg a, ConstIndex t) noexcept
+    {
+        Instruction i{};
+        i.raw = (static_cast<uint32_t>(OpCode::kOpSwitch) << 25) | static_cast<uint32_t>(a) | (t << 8);
+        return i;
+    }
+
     constexpr Instruction make_op_setlist(Reg a, uint8_t num_fields, uint8_t extra) noexcept
     {
         Instruction i{};
@@ -687,6 +773,95 @@ namespace behl
         return i;
     }
 
+    // Arithmetic and comparisons on operands proven to be two integers or two floats, nothing is checked at runtime
+    constexpr Instruction make_op_addii(Reg a, Reg b, Reg c) noexcept
+    {
+        Instruction i{};
+        i.raw = (static_cast<uint32_t>(OpCode::kOpAddII) << 25) | static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8)
+            | (static_cast<uint32_t>(c) << 16);
+        return i;
+    }
+
+    constexpr Instruction make_op_subii(Reg a, Reg b, Reg c) noexcept
+    {
+        Instruction i{};
+        i.raw = (static_cast<uint32_t>(OpCode::kOpSubII) << 25) | static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8)
+            | (static_cast<uint32_t>(c) << 16);
+        return i;
+    }
+
+    constexpr Instruction make_op_mulii(Reg a, Reg b, Reg c) noexcept
+    {
+        Instruction i{};
+        i.raw = (static_cast<uint32_t>(OpCode::kOpMulII) << 25) | static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8)
+            | (static_cast<uint32_t>(c) << 16);
+        return i;
+    }
+
+    constexpr Instruction make_op_addff(Reg a, Reg b, Reg c) noexcept
+    {
+        Instruction i{};
+        i.raw = (static_cast<uint32_t>(OpCode::kOpAddFF) << 25) | static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8)
+            | (static_cast<uint32_t>(c) << 16);
+        return i;
+    }
+
+    constexpr Instruction make_op_subff(Reg a, Reg b, Reg c) noexcept
+    {
+        Instruction i{};
+        i.raw = (static_cast<uint32_t>(OpCode::kOpSubFF) << 25) | static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8)
+            | (static_cast<uint32_t>(c) << 16);
+        return i;
+    }
+
+    constexpr Instruction make_op_mulff(Reg a, Reg b, Reg c) noexcept
+    {
+        Instruction i{};
+        i.raw = (static_cast<uint32_t>(OpCode::kOpMulFF) << 25) | static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8)
+            | (static_cast<uint32_t>(c) << 16);
+        return i;
+    }
+
+    constexpr Instruction make_op_divff(Reg a, Reg b, Reg c) noexcept
+    {
+        Instruction i{};
+        i.raw = (static_cast<uint32_t>(OpCode::kOpDivFF) << 25) | static_cast<uint32_t>(a) | (static_cast<uint32_t>(b) << 8)
+            | (static_cast<uint32_t>(c) << 16);
+        return i;
+    }
+
+    constexpr Instruction make_op_ltii(Reg b, Reg c) noexcept
+    {
+        Instruction i{};
+        i.raw = (static_cast<uint32_t>(OpCode::kOpLTII) << 25) | (static_cast<uint32_t>(b) << 8)
+            | (static_cast<uint32_t>(c) << 16);
+        return i;
+    }
+
+    constexpr Instruction make_op_leii(Reg b, Reg c) noexcept
+    {
+        Instruction i{};
+        i.raw = (static_cast<uint32_t>(OpCode::kOpLEII) << 25) | (static_cast<uint32_t>(b) << 8)
+            | (static_cast<uint32_t>(c) << 16);
+        return i;
+    }
+
+    constexpr Instruction make_op_ltff(Reg b, Reg c) noexcept
+    {
+        Instruction i{};
+        i.raw = (static_cast<uint32_t>(OpCode::kOpLTFF) << 25) | (static_cast<uint32_t>(b) << 8)
+            | (static_cast<uint32_t>(c) << 16);
+        return i;
+    }
+
+    constexpr Instruction make_op_leff(Reg b, Reg c) noexcept
+    {
+        Instruction i{};
+        i.raw = (static_cast<uint32_t>(OpCode::kOpLEFF) << 25) | (static_cast<uint32_t>(b) << 8)
+            | (static_cast<uint32_t>(c) << 16);
+        return i;
+    }
+
     constexpr Instruction make_op_addimm(Reg a, Reg b, int32_t imm) noexcept
     {
         Instruction i{};
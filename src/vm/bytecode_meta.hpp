@@ -55,6 +55,8 @@ namespace behl
         { OpCode::kOpDecUpvalue, OpMode::kNone, OpMode::kNone, OpMode::kNone, true, false, false, "DECUPVALUE" },
         // kOpDiv - R(A) = R(B) / R(C)
         { OpCode::kOpDiv, OpMode::kWrite, OpMode::kRead, OpMode::kRead, false, false, false, "DIV" },
+        // kOpDivFF - R(A) = R(B) / R(C), both floats
+        { OpCode::kOpDivFF, OpMode::kWrite, OpMode::kRead, OpMode::kRead, false, false, false, "DIVFF" },
         // kOpForLoop - Numeric for loop
         { OpCode::kOpForLoop, OpMode::kRW, OpMode::kNone, OpMode::kNone, false, true, true, "FORLOOP" },
         // kOpForPrep - Prepare numeric for loop
@@ -75,6 +77,10 @@ namespace behl
         { OpCode::kOpAddKI, OpMode::kWrite, OpMode::kRead, OpMode::kNone, false, false, false, "ADDKI" },
         // kOpAddLocal - R(A) += R(B)
         { OpCode::kOpAddLocal, OpMode::kRW, OpMode::kRead, OpMode::kNone, false, false, false, "ADDLOCAL" },
+        // kOpAddFF - R(A) = R(B) + R(C), both floats
+        { OpCode::kOpAddFF, OpMode::kWrite, OpMode::kRead, OpMode::kRead, false, false, false, "ADDFF" },
+        // kOpAddII - R(A) = R(B) + R(C), both integers
+        { OpCode::kOpAddII, OpMode::kWrite, OpMode::kRead, OpMode::kRead, false, false, false, "ADDII" },
         // kOpSub - R(A) = R(B) - R(C)
         { OpCode::kOpSub, OpMode::kWrite, OpMode::kRead, OpMode::kRead, false, false, false, "SUB" },
         // kOpSubImm - R(A) = R(B) - imm
@@ -83,6 +89,10 @@ namespace behl
         { OpCode::kOpSubKF, OpMode::kWrite, OpMode::kRead, OpMode::kNone, false, false, false, "SUBKF" },
         // kOpSubKI - R(A) = R(B) - KI(C)
         { OpCode::kOpSubKI, OpMode::kWrite, OpMode::kRead, OpMode::kNone, false, false, false, "SUBKI" },
+        // kOpSubFF - R(A) = R(B) - R(C), both floats
+        { OpCode::kOpSubFF, OpMode::kWrite, OpMode::kRead, OpMode::kRead, false, false, false, "SUBFF" },
+        // kOpSubII - R(A) = R(B) - R(C), both integers
+        { OpCode::kOpSubII, OpMode::kWrite, OpMode::kRead, OpMode::kRead, false, false, false, "SUBII" },
         // kOpEqImm - Compare R(B) == imm (test instruction)
         { OpCode::kOpEqImm, OpMode::kNone, OpMode::kRead, OpMode::kNone, false, false, false, "EQIMM" },
         // kOpGEF - Compare R(B) >= KF(C) (test instruction)
@@ -109,12 +119,20 @@ namespace behl
         { OpCode::kOpLEI, OpMode::kNone, OpMode::kRead, OpMode::kNone, false, false, false, "LEI" },
         // kOpLEImm - Compare R(B) <= imm (test instruction)
         { OpCode::kOpLEImm, OpMode::kNone, OpMode::kRead, OpMode::kNone, false, false, false, "LEIMM" },
+        // kOpLEFF - Compare R(B) <= R(C), both floats (test instruction)
+        { OpCode::kOpLEFF, OpMode::kNone, OpMode::kRead, OpMode::kRead, false, false, false, "LEFF" },
+        // kOpLEII - Compare R(B) <= R(C), both integers (test instruction)
+        { OpCode::kOpLEII, OpMode::kNone, OpMode::kRead, OpMode::kRead, false, false, false, "LEII" },
         // kOpLTF - Compare R(B) < KF(C) (test instruction)
         { OpCode::kOpLTF, OpMode::kNone, OpMode::kRead, OpMode::kNone, false, false, false, "LTF" },
         // kOpLTI - Compare R(B) < KI(C) (test instruction)
         { OpCode::kOpLTI, OpMode::kNone, OpMode::kRead, OpMode::kNone, false, false, false, "LTI" },
         // kOpLTImm - Compare R(B) < imm (test instruction)
         { OpCode::kOpLTImm, OpMode::kNone, OpMode::kRead, OpMode::kNone, false, false, false, "LTIMM" },
+        // kOpLTFF - Compare R(B) < R(C), both floats (test instruction)
+        { OpCode::kOpLTFF, OpMode::kNone, OpMode::kRead, OpMode::kRead, false, false, false, "LTFF" },
+        // kOpLTII - Compare R(B) < R(C), both integers (test instruction)
+        { OpCode::kOpLTII, OpMode::kNone, OpMode::kRead, OpMode::kRead, false, false, false, "LTII" },
         // kOpLe - Compare R(B) <= R(C) (test instruction)
         { OpCode::kOpLe, OpMode::kNone, OpMode::kRead, OpMode::kRead, false, false, false, "LE" },
         // kOpLt - Compare R(B) < R(C) (test instruction)
@@ -141,10 +159,16 @@ namespace behl
         { OpCode::kOpMove, OpMode::kWrite, OpMode::kRead, OpMode::kNone, false, false, false, "MOVE" },
         // kOpMul - R(A) = R(B) * R(C)
         { OpCode::kOpMul, OpMode::kWrite, OpMode::kRead, OpMode::kRead, false, false, false, "MUL" },
+        // kOpMulFF - R(A) = R(B) * R(C), both floats
+        { OpCode::kOpMulFF, OpMode::kWrite, OpMode::kRead, OpMode::kRead, false, false, false, "MULFF" },
+        // kOpMulII - R(A) = R(B) * R(C), both integers
+        { OpCode::kOpMulII, OpMode::kWrite, OpMode::kRead, OpMode::kRead, false, false, false, "MULII" },
         // kOpNe - Compare R(B) != R(C) (test instruction)
         { OpCode::kOpNe, OpMode::kNone, OpMode::kRead, OpMode::kRead, false, false, false, "NE" },
         // kOpNewTable - R(A) = new table
         { OpCode::kOpNewTable, OpMode::kWrite, OpMode::kNone, OpMode::kNone, false, false, false, "NEWTABLE" },
+        // kOpNewTableK - R(A) = new table filled from constant table KT(Bx)
+        { OpCode::kOpNewTableK, OpMode::kWrite, OpMode::kNone, OpMode::kNone, false, false, false, "NEWTABLEK" },
         // kOpPow - R(A) = R(B) ** R(C)
         { OpCode::kOpPow, OpMode::kWrite, OpMode::kRead, OpMode::kRead, false, false, false, "POW" },
         // kOpSelf - R(A) = R(B), R(A+1) = R(B)[R(C)]
@@ -175,6 +199,8 @@ namespace behl
         { OpCode::kOpShl, OpMode::kWrite, OpMode::kRead, OpMode::kRead, false, false, false, "SHL" },
         // kOpShr - R(A) = R(B) >> R(C)
         { OpCode::kOpShr, OpMode::kWrite, OpMode::kRead, OpMode::kRead, false, false, false, "SHR" },
+        // kOpSwitch - Continue at the JMP slot that jump table SW(Bx) selects for R(A)
+        { OpCode::kOpSwitch, OpMode::kRead, OpMode::kNone, OpMode::kNone, false, true, true, "SWITCH" },
         // kOpTailCall - Tail call with R(A) = function, R(A+1..A+nargs) = args
         { OpCode::kOpTailCall, OpMode::kRead, OpMode::kRead, OpMode::kNone, true, true, false, "TAILCALL" },
         // kOpTest - Test R(A) for truthiness
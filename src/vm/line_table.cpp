@@ -0,0 +1,147 @@
+#include "line_table.hpp"
+
+#include <cassert>
+#include <vector>
+
+namespace behl
+{
+    namespace
+    {
+        void put_delta(State* S, Vector<uint8_t>& out, int previous, int current)
+        {
+            // Wrapping arithmetic keeps the delta exact for any pair of ints.
+            const auto delta = static_cast<uint32_t>(current) - static_cast<uint32_t>(previous);
+            auto zigzag = (delta << 1) ^ (0u - (delta >> 31));
+            while (zigzag >= 0x80)
+            {
+                out.push_back(S, static_cast<uint8_t>(zigzag | 0x80));
+                zigzag >>= 7;
+            }
+            out.push_back(S, static_cast<uint8_t>(zigzag));
+        }
+
+        // Applies the next delta to value, fails on a truncated or overlong varint.
+        bool read_delta(const Vector<uint8_t>& in, size_t& pos, int& value) noexcept
+        {
+            uint32_t zigzag = 0;
+            for (uint32_t shift = 0; shift < 35; shift += 7)
+            {
+                if (pos >= in.size())
+                {
+                    return false;
+                }
+                const uint8_t byte = in[pos++];
+                zigzag |= static_cast<uint32_t>(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0)
+                {
+                    const auto delta = (zigzag >> 1) ^ (0u - (zigzag & 1));
+                    value = static_cast<int>(static_cast<uint32_t>(value) + delta);
+                    return true;
+                }
+            }
+            return false;
+        }
+    } // namespace
+
+    LineEntry LineTable::lookup(size_t pc) const noexcept
+    {
+        assert(pc < count && "LineTable::lookup: pc out of range");
+
+        const auto& checkpoint = checkpoints[pc / kLineCheckpointInterval];
+        LineEntry entry{ checkpoint.line, checkpoint.column };
+        size_t pos = checkpoint.offset;
+        for (size_t i = pc - pc % kLineCheckpointInterval; i <= pc; ++i)
+        {
+            if (!read_delta(deltas, pos, entry.line) || (has_columns && !read_delta(deltas, pos, entry.column)))
+            {
+                break;
+            }
+        }
+        return entry;
+    }
+
+    void LineTable::build(State* S, std::span<const int> lines, std::span<const int> columns)
+    {
+        assert((columns.empty() || columns.size() == lines.size()) && "LineTable::build: column count mismatch");
+
+        destroy(S);
+        count = static_cast<uint32_t>(lines.size());
+        has_columns = !columns.empty();
+        deltas.reserve(S, lines.size() * (has_columns ? 2 : 1));
+        checkpoints.reserve(S, (lines.size() + kLineCheckpointInterval - 1) / kLineCheckpointInterval);
+
+        int line = 0;
+        int column = 0;
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            if (i % kLineCheckpointInterval == 0)
+            {
+                checkpoints.push_back(S, LineCheckpoint{ static_cast<uint32_t>(deltas.size()), line, column });
+            }
+            put_delta(S, deltas, line, lines[i]);
+            line = lines[i];
+            if (has_columns)
+            {
+                put_delta(S, deltas, column, columns[i]);
+                column = columns[i];
+            }
+        }
+    }
+
+    void LineTable::strip_columns(State* S)
+    {
+        if (!has_columns)
+        {
+            return;
+        }
+
+        std::vector<int> lines(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            lines[i] = lookup(i).line;
+        }
+        build(S, lines, {});
+    }
+
+    bool LineTable::is_valid(size_t instruction_count) const noexcept
+    {
+        if (count == 0)
+        {
+            return deltas.empty() && checkpoints.empty();
+        }
+        if (count != instruction_count
+            || checkpoints.size() != (size_t{ count } + kLineCheckpointInterval - 1) / kLineCheckpointInterval)
+        {
+            return false;
+        }
+
+        int line = 0;
+        int column = 0;
+        size_t pos = 0;
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (i % kLineCheckpointInterval == 0)
+            {
+                const auto& checkpoint = checkpoints[i / kLineCheckpointInterval];
+                if (checkpoint.offset != pos || checkpoint.line != line || checkpoint.column != column)
+                {
+                    return false;
+                }
+            }
+            if (!read_delta(deltas, pos, line) || (has_columns && !read_delta(deltas, pos, column)))
+            {
+                return false;
+            }
+        }
+        return pos == deltas.size() && (has_columns || column == 0);
+    }
+
+    void LineTable::destroy(State* S)
+    {
+        deltas.destroy(S);
+        checkpoints.destroy(S);
+        count = 0;
+        has_columns = false;
+    }
+
+} // namespace behl
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "common/vector.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace behl
+{
+    struct State;
+
+    // Instructions covered by one checkpoint, a lookup decodes at most this many entries.
+    static constexpr uint32_t kLineCheckpointInterval = 32;
+
+    // Where the entry of every kLineCheckpointInterval-th instruction starts in the deltas, together with the position
+    // of the instruction before it that its deltas apply to.
+    struct LineCheckpoint
+    {
+        uint32_t offset;
+        int32_t line;
+        int32_t column;
+    };
+
+    struct LineEntry
+    {
+        int line = 0;
+        int column = 0;
+    };
+
+    // Source positions of the instructions of a function. Every instruction stores how its line and, unless the
+    // columns were stripped, its column differ from the previous instruction as zigzag LEB128 varints, which takes
+    // a byte for almost every entry instead of two ints.
+    struct LineTable
+    {
+        Vector<uint8_t> deltas;
+        Vector<LineCheckpoint> checkpoints;
+        uint32_t count = 0; // Instructions covered, 0 when the function carries no positions
+        bool has_columns = false;
+
+        bool contains(size_t pc) const noexcept
+        {
+            return pc < count;
+        }
+
+        // Position of the instruction at pc, which must be below count. Columns are 0 once stripped.
+        LineEntry lookup(size_t pc) const noexcept;
+
+        // Replaces the table with the positions of lines.size() instructions, columns is either empty or as long as lines.
+        void build(State* S, std::span<const int> lines, std::span<const int> columns);
+
+        // Re-encodes the table without columns.
+        void strip_columns(State* S);
+
+        // True when the table decodes to exactly instruction_count entries and every checkpoint matches the entries,
+        // used to validate tables read from bytecode files.
+        bool is_valid(size_t instruction_count) const noexcept;
+
+        void destroy(State* S);
+    };
+
+} // namespace behl
@@ -1,9 +1,11 @@
 #include "vm.hpp"
 
+#include "backend/compiler.hpp"
 #include "bytecode.hpp"
 #include "config_internal.hpp"
 #include "gc/gc.hpp"
 #include "gc/gc_object.hpp"
+#include "gc/gc_region.hpp"
 #include "gc/gco_closure.hpp"
 #include "gc/gco_proto.hpp"
 #include "gc/gco_string.hpp"
@@ -27,6 +29,7 @@
 
 #include <behl/exceptions.hpp>
 #include <cassert>
+#include <functional>
 
 namespace behl
 {
@@ -196,13 +199,23 @@ namespace behl
         GCProto* nested_proto = frame.proto->protos[proto_idx];
         assert(nested_proto != nullptr && "handler_closure: nested proto is null");
 
+        // A function without upvalues behaves the same for every instance, so its proto hands out one closure.
+        if (nested_proto->upvalue_names.empty())
+        {
+            if (nested_proto->shared_closure == nullptr)
+            {
+                nested_proto->shared_closure = gc_new_closure(S, nested_proto);
+                gc_region_barrier(S, nested_proto, Value(nested_proto->shared_closure));
+            }
+            get_register(S, frame, a).emplace<GCClosure*>(nested_proto->shared_closure);
+            return;
+        }
+
         auto* obj = gc_new_closure(S, nested_proto);
         assert(obj != nullptr);
 
         get_register(S, frame, a).emplace<GCClosure*>(obj);
 
-        auto& upvalue_indices = obj->upvalue_indices;
-
         for (size_t i = 0; i < nested_proto->upvalue_names.size(); ++i)
         {
             const Instruction& cap = frame.proto->code[frame.pc++];
@@ -213,16 +226,14 @@ namespace behl
                     const auto stack_idx = frame.base + cap.b();
                     const auto uv_idx = find_or_create_upvalue(S, stack_idx);
 
-                    upvalue_indices.push_back(S, uv_idx);
+                    obj->push_upvalue_index(uv_idx);
                     return;
                 }
 
                 if (cap.op() == OpCode::kOpGetUpval)
                 {
-                    const auto& parent_upvalue_indices = S->stack[frame.base].get_closure()->upvalue_indices;
-                    assert(cap.b() < parent_upvalue_indices.size() && "handler_closure : upvalue index out of bounds");
-                    const auto uv_idx = parent_upvalue_indices[cap.b()];
-                    upvalue_indices.push_back(S, uv_idx);
+                    const auto* parent = S->stack[frame.base].get_closure();
+                    obj->push_upvalue_index(parent->upvalue_index(cap.b()));
                     return;
                 }
 
@@ -355,6 +366,10 @@ namespace behl
         auto* closure_data = func_value.get_closure();
         assert(closure_data != nullptr);
         assert(closure_data->proto != nullptr && "Closure proto should not be nullptr");
+        if (closure_data->proto->lazy) [[unlikely]]
+        {
+            compile_lazy(S, closure_data->proto);
+        }
         assert(!closure_data->proto->code.empty() && "Empty function proto (compiler bug)");
 
         const auto entry_call_depth = static_cast<uint32_t>(callstack.size());
@@ -462,6 +477,9 @@ namespace behl
                 case OpCode::kOpNewTable:
                     handler_newtable(S, *frame, instr.a(), instr.b(), instr.c());
                     break;
+                case OpCode::kOpNewTableK:
+                    handler_newtablek(S, *frame, instr.a(), instr.const_or_proto_index());
+                    break;
                 case OpCode::kOpSetList:
                     handler_setlist(S, *frame, instr.a(), instr.b(), instr.c());
                     break;
@@ -531,6 +549,35 @@ namespace behl
                     handler_tonumber(S, *frame, instr.a(), instr.b());
                     break;
 
+                case OpCode::kOpAddII:
+                    handler_numeric_typed<Integer, MetaMethodType::kAdd, false, NumericAddOp>(
+                        S, *frame, instr.a(), instr.b(), instr.c());
+                    break;
+                case OpCode::kOpSubII:
+                    handler_numeric_typed<Integer, MetaMethodType::kSub, false, NumericSubOp>(
+                        S, *frame, instr.a(), instr.b(), instr.c());
+                    break;
+                case OpCode::kOpMulII:
+                    handler_numeric_typed<Integer, MetaMethodType::kMul, false, NumericMulOp>(
+                        S, *frame, instr.a(), instr.b(), instr.c());
+                    break;
+                case OpCode::kOpAddFF:
+                    handler_numeric_typed<FP, MetaMethodType::kAdd, false, NumericAddOp>(
+                        S, *frame, instr.a(), instr.b(), instr.c());
+                    break;
+                case OpCode::kOpSubFF:
+                    handler_numeric_typed<FP, MetaMethodType::kSub, false, NumericSubOp>(
+                        S, *frame, instr.a(), instr.b(), instr.c());
+                    break;
+                case OpCode::kOpMulFF:
+                    handler_numeric_typed<FP, MetaMethodType::kMul, false, NumericMulOp>(
+                        S, *frame, instr.a(), instr.b(), instr.c());
+                    break;
+                case OpCode::kOpDivFF:
+                    handler_numeric_typed<FP, MetaMethodType::kDiv, true, NumericDivOp>(
+                        S, *frame, instr.a(), instr.b(), instr.c());
+                    break;
+
                 case OpCode::kOpAddImm:
                     handler_add_imm(S, *frame, instr.a(), instr.b(), instr.signed_immediate_9bit());
                     break;
@@ -631,6 +678,19 @@ namespace behl
                         S, *frame, instr.b(), instr.small_const_index());
                     break;
 
+                case OpCode::kOpLTII:
+                    handler_cmp_typed<Integer, MetaMethodType::kLt, std::less<>>(S, *frame, instr.b(), instr.c());
+                    break;
+                case OpCode::kOpLEII:
+                    handler_cmp_typed<Integer, MetaMethodType::kLe, std::less_equal<>>(S, *frame, instr.b(), instr.c());
+                    break;
+                case OpCode::kOpLTFF:
+                    handler_cmp_typed<FP, MetaMethodType::kLt, std::less<>>(S, *frame, instr.b(), instr.c());
+                    break;
+                case OpCode::kOpLEFF:
+                    handler_cmp_typed<FP, MetaMethodType::kLe, std::less_equal<>>(S, *frame, instr.b(), instr.c());
+                    break;
+
                 case OpCode::kOpLTImm:
                     handler_cmp<MetaMethodType::kLt, CmpLtOp, operand_reg, operand_imm>(
                         S, *frame, instr.a(), instr.signed_immediate());
@@ -666,6 +726,9 @@ namespace behl
                 case OpCode::kOpJmp:
                     handler_jmp(*frame, instr.jump_offset());
                     break;
+                case OpCode::kOpSwitch:
+                    handler_switch(S, *frame, instr.a(), instr.const_or_proto_index());
+                    break;
 
                 case OpCode::kOpForPrep:
                     handler_forprep(S, *frame, instr.a(), instr.signed_offset());
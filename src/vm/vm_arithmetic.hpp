@@ -425,6 +425,40 @@ namespace behl
         numeric_binop<MetaMethodType::kAdd, false>(S, a, lhs, rhs, frame, NumericAddOp{});
     }
 
+    // Handler for operands type inference proved to be two integers or two floats, see TypeInferencePass. Images
+    // loaded from outside the process carry no such proof, so other operands take the path of the generic opcode.
+    template<typename T, MetaMethodType MMIndex, bool DivByZeroCheck, typename NumericOp>
+    BEHL_FORCEINLINE void handler_numeric_typed(State* S, CallFrame& frame, Reg a, Reg b, Reg c)
+    {
+        const Value& lhs = get_register(S, frame, b);
+        const Value& rhs = get_register(S, frame, c);
+        if constexpr (std::is_same_v<T, Integer>)
+        {
+            if (lhs.is_integer() && rhs.is_integer()) [[likely]]
+            {
+                get_register(S, frame, a).emplace<Integer>(NumericOp{}(lhs.get_integer(), rhs.get_integer()));
+                return;
+            }
+        }
+        else
+        {
+            if (lhs.is_fp() && rhs.is_fp()) [[likely]]
+            {
+                get_register(S, frame, a).emplace<FP>(NumericOp{}(lhs.get_fp(), rhs.get_fp()));
+                return;
+            }
+        }
+
+        if constexpr (MMIndex == MetaMethodType::kAdd)
+        {
+            handler_add(S, frame, a, b, c);
+        }
+        else
+        {
+            numeric_binop<MMIndex, DivByZeroCheck>(S, a, lhs, rhs, frame, NumericOp{});
+        }
+    }
+
     BEHL_FORCEINLINE
     void handler_add_imm(State* S, CallFrame& frame, Reg a, Reg b, int32_t imm)
     {
@@ -529,9 +563,7 @@ namespace behl
     BEHL_FORCEINLINE
     void handler_inc_upvalue(State* S, CallFrame& frame, Reg a)
     {
-        const auto& upvalue_indices = S->stack[frame.base].get_closure()->upvalue_indices;
-        assert(a < upvalue_indices.size() && "handler_incupvalue: upvalue index out of bounds");
-        const auto upvalue_idx = upvalue_indices[a];
+        const auto upvalue_idx = S->stack[frame.base].get_closure()->upvalue_index(a);
         Value& upval = upvalue_ref(S, upvalue_idx);
 
         if (increment_value(S, upval))
@@ -585,9 +617,7 @@ namespace behl
     BEHL_FORCEINLINE
     void handler_dec_upvalue(State* S, CallFrame& frame, Reg a)
     {
-        const auto& upvalue_indices = S->stack[frame.base].get_closure()->upvalue_indices;
-        assert(a < upvalue_indices.size() && "handler_decupvalue: upvalue index out of bounds");
-        const auto upvalue_idx = upvalue_indices[a];
+        const auto upvalue_idx = S->stack[frame.base].get_closure()->upvalue_index(a);
         Value& upval = upvalue_ref(S, upvalue_idx);
 
         if (decrement_value(S, upval))
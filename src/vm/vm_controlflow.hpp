@@ -1,5 +1,6 @@
 #pragma once
 
+#include "backend/compiler.hpp"
 #include "bytecode.hpp"
 #include "common/format.hpp"
 #include "frame.hpp"
@@ -310,6 +311,10 @@ namespace behl
                 const uint32_t actual_num_args = count_actual_args(caller_frame, call_pos, num_args);
 
                 const auto* closure_data = func.get_closure();
+                if (closure_data->proto->lazy) [[unlikely]]
+                {
+                    compile_lazy(S, closure_data->proto);
+                }
                 const auto* proto = closure_data->proto;
                 setup_call_frame(S, proto, new_base, actual_num_args, call_pos, num_results);
                 prepare_call(S, proto->max_stack_size, new_base, actual_num_args);
@@ -388,6 +393,72 @@ namespace behl
         frame.pc += static_cast<uint32_t>(offset);
     }
 
+    // Takes the JMP slot that the jump table of the instruction selects for R(A), slot 0 when no case matches. Cases
+    // are integer or string constants, a value selects a case when EQ would find it equal to its constant.
+    BEHL_FORCEINLINE
+    void handler_switch(State* S, CallFrame& frame, Reg a, ConstIndex t)
+    {
+        const GCProto* proto = frame.proto;
+        assert(t < proto->switch_tables.size() && "handler_switch: switch table index out of bounds");
+        const uint32_t* data = proto->switch_data.data() + proto->switch_tables[t];
+        const uint32_t slot_count = data[1];
+        const Value& value = get_register(S, frame, a);
+
+        uint32_t slot = 0;
+        if (static_cast<SwitchKind>(data[0]) == SwitchKind::kDense)
+        {
+            Integer key = 0;
+            bool has_key = false;
+            if (value.is_integer())
+            {
+                key = value.get_integer();
+                has_key = true;
+            }
+            else if (value.is_fp())
+            {
+                const FP fp = value.get_fp();
+                if (fp >= -static_cast<FP>(kMaxSwitchValue) && fp <= static_cast<FP>(kMaxSwitchValue)
+                    && static_cast<FP>(static_cast<Integer>(fp)) == fp)
+                {
+                    key = static_cast<Integer>(fp);
+                    has_key = true;
+                }
+            }
+            if (has_key)
+            {
+                const Integer first = get_integer_constant(proto, data[2]).get_integer();
+                const uint64_t index = static_cast<uint64_t>(key) - static_cast<uint64_t>(first);
+                if (index < slot_count - 1)
+                {
+                    slot = static_cast<uint32_t>(index) + 1;
+                }
+            }
+        }
+        else if (value.is_string())
+        {
+            const GCString* str = value.get_string();
+            const uint32_t mask = data[2] - 1;
+            const uint32_t* entries = data + kSwitchHeaderSize;
+            for (uint32_t h = switch_hash(str->view()) & mask;; h = (h + 1) & mask)
+            {
+                const uint32_t key = entries[2 * h];
+                if (key == 0)
+                {
+                    break;
+                }
+                if (GCString::compare(get_string_constant(proto, key - 1).get_string(), str) == std::strong_ordering::equal)
+                {
+                    slot = entries[2 * h + 1];
+                    break;
+                }
+            }
+        }
+
+        // Take the jump of the slot right away instead of dispatching it
+        const uint32_t slot_pc = frame.pc + slot;
+        frame.pc = slot_pc + 1 + static_cast<uint32_t>(proto->code[slot_pc].jump_offset());
+    }
+
     // Call instruction handler
     BEHL_FORCEINLINE
     CallFrame* handler_call(State* S, CallFrame& frame, Reg a, uint8_t num_args, uint8_t num_results, bool is_self_call)
@@ -476,6 +547,10 @@ namespace behl
         {
             auto* closure_data = func.get_closure();
             auto* proto = closure_data->proto;
+            if (proto->lazy) [[unlikely]]
+            {
+                compile_lazy(S, proto);
+            }
 
             if (frame.proto->has_upvalues)
             {
@@ -529,6 +604,10 @@ namespace behl
                 // Stack before: [object, arg1, arg2, ...]
                 // Stack after (at frame.base): [closure, object, arg1, arg2, ...]
                 auto* closure_data = call_mm.get_closure();
+                if (closure_data->proto->lazy) [[unlikely]]
+                {
+                    compile_lazy(S, closure_data->proto);
+                }
 
                 // Close upvalues before modifying the stack
                 close_upvalues(S, frame.base);
@@ -675,6 +754,34 @@ namespace behl
         comparison_op_general<MMIndex>(S, frame, lhs, rhs, CmpOp{});
     }
 
+    // Comparison of operands type inference proved to be two integers or two floats, see TypeInferencePass. Other
+    // operands, only possible in images loaded from outside the process, are compared like the generic opcode does.
+    template<typename T, MetaMethodType MMIndex, typename CmpOp>
+    BEHL_FORCEINLINE void handler_cmp_typed(State* S, CallFrame& frame, Reg b, Reg c)
+    {
+        const Value& lhs = get_register(S, frame, b);
+        const Value& rhs = get_register(S, frame, c);
+        if constexpr (std::is_same_v<T, Integer>)
+        {
+            if (lhs.is_integer() && rhs.is_integer()) [[likely]]
+            {
+                const bool result = CmpOp{}(lhs.get_integer(), rhs.get_integer());
+                frame.pc += !result ? 1 : 0;
+                return;
+            }
+        }
+        else
+        {
+            if (lhs.is_fp() && rhs.is_fp()) [[likely]]
+            {
+                const bool result = CmpOp{}(lhs.get_fp(), rhs.get_fp());
+                frame.pc += !result ? 1 : 0;
+                return;
+            }
+        }
+        comparison_op_general<MMIndex>(S, frame, lhs, rhs, CmpOp{});
+    }
+
     // Test instruction handler
     BEHL_FORCEINLINE
     void handler_test(State* S, CallFrame& frame, Reg a, bool invert)
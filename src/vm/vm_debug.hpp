@@ -30,12 +30,12 @@ namespace behl
         }
 
         // Get current location (using current PC before it's incremented)
-        if (!frame.proto || frame.pc >= frame.proto->line_info.size())
+        if (!frame.proto || !frame.proto->line_table.contains(frame.pc))
         {
             return false;
         }
 
-        const int current_line = frame.proto->line_info[frame.pc];
+        const int current_line = frame.proto->line_table.lookup(frame.pc).line;
 
         // Skip instructions with no line info (e.g., implicit returns)
         if (current_line <= 0)
@@ -22,25 +22,16 @@ namespace behl
             return SourceLocation("<native>");
         }
 
-        int line = 0;
-        int column = 0;
-        if (frame.pc > 0 && frame.pc - 1 < frame.proto->line_info.size())
+        LineEntry position;
+        if (frame.pc > 0 && frame.proto->line_table.contains(frame.pc - 1))
         {
-            assert(frame.pc - 1 < frame.proto->line_info.size() && "get_current_location: line_info index out of bounds");
-            line = frame.proto->line_info[frame.pc - 1];
-
-            if (frame.pc - 1 < frame.proto->column_info.size())
-            {
-                assert(
-                    frame.pc - 1 < frame.proto->column_info.size() && "get_current_location: column_info index out of bounds");
-                column = frame.proto->column_info[frame.pc - 1];
-            }
+            position = frame.proto->line_table.lookup(frame.pc - 1);
         }
 
         std::string source = !frame.proto->source_name || frame.proto->source_name->size() == 0
             ? "<script>"
             : std::string(frame.proto->source_name->view());
-        return SourceLocation(source, line, column);
+        return SourceLocation(source, position.line, position.column);
     }
 
     BEHL_FORCEINLINE
@@ -70,6 +61,27 @@ namespace behl
         return const_cast<Value&>(const_val);
     }
 
+    BEHL_FORCEINLINE
+    Value get_table_constant_value(const GCProto* proto, uint32_t entry) noexcept
+    {
+        const ConstIndex index = table_constant_index(entry);
+        switch (table_constant_kind(entry))
+        {
+            case TableConstantKind::kFalse:
+                return Value(false);
+            case TableConstantKind::kTrue:
+                return Value(true);
+            case TableConstantKind::kInteger:
+                return get_integer_constant(proto, index);
+            case TableConstantKind::kFP:
+                return get_fp_constant(proto, index);
+            case TableConstantKind::kString:
+                return get_string_constant(proto, index);
+            default:
+                return Value::Nil{};
+        }
+    }
+
     BEHL_FORCEINLINE
     Value& get_register(State* S, CallFrame& frame, size_t reg) noexcept
     {
@@ -3,6 +3,7 @@
 #include "bytecode.hpp"
 #include "frame.hpp"
 #include "gc/gc.hpp"
+#include "gc/gc_region.hpp"
 #include "gc/gco_table.hpp"
 #include "gc/gco_userdata.hpp"
 #include "platform.hpp"
@@ -110,6 +111,8 @@ namespace behl
     BEHL_FORCEINLINE
     void table_raw_setfield(State* S, struct GCTable* t, const Value& key, const Value& v)
     {
+        gc_region_barrier(S, t, key, v);
+
         // Try to interpret key as a non-negative array index
         if (const auto idx = key_as_positive_index(key))
         {
@@ -151,6 +154,7 @@ namespace behl
         // If key exists, update it directly
         if (slot != nullptr)
         {
+            gc_region_barrier(S, t, v);
             *slot = v;
             return;
         }
@@ -215,6 +219,7 @@ namespace behl
         auto* table = globals.get_table();
 
         const Value& v = get_register(S, frame, a);
+        gc_region_barrier(S, table, key, v);
         table->hash.insert_or_assign(S, key, v);
     }
 
@@ -368,6 +373,40 @@ namespace behl
         gc_step(S);
     }
 
+    // Builds a table constructor made only of constants in one step, the table is sized up front and its entries
+    // are set in the order of the constructor.
+    BEHL_FORCEINLINE
+    void handler_newtablek(State* S, CallFrame& frame, Reg a, ConstIndex k)
+    {
+        const GCProto* proto = frame.proto;
+        assert(k < proto->table_constants.size() && "handler_newtablek: constant table index out of bounds");
+        const uint32_t* data = proto->table_constant_data.data() + proto->table_constants[k];
+        const uint32_t array_size = data[0];
+        const uint32_t hash_size = data[1];
+
+        auto* obj = gc_new_table(S, array_size, hash_size);
+        get_register(S, frame, a) = Value(obj);
+
+        obj->array.resize(S, array_size);
+        const uint32_t* entry = data + 2;
+        for (uint32_t i = 0; i < array_size; ++i)
+        {
+            const Value val = get_table_constant_value(proto, *entry++);
+            gc_region_barrier(S, obj, val);
+            obj->array[i] = val;
+        }
+        for (uint32_t i = 0; i < hash_size; ++i)
+        {
+            const Value key = get_table_constant_value(proto, entry[0]);
+            const Value val = get_table_constant_value(proto, entry[1]);
+            table_raw_setfield(S, obj, key, val);
+            entry += 2;
+        }
+
+        gc_validate_on_stack(S, obj);
+        gc_step(S);
+    }
+
     BEHL_FORCEINLINE
     void handler_self(State* S, CallFrame& frame, Reg a, Reg b, Reg c)
     {
@@ -418,6 +457,7 @@ namespace behl
             for (uint8_t i = 0; i < actual_num_fields; ++i)
             {
                 Value val = get_register(S, frame, static_cast<Reg>(a + 2U + i));
+                gc_region_barrier(S, table_data, val);
                 table_data->array[static_cast<size_t>(start_idx + i - 1)] = val;
             }
         }
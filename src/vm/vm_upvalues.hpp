@@ -142,18 +142,14 @@ namespace behl
     BEHL_FORCEINLINE
     void handler_getupval(State* S, CallFrame& frame, Reg a, Reg b)
     {
-        const auto& upvalue_indices = S->stack[frame.base].get_closure()->upvalue_indices;
-        assert(b < upvalue_indices.size() && "handler_getupval: upvalue index out of bounds");
-        const auto upvalue_idx = upvalue_indices[b];
+        const auto upvalue_idx = S->stack[frame.base].get_closure()->upvalue_index(b);
         get_register(S, frame, a) = upvalue_ref(S, upvalue_idx);
     }
 
     BEHL_FORCEINLINE
     void handler_setupval(State* S, CallFrame& frame, Reg a, Reg b)
     {
-        const auto& upvalue_indices = S->stack[frame.base].get_closure()->upvalue_indices;
-        assert(b < upvalue_indices.size() && "handler_setupval: up value index out of bounds");
-        const auto upvalue_idx = upvalue_indices[b];
+        const auto upvalue_idx = S->stack[frame.base].get_closure()->upvalue_index(b);
         const Value& v = get_register(S, frame, a);
         upvalue_ref(S, upvalue_idx) = v;
     }
@@ -0,0 +1,479 @@
+#include "backend/bytecode_file.hpp"
+#include "gc/gc.hpp"
+#include "gc/gco_closure.hpp"
+#include "gc/gco_proto.hpp"
+#include "state.hpp"
+#include "vm/bytecode.hpp"
+
+#include <behl/behl.hpp>
+#include <behl/exceptions.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace behl;
+
+class BytecodeTest : public ::testing::Test
+{
+protected:
+    State* S;
+    void SetUp() override
+    {
+        S = new_state();
+        load_stdlib(S);
+    }
+    void TearDown() override
+    {
+        close(S);
+    }
+
+    static void append_chunk(State*, std::string_view chunk, void* userdata)
+    {
+        static_cast<std::string*>(userdata)->append(chunk);
+    }
+
+    std::string compile_to_bytecode(std::string_view code, bool strip_debug_info = false)
+    {
+        load_buffer(S, code, "precompiled.behl");
+        std::string out;
+        dump(S, append_chunk, &out, strip_debug_info);
+        pop(S, 1);
+        return out;
+    }
+};
+
+static constexpr std::string_view kProgram = R"(
+    function make_counter(step) {
+        let count = 0;
+        return function() {
+            count += step;
+            return count;
+        };
+    }
+    let counter = make_counter(3);
+    counter();
+    let t = { name = "bytecode", ratio = 0.25, big = 1234567890123 };
+    return counter() + t.big + t.ratio * 4, t.name;
+)";
+
+TEST_F(BytecodeTest, RoundTripRunsInFreshState)
+{
+    const auto image = compile_to_bytecode(kProgram);
+    ASSERT_TRUE(is_bytecode(image));
+
+    State* other = new_state();
+    load_stdlib(other);
+    load_bytecode(other, image, "precompiled.behlc");
+    call(other, 0, 2);
+
+    EXPECT_DOUBLE_EQ(to_number(other, 0), 1234567890123.0 + 6.0 + 1.0);
+    EXPECT_EQ(to_string(other, 1), "bytecode");
+    close(other);
+}
+
+TEST_F(BytecodeTest, LoadBufferDetectsBytecode)
+{
+    const auto image = compile_to_bytecode("return 40 + tonumber(\"2\");");
+
+    load_buffer(S, image, "precompiled.behlc");
+    call(S, 0, 1);
+    EXPECT_EQ(to_integer(S, -1), 42);
+}
+
+TEST_F(BytecodeTest, StripDebugInfoDropsLineTables)
+{
+    const auto full = compile_to_bytecode(kProgram);
+    const auto stripped = compile_to_bytecode(kProgram, true);
+    EXPECT_LT(stripped.size(), full.size());
+
+    load_bytecode(S, stripped);
+    call(S, 0, 2);
+    EXPECT_EQ(to_string(S, 1), "bytecode");
+}
+
+TEST_F(BytecodeTest, RejectsCorruptImages)
+{
+    const auto image = compile_to_bytecode(kProgram);
+
+    auto flipped = image;
+    flipped[flipped.size() / 2] = static_cast<char>(flipped[flipped.size() / 2] ^ 0x40);
+    EXPECT_THROW(load_bytecode(S, flipped), RuntimeError);
+
+    EXPECT_THROW(load_bytecode(S, image.substr(0, image.size() - 3)), RuntimeError);
+    EXPECT_THROW(load_bytecode(S, image.substr(0, 12)), RuntimeError);
+
+    auto wrong_version = image;
+    wrong_version[4] = static_cast<char>(wrong_version[4] + 1);
+    EXPECT_THROW(load_bytecode(S, wrong_version), RuntimeError);
+
+    EXPECT_THROW(load_bytecode(S, "return 1;"), RuntimeError);
+    EXPECT_EQ(get_top(S), 0);
+}
+
+TEST_F(BytecodeTest, LoadsMappedFile)
+{
+    const auto path = (std::filesystem::temp_directory_path() / "behl_bytecode_test.behlc").string();
+    {
+        std::ofstream file(path, std::ios::binary);
+        const auto image = compile_to_bytecode(kProgram);
+        file.write(image.data(), static_cast<std::streamsize>(image.size()));
+    }
+
+    load_bytecode_file(S, path);
+    call(S, 0, 2);
+    EXPECT_EQ(to_string(S, 1), "bytecode");
+    set_top(S, 0);
+
+    // The mapping is released together with the protos that reference it.
+    gc_collect(S);
+    std::filesystem::remove(path);
+
+    EXPECT_THROW(load_bytecode_file(S, path), RuntimeError);
+}
+
+TEST_F(BytecodeTest, DumpRequiresScriptFunction)
+{
+    std::string out;
+    push_integer(S, 1);
+    EXPECT_THROW(dump(S, append_chunk, &out), TypeError);
+    EXPECT_TRUE(out.empty());
+}
+
+TEST_F(BytecodeTest, SharedScriptInstancesShareCode)
+{
+    auto script = compile_shared(kProgram, "shared.behl");
+
+    State* first = new_state();
+    State* second = new_state();
+    load_stdlib(first);
+    load_stdlib(second);
+    load_compiled(first, script);
+    load_compiled(second, script);
+
+    const auto* first_proto = first->stack.back().get_closure()->proto;
+    const auto* second_proto = second->stack.back().get_closure()->proto;
+    EXPECT_NE(first_proto, second_proto);
+    EXPECT_EQ(first_proto->code.data(), second_proto->code.data());
+    EXPECT_EQ(first_proto->protos[0]->code.data(), second_proto->protos[0]->code.data());
+    EXPECT_GT(script.use_count(), 1);
+
+    call(first, 0, 2);
+    call(second, 0, 2);
+    EXPECT_EQ(to_string(first, 1), "bytecode");
+    EXPECT_EQ(to_string(second, 1), "bytecode");
+
+    close(first);
+    close(second);
+    EXPECT_EQ(script.use_count(), 1);
+}
+
+TEST_F(BytecodeTest, SharedScriptReportsCompileErrors)
+{
+    EXPECT_THROW(compile_shared("let x = ;", "broken.behl"), BehlException);
+}
+
+TEST_F(BytecodeTest, SharedScriptInstantiatesFromThreads)
+{
+    auto script = compile_shared("let sum = 0; for (let i = 1; i <= 100; i++) { sum += i; } return sum;");
+
+    std::vector<Integer> results(4);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < results.size(); ++t)
+    {
+        threads.emplace_back([&script, &results, t]() {
+            State* state = new_state();
+            load_compiled(state, script);
+            call(state, 0, 1);
+            results[t] = to_integer(state, -1);
+            close(state);
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    for (const auto result : results)
+    {
+        EXPECT_EQ(result, 5050);
+    }
+}
+
+TEST_F(BytecodeTest, ConstantTablesRoundTrip)
+{
+    constexpr std::string_view code = R"(
+        function lookup(i) {
+            let primes = {2, 3, 5, 7, 11, 13};
+            let names = {first = "one", second = 2.5, third = true};
+            names.prime = primes[i];
+            return names;
+        }
+        let n = lookup(4);
+        return n.prime + n.second, n.first;
+    )";
+
+    set_lazy_compilation(S, false);
+    load_buffer(S, code, "tables.behl");
+    const auto* proto = S->stack.back().get_closure()->proto;
+    ASSERT_EQ(proto->protos.size(), 1u);
+    EXPECT_EQ(proto->protos[0]->table_constants.size(), 2u);
+    for (const auto& instr : proto->protos[0]->code)
+    {
+        EXPECT_NE(instr.op(), OpCode::kOpSetField);
+    }
+
+    std::string image;
+    dump(S, append_chunk, &image, false);
+    pop(S, 1);
+
+    State* other = new_state();
+    load_bytecode(other, image, "tables.behlc");
+    call(other, 0, 2);
+    EXPECT_DOUBLE_EQ(to_number(other, 0), 11.0 + 2.5);
+    EXPECT_EQ(to_string(other, 1), "one");
+    close(other);
+}
+
+TEST_F(BytecodeTest, SwitchTablesRoundTrip)
+{
+    constexpr std::string_view code = R"(
+        function rank(n) {
+            if (n == 1) { return 10; }
+            elseif (n == 2) { return 20; }
+            elseif (n == 4) { return 40; }
+            elseif (n == 3) { return 30; }
+            return 0;
+        }
+        function suit(s) {
+            if (s == "hearts") { return 1; }
+            elseif (s == "spades") { return 2; }
+            elseif (s == "clubs") { return 3; }
+            elseif (s == "diamonds") { return 4; }
+            return 0;
+        }
+        return rank(3) + rank(5) + suit("clubs") + suit("joker");
+    )";
+
+    set_lazy_compilation(S, false);
+    load_buffer(S, code, "switch.behl");
+    const auto* proto = S->stack.back().get_closure()->proto;
+    ASSERT_EQ(proto->protos.size(), 2u);
+    EXPECT_EQ(proto->protos[0]->switch_tables.size(), 1u);
+    EXPECT_EQ(proto->protos[1]->switch_tables.size(), 1u);
+
+    std::string image;
+    dump(S, append_chunk, &image, false);
+    pop(S, 1);
+
+    State* other = new_state();
+    load_bytecode(other, image, "switch.behlc");
+    call(other, 0, 1);
+    EXPECT_EQ(to_integer(other, 0), 33);
+    close(other);
+}
+
+TEST_F(BytecodeTest, LineTablesDecodeEveryInstruction)
+{
+    std::vector<int> lines;
+    std::vector<int> columns;
+    for (int i = 0; i < 100; ++i)
+    {
+        lines.push_back(i % 7 == 0 ? 0 : 10 + i / 3);
+        columns.push_back(i == 50 ? 1 << 30 : (i * 37) % 120 - 5);
+    }
+
+    LineTable table;
+    table.build(S, lines, columns);
+    EXPECT_TRUE(table.is_valid(lines.size()));
+    EXPECT_FALSE(table.is_valid(lines.size() - 1));
+    EXPECT_EQ(table.checkpoints.size(), 4u);
+    for (size_t pc = 0; pc < lines.size(); ++pc)
+    {
+        const auto position = table.lookup(pc);
+        EXPECT_EQ(position.line, lines[pc]);
+        EXPECT_EQ(position.column, columns[pc]);
+    }
+
+    table.strip_columns(S);
+    EXPECT_TRUE(table.is_valid(lines.size()));
+    EXPECT_LE(table.deltas.size(), lines.size() + 1);
+    for (size_t pc = 0; pc < lines.size(); ++pc)
+    {
+        const auto position = table.lookup(pc);
+        EXPECT_EQ(position.line, lines[pc]);
+        EXPECT_EQ(position.column, 0);
+    }
+    table.destroy(S);
+}
+
+TEST_F(BytecodeTest, LineTablesKeepErrorLocations)
+{
+    std::string code = "let t = {};\nlet x = tonumber(\"0\");\n";
+    for (int i = 0; i < 60; ++i)
+    {
+        code += "x = x * 3 + " + std::to_string(i) + ";\n";
+    }
+    code += "return x + t.missing.field;\n";
+    constexpr int kErrorLine = 63;
+
+    const auto error_location = [this]() {
+        try
+        {
+            call(S, 0, 0);
+        }
+        catch (const BehlException& e)
+        {
+            set_top(S, 0);
+            return e.location();
+        }
+        ADD_FAILURE() << "expected a runtime error";
+        return SourceLocation();
+    };
+
+    load_buffer(S, code, "lines.behl");
+    const auto from_source = error_location();
+    EXPECT_EQ(from_source.line, kErrorLine);
+    EXPECT_GT(from_source.column, 0);
+
+    const auto image = compile_to_bytecode(code);
+    load_bytecode(S, image, "lines.behlc");
+    const auto from_bytecode = error_location();
+    EXPECT_EQ(from_bytecode.line, kErrorLine);
+    EXPECT_EQ(from_bytecode.column, from_source.column);
+
+    // Without column info the lines stay exact, whether the function is compiled or loaded from bytecode.
+    set_column_info(S, false);
+    load_buffer(S, code, "lines.behl");
+    const auto stripped_source = error_location();
+    EXPECT_EQ(stripped_source.line, kErrorLine);
+    EXPECT_EQ(stripped_source.column, 0);
+
+    load_bytecode(S, image, "lines.behlc");
+    const auto stripped_bytecode = error_location();
+    EXPECT_EQ(stripped_bytecode.line, kErrorLine);
+    EXPECT_EQ(stripped_bytecode.column, 0);
+    EXPECT_LT(compile_to_bytecode(code).size(), image.size());
+}
+
+// Replaces the first occurrence of from in the instructions of image, which are stored 4 byte aligned.
+static std::string with_instruction(std::string image, Instruction from, Instruction to)
+{
+    for (size_t offset = 0; offset + sizeof(uint32_t) <= image.size(); offset += sizeof(uint32_t))
+    {
+        uint32_t raw;
+        std::memcpy(&raw, image.data() + offset, sizeof(raw));
+        if (raw == from.raw)
+        {
+            std::memcpy(image.data() + offset, &to.raw, sizeof(to.raw));
+            return image;
+        }
+    }
+    ADD_FAILURE() << "instruction not found in the image";
+    return image;
+}
+
+TEST_F(BytecodeTest, RejectsOperandsOutsideTheFrame)
+{
+    constexpr std::string_view code = R"(
+        let base = tonumber("2");
+        function scale(x) {
+            return x * base;
+        }
+        return scale(21);
+    )";
+
+    set_lazy_compilation(S, false);
+    load_buffer(S, code, "operands.behl");
+    const auto* proto = S->stack.back().get_closure()->proto;
+    ASSERT_EQ(proto->protos.size(), 1u);
+
+    std::string image;
+    dump(S, append_chunk, &image, false);
+    pop(S, 1);
+
+    const auto find_op = [](const GCProto* p, OpCode op) {
+        for (const auto instr : p->code)
+        {
+            if (instr.op() == op)
+            {
+                return instr;
+            }
+        }
+        ADD_FAILURE() << "no such instruction";
+        return Instruction{};
+    };
+    // The checksum is skipped like for images that never left the process, only validation stands in the way.
+    const auto expect_rejected = [&](const std::string& patched, std::string_view reason) {
+        try
+        {
+            read_bytecode(S, patched, nullptr, "patched.behlc", false);
+            ADD_FAILURE() << "expected " << reason;
+        }
+        catch (const RuntimeError& e)
+        {
+            EXPECT_NE(std::string_view(e.what()).find(reason), std::string_view::npos) << e.what();
+        }
+    };
+
+    const auto ret = find_op(proto, OpCode::kOpReturn);
+    expect_rejected(with_instruction(image, ret, make_op_return(200, ret.b())), "register out of range");
+
+    const auto upval = find_op(proto->protos[0], OpCode::kOpGetUpval);
+    expect_rejected(with_instruction(image, upval, make_op_getupval(upval.a(), 7)), "upvalue index out of range");
+
+    EXPECT_NO_THROW(read_bytecode(S, image, nullptr, "operands.behlc", false));
+}
+
+TEST_F(BytecodeTest, TypedOpcodesFallBackOnOtherOperands)
+{
+    constexpr std::string_view code = R"(
+        function join(x, y) {
+            return x + y;
+        }
+        function less(x, y) {
+            return x < y;
+        }
+        return join("con", "cat"), join(1.5, 2), less("a", "b"), less(2.5, 1);
+    )";
+
+    set_lazy_compilation(S, false);
+    load_string(S, code, OptLevel::kO0);
+    const auto* proto = S->stack.back().get_closure()->proto;
+    ASSERT_EQ(proto->protos.size(), 2u);
+
+    std::string image;
+    dump(S, append_chunk, &image, false);
+    pop(S, 1);
+
+    // A hand-built image can claim integer operands the values do not have, the handlers must not trust it.
+    const auto find_op = [](const GCProto* p, OpCode op) {
+        for (const auto instr : p->code)
+        {
+            if (instr.op() == op)
+            {
+                return instr;
+            }
+        }
+        ADD_FAILURE() << "no such instruction";
+        return Instruction{};
+    };
+    const auto add = find_op(proto->protos[0], OpCode::kOpAdd);
+    const auto lt = find_op(proto->protos[1], OpCode::kOpLt);
+    image = with_instruction(image, add, make_op_addii(add.a(), add.b(), add.c()));
+    image = with_instruction(image, lt, make_op_ltii(lt.b(), lt.c()));
+
+    S->stack.push_back(S, Value(gc_new_closure(S, read_bytecode(S, image, nullptr, "typed.behlc", false))));
+    call(S, 0, 4);
+    EXPECT_EQ(to_string(S, 0), "concat");
+    EXPECT_DOUBLE_EQ(to_number(S, 1), 3.5);
+    EXPECT_TRUE(to_boolean(S, 2));
+    EXPECT_FALSE(to_boolean(S, 3));
+    set_top(S, 0);
+
+    load_string(S, "return join({}, 1);", OptLevel::kO0);
+    EXPECT_THROW(call(S, 0, 1), TypeError);
+}
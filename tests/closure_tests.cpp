@@ -195,3 +195,48 @@ TEST_F(ClosureTest, NestedFunctionWithDecrement)
     ASSERT_NO_THROW(behl::call(S, 0, 1));
     ASSERT_EQ(behl::to_integer(S, -1), 24); // 9 + 8 + 7
 }
+
+TEST_F(ClosureTest, ClosuresWithoutUpvaluesAreShared)
+{
+    constexpr std::string_view code = R"(
+        function make_doubler() {
+            return function(x) { return x * 2; };
+        }
+        let doublers = {};
+        for (let i = 0; i < 50; i = i + 1) {
+            doublers[i] = make_doubler();
+        }
+        let same = doublers[0] == doublers[49];
+        return same, doublers[17](21)
+    )";
+    ASSERT_NO_THROW(behl::load_string(S, code));
+    ASSERT_NO_THROW(behl::call(S, 0, 2));
+    EXPECT_TRUE(behl::to_boolean(S, 0));
+    EXPECT_EQ(behl::to_integer(S, 1), 42);
+}
+
+TEST_F(ClosureTest, CapturingClosuresStayDistinct)
+{
+    constexpr std::string_view code = R"(
+        function make_adder(a) {
+            return function(x) { return x + a; };
+        }
+        function make_mixer(a, b, c) {
+            return function(x) { return x * a + b * c; };
+        }
+        let total = 0;
+        for (let i = 0; i < 200; i = i + 1) {
+            let add = make_adder(i);
+            let mix = make_mixer(i, 2, 3);
+            total = total + add(1) + mix(1);
+        }
+        let first = make_adder(1);
+        let second = make_adder(1);
+        return total, first == second
+    )";
+    ASSERT_NO_THROW(behl::load_string(S, code));
+    ASSERT_NO_THROW(behl::call(S, 0, 2));
+    // Each iteration adds (i + 1) + (i + 6), summed over i = 0..199.
+    EXPECT_EQ(behl::to_integer(S, 0), 2 * 19900 + 7 * 200);
+    EXPECT_FALSE(behl::to_boolean(S, 1));
+}
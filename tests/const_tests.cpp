@@ -1,4 +1,5 @@
 #include <behl/behl.hpp>
+#include <behl/exceptions.hpp>
 #include <gtest/gtest.h>
 
 namespace behl
@@ -631,4 +632,26 @@ namespace behl
         EXPECT_TRUE(to_boolean(S, -1));
     }
 
+    TEST_F(ConstTest, ConstReassignmentReportsItsLine)
+    {
+        constexpr std::string_view code = R"(
+            let before = 1;
+            const limit = 10;
+
+            limit = 20;
+            return limit;
+        )";
+
+        try
+        {
+            load_buffer(S, code, "const.behl");
+            FAIL() << "expected a semantic error";
+        }
+        catch (const SemanticError& e)
+        {
+            EXPECT_EQ(e.location().filename, "const.behl");
+            EXPECT_EQ(e.location().line, 5);
+        }
+    }
+
 } // namespace behl
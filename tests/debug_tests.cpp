@@ -131,7 +131,7 @@ TEST_F(DebugTest, BasicBreakpoint)
         let result = x + y;
         let z = 4;
     )";
-    ASSERT_NO_THROW(behl::load_string(S, code, false));
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
 
     call(S, 0, 0);
 
@@ -156,7 +156,7 @@ TEST_F(DebugTest, MultipleBreakpoints)
         let a = 4;
         let b = 5;
     )";
-    ASSERT_NO_THROW(behl::load_string(S, code, false));
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
 
     call(S, 0, 0);
 
@@ -181,7 +181,7 @@ TEST_F(DebugTest, StepInto)
         let z = 3;
         let a = 4;
     )";
-    ASSERT_NO_THROW(behl::load_string(S, code, false));
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
 
     call(S, 0, 0);
 
@@ -204,7 +204,7 @@ TEST_F(DebugTest, StepOver)
         let x = foo();
         let y = 10;
     )";
-    ASSERT_NO_THROW(behl::load_string(S, code, false));
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
 
     call(S, 0, 0);
 
@@ -229,7 +229,7 @@ TEST_F(DebugTest, BreakpointInLoop)
             let x = i;
         }
     )";
-    ASSERT_NO_THROW(behl::load_string(S, code, false));
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
 
     call(S, 0, 0);
 
@@ -252,7 +252,7 @@ TEST_F(DebugTest, RemoveBreakpoint)
         let y = 2;
         let z = 3;
     )";
-    ASSERT_NO_THROW(behl::load_string(S, code, false));
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
 
     call(S, 0, 0);
 
@@ -269,7 +269,7 @@ TEST_F(DebugTest, PauseExecution)
         let x = 1;
         let y = 2;
     )";
-    ASSERT_NO_THROW(behl::load_string(S, code, false));
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
 
     call(S, 0, 0);
 
@@ -288,7 +288,7 @@ TEST_F(DebugTest, ClearAllBreakpoints)
         let y = 2;
         let z = 3;
     )";
-    ASSERT_NO_THROW(behl::load_string(S, code, false));
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
 
     call(S, 0, 0);
 
@@ -324,7 +324,7 @@ TEST(DebugStandaloneTest, GetLocation)
         let x = 1;
         let y = 2;
     )";
-    ASSERT_NO_THROW(behl::load_string(S, code, false));
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
 
     call(S, 0, 0);
 
@@ -31,7 +31,7 @@ TEST_F(ErrorTest, TypeError_ArithmeticOnNonNumber)
     constexpr std::string_view code = R"(
         let x = 5 + 'hello'
     )";
-    ASSERT_NO_THROW(behl::load_string(S, code, false));
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
     EXPECT_THROW({ behl::call(S, 0, 0); }, behl::TypeError);
 }
 
@@ -94,7 +94,7 @@ TEST_F(ErrorTest, TypeError_IndexNonTable)
     constexpr std::string_view code = R"(
         let x = 5; let y = x[1]
     )";
-    ASSERT_NO_THROW(behl::load_string(S, code, false));
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
     EXPECT_THROW({ behl::call(S, 0, 0); }, behl::TypeError);
 }
 
@@ -112,7 +112,7 @@ TEST_F(ErrorTest, ErrorIncludesSourceLocation)
     constexpr std::string_view code = R"(
         let x = 1 + nil
     )";
-    ASSERT_NO_THROW(behl::load_string(S, code, false));
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
     EXPECT_THROW({ behl::call(S, 0, 0); }, behl::TypeError);
 }
 
@@ -141,7 +141,7 @@ TEST_F(ErrorTest, MultipleOperationsShowCorrectError)
         let d = c * 'invalid'
     )";
 
-    ASSERT_NO_THROW(behl::load_string(S, code, false)); // Disable optimizations
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0)); // Disable optimizations
     EXPECT_THROW({ behl::call(S, 0, 0); }, behl::TypeError);
 }
 TEST_F(ErrorTest, ErrorFunction_BasicThrow)
@@ -1,3 +1,5 @@
+#include "state.hpp"
+
 #include <behl/behl.hpp>
 #include <gtest/gtest.h>
 
@@ -757,4 +759,64 @@ namespace behl
         EXPECT_TRUE(to_boolean(S, -1));
     }
 
+    TEST_F(GCTest, CompactReleasesTableStorage)
+    {
+        constexpr std::string_view code = R"(
+            const gc = import("gc");
+            let t = {};
+            for (let i = 0; i < 100000; i++) {
+                t[i] = i;
+                t["k" + tostring(i)] = i;
+            }
+            for (let i = 10; i < 100000; i++) {
+                t[i] = nil;
+                t["k" + tostring(i)] = nil;
+            }
+            return t;
+        )";
+
+        ASSERT_NO_THROW(load_string(S, code));
+        ASSERT_NO_THROW(call(S, 0, 1));
+        set_global(S, "t");
+
+        gc_collect(S);
+        const size_t before = S->gc.gc_total_bytes;
+
+        gc_compact(S);
+        const size_t after = S->gc.gc_total_bytes;
+        EXPECT_LT(after * 4, before);
+
+        constexpr std::string_view check = R"(
+            let sum = 0;
+            for (let i = 0; i < 10; i++) {
+                sum = sum + t[i] + t["k" + tostring(i)];
+            }
+            t[20] = 1;
+            t["new"] = 2;
+            return sum + t[20] + t["new"];
+        )";
+
+        ASSERT_NO_THROW(load_string(S, check));
+        ASSERT_NO_THROW(call(S, 0, 1));
+        EXPECT_EQ(to_integer(S, -1), 93);
+    }
+
+    TEST_F(GCTest, CompactFromScript)
+    {
+        constexpr std::string_view code = R"(
+            const gc = import("gc");
+            let keep = {1, 2, 3};
+            for (let i = 0; i < 1000; i++) {
+                let temp = {data = i};
+            }
+            gc.compact();
+            gc.compact(false);
+            return keep[0] + keep[1] + keep[2];
+        )";
+
+        ASSERT_NO_THROW(load_string(S, code));
+        ASSERT_NO_THROW(call(S, 0, 1));
+        EXPECT_EQ(to_integer(S, -1), 6);
+    }
+
 } // namespace behl
@@ -68,3 +68,43 @@ TEST_F(HashMapTombstoneTest, TombstonesAreCountedInLoadFactor)
 
     map.destroy(S);
 }
+
+TEST_F(HashMapTombstoneTest, ShrinkToFitDropsTombstonesAndCapacity)
+{
+    behl::HashMap<size_t, int> map;
+    map.init(S, 0);
+
+    for (size_t k = 0; k < 1000; ++k)
+    {
+        map.insert_or_assign(S, k, static_cast<int>(k));
+    }
+    for (size_t k = 10; k < 1000; ++k)
+    {
+        map.erase(k);
+    }
+    ASSERT_EQ(map.size(), 10u);
+    ASSERT_GT(map.tombstones(), 0u);
+
+    map.shrink_to_fit(S);
+    EXPECT_EQ(map.capacity(), 16u);
+    EXPECT_EQ(map.tombstones(), 0u);
+    for (size_t k = 0; k < 10; ++k)
+    {
+        auto it = map.find(k);
+        ASSERT_NE(it, map.end());
+        EXPECT_EQ(it->second, static_cast<int>(k));
+    }
+
+    for (size_t k = 0; k < 10; ++k)
+    {
+        map.erase(k);
+    }
+    map.shrink_to_fit(S);
+    EXPECT_EQ(map.capacity(), 0u);
+
+    // The map stays usable after its storage was released.
+    map.insert_or_assign(S, size_t{1}, 1);
+    EXPECT_EQ(map.size(), 1u);
+
+    map.destroy(S);
+}
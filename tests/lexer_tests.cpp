@@ -125,3 +125,48 @@ TEST_F(LexerTest, LexerOperators)
     ASSERT_EQ(tokens[39].type, TokenType::kGe);
     ASSERT_EQ(tokens[41].type, TokenType::kEOF);
 }
+
+TEST_F(LexerTest, LexerKeywords)
+{
+    std::string source = "let const if else elseif while for foreach function return break continue defer true false nil "
+                         "in module export local lets iff forEach _in";
+    auto tokens = tokenize(S, source);
+
+    const TokenType expected[] = { TokenType::kLet, TokenType::kConst, TokenType::kIf, TokenType::kElse,
+        TokenType::kElseIf, TokenType::kWhile, TokenType::kFor, TokenType::kForEach, TokenType::kFunction,
+        TokenType::kReturn, TokenType::kBreak, TokenType::kContinue, TokenType::kDefer, TokenType::kTrue,
+        TokenType::kFalse, TokenType::kNil, TokenType::kIn, TokenType::kModule, TokenType::kExport, TokenType::kLocal,
+        TokenType::kIdentifier, TokenType::kIdentifier, TokenType::kIdentifier, TokenType::kIdentifier, TokenType::kEOF };
+
+    ASSERT_EQ(tokens.size(), std::size(expected));
+    for (size_t i = 0; i < tokens.size(); ++i)
+    {
+        EXPECT_EQ(tokens[i].type, expected[i]) << "token " << i << " '" << tokens[i].value << "'";
+    }
+}
+
+TEST_F(LexerTest, LexerLongRunsTrackPositions)
+{
+    // Runs longer than a vector block, with multi-byte codepoints and newlines in the middle of them.
+    std::string source = "/* block comment that is long enough to cover several blocks ü and\n"
+                         "   continues on a second line */ abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789\n"
+                         "// line comment that is long enough to cover several blocks before it ends ✓\n"
+                         "      \t    \"string literal that is long enough for several blocks ä with \\\" escapes\" x";
+    auto tokens = tokenize(S, source);
+
+    ASSERT_EQ(tokens.size(), 4);
+
+    EXPECT_EQ(tokens[0].type, TokenType::kIdentifier);
+    EXPECT_EQ(tokens[0].value, "abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789");
+    EXPECT_EQ(tokens[0].line, 2);
+    EXPECT_EQ(tokens[0].column, 34);
+
+    EXPECT_EQ(tokens[1].type, TokenType::kString);
+    EXPECT_EQ(tokens[1].value, "string literal that is long enough for several blocks ä with \\\" escapes");
+    EXPECT_EQ(tokens[1].line, 4);
+    EXPECT_EQ(tokens[1].column, 12);
+
+    EXPECT_EQ(tokens[2].type, TokenType::kIdentifier);
+    EXPECT_EQ(tokens[2].line, 4);
+    EXPECT_EQ(tokens[2].column, 86);
+}
@@ -1,7 +1,10 @@
 
 #include <behl/behl.hpp>
 #include <behl/exceptions.hpp>
+#include <algorithm>
 #include <gtest/gtest.h>
+#include <string>
+#include <string_view>
 
 class LoadTest : public ::testing::Test
 {
@@ -35,3 +38,174 @@ TEST_F(LoadTest, LoadStringSyntaxError)
     const char* bad_code = "let x = ";
     EXPECT_THROW({ behl::load_string(S, bad_code); }, behl::SyntaxError);
 }
+
+TEST_F(LoadTest, LazyFunctionReportsErrorOnFirstCall)
+{
+    constexpr std::string_view code = R"(
+        function broken() {
+            const limit = 10;
+            limit = 20;
+        }
+        return 1;
+    )";
+
+    behl::set_lazy_compilation(S, true);
+    ASSERT_NO_THROW(behl::load_buffer(S, code, "lazy.behl"));
+    ASSERT_NO_THROW(behl::call(S, 0, 0));
+
+    // The function stays uncompiled after a failure, every call reports the error.
+    for (int attempt = 0; attempt < 2; ++attempt)
+    {
+        behl::get_global(S, "broken");
+        try
+        {
+            behl::call(S, 0, 0);
+            FAIL() << "expected a compile error";
+        }
+        catch (const behl::SemanticError& e)
+        {
+            EXPECT_EQ(e.location().filename, "lazy.behl");
+            EXPECT_EQ(e.location().line, 4);
+        }
+        behl::set_top(S, 0);
+    }
+}
+
+TEST_F(LoadTest, EagerCompilationReportsErrorsAtLoad)
+{
+    constexpr std::string_view code = R"(
+        function broken() {
+            const limit = 10;
+            limit = 20;
+        }
+        return 1;
+    )";
+
+    try
+    {
+        behl::load_buffer(S, code, "eager.behl");
+        FAIL() << "expected a compile error";
+    }
+    catch (const behl::SemanticError& e)
+    {
+        EXPECT_EQ(e.location().filename, "eager.behl");
+        EXPECT_EQ(e.location().line, 4);
+    }
+}
+
+TEST_F(LoadTest, LazyFunctionsCaptureEnclosingVariables)
+{
+    constexpr std::string_view code = R"(
+        let base = 100;
+        const step = 2;
+        function make_counter(start) {
+            let count = start;
+            let helper = function(n) {
+                // Reaches base through make_counter, which captures it only for this function.
+                return function() {
+                    count += n * step;
+                    return base + count;
+                };
+            };
+            return helper(1);
+        }
+        let counter = make_counter(10);
+        counter();
+        base = 1000;
+        let shadow = function(base) { return base; };
+        return counter(), shadow(7);
+    )";
+
+    behl::set_lazy_compilation(S, true);
+    behl::load_buffer(S, code, "closures.behl");
+    behl::call(S, 0, 2);
+
+    EXPECT_EQ(behl::to_integer(S, 0), 1014);
+    EXPECT_EQ(behl::to_integer(S, 1), 7);
+}
+
+TEST_F(LoadTest, LazyFunctionsCompileOnEveryCallPath)
+{
+    // Every function is first reached through a different kind of call.
+    constexpr std::string_view code = R"(
+        function tail(n) { return n * 2; }
+        function through_tail(n) { return tail(n + 1); }
+        let callable = setmetatable({ base = 5 }, { __call = function(self, n) { return self.base + n; } });
+        function through_call_metamethod(n) { return callable(n); }
+        function fib(n) {
+            if (n < 2) { return n; }
+            return fib(n - 1) + fib(n - 2);
+        }
+        let ok, value = pcall(function() { return fib(10); });
+        return through_tail(20), through_call_metamethod(1), value;
+    )";
+
+    behl::load_stdlib(S);
+    behl::set_lazy_compilation(S, true);
+    behl::load_buffer(S, code, "paths.behl");
+    behl::call(S, 0, 3);
+
+    EXPECT_EQ(behl::to_integer(S, 0), 42);
+    EXPECT_EQ(behl::to_integer(S, 1), 6);
+    EXPECT_EQ(behl::to_integer(S, 2), 55);
+}
+
+namespace
+{
+    // Hands out the source in chunks of varying size so tokens straddle chunk boundaries.
+    struct ChunkedSource
+    {
+        std::string_view text;
+        size_t pos = 0;
+        size_t step = 0;
+    };
+
+    std::string_view read_chunk(behl::State*, void* userdata)
+    {
+        auto* src = static_cast<ChunkedSource*>(userdata);
+        const size_t size = std::min(src->step++ % 7 + 1, src->text.size() - src->pos);
+        const auto chunk = src->text.substr(src->pos, size);
+        src->pos += size;
+        return chunk;
+    }
+} // namespace
+
+TEST_F(LoadTest, LoadReaderAcrossChunkBoundaries)
+{
+    constexpr std::string_view code = R"(
+        // A comment that spans several chunks of the reader.
+        let greeting = "hello, streaming world";
+        let long_identifier_name = 0x1F + 32.5;
+        /* block comment
+           over two lines */
+        let parts = {greeting, 'é'};
+        for (let i = 0; i < 3; i++) {
+            long_identifier_name += i;
+        }
+        return greeting, long_identifier_name, parts[1];
+    )";
+
+    ChunkedSource src{ code };
+    behl::load_reader(S, read_chunk, &src, "chunked.behl");
+    behl::call(S, 0, 3);
+
+    EXPECT_EQ(behl::to_string(S, 0), "hello, streaming world");
+    EXPECT_DOUBLE_EQ(behl::to_number(S, 1), 66.5);
+    EXPECT_EQ(behl::to_string(S, 2), "é");
+}
+
+TEST_F(LoadTest, LoadReaderReportsErrorLines)
+{
+    constexpr std::string_view code = "let a = 1;\nlet b = 2;\nlet c = ;\n";
+
+    ChunkedSource src{ code };
+    try
+    {
+        behl::load_reader(S, read_chunk, &src, "broken.behl");
+        FAIL() << "Expected a syntax error";
+    }
+    catch (const behl::SyntaxError& e)
+    {
+        EXPECT_NE(std::string_view(e.what()).find("broken.behl(3,"), std::string_view::npos) << e.what();
+    }
+}
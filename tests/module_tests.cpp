@@ -1,5 +1,8 @@
 #include <behl/behl.hpp>
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <string>
 
 class ModuleTest : public ::testing::Test
 {
@@ -258,3 +261,171 @@ TEST_F(ModuleTest, Module_CannotAccessStdLibWithoutImport)
 
     EXPECT_THROW(behl::load_string(S, code), std::exception);
 }
+
+class ModuleCacheTest : public ::testing::Test
+{
+protected:
+    std::filesystem::path root;
+    std::filesystem::path cache_dir;
+
+    void SetUp() override
+    {
+        root = std::filesystem::temp_directory_path() / "behl_module_cache_test";
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root / "src");
+        cache_dir = root / "cache";
+
+        write_file("util.behl", "module; export function value() { return 41 + 1; }");
+    }
+
+    void TearDown() override
+    {
+        std::filesystem::remove_all(root);
+    }
+
+    void write_file(const std::string& name, std::string_view content)
+    {
+        std::ofstream file(root / "src" / name, std::ios::binary);
+        file.write(content.data(), static_cast<std::streamsize>(content.size()));
+    }
+
+    size_t cache_entries() const
+    {
+        size_t count = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(cache_dir))
+        {
+            if (entry.path().extension() == ".behlc")
+            {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    // Runs main.behl in a fresh state that uses the cache directory and returns util.value().
+    behl::Integer run_main()
+    {
+        behl::State* S = behl::new_state();
+        behl::load_stdlib(S);
+        behl::set_module_cache_dir(S, cache_dir.string());
+
+        const auto main_path = std::filesystem::canonical(root / "src").string() + "/main.behl";
+        behl::load_buffer(S, "let util = import(\"./util\"); return util.value();", main_path);
+        behl::call(S, 0, 1);
+        const auto result = behl::to_integer(S, -1);
+
+        behl::close(S);
+        return result;
+    }
+};
+
+TEST_F(ModuleCacheTest, ReusesCompiledModules)
+{
+    EXPECT_EQ(run_main(), 42);
+    ASSERT_TRUE(std::filesystem::exists(cache_dir));
+    EXPECT_EQ(cache_entries(), 1u);
+
+    const auto entry = std::filesystem::directory_iterator(cache_dir)->path();
+    const auto written = std::filesystem::last_write_time(entry);
+
+    EXPECT_EQ(run_main(), 42);
+    EXPECT_EQ(std::filesystem::last_write_time(entry), written);
+    EXPECT_EQ(cache_entries(), 1u);
+}
+
+TEST_F(ModuleCacheTest, RebuildsStaleEntries)
+{
+    EXPECT_EQ(run_main(), 42);
+
+    // Same size as the original source, only the content hash tells them apart.
+    write_file("util.behl", "module; export function value() { return 41 + 2; }");
+    EXPECT_EQ(run_main(), 43);
+    EXPECT_EQ(run_main(), 43);
+    EXPECT_EQ(cache_entries(), 1u);
+}
+
+TEST_F(ModuleCacheTest, RebuildsDamagedEntries)
+{
+    EXPECT_EQ(run_main(), 42);
+
+    const auto entry = std::filesystem::directory_iterator(cache_dir)->path();
+    const auto size = std::filesystem::file_size(entry);
+    std::filesystem::resize_file(entry, size - 8);
+
+    EXPECT_EQ(run_main(), 42);
+    EXPECT_EQ(std::filesystem::file_size(entry), size);
+}
+
+class ModulePreloadTest : public ::testing::Test
+{
+protected:
+    std::filesystem::path root;
+    behl::State* S = nullptr;
+
+    void SetUp() override
+    {
+        root = std::filesystem::temp_directory_path() / "behl_module_preload_test";
+        std::filesystem::remove_all(root);
+        std::filesystem::create_directories(root / "lib");
+        root = std::filesystem::canonical(root);
+
+        S = behl::new_state();
+        behl::load_stdlib(S);
+    }
+
+    void TearDown() override
+    {
+        behl::close(S);
+        std::filesystem::remove_all(root);
+    }
+
+    void write_file(const std::string& name, std::string_view content)
+    {
+        std::ofstream file(root / name, std::ios::binary);
+        file.write(content.data(), static_cast<std::streamsize>(content.size()));
+    }
+
+    std::string main_path() const
+    {
+        return (root / "main.behl").string();
+    }
+};
+
+TEST_F(ModulePreloadTest, CompilesDependencyGraph)
+{
+    constexpr std::string_view main_code = R"(
+        let math = import("math");
+        let a = import("./lib/a");
+        let b = import("./lib/b");
+        return a.value() + b.value() + math.abs(-1);
+    )";
+    write_file("main.behl", main_code);
+    write_file("lib/a.behl", "module; let c = import(\"./c\"); export function value() { return c.base * 2; }");
+    write_file("lib/b.behl", "module; let c = import(\"./c\"); export function value() { return c.base + 1; }");
+    write_file("lib/c.behl", "module; export const base = 10;");
+
+    EXPECT_EQ(behl::preload_modules(S, main_path(), 4), 3u);
+
+    // The preloaded modules no longer need their sources.
+    std::filesystem::remove_all(root / "lib");
+
+    behl::load_buffer(S, main_code, main_path());
+    behl::call(S, 0, 1);
+    EXPECT_EQ(behl::to_integer(S, -1), 32);
+}
+
+TEST_F(ModulePreloadTest, LeavesErrorsToImport)
+{
+    constexpr std::string_view main_code = R"(
+        let ok = import("./lib/ok");
+        let broken = import("./lib/broken");
+    )";
+    write_file("main.behl", main_code);
+    write_file("lib/ok.behl", "module; export const value = 1;");
+    write_file("lib/broken.behl", "module; export const value = ;");
+
+    EXPECT_EQ(behl::preload_modules(S, main_path(), 2), 1u);
+
+    behl::load_buffer(S, main_code, main_path());
+    EXPECT_THROW(behl::call(S, 0, 0), std::exception);
+}
@@ -5,8 +5,13 @@
 #include "vm/bytecode.hpp"
 #include "vm/value.hpp"
 
+#include <algorithm>
 #include <behl/behl.hpp>
+#include <behl/exceptions.hpp>
+#include <filesystem>
+#include <fstream>
 #include <gtest/gtest.h>
+#include <optional>
 
 class OptimizationsTest : public ::testing::Test
 {
@@ -271,3 +276,1028 @@ TEST_F(OptimizationsTest, MismatchedDirectionNotOptimized)
     EXPECT_FALSE(has_forprep);
     EXPECT_FALSE(has_forloop);
 }
+
+TEST_F(OptimizationsTest, OptLevelO0KeepsLoopUnoptimized)
+{
+    constexpr std::string_view code = R"(
+        for (let i = 0; i < 10; i++) {
+        }
+    )";
+
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
+
+    auto* proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+
+    for (size_t i = 0; i < proto->code.size(); ++i)
+    {
+        EXPECT_NE(proto->code[i].op(), behl::OpCode::kOpForPrep);
+    }
+    EXPECT_TRUE(behl::get_optimization_report(S).empty());
+}
+
+TEST_F(OptimizationsTest, OptimizationReportListsEnabledPasses)
+{
+    constexpr std::string_view code = R"(
+        function f() {
+            for (let i = 0; i < 10; i++) {
+            }
+            return 2 * 3;
+        }
+    )";
+
+    ASSERT_NO_THROW(behl::load_string(S, code));
+
+    auto report = behl::get_optimization_report(S);
+    ASSERT_EQ(report.size(), 17u);
+    EXPECT_EQ(report[0].name, "LoopOptimization");
+    EXPECT_EQ(report[1].name, "Inlining");
+    EXPECT_EQ(report[2].name, "ScalarReplacement");
+    EXPECT_EQ(report[3].name, "ConstantPropagation");
+    EXPECT_EQ(report[4].name, "ConstantFolding");
+    EXPECT_EQ(report[5].name, "LoopUnrolling");
+    EXPECT_EQ(report[6].name, "LoopInvariantCodeMotion");
+    EXPECT_EQ(report[7].name, "CommonSubexpressionElimination");
+    EXPECT_EQ(report[8].name, "StrengthReduction");
+    EXPECT_EQ(report[9].name, "DeadStoreElimination");
+    EXPECT_EQ(report[10].name, "TypeInference");
+    EXPECT_EQ(report[11].name, "JumpThreading");
+    EXPECT_EQ(report[12].name, "CompareJumpFusion");
+    EXPECT_EQ(report[13].name, "MoveCoalescing");
+    EXPECT_EQ(report[14].name, "RedundantLoadNil");
+    EXPECT_EQ(report[15].name, "DeadCodeElimination");
+    EXPECT_EQ(report[16].name, "RegisterAllocation");
+    for (const auto& pass : report)
+    {
+        EXPECT_GE(pass.runs, 1u);
+        EXPECT_LE(pass.changes, pass.runs);
+    }
+    EXPECT_EQ(report[0].changes, 1u);
+    EXPECT_EQ(report[1].changes, 0u);
+    EXPECT_EQ(report[2].changes, 0u);
+    EXPECT_EQ(report[3].changes, 0u);
+    EXPECT_EQ(report[4].changes, 1u);
+
+    behl::set_top(S, 0);
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO1));
+
+    report = behl::get_optimization_report(S);
+    ASSERT_EQ(report.size(), 7u);
+    EXPECT_EQ(report[0].name, "LoopOptimization");
+    EXPECT_EQ(report[1].name, "ConstantFolding");
+    EXPECT_EQ(report[2].name, "JumpThreading");
+}
+
+TEST_F(OptimizationsTest, OptLevelsProduceSameResults)
+{
+    constexpr std::string_view code = R"(
+        const K = 4;
+        function scale(x) {
+            let unused = x * 2;
+            unused = 1 + 1;
+            return x * (K + 2 * 3);
+        }
+        function outer() {
+            let inner = function(n) {
+                let s = 0;
+                for (let i = 0; i < n; i++) {
+                    s = s + i * (1 + 1);
+                }
+                return s;
+            };
+            return inner(5) + scale(2);
+        }
+        return outer();
+    )";
+
+    for (auto level : { behl::OptLevel::kO0, behl::OptLevel::kO1, behl::OptLevel::kO2 })
+    {
+        behl::set_top(S, 0);
+        ASSERT_NO_THROW(behl::load_string(S, code, level));
+        ASSERT_NO_THROW(behl::call(S, 0, 1));
+        EXPECT_EQ(behl::to_integer(S, -1), 40);
+    }
+}
+
+TEST_F(OptimizationsTest, CompareJumpFusedIntoCondition)
+{
+    constexpr std::string_view code = R"(
+        let a = 1;
+        let b = 5;
+        let hits = 0;
+        if (a < b && b > 3) {
+            hits = hits + 1;
+        }
+        return hits;
+    )";
+
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
+    const size_t unoptimized = get_proto_from_stack()->code.size();
+    behl::set_top(S, 0);
+
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO1));
+    auto* proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+
+    EXPECT_LT(proto->code.size(), unoptimized);
+    for (size_t i = 0; i < proto->code.size(); ++i)
+    {
+        EXPECT_NE(proto->code[i].op(), behl::OpCode::kOpLoadBool);
+        EXPECT_NE(proto->code[i].op(), behl::OpCode::kOpTest);
+    }
+    EXPECT_EQ(proto->line_table.count, proto->code.size());
+    EXPECT_TRUE(proto->line_table.has_columns);
+
+    ASSERT_NO_THROW(behl::call(S, 0, 1));
+    EXPECT_EQ(behl::to_integer(S, -1), 1);
+}
+
+TEST_F(OptimizationsTest, MovesThroughTemporariesCoalesced)
+{
+    constexpr std::string_view code = R"(
+        let a = 2;
+        let b = 3;
+        let x = 0;
+        x = a + b;
+        return x;
+    )";
+
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO1));
+    auto* proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+
+    for (size_t i = 0; i < proto->code.size(); ++i)
+    {
+        EXPECT_NE(proto->code[i].op(), behl::OpCode::kOpMove);
+        EXPECT_NE(proto->code[i].op(), behl::OpCode::kOpLoadNil);
+    }
+
+    ASSERT_NO_THROW(behl::call(S, 0, 1));
+    EXPECT_EQ(behl::to_integer(S, -1), 5);
+}
+
+TEST_F(OptimizationsTest, JumpsToReturnThreaded)
+{
+    constexpr std::string_view code = R"(
+        let x = 3;
+        if (x > 2) {
+            x = 10;
+        } else {
+            x = 20;
+        }
+    )";
+
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO1));
+    auto* proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+
+    // The jump over the else branch ends the chunk, it returns directly
+    size_t returns = 0;
+    for (size_t i = 0; i < proto->code.size(); ++i)
+    {
+        EXPECT_NE(proto->code[i].op(), behl::OpCode::kOpJmp);
+        if (proto->code[i].op() == behl::OpCode::kOpReturn)
+        {
+            returns++;
+        }
+    }
+    EXPECT_EQ(returns, 2u);
+}
+
+TEST_F(OptimizationsTest, BytecodeOptimizationKeepsErrorLocation)
+{
+    constexpr std::string_view code = R"(
+        let a = 1;
+        let b = 2;
+        if (a < b && b > 1) {
+            a = b;
+        }
+        let t = nil;
+        return t.field;
+    )";
+
+    for (auto level : { behl::OptLevel::kO0, behl::OptLevel::kO1 })
+    {
+        behl::set_top(S, 0);
+        ASSERT_NO_THROW(behl::load_string(S, code, level));
+        try
+        {
+            behl::call(S, 0, 1);
+            FAIL() << "Expected a TypeError";
+        }
+        catch (const behl::TypeError& e)
+        {
+            EXPECT_EQ(e.location().line, 8);
+        }
+    }
+}
+
+TEST_F(OptimizationsTest, BytecodeOptimizationPreservesSemantics)
+{
+    constexpr std::string_view code = R"(
+        function make(n) {
+            let acc = 0;
+            let fs = {};
+            for (let i = 0; i < n; i++) {
+                let j = i * 2;
+                fs[i] = function() { acc = acc + j; return acc; };
+            }
+            return fs;
+        }
+        function pick(a, b) {
+            let x;
+            let y;
+            if (a < b || b == 3) { x = 1; } else { x = 2; }
+            while (true) {
+                if (x > 5) {
+                    break;
+                }
+                x++;
+            }
+            let q = !(a >= b);
+            if (q && y == nil) {
+                x = x + 100;
+            }
+            return x;
+        }
+        let m = { __lt = function(l, r) { return l.v < r.v; } };
+        let lo = setmetatable({ v = 1 }, m);
+        let hi = setmetatable({ v = 2 }, m);
+        let meta = 0;
+        if (lo < hi && !(hi < lo)) {
+            meta = 1000;
+        }
+        let fs = make(4);
+        let s = 0;
+        let k = 0;
+        while (k < 20) {
+            k++;
+            if (k % 2 == 0) {
+                continue;
+            }
+            s = s + k;
+        }
+        return fs[0]() + fs[1]() + fs[3]() + pick(1, 2) + pick(5, 3) + meta + s;
+    )";
+
+    std::optional<behl::Integer> expected;
+    for (auto level : { behl::OptLevel::kO0, behl::OptLevel::kO1, behl::OptLevel::kO2 })
+    {
+        behl::close(S);
+        S = behl::new_state();
+        behl::load_stdlib(S);
+        ASSERT_NO_THROW(behl::load_string(S, code, level));
+        ASSERT_NO_THROW(behl::call(S, 0, 1));
+        const auto result = behl::to_integer(S, -1);
+        if (!expected)
+        {
+            expected = result;
+        }
+        EXPECT_EQ(result, *expected);
+    }
+    EXPECT_EQ(*expected, 6 + 12 + 18 + 106 + 6 + 1000 + 100);
+}
+
+TEST_F(OptimizationsTest, RegisterAllocationShrinksFrame)
+{
+    constexpr std::string_view code = R"(
+        function chain(n) {
+            let a = n * 2;
+            let b = a + 1;
+            let c = b * 3;
+            let d = c - 4;
+            return d;
+        }
+        return chain;
+    )";
+
+    behl::set_lazy_compilation(S, false);
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO1));
+    auto* proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+    ASSERT_EQ(proto->protos.size(), 1u);
+    const uint32_t unallocated = proto->protos[0]->max_stack_size;
+    behl::set_top(S, 0);
+
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO2));
+    proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+    EXPECT_LT(proto->protos[0]->max_stack_size, unallocated);
+
+    ASSERT_NO_THROW(behl::call(S, 0, 1));
+    behl::push_integer(S, 3);
+    ASSERT_NO_THROW(behl::call(S, 1, 1));
+    EXPECT_EQ(behl::to_integer(S, -1), 17);
+}
+
+TEST_F(OptimizationsTest, RegisterAllocationKeepsValuesAcrossCalls)
+{
+    constexpr std::string_view code = R"(
+        function triple(x) { return x, x * 2, x * 3; }
+        function run(n) {
+            let before = n + 1;
+            let p, q, r = triple(before);
+            let spent = p * 100;
+            let total = 0;
+            let add = function(v) { total = total + v; };
+            for (let i = 0; i < n; i++) {
+                let step = i * q;
+                add(step);
+                let unused = step + 1;
+            }
+            let t = { p, q, r };
+            let label = tostring(spent) + ":" + tostring(#t);
+            return total + r + before + #label;
+        }
+        return run(4);
+    )";
+
+    std::optional<behl::Integer> expected;
+    for (auto level : { behl::OptLevel::kO0, behl::OptLevel::kO2 })
+    {
+        behl::set_top(S, 0);
+        ASSERT_NO_THROW(behl::load_string(S, code, level));
+        ASSERT_NO_THROW(behl::call(S, 0, 1));
+        const auto result = behl::to_integer(S, -1);
+        if (!expected)
+        {
+            expected = result;
+        }
+        EXPECT_EQ(result, *expected);
+    }
+    EXPECT_EQ(*expected, 60 + 15 + 5 + 5);
+}
+
+TEST_F(OptimizationsTest, InliningFoldsConstCalls)
+{
+    constexpr std::string_view code = R"(
+        const sq = function(x) { return x * x; };
+        function area() {
+            return sq(3) + sq(4);
+        }
+        return area;
+    )";
+
+    behl::set_lazy_compilation(S, false);
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO2));
+    auto* proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+    ASSERT_EQ(proto->protos.size(), 2u);
+    for (const auto& instr : proto->protos[1]->code)
+    {
+        EXPECT_NE(instr.op(), behl::OpCode::kOpCall);
+    }
+
+    ASSERT_NO_THROW(behl::call(S, 0, 1));
+    ASSERT_NO_THROW(behl::call(S, 0, 1));
+    EXPECT_EQ(behl::to_integer(S, -1), 25);
+}
+
+TEST_F(OptimizationsTest, InliningKeepsSemantics)
+{
+    constexpr std::string_view code = R"(
+        let function getx(p) { return p.x; }
+        let function len2(a, b) { return a * a + b * b; }
+        const pick = function(c, a, b) { return c ? a : b; };
+        const vec = function(x, y) { return { x = x, y = y }; };
+        let function fact(n) { return n < 2 ? 1 : n * fact(n - 1); }
+        let function shadowed(v) { return v + 1; }
+        const K = 10;
+        const addk = function(v) { return v + K; };
+        let counter = 0;
+        let function bump(v) { counter = counter + 1; return v; }
+        let function twice(v) { return bump(v) + bump(v); }
+        let function opt(a, b) { return b == nil ? a : b; }
+        shadowed = function(v) { return v + 100; };
+
+        let total = 0;
+        for (let i = 0; i < 5; i++) {
+            let p = vec(i, i + 1);
+            total = total + getx(p) + len2(i, 2) + pick(i > 2, 1, 2) + fact(i) + addk(i);
+        }
+        let K2 = twice(3) + counter + opt(7, nil) + opt(7, 8) + shadowed(1);
+        {
+            const K = 1000;
+            total = total + addk(1);
+        }
+        return total + K2;
+    )";
+
+    std::optional<behl::Integer> expected;
+    for (auto level : { behl::OptLevel::kO0, behl::OptLevel::kO2 })
+    {
+        behl::set_top(S, 0);
+        ASSERT_NO_THROW(behl::load_string(S, code, level));
+        ASSERT_NO_THROW(behl::call(S, 0, 1));
+        const auto result = behl::to_integer(S, -1);
+        if (!expected)
+        {
+            expected = result;
+        }
+        EXPECT_EQ(result, *expected);
+    }
+    EXPECT_EQ(*expected, 10 + 50 + 8 + 1 + 1 + 2 + 6 + 24 + 60 + 11 + 6 + 2 + 7 + 8 + 101);
+}
+
+TEST_F(OptimizationsTest, LoopInvariantCodeMotionHoistsFieldReads)
+{
+    constexpr std::string_view code = R"(
+        function scale(n) {
+            let cfg = { factor = 3, offset = 4 };
+            let step = 2;
+            let sum = 0;
+            for (let i = 0; i < n; i++) {
+                sum = sum + i * cfg.factor + cfg.offset * step;
+            }
+            return sum;
+        }
+        return scale;
+    )";
+
+    behl::set_lazy_compilation(S, false);
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO2));
+    auto* proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+    ASSERT_EQ(proto->protos.size(), 1u);
+
+    bool in_loop = false;
+    for (const auto& instr : proto->protos[0]->code)
+    {
+        if (instr.op() == behl::OpCode::kOpForPrep)
+        {
+            in_loop = true;
+        }
+        else if (instr.op() == behl::OpCode::kOpForLoop)
+        {
+            in_loop = false;
+        }
+        else if (in_loop)
+        {
+            EXPECT_NE(instr.op(), behl::OpCode::kOpGetFieldS);
+            EXPECT_NE(instr.op(), behl::OpCode::kOpGetField);
+        }
+    }
+
+    ASSERT_NO_THROW(behl::call(S, 0, 1));
+    behl::push_integer(S, 10);
+    ASSERT_NO_THROW(behl::call(S, 1, 1));
+    EXPECT_EQ(behl::to_integer(S, -1), 215);
+}
+
+TEST_F(OptimizationsTest, LoopInvariantCodeMotionKeepsSemantics)
+{
+    constexpr std::string_view code = R"(
+        let total = 0;
+        let t = { a = 1, b = 2 };
+        let k = 3;
+        for (let i = 0; i < 4; i++) {
+            total = total + t.a + t.b;
+            t.a = t.a + 1;
+            let w = k * 2;
+            total = total + w + k * k;
+        }
+        let c = 5;
+        let bump = function() { c = c + 1; return c; };
+        let j = 0;
+        while (j < 3) {
+            total = total + c * 2 + bump();
+            j++;
+        }
+        let m = 2;
+        for (let i = 0; i < 3; i++) {
+            total = total + m * 10;
+            if (i == 1) {
+                m = 7;
+            }
+        }
+        let u = { x = 1 };
+        for (let i = 0; i < 3; i++) {
+            total = total + u.x;
+            u["x"] = u.x + 1;
+        }
+        let v = { 10, 20 };
+        for (let i = 0; i < 2; i++) {
+            total = total + v[0] + v[1];
+            v[i] = 0;
+        }
+        let n = 3;
+        for (let i = 0; i < n; i++) {
+            for (let q = 0; q < n; q++) {
+                total = total + i * n + q * (n + 1);
+            }
+        }
+        return total;
+    )";
+
+    std::optional<behl::Integer> expected;
+    for (auto level : { behl::OptLevel::kO0, behl::OptLevel::kO2 })
+    {
+        behl::set_top(S, 0);
+        ASSERT_NO_THROW(behl::load_string(S, code, level));
+        ASSERT_NO_THROW(behl::call(S, 0, 1));
+        const auto result = behl::to_integer(S, -1);
+        if (!expected)
+        {
+            expected = result;
+        }
+        EXPECT_EQ(result, *expected);
+    }
+    EXPECT_EQ(*expected, 78 + 57 + 110 + 6 + 50 + 63);
+}
+
+TEST_F(OptimizationsTest, CommonSubexpressionEliminationSharesReads)
+{
+    constexpr std::string_view code = R"(
+        function f() {
+            let p = { 10, 20, x = 3, y = 4 };
+            let base = 6;
+            let off = 2;
+            base += 1;
+            off += 1;
+            return p.x * p.x + p.y * p.y + (base - off) * (base - off);
+        }
+        return f;
+    )";
+
+    behl::set_lazy_compilation(S, false);
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO2));
+    auto* proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+    ASSERT_EQ(proto->protos.size(), 1u);
+
+    size_t field_reads = 0;
+    size_t subtractions = 0;
+    for (const auto& instr : proto->protos[0]->code)
+    {
+        if (instr.op() == behl::OpCode::kOpGetFieldS)
+        {
+            field_reads++;
+        }
+        else if (instr.op() == behl::OpCode::kOpSubII)
+        {
+            subtractions++;
+        }
+    }
+    EXPECT_EQ(field_reads, 2u);
+    EXPECT_EQ(subtractions, 1u);
+
+    ASSERT_NO_THROW(behl::call(S, 0, 1));
+    ASSERT_NO_THROW(behl::call(S, 0, 1));
+    EXPECT_EQ(behl::to_integer(S, -1), 41);
+}
+
+TEST_F(OptimizationsTest, ConstantPropagationKeepsPatchedModuleFunctions)
+{
+    // Module tables are shared and writable, another module may replace a library function after this one is compiled.
+    const auto root = std::filesystem::temp_directory_path() / "behl_patched_module_test";
+    std::filesystem::create_directories(root);
+    {
+        std::ofstream helper(root / "helper_mod.behl", std::ios::binary);
+        helper << R"(
+            module;
+            export function patch() { import("math").floor = function(x) { return "patched"; }; }
+        )";
+    }
+    constexpr std::string_view code = R"(
+        const m = import("math");
+        const other = import("helper_mod");
+        other.patch();
+        return m.floor(3.7), m.sqrt(16);
+    )";
+
+    for (auto level : { behl::OptLevel::kO0, behl::OptLevel::kO2 })
+    {
+        // Every state gets a fresh math module.
+        behl::close(S);
+        S = behl::new_state();
+        behl::load_stdlib(S);
+        ASSERT_NO_THROW(behl::load_buffer(S, code, (root / "main.behl").string(), level));
+        ASSERT_NO_THROW(behl::call(S, 0, 2));
+        EXPECT_EQ(behl::to_string(S, 0), "patched");
+        EXPECT_EQ(behl::to_number(S, 1), 4.0);
+    }
+    std::filesystem::remove_all(root);
+}
+
+TEST_F(OptimizationsTest, ConstantPropagationKeepsSemantics)
+{
+    constexpr std::string_view code = R"(
+        const math = import("math");
+        let fake = { sqrt = function(x) { return x + 1; } };
+        let k = 5;
+        let s = "xy";
+        let changed = 1;
+        let total = 0;
+        for (let i = 0; i < 3; i++) {
+            changed = changed + i;
+            total = total + k + #s;
+        }
+        let function g(math) { return math.sqrt(9); }
+        let patched = import("math");
+        let floor = patched.floor;
+        {
+            let k = 100;
+            total = total + k;
+        }
+        return total + changed + g(fake) + math.sqrt(9) + floor(2.5);
+    )";
+
+    behl::load_stdlib(S);
+    std::optional<behl::FP> expected;
+    for (auto level : { behl::OptLevel::kO0, behl::OptLevel::kO2 })
+    {
+        behl::set_top(S, 0);
+        ASSERT_NO_THROW(behl::load_string(S, code, level));
+        ASSERT_NO_THROW(behl::call(S, 0, 1));
+        const auto result = behl::to_number(S, -1);
+        if (!expected)
+        {
+            expected = result;
+        }
+        EXPECT_EQ(result, *expected);
+    }
+    EXPECT_EQ(*expected, 21.0 + 100 + 4 + 10 + 3 + 2);
+}
+
+TEST_F(OptimizationsTest, ScalarReplacementRemovesTemporaryTables)
+{
+    constexpr std::string_view code = R"(
+        const point = function(x, y) { return { x = x, y = y }; };
+        function f(a, b) {
+            let p = { x = a, y = b };
+            let q = point(b, a);
+            p.x = p.x + q.y;
+            q.z = p["y"] * 2;
+            return p.x * p.y + q.x + q.z;
+        }
+        return f;
+    )";
+
+    behl::set_lazy_compilation(S, false);
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO2));
+    auto* proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+    ASSERT_EQ(proto->protos.size(), 2u);
+    for (const auto& instr : proto->protos[1]->code)
+    {
+        EXPECT_NE(instr.op(), behl::OpCode::kOpNewTable);
+        EXPECT_NE(instr.op(), behl::OpCode::kOpGetFieldS);
+        EXPECT_NE(instr.op(), behl::OpCode::kOpSetFieldS);
+    }
+
+    ASSERT_NO_THROW(behl::call(S, 0, 1));
+    behl::push_integer(S, 3);
+    behl::push_integer(S, 5);
+    ASSERT_NO_THROW(behl::call(S, 2, 1));
+    EXPECT_EQ(behl::to_integer(S, -1), (3 + 3) * 5 + 5 + 10);
+}
+
+TEST_F(OptimizationsTest, ScalarReplacementKeepsSemantics)
+{
+    constexpr std::string_view code = R"(
+        let escaped = nil;
+        function keep(t) { escaped = t; return t.n; }
+        let total = 0;
+        for (let i = 0; i < 4; i++) {
+            let acc = { n = i, m = nil };
+            acc.n = acc.n + 1;
+            if (acc.m == nil) {
+                acc.m = acc.n * 10;
+            }
+            let inner = { v = { w = acc.m } };
+            total = total + acc.n + acc.m + inner.v.w;
+        }
+        let passed = { n = 7 };
+        total = total + keep(passed) + escaped.n;
+        let keyed = { a = 1, b = 2 };
+        let key = "b";
+        total = total + keyed[key];
+        let captured = { c = 3 };
+        let function get() { return captured.c; }
+        captured.c = 4;
+        let empty = {};
+        if (empty.missing == nil) {
+            total = total + 1;
+        }
+        return total + get();
+    )";
+
+    std::optional<behl::Integer> expected;
+    for (auto level : { behl::OptLevel::kO0, behl::OptLevel::kO2 })
+    {
+        behl::set_top(S, 0);
+        ASSERT_NO_THROW(behl::load_string(S, code, level));
+        ASSERT_NO_THROW(behl::call(S, 0, 1));
+        const auto result = behl::to_integer(S, -1);
+        if (!expected)
+        {
+            expected = result;
+        }
+        EXPECT_EQ(result, *expected);
+    }
+    EXPECT_EQ(*expected, 10 + 100 + 100 + 14 + 2 + 4 + 1);
+}
+
+TEST_F(OptimizationsTest, TypeInferenceEmitsTypedOpcodes)
+{
+    constexpr std::string_view code = R"(
+        function f(n) {
+            let sum = 0;
+            let scale = 0.5;
+            for (let i = 0; i < 100; i++) {
+                let j = i * 3 - 1;
+                sum += j + i;
+                scale = scale * 1.5 - 0.25;
+            }
+            return sum + scale + n;
+        }
+        return f;
+    )";
+
+    behl::set_lazy_compilation(S, false);
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO2));
+    auto* proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+    ASSERT_EQ(proto->protos.size(), 1u);
+    bool has_int_op = false;
+    bool has_float_op = false;
+    for (const auto& instr : proto->protos[0]->code)
+    {
+        const auto op = instr.op();
+        has_int_op |= op == behl::OpCode::kOpAddII || op == behl::OpCode::kOpSubII || op == behl::OpCode::kOpMulII;
+        has_float_op |= op == behl::OpCode::kOpSubFF || op == behl::OpCode::kOpMulFF;
+    }
+    EXPECT_TRUE(has_int_op);
+    EXPECT_TRUE(has_float_op);
+}
+
+TEST_F(OptimizationsTest, TypeInferenceIsFlowInsensitive)
+{
+    // total holds integers inside the loop, but the float assigned after it leaves total untyped everywhere.
+    constexpr std::string_view code = R"(
+        function average(n) {
+            let total = 0;
+            for (let i = 0; i < 100; i++) {
+                total = total * 3 + i;
+            }
+            total = total / n;
+            return total;
+        }
+        return average;
+    )";
+
+    behl::set_lazy_compilation(S, false);
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO2));
+    auto* proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+    ASSERT_EQ(proto->protos.size(), 1u);
+    bool has_generic_mul = false;
+    for (const auto& instr : proto->protos[0]->code)
+    {
+        EXPECT_NE(instr.op(), behl::OpCode::kOpMulII);
+        has_generic_mul |= instr.op() == behl::OpCode::kOpMul;
+    }
+    EXPECT_TRUE(has_generic_mul);
+}
+
+TEST_F(OptimizationsTest, TypeInferenceKeepsSemantics)
+{
+    constexpr std::string_view code = R"(
+        let total = 0;
+        let mixed = 1;
+        let ratio = 3;
+        for (let i = 0; i < 10; i++) {
+            let k = i * i - 2;
+            if (k < i) {
+                total += k;
+            }
+            if (i >= 5) {
+                mixed = mixed + 0.5;
+            }
+            ratio = ratio / 2;
+        }
+        let whole = 7;
+        let half = whole / 2;
+        let f = 2.0;
+        let g = f * f - 1.0;
+        if (g <= 3.0) {
+            total = total + 1;
+        }
+        return total + mixed * 2 + ratio * 1024 + half * 2 + g;
+    )";
+
+    std::optional<behl::FP> expected;
+    for (auto level : { behl::OptLevel::kO0, behl::OptLevel::kO2 })
+    {
+        behl::set_top(S, 0);
+        ASSERT_NO_THROW(behl::load_string(S, code, level));
+        ASSERT_NO_THROW(behl::call(S, 0, 1));
+        const auto result = behl::to_number(S, -1);
+        if (!expected)
+        {
+            expected = result;
+        }
+        EXPECT_EQ(result, *expected);
+    }
+    EXPECT_EQ(*expected, (-2 - 1 + 1) + 7.0 + 3.0 + 7.0 + 3.0);
+}
+
+TEST_F(OptimizationsTest, SwitchTablesReplaceCompareChains)
+{
+    constexpr std::string_view code = R"(
+        function digit(n) {
+            if (n == 1) { return "one"; }
+            elseif (n == 2) { return "two"; }
+            elseif (n == 3) { return "three"; }
+            elseif (n == 5) { return "five"; }
+            return "other";
+        }
+        function color(c) {
+            if (c == "red") { return 1; }
+            elseif (c == "green") { return 2; }
+            elseif ("blue" == c) { return 3; }
+            elseif (c == "alpha") { return 4; }
+            else { return 0; }
+        }
+        function pair(n) {
+            if (n == 1) { return 1; }
+            elseif (n == 2) { return 2; }
+            return 0;
+        }
+        return digit, color, pair;
+    )";
+
+    behl::set_lazy_compilation(S, false);
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO2));
+    auto* proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+    ASSERT_EQ(proto->protos.size(), 3u);
+    const auto has_switch = [](const behl::GCProto* fn) {
+        return std::any_of(fn->code.begin(), fn->code.end(),
+            [](behl::Instruction instr) { return instr.op() == behl::OpCode::kOpSwitch; });
+    };
+    EXPECT_TRUE(has_switch(proto->protos[0]));
+    EXPECT_TRUE(has_switch(proto->protos[1]));
+    EXPECT_FALSE(has_switch(proto->protos[2]));
+}
+
+TEST_F(OptimizationsTest, SwitchTablesKeepSemantics)
+{
+    constexpr std::string_view code = R"(
+        function digit(n) {
+            let r = 0;
+            if (n == 10) { r = 1; }
+            elseif (n == 11) { r = 2; }
+            elseif (n == 13) { r = 3; }
+            elseif (n == 12) { r = 4; }
+            elseif (n == 15) { r = 5; }
+            else { r = 9; }
+            return r;
+        }
+        function word(s) {
+            if (s == "a") { return 1; }
+            elseif (s == "bb") { return 2; }
+            elseif (s == "ccc") { return 3; }
+            elseif (s == "dddd") { return 4; }
+            elseif (s == "a long string that is not stored inline") { return 5; }
+            return 0;
+        }
+        let total = 0;
+        let keys = {9, 10, 11, 12, 13, 14, 15, 16, 10.0, 12.5, 13.0, "10", true};
+        for (let i = 0; i < #keys; i++) {
+            total = total * 3 + digit(keys[i]);
+        }
+        let words = {"a", "bb", "ccc", "dddd", "e", "a long string that is not stored inline", 1, "ab"};
+        for (let i = 0; i < #words; i++) {
+            total = total * 7 + word(words[i]);
+        }
+        return total * 11 + digit(nil) + word("long string that is not stored inline" + "");
+    )";
+
+    std::optional<behl::Integer> expected;
+    for (auto level : { behl::OptLevel::kO0, behl::OptLevel::kO2 })
+    {
+        behl::set_top(S, 0);
+        ASSERT_NO_THROW(behl::load_string(S, code, level));
+        ASSERT_NO_THROW(behl::call(S, 0, 1));
+        const auto result = behl::to_integer(S, -1);
+        if (!expected)
+        {
+            expected = result;
+        }
+        EXPECT_EQ(result, *expected);
+    }
+    EXPECT_EQ(*expected, 329907127334871);
+}
+
+TEST_F(OptimizationsTest, LoopUnrollingCopiesSmallLoops)
+{
+    constexpr std::string_view code = R"(
+        function dot(a, b) {
+            let sum = 0;
+            for (let i = 0; i < 4; i++) {
+                sum += a[i] * b[i];
+            }
+            return sum;
+        }
+        function scan(t) {
+            let n = 0;
+            for (let i = 0; i < 4; i++) {
+                if (t[i] == nil) {
+                    break;
+                }
+                n++;
+            }
+            return n;
+        }
+        return dot, scan;
+    )";
+
+    behl::set_lazy_compilation(S, false);
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO2));
+    auto* proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+    ASSERT_EQ(proto->protos.size(), 2u);
+    const auto has_loop = [](const behl::GCProto* fn) {
+        return std::any_of(fn->code.begin(), fn->code.end(),
+            [](behl::Instruction instr) { return instr.op() == behl::OpCode::kOpForLoop; });
+    };
+    EXPECT_FALSE(has_loop(proto->protos[0]));
+    EXPECT_TRUE(has_loop(proto->protos[1]));
+}
+
+TEST_F(OptimizationsTest, StrengthReductionRemovesIndexProducts)
+{
+    constexpr std::string_view code = R"(
+        function pack(t) {
+            for (let i = 0; i < 100; i++) {
+                t[i] = i * 3;
+            }
+            return t;
+        }
+        return pack;
+    )";
+
+    behl::set_lazy_compilation(S, false);
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO2));
+    auto* proto = get_proto_from_stack();
+    ASSERT_NE(proto, nullptr);
+    ASSERT_EQ(proto->protos.size(), 1u);
+    bool has_mul = false;
+    for (const auto& instr : proto->protos[0]->code)
+    {
+        has_mul |= instr.op() == behl::OpCode::kOpMul || instr.op() == behl::OpCode::kOpMulII;
+    }
+    EXPECT_FALSE(has_mul);
+}
+
+TEST_F(OptimizationsTest, LoopUnrollingAndStrengthReductionKeepSemantics)
+{
+    constexpr std::string_view code = R"(
+        let t = {};
+        for (let i = 0; i < 40; i++) {
+            t[i] = i * 7 % 11;
+        }
+        let total = 0;
+        for (let i = 0; i < 4; i++) {
+            total = total * 3 + t[i * 2] + t[i * 5 + 1];
+        }
+        for (let i = 9; i >= 3; i -= 2) {
+            let k = i * 4;
+            total = total * 5 + k;
+        }
+        for (let i = 5; i < 5; i++) {
+            total = 0;
+        }
+        let n = 30;
+        for (let i = 1; i <= n; i += 3) {
+            if (i % 2 == 0) {
+                continue;
+            }
+            total = (total * 31 + t[i * 1] + i * -2 + i * 1000000007) % 1000000009;
+        }
+        for (let i = n; i > 0; i--) {
+            total = (total + i * 5) % 1000000009;
+        }
+        let fs = {};
+        for (let i = 0; i < 3; i++) {
+            fs[i] = function() { return i; };
+        }
+        return total * 10 + fs[0]();
+    )";
+
+    std::optional<behl::Integer> expected;
+    for (auto level : { behl::OptLevel::kO0, behl::OptLevel::kO2 })
+    {
+        behl::set_top(S, 0);
+        ASSERT_NO_THROW(behl::load_string(S, code, level));
+        ASSERT_NO_THROW(behl::call(S, 0, 1));
+        EXPECT_TRUE(behl::is_integer(S, -1));
+        const auto result = behl::to_integer(S, -1);
+        if (!expected)
+        {
+            expected = result;
+        }
+        EXPECT_EQ(result, *expected);
+    }
+}
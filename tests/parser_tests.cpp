@@ -520,6 +520,37 @@ TEST_F(ParserTest, ParserBreakContinue)
     ASSERT_EQ(else_stat0->type, AstNodeType::kContinue);
 }
 
+TEST_F(ParserTest, ParserInternsIdentifiers)
+{
+    const auto source = "let a = 1\nlet b = a\nlet c = \"b\"\nlet d = \"\\tb\"";
+    auto tokens = tokenize(S, source);
+    AstHolder holder(S);
+    auto ast = parse(holder, tokens);
+    ASSERT_EQ(count_children(ast->block->first_stat), 4);
+
+    const auto& decl_a = static_cast<const AstLocalDecl&>(*get_child_at(ast->block->first_stat, 0));
+    const auto& decl_b = static_cast<const AstLocalDecl&>(*get_child_at(ast->block->first_stat, 1));
+    const auto& decl_c = static_cast<const AstLocalDecl&>(*get_child_at(ast->block->first_stat, 2));
+    const auto& decl_d = static_cast<const AstLocalDecl&>(*get_child_at(ast->block->first_stat, 3));
+
+    // Equal names share one atom and one copy of their text
+    ASSERT_EQ(decl_b.first_init->type, AstNodeType::kIdent);
+    const auto* read_a = static_cast<const AstIdent*>(decl_b.first_init)->name;
+    EXPECT_EQ(read_a->atom, decl_a.first_name->atom);
+    EXPECT_EQ(read_a->data, decl_a.first_name->data);
+    EXPECT_NE(decl_a.first_name->atom, decl_b.first_name->atom);
+
+    // String literals are interned with the identifiers, after their escapes are processed
+    ASSERT_EQ(decl_c.first_init->type, AstNodeType::kString);
+    EXPECT_EQ(static_cast<const AstString*>(decl_c.first_init)->atom, decl_b.first_name->atom);
+    ASSERT_EQ(decl_d.first_init->type, AstNodeType::kString);
+    const auto* escaped = static_cast<const AstString*>(decl_d.first_init);
+    EXPECT_EQ(escaped->view(), "\tb");
+    EXPECT_EQ(escaped->atom, holder.intern("\tb"));
+
+    EXPECT_EQ(holder.intern("self"), kAtomSelf);
+}
+
 TEST_F(ParserTest, ParserErrorMissingEnd)
 {
     const auto source = "if true { print()";
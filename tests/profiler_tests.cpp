@@ -0,0 +1,117 @@
+#include <behl/behl.hpp>
+#include <behl/profiler.hpp>
+#include <gtest/gtest.h>
+#include <string>
+
+using namespace behl;
+
+class ProfilerTest : public ::testing::Test
+{
+protected:
+    State* S;
+    void SetUp() override
+    {
+        S = new_state();
+        load_stdlib(S);
+    }
+    void TearDown() override
+    {
+        close(S);
+    }
+
+    void run(std::string_view code)
+    {
+        load_buffer(S, code, "profiled.behl");
+        call(S, 0, 0);
+    }
+};
+
+TEST_F(ProfilerTest, DisabledByDefault)
+{
+    EXPECT_FALSE(profiler_is_running(S));
+
+    run("let t = {}; for (let i = 0; i < 1000; i++) { t[i] = {i}; }");
+
+    EXPECT_EQ(profiler_sample_count(S), 0u);
+    EXPECT_TRUE(profiler_dump(S, ProfileFormat::kFolded).empty());
+}
+
+TEST_F(ProfilerTest, AttributesSamplesToScriptFunction)
+{
+    profiler_start(S, 256);
+    EXPECT_TRUE(profiler_is_running(S));
+
+    run(R"(
+        function make_tables(n) {
+            let t = {};
+            for (let i = 0; i < n; i++) {
+                t[i] = {x = i, y = i};
+            }
+            return t;
+        }
+        make_tables(2000);
+    )");
+
+    profiler_stop(S);
+    EXPECT_FALSE(profiler_is_running(S));
+    EXPECT_GT(profiler_sample_count(S), 0u);
+
+    const auto folded = profiler_dump(S, ProfileFormat::kFolded);
+    EXPECT_NE(folded.find("<main chunk> (profiled.behl:"), std::string::npos);
+    EXPECT_NE(folded.find(";make_tables (profiled.behl:"), std::string::npos);
+    EXPECT_NE(folded.find("[table]"), std::string::npos);
+}
+
+TEST_F(ProfilerTest, FoldedLinesEndWithByteCounts)
+{
+    profiler_start(S, 128);
+    run("let s = {}; for (let i = 0; i < 500; i++) { s[i] = tostring(i) + \"-suffix-to-avoid-sso-storage\"; }");
+    profiler_stop(S);
+
+    const auto folded = profiler_dump(S, ProfileFormat::kFolded);
+    ASSERT_FALSE(folded.empty());
+
+    size_t total_bytes = 0;
+    size_t pos = 0;
+    while (pos < folded.size())
+    {
+        const auto eol = folded.find('\n', pos);
+        ASSERT_NE(eol, std::string::npos);
+        const auto line = folded.substr(pos, eol - pos);
+        const auto space = line.rfind(' ');
+        ASSERT_NE(space, std::string::npos);
+        total_bytes += std::stoull(line.substr(space + 1));
+        pos = eol + 1;
+    }
+
+    EXPECT_EQ(total_bytes, profiler_sample_count(S) * 128);
+    EXPECT_NE(folded.find("[string]"), std::string::npos);
+}
+
+TEST_F(ProfilerTest, PprofOutputIsWellFormed)
+{
+    profiler_start(S, 256);
+    run("let t = {}; for (let i = 0; i < 1000; i++) { t[i] = {i}; }");
+    profiler_stop(S);
+
+    const auto pprof = profiler_dump(S, ProfileFormat::kPprof);
+    ASSERT_FALSE(pprof.empty());
+
+    // First field is sample_type (field 1, length delimited).
+    EXPECT_EQ(static_cast<uint8_t>(pprof[0]), (1u << 3) | 2u);
+    EXPECT_NE(pprof.find("alloc_space"), std::string::npos);
+    EXPECT_NE(pprof.find("<main chunk>"), std::string::npos);
+    EXPECT_NE(pprof.find("profiled.behl"), std::string::npos);
+}
+
+TEST_F(ProfilerTest, ResetDiscardsSamples)
+{
+    profiler_start(S, 256);
+    run("let t = {}; for (let i = 0; i < 1000; i++) { t[i] = {i}; }");
+    EXPECT_GT(profiler_sample_count(S), 0u);
+
+    profiler_reset(S);
+    EXPECT_EQ(profiler_sample_count(S), 0u);
+    EXPECT_TRUE(profiler_dump(S, ProfileFormat::kFolded).empty());
+    EXPECT_TRUE(profiler_is_running(S));
+}
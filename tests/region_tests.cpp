@@ -0,0 +1,218 @@
+#include "state.hpp"
+
+#include <behl/behl.hpp>
+#include <gtest/gtest.h>
+
+namespace behl
+{
+    class RegionTest : public ::testing::Test
+    {
+    protected:
+        State* S;
+        void SetUp() override
+        {
+            S = new_state();
+            load_stdlib(S);
+            gc_collect(S);
+        }
+        void TearDown() override
+        {
+            close(S);
+        }
+
+        void run(std::string_view code, int32_t nresults = 0)
+        {
+            load_string(S, code);
+            call(S, 0, nresults);
+        }
+    };
+
+    TEST_F(RegionTest, TemporariesAreReleasedAtRegionEnd)
+    {
+        const size_t objects_before = S->gc.gc_all_objects.count();
+        const size_t bytes_before = S->gc.gc_total_bytes;
+
+        region_begin(S);
+        run(R"(
+            let sum = 0;
+            for (let i = 0; i < 10000; i++) {
+                let t = {x = i, name = "item" + tostring(i)};
+                sum = sum + t.x;
+            }
+        )");
+        EXPECT_EQ(S->gc.gc_all_objects.count(), objects_before);
+        EXPECT_GT(S->gc.gc_region_objects.count(), 10000u);
+        region_end(S);
+
+        EXPECT_EQ(S->gc.gc_region_objects.count(), 0u);
+        EXPECT_EQ(S->gc.gc_all_objects.count(), objects_before);
+        EXPECT_EQ(S->gc.gc_total_bytes, bytes_before);
+    }
+
+    TEST_F(RegionTest, GlobalEscapesArePromoted)
+    {
+        region_begin(S);
+        run(R"(
+            cached = {items = {10, 20, 30}, label = "cached-" + tostring(42)};
+            let temp = {1, 2, 3};
+        )");
+        region_end(S);
+
+        gc_collect(S);
+
+        run(R"(
+            return cached.items[0] + cached.items[2], cached.label;
+        )",
+            2);
+        EXPECT_EQ(to_integer(S, 0), 40);
+        EXPECT_EQ(to_string(S, 1), "cached-42");
+    }
+
+    TEST_F(RegionTest, StoreIntoOldTableEscapes)
+    {
+        run("registry = {};");
+
+        region_begin(S);
+        run(R"(
+            let key = "k" + tostring(7);
+            let entry = {value = 99};
+            registry[key] = entry;
+            registry[0] = {nested = {deep = "yes"}};
+        )");
+        region_end(S);
+
+        gc_collect(S);
+
+        run(R"(
+            return registry["k7"].value, registry[0].nested.deep;
+        )",
+            2);
+        EXPECT_EQ(to_integer(S, 0), 99);
+        EXPECT_EQ(to_string(S, 1), "yes");
+    }
+
+    TEST_F(RegionTest, StackAndPinnedValuesArePromoted)
+    {
+        region_begin(S);
+        run(R"(
+            return {a = 1}, {b = 2};
+        )",
+            2);
+        const auto handle = pin(S);
+        region_end(S);
+
+        gc_collect(S);
+
+        pinned_push(S, handle);
+        table_getfield(S, -1, "b");
+        EXPECT_EQ(to_integer(S, -1), 2);
+        table_getfield(S, 0, "a");
+        EXPECT_EQ(to_integer(S, -1), 1);
+        unpin(S, handle);
+    }
+
+    TEST_F(RegionTest, ClosuresKeepCapturedValues)
+    {
+        region_begin(S);
+        run(R"(
+            let state = {count = 0};
+            counter = function() {
+                state.count = state.count + 1;
+                return state.count;
+            };
+        )");
+        region_end(S);
+
+        gc_collect(S);
+
+        run("counter(); return counter();", 1);
+        EXPECT_EQ(to_integer(S, -1), 2);
+    }
+
+    TEST_F(RegionTest, LazyCompilationInsideRegionOutlivesIt)
+    {
+        set_lazy_compilation(S, true);
+        run(R"(
+            make = function(step) {
+                let label = "step " + tostring(step);
+                return function(x) { return x + step; };
+            };
+        )");
+
+        // The first call compiles make, its code belongs to a function created before the region.
+        region_begin(S);
+        run("make(1);");
+        region_end(S);
+
+        gc_collect(S);
+
+        region_begin(S);
+        run(R"(
+            let junk = {};
+            for (let i = 0; i < 2000; i = i + 1) {
+                junk[i] = {value = "junk " + tostring(i)};
+            }
+        )");
+        region_end(S);
+
+        run("return make(2)(40);", 1);
+        EXPECT_EQ(to_integer(S, -1), 42);
+    }
+
+    TEST_F(RegionTest, SharedClosuresSurviveRegionEnd)
+    {
+        run(R"(
+            make = function() {
+                return function(x) { return x + 1; };
+            };
+        )");
+
+        region_begin(S);
+        run("make(); make();");
+        region_end(S);
+
+        gc_collect(S);
+
+        run("return make() == make(), make()(41);", 2);
+        EXPECT_TRUE(to_boolean(S, -2));
+        EXPECT_EQ(to_integer(S, -1), 42);
+    }
+
+    TEST_F(RegionTest, NestedRegionsReleaseAtOutermostEnd)
+    {
+        region_begin(S);
+        region_begin(S);
+        run("let t = {1, 2, 3};");
+        region_end(S);
+        EXPECT_GT(S->gc.gc_region_objects.count(), 0u);
+        region_end(S);
+        EXPECT_EQ(S->gc.gc_region_objects.count(), 0u);
+    }
+
+    TEST_F(RegionTest, CollectInsideRegionIsDeferred)
+    {
+        region_begin(S);
+        run(R"(
+            const gc = import("gc");
+            let keep = {value = 5};
+            for (let i = 0; i < 1000; i++) {
+                let temp = {i};
+            }
+            gc.collect();
+            result = keep.value;
+        )");
+        region_end(S);
+
+        gc_collect(S);
+
+        get_global(S, "result");
+        EXPECT_EQ(to_integer(S, -1), 5);
+    }
+
+    TEST_F(RegionTest, CloseWithOpenRegion)
+    {
+        region_begin(S);
+        run("let t = {x = {y = 1}};");
+    }
+
+} // namespace behl
@@ -1,3 +1,7 @@
+#include "gc/gco_closure.hpp"
+#include "gc/gco_proto.hpp"
+#include "state.hpp"
+
 #include <behl/behl.hpp>
 #include <gtest/gtest.h>
 
@@ -458,3 +462,26 @@ TEST_F(RegisterTest, ExtremeRegisterPressure)
     ASSERT_EQ(15, behl::to_integer(S, -1));
     behl::pop(S, 1);
 }
+
+TEST_F(RegisterTest, ParametersAreCountedInFrameSize)
+{
+    const char* source = R"(
+        function ignore(a, b, c) {
+        }
+        function first(a, b) {
+            return a;
+        }
+        ignore(1, 2, 3);
+        return first(7, 8);
+    )";
+
+    ASSERT_NO_THROW(behl::load_string(S, source));
+    behl::dup(S, -1);
+    ASSERT_NO_THROW(behl::call(S, 0, 1));
+    EXPECT_EQ(behl::to_integer(S, -1), 7);
+
+    const auto* proto = S->stack[0].get_closure()->proto;
+    ASSERT_EQ(proto->protos.size(), 2u);
+    EXPECT_GE(proto->protos[0]->max_stack_size, 4u);
+    EXPECT_GE(proto->protos[1]->max_stack_size, 3u);
+}
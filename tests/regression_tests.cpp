@@ -531,3 +531,17 @@ TEST_F(RegressionTest, ErrorColumnNumberForCallToNilValue)
     ASSERT_NO_THROW(behl::load_string(S, code)) << "Code should compile successfully";
     EXPECT_THROW({ behl::call(S, 0, 0); }, behl::TypeError) << "Call should fail because undefined_func is nil";
 }
+
+TEST_F(RegressionTest, ComputedIndexKeyAsRightOperand)
+{
+    constexpr std::string_view code = R"(
+        let t = {10, 20, 30, 40, 50, 60, 70}
+        let total = 1
+        let i = 3
+        total = total * 10 + t[i * 2]
+        return total
+    )";
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0));
+    ASSERT_NO_THROW(behl::call(S, 0, 1));
+    ASSERT_EQ(behl::to_integer(S, -1), 80) << "The key temporaries must not hide the indexed value";
+}
@@ -73,3 +73,48 @@ TEST_F(TableConstructionTest, EmptyTableCreation)
     ASSERT_NO_THROW(behl::call(S, 0, 1));
     ASSERT_EQ(behl::to_integer(S, -1), 42);
 }
+
+TEST_F(TableConstructionTest, ConstantTablesMatchGenericConstruction)
+{
+    constexpr std::string_view code = R"(
+        let list = {1, 2.5, "three", true, false, nil, 7, name = "list", [false] = 0, name = "renamed"}
+        let sparse = {[0] = "a", [1] = "b", [3] = "d", [1.0] = "B", [-1] = "neg", [100000] = "far"}
+        let score = 0
+        if (list[0] == 1 && list[1] == 2.5 && list[2] == "three" && list[3] == true) { score = score + 1 }
+        if (list[4] == false && list[5] == nil && list[6] == 7) { score = score + 2 }
+        if (list.name == "renamed" && list[false] == 0) { score = score + 4 }
+        if (sparse[0] == "a" && sparse[1] == "B" && sparse[2] == nil && sparse[3] == "d") { score = score + 8 }
+        if (sparse[-1] == "neg" && sparse[100000] == "far") { score = score + 16 }
+        list[7] = 8
+        sparse.extra = 1
+        if (list[7] == 8 && sparse.extra == 1) { score = score + 32 }
+        return score
+    )";
+    for (auto level : { behl::OptLevel::kO0, behl::OptLevel::kO2 })
+    {
+        behl::set_top(S, 0);
+        ASSERT_NO_THROW(behl::load_string(S, code, level));
+        ASSERT_NO_THROW(behl::call(S, 0, 1));
+        EXPECT_EQ(behl::to_integer(S, -1), 63);
+    }
+}
+
+TEST_F(TableConstructionTest, HugeConstantTable)
+{
+    constexpr int kEntries = 100000;
+    std::string code = "let t = {";
+    for (int i = 0; i < kEntries; ++i)
+    {
+        code += (i > 0 ? ", " : "") + std::to_string(i * 3);
+    }
+    code += "}\nlet names = {";
+    for (int i = 0; i < kEntries; ++i)
+    {
+        code += (i > 0 ? ", k" : "k") + std::to_string(i) + " = " + std::to_string(i);
+    }
+    code += "}\nreturn t[0] + t[" + std::to_string(kEntries - 1) + "] + names.k0 + names.k" + std::to_string(kEntries - 1);
+
+    ASSERT_NO_THROW(behl::load_string(S, code));
+    ASSERT_NO_THROW(behl::call(S, 0, 1));
+    EXPECT_EQ(behl::to_integer(S, -1), (kEntries - 1) * 3 + (kEntries - 1));
+}
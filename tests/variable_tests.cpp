@@ -35,7 +35,7 @@ TEST_F(VariableTest, ExecuteConstVariable)
         const x = 100
         return x
     )";
-    ASSERT_NO_THROW(behl::load_string(S, code, false)); // Disable optimizations to keep unused const
+    ASSERT_NO_THROW(behl::load_string(S, code, behl::OptLevel::kO0)); // Disable optimizations to keep unused const
     ASSERT_NO_THROW(behl::call(S, 0, 1));
     ASSERT_EQ(behl::get_top(S), 1);
     ASSERT_EQ(behl::to_integer(S, -1), 100);
@@ -48,7 +48,8 @@ TEST_F(VariableTest, ConstIsImmutable)
         x = 200
     )";
 
-    EXPECT_THROW({ behl::load_string(S, code, false); }, behl::SemanticError); // Disable optimizations for error testing
+    // Disable optimizations for error testing
+    EXPECT_THROW({ behl::load_string(S, code, behl::OptLevel::kO0); }, behl::SemanticError);
 }
 
 TEST_F(VariableTest, GlobalAssignReflectsIn_G)
@@ -323,3 +323,60 @@ TEST_F(VectorTest, EraseRangeNonTrivialType)
 
     EXPECT_EQ(NonTrivial::construct_count, NonTrivial::destruct_count);
 }
+
+TEST_F(VectorTest, ShrinkToFitReleasesCapacity)
+{
+    Vector<int> vec;
+    vec.init(state, 0);
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        vec.push_back(state, i);
+    }
+    while (vec.size() > 5)
+    {
+        vec.pop_back();
+    }
+    ASSERT_EQ(vec.capacity(), 1024u);
+
+    vec.shrink_to_fit(state);
+    EXPECT_EQ(vec.capacity(), 8u);
+    ASSERT_EQ(vec.size(), 5u);
+    for (int i = 0; i < 5; ++i)
+    {
+        EXPECT_EQ(vec[static_cast<size_t>(i)], i);
+    }
+
+    vec.clear();
+    vec.shrink_to_fit(state);
+    EXPECT_EQ(vec.capacity(), 0u);
+
+    vec.push_back(state, 42);
+    EXPECT_EQ(vec[0], 42);
+
+    vec.destroy(state);
+}
+
+TEST_F(VectorTest, ExternalStorageIsCopiedOnGrow)
+{
+    int external[3] = { 1, 2, 3 };
+
+    Vector<int> vec;
+    vec.init(state, 0);
+    vec.assign_external(state, external, 3);
+    EXPECT_TRUE(vec.is_external());
+    EXPECT_EQ(vec.data(), external);
+    ASSERT_EQ(vec.size(), 3u);
+
+    vec.push_back(state, 4);
+    EXPECT_FALSE(vec.is_external());
+    EXPECT_NE(vec.data(), external);
+    ASSERT_EQ(vec.size(), 4u);
+    for (int i = 0; i < 4; ++i)
+    {
+        EXPECT_EQ(vec[static_cast<size_t>(i)], i + 1);
+    }
+    EXPECT_EQ(external[2], 3);
+
+    vec.destroy(state);
+}